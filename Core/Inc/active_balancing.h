@@ -12,14 +12,15 @@
 // Include necessary header files for program to run
 #include "main.h" // Main application header
 #include "pack_config.h" // Configuration settings for pack configuration
+#include "pack_stats.h" // Streaming pack statistics
 
 /* ***** EXTERNAL VARIABLES ***** */
 extern float soc_values[NOC]; // Array storing SOC values for all cells
+extern float usable_values[NOC]; // Usable charge of each cell (% of rated capacity)
+extern PackStats soc_stats; // Streaming usable charge statistics kept by main.c
 
 /* ***** FUNCTION PROTOTYPES ***** */
 void active_balance_trigger(); // Triggers active balancing process
 void detect_imbalanced_cell(); // Identifies the most imbalanced cell
-void balance_undercharged_cell(int cell_index); // Balances an undercharged cell
-void balance_overcharged_cell(int cell_index); // Balances an overcharged cell
 
 #endif
@@ -0,0 +1,44 @@
+/**
+  ******************************************************************************
+  * @file           : balancing_accounting.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_BALANCING_ACCOUNTING_H_
+#define INC_BALANCING_ACCOUNTING_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include "pack_config.h" // Configuration settings for pack configuration
+
+/* ***** DEFINE CONSTANTS ***** */
+#define ACCOUNTING_PERSIST_MAH 100.0f // Delivered charge that makes lifetime totals worth writing to flash mid-session (mAh)
+#define ACCOUNTING_PERSIST_INTERVAL_MS 900000 // Longest time unsaved totals are held during a session (ms)
+
+/**
+ * @brief Charge and energy moved by the balancer
+ * Efficiency is only accumulated over samples where the pack-side input was measured
+ */
+typedef struct {
+	float charge_mAh; // Charge delivered into the cell (mAh)
+	float energy_mWh; // Energy delivered into the cell (mWh)
+	float eff_output_mWh; // Output energy over samples with a valid input measurement (mWh)
+	float eff_input_mWh; // Input energy drawn from the pack over the same samples (mWh)
+	uint32_t active_ms; // Time the converter was delivering charge (ms)
+	uint32_t transfers; // Number of completed transfers
+} BalanceAccount;
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void accounting_init(); // Restore lifetime totals from flash and start a new session
+void accounting_start_session(); // Clear session totals
+void accounting_add_sample(int cell_number, float current, float input_current, uint32_t dt_ms); // Accumulate one balancing current sample
+void accounting_end_transfer(int cell_number); // Close a transfer
+void accounting_service(int balancing); // Persist lifetime totals between transfers, call from main loop
+float accounting_efficiency(const BalanceAccount *account); // Estimated converter efficiency (0 to 1, negative if unknown)
+const BalanceAccount *accounting_get_session(int cell_number); // Session totals for a cell
+const BalanceAccount *accounting_get_lifetime(int cell_number); // Lifetime totals for a cell
+void accounting_print_telemetry(); // Export per-cell and session totals over the serial monitor
+
+#endif
@@ -0,0 +1,55 @@
+/**
+  ******************************************************************************
+  * @file           : balancing_planner.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_BALANCING_PLANNER_H_
+#define INC_BALANCING_PLANNER_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include "pack_config.h" // Include number of cells
+#include "balancing_sequencer.h" // Include sequencer ramp time
+
+/* ***** DEFINE CONSTANTS ***** */
+#define PLANNER_TARGET_SPREAD 2.0f // SOC spread (max - min) at which the pack counts as balanced (%)
+#define PLANNER_MIN_STEP_MS 2000 // Shortest step worth a path change and two ramps (ms)
+#define PLANNER_TIME_LIMIT_PCT 150 // Regulation time limit of a step, percentage of the predicted time
+#define PLANNER_SWITCH_COST_MS (2 * SEQ_RAMP_MS) // Converter time lost to ramps at every step (ms)
+
+/**
+ * @brief One step of the plan, charge into a single cell
+ */
+typedef struct {
+	int cell; // Cell number receiving charge (1 to NOC)
+	float charge_mAh; // Charge still needed to bring the cell into the target spread (mAh)
+	uint32_t duration_ms; // Predicted regulation time for that charge at the plan setpoint (ms)
+} PlannerStep;
+
+/**
+ * @brief Time-ordered balancing schedule
+ */
+typedef struct {
+	PlannerStep step[NOC]; // Steps, largest charge first
+	int count; // Number of steps
+	int next; // First step not yet handed to the sequencer
+	float setpoint; // Balancing current for every step (A)
+	float reference_soc; // Usable charge of the highest cell, which every other cell is brought up to (% of rated capacity)
+	uint32_t total_ms; // Predicted time to balance including switching cost (ms)
+	uint32_t replans; // Number of times the plan was rebuilt from measurements
+} BalancingPlan;
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void planner_update(const float *soc); // Re-plan from the latest usable charge of every cell (% of rated capacity, index as volt[])
+void planner_begin(); // Start executing the plan until the pack is balanced
+void planner_service(); // Start a sequence of the planned steps when the converter is free, call from main loop
+void planner_stop(); // Stop executing the plan, a running step is finished by the sequencer
+int planner_is_active(); // Check whether the plan is being executed
+int planner_is_balanced(); // Check whether the last update found every cell within the target spread
+const BalancingPlan *planner_get_plan(); // Current plan
+void planner_print_plan(); // Export the plan over the serial monitor
+
+#endif
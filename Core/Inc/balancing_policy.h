@@ -0,0 +1,60 @@
+/**
+  ******************************************************************************
+  * @file           : balancing_policy.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_BALANCING_POLICY_H_
+#define INC_BALANCING_POLICY_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include <stdint.h> // Standard integer type definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+#define POLICY_SAMPLE_MS 100 // Period of pack current samples taken from the filtered stream (ms)
+#define POLICY_FAST_TAU_MS 1000 // Time constant of the fast pack current average (ms)
+#define POLICY_SLOW_TAU_MS 30000 // Time constant of the slow pack current average (ms)
+#define POLICY_ACTIVE_A 0.3f // Slow average beyond which the pack is charging or discharging (A)
+// Pulse thresholds follow the pack current limit (PACK_MAX_CURRENT_A, pack_config.h) so a pulse is seen before the overcurrent fault opens the relay
+#define POLICY_PULSE_A (0.8f * PACK_MAX_CURRENT_A) // Fast average beyond which the pack is in a high-current pulse (A)
+#define POLICY_PULSE_STEP_A (0.5f * PACK_MAX_CURRENT_A) // Fast minus slow average beyond which the pack is in a pulse (A)
+#define POLICY_SETTLE_MS 10000 // Time a new rest, charge or discharge mode must persist before it is used (ms)
+#define POLICY_PULSE_HOLDOFF_MS 30000 // Time after the last pulse before balancing resumes, lets cell voltages relax (ms)
+#define POLICY_CONVERTER_EFFICIENCY 0.8f // Flyback output over input, to remove its own draw from the pack current
+#define POLICY_CHARGE_START_SCALE 0.5f // Start threshold multiplier while charging, balancing is powered by the charger
+
+/**
+ * @brief Pack activity modes
+ */
+typedef enum {
+	POLICY_REST = 0, // Little or no pack current, OCV-based SOC is reliable
+	POLICY_CHARGE = 1, // Steady charging (CC), balance earlier so every cell reaches the top together
+	POLICY_DISCHARGE = 2, // Steady discharge, balance as at rest
+	POLICY_PULSE = 3, // High-current pulse or its relaxation, SOC unreliable so no balancing
+	POLICY_MODE_COUNT = 4
+} PolicyMode;
+
+/**
+ * @brief Time spent in each mode and balancing in it
+ */
+typedef struct {
+	uint32_t mode_ms[POLICY_MODE_COUNT]; // Time in each mode (ms)
+	uint32_t balancing_ms[POLICY_MODE_COUNT]; // Converter running time in each mode (ms)
+	uint32_t pulses; // Pulses detected
+	uint32_t interrupted; // Balancing steps stopped by a pulse
+} PolicyStats;
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void policy_service(); // Sample the filtered pack current and update the mode, call from main loop
+PolicyMode policy_mode(); // Current pack activity mode
+int policy_allows_balancing(); // 0 during a pulse and its hold-off
+float policy_start_scale(); // Multiplier on the balancing start threshold for the current mode
+float policy_external_current(); // Slow average of the pack current without the converter's own draw (A), positive discharges
+const char *policy_mode_name(PolicyMode mode); // Printable name of a mode
+const PolicyStats *policy_get_stats(); // Time in each mode since boot
+void policy_print_report(); // Export mode, currents and time per mode over the serial monitor
+
+#endif
@@ -0,0 +1,44 @@
+/**
+  ******************************************************************************
+  * @file           : balancing_sequencer.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_BALANCING_SEQUENCER_H_
+#define INC_BALANCING_SEQUENCER_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include "pack_config.h" // Configuration settings for pack configuration
+
+/* ***** DEFINE CONSTANTS ***** */
+#define SEQ_RAMP_MS 50 // Soft-start and soft-stop ramp in each slot (ms)
+#define SEQ_CHARGE_DONE_MAH 0.5f // Charge still owed below which a cell counts as done (mAh)
+
+/**
+ * @brief Figures of merit for the last (or running) sequence
+ */
+typedef struct {
+	int cells; // Number of different cells the sequence has been given
+	uint32_t slots; // Slots completed
+	uint32_t elapsed_ms; // Wall time since the sequence started (ms)
+	uint32_t active_ms; // Time the converter was running, including ramps (ms)
+	float charge_mAh; // Charge delivered to the target cells (mAh)
+	float target_mAh; // Charge requested for the target cells (mAh)
+	float energy_mWh; // Energy delivered to the target cells (mWh)
+	uint32_t switch_us_total; // Time from the end of one slot to the start of the next, summed (us)
+	uint32_t switch_us_max; // Longest slot changeover (us)
+} SequencerReport;
+
+/* ***** FUNCTION PROTOTYPES ***** */
+int sequencer_start_charge(const int *cells, const float *charge_mAh, const uint32_t *limit_ms, int count, float setpoint, uint32_t slot_ms); // Start balancing that delivers a measured charge to each cell
+int sequencer_update_charge(const int *cells, const float *charge_mAh, const uint32_t *limit_ms, int count); // Replace the cells still waiting in the running sequence and their charge
+void sequencer_service(); // Advance the sequence, call from main loop
+void sequencer_abort(); // Stop the converter and open the switch matrix immediately
+int sequencer_is_busy(); // Check whether a sequence is running
+const SequencerReport *sequencer_get_report(); // Figures of merit for the last sequence
+void sequencer_print_report(); // Export figures of merit over the serial monitor
+
+#endif
@@ -0,0 +1,71 @@
+/**
+  ******************************************************************************
+  * @file           : balancing_trigger.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_BALANCING_TRIGGER_H_
+#define INC_BALANCING_TRIGGER_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include <stdint.h> // Standard integer type definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+// Defaults, used until a configuration is saved from the serial console
+#define TRIGGER_START_STD_DEFAULT 5.0f // Start balancing above this SOC standard deviation (%)
+#define TRIGGER_STOP_STD_DEFAULT 1.0f // Lowest start threshold, a running plan stops when the planner finds the pack balanced (%)
+#define TRIGGER_DWELL_S_DEFAULT 60 // Minimum time between a start or stop and the next one (s)
+#define TRIGGER_HORIZON_S_DEFAULT 120 // A start is skipped if the trend falls back below the start threshold within this time (s)
+
+#define TRIGGER_CONFIG_VERSION 1 // Layout version of the stored configuration
+#define TRIGGER_TREND_SAMPLES 8 // Monitoring cycles in the trend fit
+
+/**
+ * @brief Tunable trigger configuration, stored in flash
+ */
+typedef struct {
+	uint16_t version; // TRIGGER_CONFIG_VERSION
+	uint16_t dwell_s; // Minimum time between a start or stop and the next one (s)
+	uint16_t horizon_s; // Prediction horizon for skipping a start (s)
+	uint16_t reserved; // Keeps the floats aligned
+	float start_std; // Start threshold on SOC standard deviation (%)
+	float stop_std; // Lowest start threshold on SOC standard deviation, the policy cannot scale below it (%)
+} TriggerConfig;
+
+/**
+ * @brief Outcome of one evaluation
+ */
+typedef enum {
+	TRIGGER_HOLD, // Keep the current state
+	TRIGGER_START, // Start balancing
+	TRIGGER_STOP // Stop balancing
+} TriggerDecision;
+
+/**
+ * @brief Decisions taken, and starts a single snapshot threshold would have made but the trigger did not
+ */
+typedef struct {
+	uint32_t starts; // Balancing starts
+	uint32_t stops; // Balancing stops
+	uint32_t avoided_dwell; // Above the start threshold within the dwell time of the last stop
+	uint32_t avoided_noise; // Snapshot above the start threshold, window average below it
+	uint32_t avoided_trend; // Trend predicted to fall back below the start threshold within the horizon
+} TriggerCounters;
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void trigger_init(); // Restore the configuration from flash, or use the defaults
+TriggerDecision trigger_evaluate(float std_now, float std_window, int balancing, int balanced, uint32_t now_ms); // Decide whether to start or stop balancing, call once per monitoring cycle
+void trigger_set_start_scale(float scale); // Scale the start threshold for the pack activity, 1 for the configured value
+float trigger_slope(); // Trend of SOC standard deviation (% per s)
+float trigger_eta_s(); // Predicted time until the stop threshold is reached (s), -1 if not converging
+const TriggerConfig *trigger_get_config(); // Active configuration
+int trigger_set(const char *name, float value); // Change one configuration value (start, stop, dwell, horizon)
+int trigger_save(); // Write the active configuration to flash
+const TriggerCounters *trigger_get_counters(); // Decisions and avoided starts since boot
+void trigger_reset_counters(); // Clear the counters
+void trigger_print_report(); // Export configuration, trend and counters over the serial monitor
+
+#endif
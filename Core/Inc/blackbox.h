@@ -0,0 +1,77 @@
+/**
+  ******************************************************************************
+  * @file           : blackbox.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_BLACKBOX_H_
+#define INC_BLACKBOX_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include "pl455.h" // Include CRC16 checksum function, before pack_config.h whose NOC macro names a pl455.h parameter
+#include "pack_config.h" // Include number of cells
+#include <stdint.h> // Standard integer type definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+#define BLACKBOX_SAMPLE_MS 100 // Period of the recorded samples (ms)
+#define BLACKBOX_SAMPLES 300 // Samples in the RAM ring buffer, 30s at BLACKBOX_SAMPLE_MS
+#define BLACKBOX_POST_SAMPLES 20 // Samples still recorded after the trigger, so the fault action is captured
+#define BLACKBOX_PAGES_PER_EVENT 4 // Flash pages holding one capture
+#define BLACKBOX_PROGRAM_SAMPLES 8 // Samples programmed per blackbox_service() call
+#define BLACKBOX_MAGIC 0x58424242 // Marks a sealed capture ("BBBX")
+#define BLACKBOX_VERSION 1 // Layout version of BlackboxHeader and BlackboxSample
+#define BLACKBOX_TRIGGER_MANUAL 0xFF // Fault id of a capture taken from the serial console
+
+/**
+ * @brief One recorded sample, layout shared with Tools/blackbox_decode.py
+ */
+typedef struct {
+	uint32_t tick_ms; // HAL tick of the sample (ms)
+	uint16_t cell_mv[NOC]; // Cell voltages, index as volt[] (mV)
+	int16_t pack_mA; // Filtered pack current, positive discharges (mA)
+	int16_t balancing_mA; // Filtered balancing current (mA)
+	uint8_t target; // Cell receiving balancing charge, 0 if none
+	uint8_t mode; // PolicyMode
+	uint8_t flags; // BLACKBOX_FLAG_x
+	uint8_t faults; // Active faults, bit = FaultId
+} BlackboxSample;
+
+#define BLACKBOX_FLAG_RELAY 0x01 // Pack relay closed
+#define BLACKBOX_FLAG_SEQUENCER 0x02 // Balancing sequence running
+#define BLACKBOX_FLAG_PLANNER 0x04 // Balancing plan active
+
+/**
+ * @brief Header at the start of a stored capture, programmed last
+ */
+typedef struct {
+	uint32_t magic; // BLACKBOX_MAGIC once the capture is complete
+	uint16_t version; // BLACKBOX_VERSION
+	uint16_t crc; // CRC16 of the samples as programmed
+	uint32_t sequence; // Capture number, the highest is the newest
+	uint32_t trigger_tick; // HAL tick of the trigger (ms)
+	uint32_t fault_bits; // Active faults at the trigger, bit = FaultId
+	uint16_t samples; // Samples stored
+	uint16_t trigger_index; // First sample taken after the trigger
+	uint16_t sample_ms; // BLACKBOX_SAMPLE_MS
+	uint8_t fault; // FaultId that triggered the capture, BLACKBOX_TRIGGER_MANUAL from the console
+	uint8_t reserved;
+	uint32_t missed; // Triggers ignored while an earlier capture was being stored
+} BlackboxHeader;
+
+_Static_assert(sizeof(BlackboxSample) % 8 == 0 && sizeof(BlackboxHeader) % 8 == 0, "Flash is programmed in double-words");
+_Static_assert(sizeof(BlackboxHeader) + BLACKBOX_SAMPLES * sizeof(BlackboxSample) <= BLACKBOX_PAGES_PER_EVENT * FLASH_PAGE_SIZE, "Capture must fit its pages");
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void blackbox_init(); // Find the newest stored capture so the next one goes to the following slot
+void blackbox_record(const BlackboxSample *sample); // Add a sample to the ring buffer, call every BLACKBOX_SAMPLE_MS
+void blackbox_trigger(uint8_t fault, uint32_t fault_bits); // Freeze the buffer after BLACKBOX_POST_SAMPLES more samples, O(1)
+void blackbox_service(); // Store a frozen capture in flash one page or chunk at a time, call from main loop
+int blackbox_is_busy(); // Check whether a capture is waiting for its post-trigger samples or being stored
+void blackbox_print_report(); // List the stored captures over the serial monitor
+int blackbox_dump(uint32_t sequence); // Print a stored capture as hex for Tools/blackbox_decode.py
+int blackbox_erase(); // Erase every stored capture
+
+#endif
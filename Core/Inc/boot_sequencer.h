@@ -0,0 +1,45 @@
+/**
+  ******************************************************************************
+  * @file           : boot_sequencer.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_BOOT_SEQUENCER_H_
+#define INC_BOOT_SEQUENCER_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include <stdint.h> // Standard integer type definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+#define BOOT_STEPS_MAX 16 // Steps a boot sequence can hold
+
+/**
+ * @brief Independent chains of steps, in priority order
+ */
+typedef enum {
+	BOOT_LANE_MONITOR = 0, // Cell monitor power-down, wake and configuration, the critical path
+	BOOT_LANE_MCU = 1, // Peripherals and modules, run while the monitor lane waits
+	BOOT_LANE_LATE = 2, // Steps that block for long, run once the other lanes are done
+	BOOT_LANE_COUNT
+} BootLane;
+
+#define BOOT_LANE_BIT(lane) (1UL << (lane)) // Lane mask bit for boot_run()
+
+/**
+ * @brief One step of the boot sequence
+ */
+typedef struct {
+	const char *name; // Name in the report
+	void (*run)(); // Initialisation done by the step
+	uint8_t lane; // BootLane the step belongs to, steps of a lane run in table order
+	uint32_t wait_us; // Minimum time from the end of the previous step of the lane (us)
+} BootStep;
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void boot_run(const BootStep *steps, int count, uint32_t lanes); // Run the steps of the lanes in the mask, overlapping the lanes
+void boot_print_report(); // Export the start and end of every step over the serial monitor
+
+#endif
@@ -0,0 +1,26 @@
+/**
+  ******************************************************************************
+  * @file           : cell_convert.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_CELL_CONVERT_H_
+#define INC_CELL_CONVERT_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include <stdint.h> // Standard integer type definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+#define CELL_CONVERT_LSB_UV_Q16 5023990UL // Cell voltage code weight, 76.66uV (0.00007666V) in Q16
+#define CELL_CONVERT_BENCH_CELLS 192 // Largest stack timed by cell_convert_print_benchmark()
+
+/* ***** FUNCTION PROTOTYPES ***** */
+uint32_t cell_convert_code_uv(uint16_t code); // Cell voltage (uV) from one raw code
+void cell_convert_codes(const uint8_t *codes, int count, uint32_t *cell_uv, float *cell_volt); // Big-endian cell codes to uV, and V if cell_volt is not NULL
+void cell_convert_stack(const uint8_t *codes, int count, int16_t temp_decic, const uint8_t *branch, uint32_t *cell_uv, uint16_t *soc_centi); // Cell codes to uV and SOC in one call
+void cell_convert_print_benchmark(); // Export cycles per cell for 6, 96 and CELL_CONVERT_BENCH_CELLS cells
+
+#endif
@@ -0,0 +1,79 @@
+/**
+  ******************************************************************************
+  * @file           : cell_health.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_CELL_HEALTH_H_
+#define INC_CELL_HEALTH_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include "pack_config.h" // Include number of cells
+#include <stdint.h> // Standard integer type definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+// Capacity from rest points
+#define CELL_HEALTH_REST_A 0.05f // Cell current below which the pack counts as resting (A)
+#define CELL_HEALTH_REST_MS 600000 // Rest after which the OCV SOC is trusted (ms)
+#define CELL_HEALTH_MIN_DSOC 5.0f // Smallest SOC change between rest points that gives a capacity estimate (%)
+#define CELL_HEALTH_DSOC_WEIGHT 20.0f // SOC change at which an estimate moves the capacity half way (%)
+#define CELL_HEALTH_CAPACITY_MIN_PCT 50 // Estimates outside these limits of rated capacity are rejected (%)
+#define CELL_HEALTH_CAPACITY_MAX_PCT 120
+
+// Resistance from current steps
+#define CELL_HEALTH_STEP_A 0.5f // Current change between monitoring cycles that gives a resistance estimate (A)
+#define CELL_HEALTH_R_GAIN 0.125f // Weight of each resistance estimate
+#define CELL_HEALTH_R_DEFAULT_OHM 0.015f // Resistance before the first estimate (Ohm)
+#define CELL_HEALTH_R_MAX_OHM 0.2f // Estimates above this are rejected (Ohm)
+
+#define CELL_HEALTH_SAVE_R_UPDATES 16 // Resistance updates between saves when no capacity update comes first
+#define CELL_HEALTH_VERSION 1 // Layout version of the stored records
+
+/**
+ * @brief Compact per-cell health record, stored in flash
+ */
+typedef struct {
+	uint16_t capacity_mAh; // Estimated capacity (mAh)
+	uint16_t resistance_10uohm; // Estimated resistance (10 uOhm units)
+	uint8_t capacity_updates; // Capacity estimates taken, saturates at 255
+	uint8_t resistance_updates; // Resistance estimates taken, saturates at 255
+} CellHealthRecord;
+
+/**
+ * @brief Stored records of every cell (index as volt[])
+ */
+typedef struct {
+	uint16_t version; // CELL_HEALTH_VERSION
+	uint16_t rated_mAh; // Rated capacity of the chemistry profile the records belong to (mAh)
+	CellHealthRecord cell[NOC];
+} CellHealthStore;
+
+/**
+ * @brief Rest point and charge counted since it, lost on a cold start (index as volt[])
+ */
+typedef struct {
+	float rest_soc[NOC]; // OCV SOC at the last rest point (%)
+	float charge_mAh[NOC]; // Charge out of each cell since the last rest point, positive discharges (mAh)
+	float last_volt[NOC]; // Cell voltage at the previous cycle (V)
+	float last_current[NOC]; // Cell current at the previous cycle (A)
+	uint32_t rest_ms; // Time every cell current has been below CELL_HEALTH_REST_A (ms)
+	uint32_t rest_valid; // 1 once there is a rest point
+} CellHealthTracking;
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void cell_health_init(); // Restore the records from flash, or start every cell at rated capacity
+void cell_health_update(const float *cell_volt, const float *cell_current, const float *ocv_soc, uint32_t dt_ms); // Track rest points and current steps, call once per monitoring cycle
+void cell_health_usable(const float *soc, float *usable); // Usable charge of every cell as % of rated capacity
+float cell_health_capacity_mAh(int index); // Estimated capacity of a cell (mAh)
+float cell_health_resistance_ohm(int index); // Estimated resistance of a cell (Ohm)
+const CellHealthRecord *cell_health_record(int index); // Stored record of a cell
+int cell_health_save(); // Write the records to flash
+void cell_health_get_tracking(CellHealthTracking *tracking); // Rest point, charge counts and previous cycle
+void cell_health_restore_tracking(const CellHealthTracking *tracking); // Continue counting from a saved rest point and charge
+void cell_health_reset(); // Forget every estimate and start again from rated capacity
+void cell_health_print_report(); // Export capacity, state of health and resistance over the serial monitor
+
+#endif
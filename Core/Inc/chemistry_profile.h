@@ -0,0 +1,69 @@
+/**
+  ******************************************************************************
+  * @file           : chemistry_profile.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_CHEMISTRY_PROFILE_H_
+#define INC_CHEMISTRY_PROFILE_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include <stdint.h> // Standard integer type definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+#define CHEM_PROFILE_MAGIC 0x4D454843 // "CHEM" little-endian, marks a programmed partition
+#define CHEM_PROFILE_VERSION 1 // Image format version, bumped on any layout change (Tools/chem_profile.py must match)
+#define CHEM_PROFILE_NAME_LEN 16 // Cell name, NUL padded
+#define CHEM_PROFILE_CRC_START 8 // CRC16 covers the image from the length field to the end
+
+/**
+ * @brief Chemistry profile image header, followed by the OCV surface
+ *
+ * The surface is uint16_t SOC in 0.01% units indexed [branch][temperature][voltage]
+ * as described in ocv_model.h. All fields are little-endian and naturally aligned
+ * so the image is used in place from flash.
+ */
+typedef struct {
+	uint32_t magic; // CHEM_PROFILE_MAGIC
+	uint16_t version; // CHEM_PROFILE_VERSION
+	uint16_t crc; // CRC16 (as pl455.c) from CHEM_PROFILE_CRC_START to length
+	uint32_t length; // Image length including header and surface (bytes)
+	char name[CHEM_PROFILE_NAME_LEN]; // Cell type, e.g. "Molicel P45B"
+
+	// Cell limits
+	uint16_t cell_min_mv; // Undervoltage fault threshold (mV)
+	uint16_t cell_max_mv; // Overvoltage fault threshold (mV)
+	uint16_t capacity_mAh; // Rated capacity (mAh)
+
+	// Balancing limits
+	uint16_t balance_max_mA; // Highest balancing current into a cell (mA)
+	uint16_t derate_start_mv; // Target cell voltage at which balancing current derating begins (mV)
+	uint16_t derate_stop_mv; // Target cell voltage at which balancing current reaches zero (mV)
+
+	// OCV surface
+	uint32_t ocv_v0_uv; // Voltage of the first grid point (uV)
+	uint16_t ocv_v_size; // Number of voltage points
+	uint8_t ocv_v_shift; // Voltage step is 2^ocv_v_shift uV
+	uint8_t ocv_t_size; // Number of temperatures
+	int16_t ocv_t0_decic; // Temperature of the first curve (0.1 degC)
+	int16_t ocv_t_step_decic; // Temperature step between curves (0.1 degC)
+	uint32_t ocv_offset; // Offset of the surface from the start of the image (bytes)
+} ChemistryProfile;
+
+_Static_assert(sizeof(ChemistryProfile) == 56, "ChemistryProfile layout must match Tools/chem_profile.py");
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void chemistry_profile_init(); // Select the profile in the partition if valid, otherwise the built-in one
+const ChemistryProfile *chemistry_profile(); // Active profile, in place in flash
+const uint16_t *chemistry_profile_ocv(); // OCV surface of the active profile
+int chemistry_profile_is_builtin(); // 1 while the built-in profile is active
+int chemistry_profile_upload_begin(uint32_t length); // Erase the partition to receive a new image
+int chemistry_profile_upload_data(uint32_t offset, const uint8_t *data, uint32_t len); // Program part of the new image
+int chemistry_profile_upload_end(); // Validate and activate the uploaded image
+int chemistry_profile_erase(); // Erase the partition and return to the built-in profile
+void chemistry_profile_print(); // Print the active profile over the serial monitor
+
+#endif
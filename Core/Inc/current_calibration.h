@@ -0,0 +1,52 @@
+/**
+  ******************************************************************************
+  * @file           : current_calibration.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_CURRENT_CALIBRATION_H_
+#define INC_CURRENT_CALIBRATION_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include <stdint.h> // Standard integer type definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+#define CAL_GAIN_SHIFT 16 // Gains are mA per ADC code in q16
+#define CAL_PACK_GAIN_NOMINAL 105600 // 3.3V / 4096 / 0.5V/A = 1.611mA per code (q16)
+#define CAL_BALANCING_GAIN_NOMINAL 528000 // 3.3V / 4096 / 20V/V / 5mOhm = 8.057mA per code (q16)
+#define CAL_ZERO_SAMPLES 16 // Filtered blocks averaged for a calibration point (16 x CURRENT_SENSE_BLOCK_MS, about 550ms)
+#define CAL_MAX_OFFSET 124 // Largest accepted zero offset in codes (100mV at the ADC input)
+#define CAL_GAIN_TOLERANCE 20 // Largest accepted deviation from nominal gain (%)
+#define CAL_PERSIST_DELTA 2 // Offset change (codes) needed before an automatic zero is written to flash
+#define CAL_AUTO_ZERO_INTERVAL_MS 600000 // Automatic zero calibration period while idle (10 minutes)
+
+/**
+ * @brief Current sense channels
+ */
+typedef enum {
+	CURRENT_CHANNEL_PACK = 0, // ADC1, pack current
+	CURRENT_CHANNEL_BALANCING = 1, // ADC2, flyback output current
+	CURRENT_CHANNEL_COUNT = 2
+} CurrentChannel;
+
+/**
+ * @brief Offset and gain of one channel, mA = (code - offset) x gain >> CAL_GAIN_SHIFT
+ */
+typedef struct {
+	int32_t offset; // ADC code at zero current
+	int32_t gain; // mA per code (q16)
+} ChannelCalibration;
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void calibration_init(); // Restore coefficients from flash, zero any channel that was never calibrated
+int32_t calibration_code_to_mA(CurrentChannel channel, int16_t code); // Convert a filtered ADC code to mA
+int calibration_zero(CurrentChannel channel, int persist); // Measure the zero-current offset of a channel
+int calibration_gain(CurrentChannel channel, float reference_current); // Two-point gain calibration with a known current applied
+void calibration_service(); // Periodic zero calibration of the balancing channel while the converter is idle, call from main loop
+const ChannelCalibration *calibration_get(CurrentChannel channel); // Active coefficients for a channel
+void calibration_print_report(); // Export the coefficients of every channel over the serial monitor
+
+#endif
@@ -0,0 +1,36 @@
+/**
+  ******************************************************************************
+  * @file           : current_filter.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_CURRENT_FILTER_H_
+#define INC_CURRENT_FILTER_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include <stdint.h> // Standard integer type definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+#define CURRENT_FILTER_TAPS 8 // Number of FIR coefficients
+#define CURRENT_FILTER_GAIN_SHIFT 0 // FMAC output gain R (left shift), 0 for unity gain coefficients
+
+/**
+ * @brief Software FIR filter state, bit-exact model of the FMAC FIR function
+ */
+typedef struct {
+	int16_t history[CURRENT_FILTER_TAPS]; // Most recent input samples (circular)
+	uint8_t index; // Position of the newest sample in history
+	int16_t output; // Most recent filter output
+} CurrentFilter;
+
+/* ***** EXTERNAL VARIABLES ***** */
+extern const int16_t current_filter_coeffs[CURRENT_FILTER_TAPS]; // Low-pass FIR coefficients (q1.15)
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void current_filter_init(CurrentFilter *filter); // Clear filter history
+int16_t current_filter_step(CurrentFilter *filter, int16_t sample); // Filter one sample
+void current_filter_block(CurrentFilter *filter, const uint16_t *samples, int16_t *output, uint16_t count); // Filter a block of ADC codes
+
+#endif
@@ -0,0 +1,43 @@
+/**
+  ******************************************************************************
+  * @file           : current_sense.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_CURRENT_SENSE_H_
+#define INC_CURRENT_SENSE_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include "current_filter.h" // Include fixed-point FIR filter
+
+/* ***** DEFINE CONSTANTS ***** */
+#ifndef CURRENT_FILTER_USE_FMAC
+#define CURRENT_FILTER_USE_FMAC 1 // 1 = filter pack current on the FMAC, 0 = software filter only
+#endif
+#define CURRENT_SENSE_BLOCK 32 // ADC samples per DMA half-buffer
+#define CURRENT_SENSE_SAMPLE_US 1075 // Oversampled conversion period, 16 x (92.5 + 12.5) cycles of SYSCLK 100MHz / 64 (adc.c), about 930S/s
+#define CURRENT_SENSE_BLOCK_MS ((CURRENT_SENSE_BLOCK * CURRENT_SENSE_SAMPLE_US + 500) / 1000) // Time to fill one block (ms), about 34ms
+
+/**
+ * @brief Filtered pack and balancing current codes sampled at the same instant
+ */
+typedef struct {
+	int16_t pack_code; // Filtered ADC1 code (pack current)
+	int16_t balancing_code; // Filtered ADC2 code (balancing current)
+} CurrentSample;
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void current_sense_start(); // Calibrate ADCs, configure FMAC and start continuous sampling
+void current_sense_block_ready(ADC_HandleTypeDef *hadc, int second_half); // Hand a completed DMA half-buffer to the filters
+CurrentSample current_sense_sample(); // Latest time-coherent pair of filtered ADC codes
+uint32_t current_sense_block_count(); // Number of blocks filtered since start
+int32_t current_sense_pack_mA(); // Latest filtered pack current (mA), offset and gain corrected
+int32_t current_sense_balancing_mA(); // Latest filtered balancing current (mA), offset and gain corrected
+float current_sense_pack_current(); // Latest filtered pack current (A)
+float current_sense_balancing_current(); // Latest filtered balancing current (A)
+void current_sense_read(float *pack_current, float *balancing_current); // Pack and balancing current (A) sampled at the same instant
+
+#endif
@@ -0,0 +1,20 @@
+/**
+  ******************************************************************************
+  * @file           : cycle_timer.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_CYCLE_TIMER_H_
+#define INC_CYCLE_TIMER_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void cycle_timer_init(); // Start the DWT cycle counter
+uint32_t cycle_timer_now(); // Current CPU cycle count
+void cycle_timer_delay_us(uint32_t us); // Busy-wait for a number of microseconds
+
+#endif
@@ -0,0 +1,78 @@
+/**
+  ******************************************************************************
+  * @file           : fault_manager.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_FAULT_MANAGER_H_
+#define INC_FAULT_MANAGER_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include <stdint.h> // Standard integer type definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+#define FAULT_READING_MIN_MV 500 // Cell readings below this are treated as a failed measurement, not a cell voltage (mV)
+#define FAULT_CELL_LOW_MARGIN_MV 100 // Warn this far above the undervoltage threshold (mV)
+
+/**
+ * @brief Faults, each owns one bit of the fault bitmap
+ */
+typedef enum {
+	FAULT_CELL_OVERVOLTAGE = 0, // A cell above the chemistry profile maximum
+	FAULT_CELL_UNDERVOLTAGE = 1, // A cell below the chemistry profile minimum
+	FAULT_PACK_OVERCURRENT = 2, // Filtered pack current above the threshold
+	FAULT_CELL_HIGH = 3, // A cell at or above the voltage where balancing current reaches zero
+	FAULT_CELL_LOW = 4, // A cell within FAULT_CELL_LOW_MARGIN_MV of the undervoltage threshold
+	FAULT_MONITOR_READING = 5, // Cell monitor returned no fresh reading or an implausible one, the cells are unprotected
+	FAULT_COUNT
+} FaultId;
+
+/**
+ * @brief Action taken while a fault is active, in increasing order
+ */
+typedef enum {
+	FAULT_SEVERITY_NONE = 0, // No fault
+	FAULT_SEVERITY_WARN = 1, // Report only
+	FAULT_SEVERITY_DERATE = 2, // Balancing stopped
+	FAULT_SEVERITY_OPEN_RELAY = 3, // Balancing stopped and pack relay opened
+	FAULT_SEVERITY_COUNT
+} FaultSeverity;
+
+/**
+ * @brief Fixed behaviour of one fault
+ */
+typedef struct {
+	const char *name; // Name in messages
+	uint8_t severity; // FaultSeverity while active
+	uint8_t latched; // 1 if the fault stays active until cleared from the console
+	uint8_t set_samples; // Consecutive samples with the condition before the fault is set
+	uint8_t clear_samples; // Consecutive samples without the condition before it is cleared (or may be cleared, if latched)
+} FaultConfig;
+
+/**
+ * @brief Debounce state of one fault
+ */
+typedef struct {
+	uint8_t set_count; // Consecutive samples with the condition
+	uint8_t clear_count; // Consecutive samples without the condition
+	uint8_t condition; // Debounced condition
+	uint8_t active; // 1 while the fault is active
+	uint32_t trips; // Times the fault was set since boot
+} FaultState;
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void fault_report(FaultId id, int condition); // Debounce one sample of a fault condition, O(1)
+FaultSeverity fault_severity(); // Highest severity among the active faults
+int fault_is_active(FaultId id); // Check whether a fault is active
+uint32_t fault_bitmap(); // Active faults, bit = FaultId
+uint32_t fault_latched_bitmap(); // Active faults held only by their latch, bit = FaultId
+int fault_clear_latched(); // Clear latched faults whose condition has gone, returns the number still active
+void fault_restore(const FaultState *states); // Continue from a saved debounce state of every fault
+const FaultConfig *fault_config(FaultId id); // Behaviour of a fault
+const FaultState *fault_state(FaultId id); // Debounce state of a fault
+void fault_print_report(); // Export fault bitmaps, severity and trip counts over the serial monitor
+
+#endif
@@ -0,0 +1,38 @@
+/**
+  ******************************************************************************
+  * @file           : flash_storage.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_FLASH_STORAGE_H_
+#define INC_FLASH_STORAGE_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include <stdint.h> // Standard integer type definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+#define STORAGE_MAGIC 0xB355 // Marks a programmed record slot
+#define STORAGE_MAX_PAYLOAD 496 // Largest record payload (bytes), header + payload fits a 512 byte slot
+#define STORAGE_PAGES_PER_RECORD 2 // Each record alternates between two pages so the old copy survives an erase
+
+/**
+ * @brief Record identifiers, each owns STORAGE_PAGES_PER_RECORD pages of the NVM region
+ */
+typedef enum {
+	STORAGE_ID_ACCOUNTING = 0, // Lifetime balancing charge and energy totals
+	STORAGE_ID_CALIBRATION = 1, // Current sense offset and gain coefficients
+	STORAGE_ID_TRIGGER = 2, // Balancing trigger thresholds and times
+	STORAGE_ID_HEALTH = 3, // Per-cell capacity and resistance estimates
+	STORAGE_ID_COUNT = 4 // Number of record slots the NVM region is divided into
+} StorageRecordId;
+
+/* ***** FUNCTION PROTOTYPES ***** */
+int storage_read(StorageRecordId id, void *data, uint16_t len); // Read latest valid copy of a record
+int storage_write(StorageRecordId id, const void *data, uint16_t len); // Append a new copy of a record
+int storage_erase_area(uintptr_t start, uint32_t len); // Erase the pages of a flash area outside the record slots
+int storage_program(uintptr_t address, const void *data, uint32_t len); // Program erased flash outside the record slots
+
+#endif
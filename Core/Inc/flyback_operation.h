@@ -13,10 +13,71 @@
 #include "main.h"  // Include main application definitions
 #include <stdio.h> // Include standard I/O functions for debugging
 
+/* ***** DEFINE CONSTANTS ***** */
+#define FLYBACK_CONTROL_PERIOD_MS 10 // Period of the duty cycle feedback loop (ms)
+#define FLYBACK_MIN_CURRENT 0.5f // Lowest balancing current setpoint accepted (A)
+#define FLYBACK_MAX_CURRENT 4.0f // Highest balancing current setpoint accepted (A)
+#define FLYBACK_CURRENT_BAND 0.05f // Regulation deadband as a fraction of setpoint (+/-5%)
+#define FLYBACK_DUTY_MAX 80 // Maximum PWM duty cycle (%), TIM1 period is 100 counts
+#define FLYBACK_DUTY_FF_OFFSET 20 // Feedforward duty cycle at 0A (%)
+#define FLYBACK_DUTY_FF_SLOPE 8 // Feedforward duty cycle per amp (%/A), gives 28% at 1A
+#define FLYBACK_DEFAULT_RAMP_MS 200 // Default soft-start and soft-stop ramp time (ms)
+
+// Derating limits, current is reduced linearly from START to zero at STOP
+// Target cell voltage limits come from the chemistry profile (see chemistry_profile.h)
+#define FLYBACK_DERATE_TEMP_START 45.0f // Temperature at which derating begins (degC)
+#define FLYBACK_DERATE_TEMP_STOP 60.0f // Temperature at which balancing current reaches zero (degC)
+
+
+/* ***** TYPE DEFINITIONS ***** */
+
+/**
+ * @brief Power stage states
+ */
+typedef enum {
+	FLYBACK_IDLE, // PWM stopped, ready for a new request
+	FLYBACK_RAMP_UP, // Soft-start towards the setpoint
+	FLYBACK_REGULATE, // Regulating at the (derated) setpoint
+	FLYBACK_RAMP_DOWN // Soft-stop towards zero current
+} FlybackState;
+
+/**
+ * @brief Balancing transfer request
+ * Transfer ends when either the duration or the charge target is reached (set unused one to 0)
+ */
+typedef struct {
+	int target_cell; // Cell number receiving charge (1 to NOC)
+	float setpoint; // Balancing current setpoint (A)
+	uint32_t duration_ms; // Time to regulate at setpoint (ms), 0 if not used
+	float charge_target_mAh; // Charge to deliver to the target cell including the soft-stop (mAh), 0 if not used
+	uint32_t ramp_up_ms; // Soft-start ramp time (ms)
+	uint32_t ramp_down_ms; // Soft-stop ramp time (ms)
+} FlybackRequest;
+
+/**
+ * @brief Summary of a completed balancing transfer
+ */
+typedef struct {
+	int target_cell; // Cell number that received charge
+	float charge_mAh; // Measured charge delivered (mAh)
+	uint32_t active_ms; // Time PWM was active including ramps (ms)
+	int aborted; // 1 if the transfer was stopped early or fully derated
+	int terminated; // 1 if the transfer was cut off without a soft-stop (terminate_flyback())
+} FlybackResult;
+
+
 /* ***** FUNCTION PROTOTYPES ***** */
-void flyback_1A_balance(); // Activate flyback converter for 1A balancing
-void flyback_4A_balance(); // Activate flyback converter for 4A balancing
+int flyback_start(const FlybackRequest *request); // Start an asynchronous balancing transfer
+void flyback_service(); // Run the power stage state machine, call from main loop
+void flyback_set_setpoint(float setpoint); // Change the current setpoint of the running transfer
+void flyback_stop(); // Request a soft stop of the running transfer
+void flyback_update_derating(float temperature, float cell_voltage); // Update derating inputs
+int flyback_is_busy(); // Check whether a transfer is in progress
+FlybackState flyback_get_state(); // Get current power stage state
+int flyback_get_target(); // Cell receiving charge, 0 while idle
+const FlybackResult *flyback_get_result(); // Get summary of the last completed transfer
+void flyback_complete_callback(const FlybackResult *result); // Transfer completion callback (weak)
 float read_balancing_current(); // Read balancing current using ADC measurement
-void terminate_flyback(); // Terminate flyback converter operation
+void terminate_flyback(); // Immediately terminate flyback converter operation
 
 #endif
@@ -0,0 +1,62 @@
+/**
+  ******************************************************************************
+  * @file           : ocv_model.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_OCV_MODEL_H_
+#define INC_OCV_MODEL_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include "pack_config.h" // Include number of cells
+#include <stdint.h> // Standard integer type definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+// Built-in surface generated by Tools/gen_ocv_surface.py (see ocv_surface.c), loaded profiles carry their own
+// Placeholder until more curves are characterised: 25 degC only, the same curve on both branches
+#define OCV_V0_UV 2600000 // Voltage of the first grid point (uV)
+#define OCV_V_SHIFT 11 // Voltage step is 2^OCV_V_SHIFT uV (2.048mV)
+#define OCV_V_SIZE 778 // Number of voltage points, last one at or above the 100% voltage
+#define OCV_T0_DECIC 250 // Temperature of the first curve (0.1 degC)
+#define OCV_T_STEP_DECIC 100 // Temperature step between curves (0.1 degC)
+#define OCV_T_SIZE 1 // Number of characterised temperatures
+
+#define OCV_HYST_SWITCH_UV 5000 // Voltage reversal that moves a cell to the other branch (uV), above measurement noise
+
+/**
+ * @brief Hysteresis branch of the OCV curve
+ */
+typedef enum {
+	OCV_BRANCH_DISCHARGE = 0, // Cell was last being discharged
+	OCV_BRANCH_CHARGE = 1, // Cell was last being charged
+	OCV_BRANCH_COUNT = 2
+} OcvBranch;
+
+/**
+ * @brief Per-cell branch selector state
+ */
+typedef struct {
+	uint32_t turn_uv; // Highest voltage since moving to charge, lowest since moving to discharge (uV)
+	uint8_t branch; // Current OcvBranch
+	uint8_t valid; // 0 until the first reading
+} OcvCellState;
+
+extern const uint16_t ocv_surface[OCV_BRANCH_COUNT][OCV_T_SIZE][OCV_V_SIZE]; // Built-in surface (0.01% SOC)
+
+/* ***** FUNCTION PROTOTYPES ***** */
+uint16_t ocv_soc_centi(uint32_t cell_uv, int16_t temp_decic, OcvBranch branch); // SOC (0.01% units) from the surface
+void ocv_soc_centi_batch(const uint32_t *cell_uv, const uint8_t *branch, int count, int16_t temp_decic, uint16_t *soc_centi); // SOC (0.01% units) of a batch of cells at one temperature
+OcvBranch ocv_track_branch(int index, uint32_t cell_uv); // Update the branch of one cell from a new voltage reading
+void ocv_model_update(const uint32_t *cell_uv, float temperature, float *soc); // SOC (%) of every cell
+OcvBranch ocv_model_get_branch(int index); // Branch currently selected for a cell
+const OcvCellState *ocv_model_state(); // Branch selector state of every cell
+void ocv_model_restore(const OcvCellState *state); // Continue from a saved branch selector state
+int ocv_model_branches_changed(); // 1 once after any cell changed branch, to report branches only when they move
+uint32_t ocv_model_footprint(); // Bytes of flash and RAM used by the surface and selector
+uint32_t ocv_model_cycles_per_cell(); // CPU cycles per cell in the last ocv_model_update()
+void ocv_model_print_report(); // Export footprint, evaluation cost and branches over the serial monitor
+
+#endif
@@ -4,5 +4,6 @@
 #define SRC_PACK_CONFIG_H_
 
 #define NOC 6 // Number of cells - 6
+#define PACK_MAX_CURRENT_A 1.0f // Pack current limit, above it the overcurrent fault opens the relay (A)
 
 #endif
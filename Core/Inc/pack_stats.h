@@ -0,0 +1,58 @@
+/**
+  ******************************************************************************
+  * @file           : pack_stats.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_PACK_STATS_H_
+#define INC_PACK_STATS_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include "pack_config.h" // Include number of cells
+#include <stdint.h> // Standard integer type definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+#define PACK_STATS_CAPACITY 8 // Leaves of the min / max trees, power of two at least NOC
+#define PACK_STATS_WINDOW 8 // Samples in the sliding window averages
+#define PACK_STATS_REBUILD_INTERVAL 1024 // Cell updates between exact recomputations of mean and variance
+
+_Static_assert(PACK_STATS_CAPACITY >= NOC && (PACK_STATS_CAPACITY & (PACK_STATS_CAPACITY - 1)) == 0,
+		"PACK_STATS_CAPACITY must be a power of two at least NOC");
+
+/**
+ * @brief Streaming statistics of one value per cell
+ */
+typedef struct {
+	float value[PACK_STATS_CAPACITY]; // Latest value of each cell
+	uint16_t min_node[2 * PACK_STATS_CAPACITY]; // Tournament tree, index of the smallest value below each node
+	uint16_t max_node[2 * PACK_STATS_CAPACITY]; // Tournament tree, index of the largest value below each node
+	int count; // Number of cells
+	float mean; // Mean of all cells
+	float m2; // Sum of squared differences from the mean (Welford)
+	uint32_t updates; // Cell updates since the last exact recomputation
+
+	// Sliding window of pack samples
+	float window_mean[PACK_STATS_WINDOW]; // Mean at each sample
+	float window_std[PACK_STATS_WINDOW]; // Standard deviation at each sample
+	float window_mean_sum; // Running sum of window_mean
+	float window_std_sum; // Running sum of window_std
+	int window_next; // Slot of the next sample
+	int window_fill; // Samples in the window (up to PACK_STATS_WINDOW)
+} PackStats;
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void pack_stats_init(PackStats *stats, const float *values, int count); // Start from a full set of cell values
+void pack_stats_update(PackStats *stats, int index, float value); // Change the value of one cell
+float pack_stats_mean(const PackStats *stats); // Mean of all cells
+float pack_stats_std_dev(const PackStats *stats); // Population standard deviation of all cells
+float pack_stats_min(const PackStats *stats, int *index); // Smallest value and its cell index
+float pack_stats_max(const PackStats *stats, int *index); // Largest value and its cell index
+float pack_stats_max_deviation(const PackStats *stats, int *index); // Largest distance from the mean and its cell index
+void pack_stats_sample(PackStats *stats); // Add the current mean and standard deviation to the window
+float pack_stats_window_mean(const PackStats *stats); // Mean averaged over the window
+float pack_stats_window_std_dev(const PackStats *stats); // Standard deviation averaged over the window
+
+#endif
@@ -31,6 +31,11 @@
 #define TOTALBOARDS	1 // Number of ICs in the stack
 #define BAUDRATE 250000 // Defined IC baudrate (recommended)
 
+// Power-up timing, as in TI's reference wake sequence (see boot_sequencer.c)
+#define PL455_SHUTDOWN_MS 5 // Shutdown command to wake pulse
+#define PL455_WAKE_PULSE_US 10 // Low time of the wake pulse
+#define PL455_STARTUP_MS 5 // Wake pulse to the first command
+
 
 // ========================== FUNCTION PROTOTYPES =========================== //
 
@@ -48,6 +53,9 @@ int  WriteReg(BYTE bID, uint16_t wAddr, uint64_t dwData, BYTE bLen, BYTE bWriteT
 int ReadResp(BYTE * pData, uint16_t bLen); // Read response data from IC
 int  WriteFrame(BYTE bID, uint16_t wAddr, BYTE * pData, BYTE bLen, BYTE bWriteType); // Construct and transmit frame to IC
 
+// Checksum functions
+uint16_t CRC16(BYTE *pBuf, int nLen); // Compute CRC16 checksum (also used for flash records)
+
 // Delay functions
 void delayms(uint16_t ms); // Millisecond delay function
 void delayus(uint16_t us); // Microsecond delay function
@@ -0,0 +1,26 @@
+/**
+  ******************************************************************************
+  * @file           : serial_console.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_SERIAL_CONSOLE_H_
+#define INC_SERIAL_CONSOLE_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+#define CONSOLE_RX_BUFFER 256 // Receive ring buffer (bytes), power of two
+#define CONSOLE_LINE_MAX 192 // Longest command line (characters)
+#define CONSOLE_DATA_MAX 64 // Largest binary payload of one command (bytes)
+#define CONSOLE_STALL_MAX_MS 10000 // Longest main loop stall of "watchdog stall" (ms)
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void serial_console_init(); // Enable LPUART1 receive interrupt
+void serial_console_rx_irq(); // Store received bytes, called from LPUART1_IRQHandler
+void serial_console_service(); // Execute complete command lines, call from main loop
+
+#endif
@@ -0,0 +1,55 @@
+/**
+  ******************************************************************************
+  * @file           : soc_ekf.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_SOC_EKF_H_
+#define INC_SOC_EKF_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include "pack_config.h" // Include number of cells
+
+/* ***** DEFINE CONSTANTS ***** */
+// First-order RC equivalent circuit (Tools/soc_ekf_reference.py reads these values)
+#define SOC_EKF_R0_OHM 0.015f // Series resistance (Ohm)
+#define SOC_EKF_R1_OHM 0.010f // Polarisation resistance (Ohm)
+#define SOC_EKF_TAU_S 30.0f // Polarisation time constant R1 x C1 (s)
+#define SOC_EKF_EFFICIENCY 1.0f // Coulombic efficiency
+
+// Noise model
+#define SOC_EKF_Q_SOC 1e-7f // Process noise of SOC per update (fraction^2)
+#define SOC_EKF_Q_VRC 1e-6f // Process noise of the RC voltage per update (V^2)
+#define SOC_EKF_R_V 1e-5f // Cell voltage measurement noise (V^2), about 3mV rms
+#define SOC_EKF_P0_SOC 0.01f // Initial SOC variance (fraction^2), 10% rms
+#define SOC_EKF_P0_VRC 1e-4f // Initial RC voltage variance (V^2)
+
+#define SOC_EKF_OCV_POINTS 51 // Points of the SOC to OCV table (every 2% SOC)
+#define SOC_EKF_OCV_REBUILD_C 2.0f // Temperature change that rebuilds the SOC to OCV table (degC)
+#define SOC_EKF_CYCLE_BUDGET 600 // CPU cycles allowed per cell and update
+
+/**
+ * @brief Estimator state for all cells, one array per quantity (index as volt[])
+ */
+typedef struct {
+	float soc[NOC]; // State of charge (fraction)
+	float v_rc[NOC]; // Voltage across the RC pair (V)
+	float p00[NOC]; // Covariance of SOC
+	float p01[NOC]; // Covariance of SOC and RC voltage
+	float p11[NOC]; // Covariance of RC voltage
+} SocEkfBank;
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void soc_ekf_init(const float *soc_percent, float temperature); // Start every cell from an OCV estimate
+void soc_ekf_restore(const SocEkfBank *state, float temperature); // Continue from a saved estimator state
+int soc_ekf_is_initialised(); // 1 once soc_ekf_init() has run
+void soc_ekf_update(const float *cell_volt, const float *cell_current, float dt_s, float temperature); // One predict and correct step for all cells
+void soc_ekf_get_soc(float *soc_percent); // SOC estimate of every cell (%)
+const SocEkfBank *soc_ekf_state(); // Full estimator state
+uint32_t soc_ekf_cycles_per_cell(); // CPU cycles per cell in the last update
+void soc_ekf_print_report(); // Export estimates, uncertainty and cost over the serial monitor
+
+#endif
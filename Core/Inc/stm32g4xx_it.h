@@ -56,11 +56,11 @@ void DebugMon_Handler(void);
 void PendSV_Handler(void);
 void SysTick_Handler(void);
 void DMA1_Channel1_IRQHandler(void);
-void DMA1_Channel2_IRQHandler(void);
 void ADC1_2_IRQHandler(void);
 void USART3_IRQHandler(void);
 void EXTI15_10_IRQHandler(void);
 /* USER CODE BEGIN EFP */
+void LPUART1_IRQHandler(void);
 
 /* USER CODE END EFP */
 
@@ -11,8 +11,15 @@
 // Include necessary header files for program to run
 #include "main.h" // Include main application definitions
 
+/* ***** DEFINE CONSTANTS ***** */
+#ifndef SWITCH_MATRIX_DEAD_TIME_US
+#define SWITCH_MATRIX_DEAD_TIME_US 100 // Gate settling time after a switch matrix change (us)
+#endif
+
 /* ***** FUNCTION PROTOTYPES ***** */
-void enable_cell_path(int target_cell); // Enable switch matrix path to specified target cell
+int enable_cell_path(int target_cell); // Enable switch matrix path to specified target cell
+int switch_matrix_select(int target_cell); // Select a path without serial output (sequencer changeover)
+int switch_matrix_verify(int target_cell); // Confirm from the output registers that only this path (0 = none) is on
 void switch_matrix_reset(); // Reset switch matrix by disabling all MOSFETs
 
 #endif
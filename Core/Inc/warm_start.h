@@ -0,0 +1,66 @@
+/**
+  ******************************************************************************
+  * @file           : warm_start.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_WARM_START_H_
+#define INC_WARM_START_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include "pl455.h" // Include CRC16 checksum function, before pack_config.h whose NOC macro names a pl455.h parameter
+#include "pack_config.h" // Include number of cells
+#include "soc_ekf.h" // Include estimator state
+#include "ocv_model.h" // Include branch selector state
+#include "cell_health.h" // Include rest point and charge counts
+#include "fault_manager.h" // Include fault debounce state
+#include <stdint.h> // Standard integer type definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+#define WARM_START_MAGIC 0x4D524157 // Marks a retained state block ("WARM")
+#define WARM_START_VERSION 1 // Layout version of WarmStartState
+#define WARM_START_SHADOW_MAX 24 // Cell monitor register writes the shadow can hold
+
+/**
+ * @brief One cell monitor register write of the configuration sequence
+ */
+typedef struct {
+	uint16_t addr; // Register address
+	uint32_t value; // Register value
+	uint8_t len; // Bytes written
+	uint8_t type; // FRMWRT_x frame type
+	uint8_t delay_ms; // Delay after the write (ms)
+} ChipRegWrite;
+
+/**
+ * @brief State kept in .noinit RAM over a reset that does not remove power
+ */
+typedef struct {
+	uint32_t magic; // WARM_START_MAGIC
+	uint16_t version; // WARM_START_VERSION
+	uint16_t crc; // CRC16 of everything from size to the end
+	uint32_t size; // sizeof(WarmStartState)
+	uint32_t warm_boots; // Warm boots since the last cold boot
+	uint8_t estimator_valid; // 1 once ekf, ocv and health hold a running state
+	uint8_t shadow_count; // Writes in shadow, 0 while the cell monitor is not known to be configured
+	uint16_t reserved;
+	ChipRegWrite shadow[WARM_START_SHADOW_MAX]; // Configuration last written to the cell monitor
+	SocEkfBank ekf; // Kalman filter state
+	OcvCellState ocv[NOC]; // Hysteresis branch of every cell
+	CellHealthTracking health; // Rest point and charge counted since it
+	FaultState faults[FAULT_COUNT]; // Debounce state, active and latched faults, trip counts
+} WarmStartState;
+
+/* ***** FUNCTION PROTOTYPES ***** */
+int warm_start_init(); // Validate the retained state, returns 1 on a warm boot, call after watchdog_init()
+void warm_start_restore(float temperature); // Continue estimation and fault handling from the retained state
+int warm_start_chip_configured(const ChipRegWrite *config, int count); // Check the cell monitor still holds this configuration
+void warm_start_set_chip(const ChipRegWrite *config, int count); // Record the configuration written to the cell monitor, count 0 while writing
+void warm_start_save(); // Retain the estimator and fault state, call once per monitoring cycle
+int warm_start_first_sample(); // Report the time from reset to the first protected sample once, returns 1 when it did, call after the protection checks
+void warm_start_print_report(); // Export boot type, time to first protected sample and warm boots over the serial monitor
+
+#endif
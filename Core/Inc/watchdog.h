@@ -0,0 +1,60 @@
+/**
+  ******************************************************************************
+  * @file           : watchdog.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef INC_WATCHDOG_H_
+#define INC_WATCHDOG_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "main.h" // Include main application definitions
+#include <stdint.h> // Standard integer type definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+#define WATCHDOG_TIMEOUT_MS 4000 // IWDG timeout, longer than the slowest main loop pass (a capture dump on the console)
+#define WATCHDOG_PRESCALER 4 // IWDG PR value, LSI 32kHz / 64 = 2ms per count
+#define WATCHDOG_COUNT_MS 2 // Time of one IWDG count at WATCHDOG_PRESCALER (ms)
+#define WATCHDOG_RECORD_MAGIC 0x57444F47 // Marks a valid record in reset-surviving RAM ("WDOG")
+#define WATCHDOG_TASK_NONE 0xFF // No task missed its deadline
+
+/**
+ * @brief Supervised tasks, each checks in at least once per deadline
+ */
+typedef enum {
+	WATCHDOG_TASK_MAIN_LOOP = 0, // Every main loop pass
+	WATCHDOG_TASK_MONITOR = 1, // Every cell monitoring cycle, failed readings are handled by the fault manager
+	WATCHDOG_TASK_CURRENT_SENSE = 2, // Every filtered current sense block (ADC DMA interrupt)
+	WATCHDOG_TASK_COUNT
+} WatchdogTask;
+
+/**
+ * @brief Supervision state kept in .noinit RAM, survives a watchdog reset
+ */
+typedef struct {
+	uint32_t magic; // WATCHDOG_RECORD_MAGIC
+	uint32_t magic_inv; // ~WATCHDOG_RECORD_MAGIC
+	uint32_t resets; // Watchdog resets since power-up
+	uint8_t task; // Task that missed its deadline before the last reset, WATCHDOG_TASK_NONE if the main loop stopped
+	uint8_t reset_cause; // WATCHDOG_CAUSE_x of the last reset
+	uint16_t reserved;
+	uint32_t overdue_ms; // Time past the deadline when the miss was found (ms)
+	uint32_t miss_tick; // HAL tick of the miss, or of the last kick if the main loop stopped (ms)
+	uint32_t last_checkin[WATCHDOG_TASK_COUNT]; // HAL tick of every task's last check-in (ms)
+} WatchdogRecord;
+
+#define WATCHDOG_CAUSE_POWER 0 // Power-on or brown-out, the record was cleared
+#define WATCHDOG_CAUSE_WATCHDOG 1 // IWDG reset
+#define WATCHDOG_CAUSE_OTHER 2 // Reset pin or software reset
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void watchdog_init(); // Read the reset cause and the record of the last reset, call first after HAL_Init()
+void watchdog_start(); // Start the IWDG with every task checked in now
+void watchdog_checkin(WatchdogTask task); // Report a task as alive, O(1), also from interrupts
+int watchdog_service(); // Kick the IWDG if every task met its deadline, returns -1 once a task has missed
+const WatchdogRecord *watchdog_record(); // Reset-surviving record
+void watchdog_print_report(); // Export the last reset and the margin of every task over the serial monitor
+
+#endif
@@ -8,17 +8,18 @@
 /* ***** HEADER FILES ***** */
 // Include necessary header files for program to run
 #include "active_balancing.h" // Include header file for active balancing functions
-#include "switch_matrix.h" // Include header for switch matrix control
 #include <stdio.h> // Include standard I/O functions
-#include <math.h> // Include math functions (for fabs())
 #include "tim.h" // Include STM32 HAL Timer library for timing operations
-#include "flyback_operation.h" // Include flyback converter control functions
+#include "balancing_planner.h" // Include multi-cell balancing planner
+#include "balancing_accounting.h" // Include charge and energy accounting
 
-extern float mean_soc; // Access the calculated mean SOC from main.c
+extern float mean_soc; // Access the mean usable charge from main.c
 
 
 /**
  * @brief  Trigger the active balancing process
+ *         - Plans the charge every cell needs and starts the first step, further steps
+ *           are started by planner_service() until the pack is within the target spread
  */
 void active_balance_trigger()
 {
@@ -27,9 +28,13 @@ void active_balance_trigger()
 
 	detect_imbalanced_cell(); // Identify the most imbalanced cell and determine if undercharged or overcharged
 
-	printf("------------------------------------------------------\n"); // Print for readability
+	planner_print_plan(); // Export the balancing schedule (see balancing_planner.c)
+	planner_begin(); // Execute the plan until balanced
+	planner_service(); // Start the first step now rather than on the next main loop pass
+
+	accounting_print_telemetry(); // Export charge and energy moved so far (see balancing_accounting.c)
 
-	HAL_Delay(2000); // 2 second delay for system stability
+	printf("------------------------------------------------------\n"); // Print for readability
 }
 
 
@@ -39,82 +44,18 @@ void active_balance_trigger()
  */
 void detect_imbalanced_cell()
 {
-	int most_imbalanced_index = 0; // Initialise variable for index of most imbalanced cell
-	float max_deviation = 0.0; // Initialise variable for max deviation from mean SOC
+	int most_imbalanced_index; // Index of most imbalanced cell
 
-	// Iterate through all cells to find the most imbalanced one
-	for (int i = 0; i < NOC; i++)
-	{
-		float deviation = fabs(soc_values[i] - mean_soc); // Calculate absolute deviation from mean SOC
-		if (deviation > max_deviation)
-		{
-			max_deviation = deviation;
-			most_imbalanced_index = i;
-		}
-	}
+	pack_stats_max_deviation(&soc_stats, &most_imbalanced_index); // Furthest cell from the mean, tracked as usable charge changes (see pack_stats.c)
 
 	// Determine if the most imbalanced cell is overcharged or undercharged
-	if (soc_values[most_imbalanced_index] > mean_soc) // If cell SOC is greater than mean SOC
+	if (usable_values[most_imbalanced_index] > mean_soc) // If cell holds more usable charge than the mean
 	{
-		printf("Cell %d is OVERCHARGED (%.1f%% SOC, Mean: %.1f%%)\n", NOC - most_imbalanced_index, soc_values[most_imbalanced_index], mean_soc); // Print overcharged message
-		balance_overcharged_cell(most_imbalanced_index); // Call function to balance overcharged cell
+		printf("Cell %d is OVERCHARGED (%.1f%% SOC, usable %.1f%%, Mean: %.1f%%)\n", NOC - most_imbalanced_index, soc_values[most_imbalanced_index],
+				usable_values[most_imbalanced_index], mean_soc); // Print overcharged message
 	} else
 	{
-		printf("Cell %d is UNDERCHARGED (SOC: %.1f%%, Mean: %.1f%%)\n", NOC - most_imbalanced_index, soc_values[most_imbalanced_index], mean_soc); // Print undercharged message
-		balance_undercharged_cell(most_imbalanced_index); // Call function to balance undercharged cell
+		printf("Cell %d is UNDERCHARGED (SOC: %.1f%%, usable %.1f%%, Mean: %.1f%%)\n", NOC - most_imbalanced_index, soc_values[most_imbalanced_index],
+				usable_values[most_imbalanced_index], mean_soc); // Print undercharged message
 	}
-
-	HAL_Delay(1000); // 1 second delay before continuing
-}
-
-
-/**
- * @brief  Algorithm for balancing undercharged cell
- */
-void balance_undercharged_cell(int cell_index)
-{
-	int cell_number = NOC - cell_index; // Convert index to cell number
-
-	printf("\n********** BALANCING UNDERCHARGED CELL %d **********\n", cell_number); // Print undercharged cell message
-
-	enable_cell_path(cell_number); // Activate switch matrix path to the undercharged cell (see switch_matrix.c)
-
-	flyback_1A_balance(); // Initiate flyback converter energy transfer by generating PWM signal (see flyback_operation.c)
-
-	terminate_flyback(); // Stop flyback converter operation (see flyback_operation.c)
-
-	switch_matrix_reset(); // Reset switch matrix (see switch_matrix.c)
-
-	printf("\n********** UNDERCHARGE BALANCING COMPLETED **********\n"); // Print balancing completion message
 }
-
-
-/**
- * @brief  Algorithm for balancing overcharged cell
- */
-void balance_overcharged_cell(int cell_index)
-{
-	int cell_number = NOC - cell_index; // Convert index to cell number
-
-	printf("\n********** BALANCING OVERCHARGED CELL %d **********\n", cell_number); // Print overcharged cell message
-
-	// Iterate through all cells except the overcharged cell
-	for (int i = 1; i <= NOC; i++)
-	{
-		if (i == cell_number) // Skip the overcharged cell
-			continue;
-
-		printf("Balancing Cell %d...\n", i); // Print message for cell balanced
-
-		enable_cell_path(i); // Activate switch matrix path to the current cell (see switch_matrix.c)
-
-		flyback_1A_balance(); // Initiate flyback converter energy transfer by generating PWM signal (see flyback_operation.c)
-
-		terminate_flyback(); // Stop flyback converter operation (see flyback_operation.c)
-
-		switch_matrix_reset(); // Reset switch matrix (see switch_matrix.c)
-	}
-
-	printf("\n********** OVERCHARGE BALANCING COMPLETED **********\n"); // Print balancing completion message
-}
-
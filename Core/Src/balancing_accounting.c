@@ -0,0 +1,222 @@
+/**
+  ******************************************************************************
+  * @file           : balancing_accounting.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "balancing_accounting.h" // Include header file for balancing accounting functions
+#include "flash_storage.h" // Include flash storage for persisting lifetime totals
+#include "flyback_operation.h" // Include converter state, flash is not written during a transfer
+#include "balancing_policy.h" // Include pack activity mode, efficiency is only measured at rest
+#include <stdio.h> // Include standard I/O functions
+#include <string.h> // Include string manipulation functions
+
+extern float volt[NOC]; // Access the latest cell voltages from main.c
+
+/*
+ * Lifetime totals are counted in RAM and written to flash by accounting_service()
+ * from the main loop, never from the flyback control path. A write is made
+ * between transfers once ACCOUNTING_PERSIST_MAH has been delivered or
+ * ACCOUNTING_PERSIST_INTERVAL_MS has passed since the first unsaved transfer,
+ * and when the balancing session ends. A reset loses at most that much.
+ *
+ * The pack current stands for the converter input only while the pack is at
+ * rest. A load or charger current would be counted as converter input, so
+ * efficiency samples are only taken in POLICY_REST (see balancing_policy.c).
+ */
+
+/* ***** ACCOUNTING STATE ***** */
+static BalanceAccount session[NOC]; // Per-cell totals since the session started (index = cell number - 1)
+static BalanceAccount session_total; // Whole-pack totals since the session started
+static BalanceAccount lifetime[NOC]; // Per-cell totals since first boot, persisted in flash
+static uint32_t session_start_tick = 0; // Tick at which the session started
+static float unsaved_mAh = 0.0f; // Lifetime charge not yet written to flash (mAh)
+static uint32_t unsaved_transfers = 0; // Transfers closed since the last write
+static uint32_t unsaved_tick = 0; // Tick of the first transfer since the last write
+
+
+/**
+ * @brief  Add a sample to an account
+ */
+static void account_add(BalanceAccount *account, float charge_mAh, float energy_mWh, float input_mWh, uint32_t dt_ms)
+{
+	account->charge_mAh += charge_mAh;
+	account->energy_mWh += energy_mWh;
+	account->active_ms += dt_ms;
+
+	if (input_mWh > 0.0f) // Only samples with a measured input contribute to efficiency
+	{
+		account->eff_output_mWh += energy_mWh;
+		account->eff_input_mWh += input_mWh;
+	}
+}
+
+
+/**
+ * @brief  Restore lifetime totals from flash and start a new session
+ */
+void accounting_init()
+{
+	if (!storage_read(STORAGE_ID_ACCOUNTING, lifetime, sizeof(lifetime))) // No stored totals yet
+	{
+		memset(lifetime, 0, sizeof(lifetime));
+	}
+
+	accounting_start_session();
+}
+
+
+/**
+ * @brief  Clear session totals
+ */
+void accounting_start_session()
+{
+	memset(session, 0, sizeof(session));
+	memset(&session_total, 0, sizeof(session_total));
+	session_start_tick = HAL_GetTick();
+}
+
+
+/**
+ * @brief  Accumulate one balancing current sample
+ *         - cell_number -> cell receiving charge (1 to NOC)
+ *         - current -> measured balancing current (A)
+ *         - input_current -> pack current sampled at the same instant (A)
+ *         - dt_ms -> time since previous sample (ms)
+ */
+void accounting_add_sample(int cell_number, float current, float input_current, uint32_t dt_ms)
+{
+	float pack_voltage = 0.0f;
+	float charge_mAh; // Charge delivered by this sample (mAh)
+	float energy_mWh; // Energy delivered by this sample (mWh)
+	float input_mWh = 0.0f; // Energy drawn from the pack by this sample (mWh)
+
+	if (cell_number < 1 || cell_number > NOC)
+	{
+		return;
+	}
+
+	charge_mAh = current * (float)dt_ms / 3600.0f; // A x ms / 3600 = mAh
+	energy_mWh = charge_mAh * volt[NOC - cell_number]; // mAh x V = mWh
+
+	for (int i = 0; i < NOC; i++) // Flyback draws from the whole stack
+	{
+		pack_voltage += volt[i];
+	}
+
+	if (input_current > 0.0f && policy_mode() == POLICY_REST) // No load or charger, the pack current is the converter input
+	{
+		input_mWh = input_current * (float)dt_ms / 3600.0f * pack_voltage;
+	}
+
+	account_add(&session[cell_number - 1], charge_mAh, energy_mWh, input_mWh, dt_ms);
+	account_add(&session_total, charge_mAh, energy_mWh, input_mWh, dt_ms);
+	account_add(&lifetime[cell_number - 1], charge_mAh, energy_mWh, input_mWh, dt_ms);
+	unsaved_mAh += charge_mAh;
+}
+
+
+/**
+ * @brief  Close a transfer, the lifetime totals are persisted later by accounting_service()
+ */
+void accounting_end_transfer(int cell_number)
+{
+	if (cell_number < 1 || cell_number > NOC)
+	{
+		return;
+	}
+
+	session[cell_number - 1].transfers++;
+	session_total.transfers++;
+	lifetime[cell_number - 1].transfers++;
+
+	if (unsaved_transfers++ == 0)
+	{
+		unsaved_tick = HAL_GetTick();
+	}
+}
+
+
+/**
+ * @brief  Persist lifetime totals between transfers, call from main loop
+ *         - balancing -> 1 while a balancing session is running, 0 writes any unsaved totals straight away
+ */
+void accounting_service(int balancing)
+{
+	if (unsaved_transfers == 0 || flyback_is_busy())
+	{
+		return;
+	}
+	if (balancing && unsaved_mAh < ACCOUNTING_PERSIST_MAH && HAL_GetTick() - unsaved_tick < ACCOUNTING_PERSIST_INTERVAL_MS)
+	{
+		return;
+	}
+
+	if (storage_write(STORAGE_ID_ACCOUNTING, lifetime, sizeof(lifetime)) != 0)
+	{
+		printf("Balancing totals could not be saved to flash\n");
+	}
+	unsaved_mAh = 0.0f; // Not retried until the next transfer, a failing write would otherwise block every pass
+	unsaved_transfers = 0;
+}
+
+
+/**
+ * @brief  Estimated converter efficiency (0 to 1), negative if the input was never measured
+ */
+float accounting_efficiency(const BalanceAccount *account)
+{
+	if (account->eff_input_mWh <= 0.0f)
+	{
+		return -1.0f;
+	}
+	return account->eff_output_mWh / account->eff_input_mWh;
+}
+
+
+/**
+ * @brief  Session totals for a cell
+ */
+const BalanceAccount *accounting_get_session(int cell_number)
+{
+	return &session[cell_number - 1];
+}
+
+
+/**
+ * @brief  Lifetime totals for a cell
+ */
+const BalanceAccount *accounting_get_lifetime(int cell_number)
+{
+	return &lifetime[cell_number - 1];
+}
+
+
+/**
+ * @brief  Export per-cell and session totals over the serial monitor
+ *
+ * Lines are comma separated so they can be logged and parsed on a PC:
+ *   $BAL,<cell>,<mAh>,<mWh>,<active s>,<efficiency %>,<transfers>,<lifetime mAh>
+ *   $BALS,<mAh>,<mWh>,<active s>,<efficiency %>,<transfers>,<session s>
+ * Efficiency is reported as -1 when the input side was not measured
+ */
+void accounting_print_telemetry()
+{
+	for (int cell = 1; cell <= NOC; cell++)
+	{
+		const BalanceAccount *account = &session[cell - 1];
+		float efficiency = accounting_efficiency(account);
+
+		printf("$BAL,%d,%.2f,%.2f,%.1f,%.1f,%lu,%.2f\n", cell, account->charge_mAh, account->energy_mWh,
+				account->active_ms / 1000.0f, efficiency < 0.0f ? -1.0f : efficiency * 100.0f,
+				(unsigned long)account->transfers, lifetime[cell - 1].charge_mAh);
+	}
+
+	float efficiency = accounting_efficiency(&session_total);
+	printf("$BALS,%.2f,%.2f,%.1f,%.1f,%lu,%lu\n", session_total.charge_mAh, session_total.energy_mWh,
+			session_total.active_ms / 1000.0f, efficiency < 0.0f ? -1.0f : efficiency * 100.0f,
+			(unsigned long)session_total.transfers, (unsigned long)((HAL_GetTick() - session_start_tick) / 1000));
+}
@@ -0,0 +1,267 @@
+/**
+  ******************************************************************************
+  * @file           : balancing_planner.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "balancing_planner.h" // Include header file for balancing planner functions
+#include "flyback_operation.h" // Include converter current limit and target cell
+#include "chemistry_profile.h" // Include cell capacity and balancing current limit
+#include <stdio.h> // Include standard I/O functions
+
+/*
+ * Plans balancing as a whole instead of nudging the worst cell each cycle.
+ *
+ * The converter moves charge from the pack into one cell at a time. Every cell,
+ * the target included, supplies the same share of the input, so charging cell k
+ * for time t at current I raises it by I x t relative to every other cell and
+ * leaves the differences between the others unchanged. Differences can only be
+ * closed upwards: the highest cell is the reference, and every other cell needs
+ *   dQ_k = (SOC_ref - SOC_k - PLANNER_TARGET_SPREAD / 2) x capacity
+ * to end in the middle of the target spread. The SOC passed in is usable charge
+ * as a percentage of rated capacity (see cell_health.c), so cells of different
+ * capacity end up holding the same charge rather than the same SOC.
+ *
+ * With one path at a time the total time is at least sum(dQ_k) / I_max, plus a
+ * ramp-up and ramp-down for every step. The plan reaches this bound by running
+ * every step at the highest current the converter and chemistry allow, and
+ * giving each cell one contiguous step, so the path changes once per cell. Steps
+ * too short to be worth their switching cost are dropped.
+ *
+ * Each step is a charge target, not a time: the converter regulates until the
+ * measured charge delivered to the cell reaches dQ_k (see flyback_operation.c),
+ * so one step closes the gap whatever current derating or ramps actually gave.
+ * The predicted time is only used for the plan total and as a limit.
+ *
+ * Steps are ordered largest charge first, so the largest differences are closed
+ * first if the plan is interrupted. The whole plan is handed to one sequence
+ * (balancing_sequencer.c), which runs the steps back to back with the next path
+ * prepared during the ramp-down of the previous one. Each new measurement
+ * re-plans the remaining cells: the previous order is repaired by insertion
+ * sort, which is linear when the order barely changes, the cell currently being
+ * charged is left to its running step, and the running sequence is given the
+ * new steps in place of the ones still waiting. Their charge is still valid
+ * after the running step because charging one cell does not change the
+ * differences between the others.
+ */
+
+/* ***** PLANNER STATE ***** */
+static BalancingPlan plan; // Current plan
+static int order[NOC]; // Cell indices by charge needed at the last update, largest first
+static float need_mAh[NOC]; // Charge needed by each cell at the last update (mAh), index as volt[]
+static int active = 0; // 1 while the plan is being executed
+static int balanced = 0; // 1 if the last update found every cell within the target spread
+
+
+/**
+ * @brief  Highest balancing current the converter and the cell chemistry allow (A)
+ */
+static float plan_setpoint()
+{
+	float cell_max = chemistry_profile()->balance_max_mA / 1000.0f;
+
+	return (cell_max < FLYBACK_MAX_CURRENT) ? cell_max : FLYBACK_MAX_CURRENT;
+}
+
+
+/**
+ * @brief  Give the steps not yet handed over to the sequencer
+ *         - start -> 1 to start a sequence, 0 to update the running one
+ *         - The step ends on measured charge, its predicted time with margin is the limit
+ *         - Returns 0 on success, -1 if the sequencer refused
+ */
+static int hand_over(int start)
+{
+	int cells[NOC];
+	float charge[NOC];
+	uint32_t limit[NOC];
+	uint32_t slot = 0;
+	int count = 0;
+
+	for (int j = plan.next; j < plan.count; j++, count++)
+	{
+		cells[count] = plan.step[j].cell;
+		charge[count] = plan.step[j].charge_mAh;
+		limit[count] = plan.step[j].duration_ms / 100 * PLANNER_TIME_LIMIT_PCT; // Only reached if the converter cannot deliver
+		slot = (limit[count] > slot) ? limit[count] : slot; // One slot per cell, no multiplexing
+	}
+	plan.next = plan.count;
+
+	if (start)
+	{
+		return sequencer_start_charge(cells, charge, limit, count, plan.setpoint, slot); // See balancing_sequencer.c
+	}
+	return sequencer_update_charge(cells, charge, limit, count);
+}
+
+
+/**
+ * @brief  Re-plan from the latest SOC of every cell
+ *         - soc -> usable charge of each cell (% of rated capacity), index as volt[]
+ */
+void planner_update(const float *soc)
+{
+	float capacity = chemistry_profile()->capacity_mAh;
+	int running = flyback_get_target(); // Cell number being charged, 0 if none
+	float soc_max = soc[0];
+	float soc_min = soc[0];
+
+	for (int i = 1; i < NOC; i++)
+	{
+		soc_max = (soc[i] > soc_max) ? soc[i] : soc_max;
+		soc_min = (soc[i] < soc_min) ? soc[i] : soc_min;
+	}
+
+	if (plan.replans == 0) // First update, start from cell index order
+	{
+		for (int i = 0; i < NOC; i++)
+		{
+			order[i] = i;
+		}
+	}
+
+	plan.setpoint = plan_setpoint();
+	plan.reference_soc = soc_max;
+	balanced = (soc_max - soc_min <= PLANNER_TARGET_SPREAD);
+
+	// Charge each cell needs to reach the middle of the target spread
+	for (int i = 0; i < NOC; i++)
+	{
+		float gap = soc_max - soc[i] - PLANNER_TARGET_SPREAD / 2.0f; // SOC below the target (%)
+
+		need_mAh[i] = (gap > 0.0f && NOC - i != running) ? gap / 100.0f * capacity : 0.0f;
+	}
+
+	// Repair the previous order, largest charge first
+	for (int j = 1; j < NOC; j++)
+	{
+		int index = order[j];
+		int k = j - 1;
+
+		while (k >= 0 && need_mAh[order[k]] < need_mAh[index])
+		{
+			order[k + 1] = order[k];
+			k--;
+		}
+		order[k + 1] = index;
+	}
+
+	// Build the steps, one per cell that is worth its switching cost
+	plan.count = 0;
+	plan.next = 0;
+	plan.total_ms = 0;
+	for (int j = 0; j < NOC; j++)
+	{
+		int i = order[j];
+		float full_ms = need_mAh[i] * 3600.0f / plan.setpoint; // mAh / A = 3.6s
+		uint32_t duration = (full_ms > SEQ_RAMP_MS) ? (uint32_t)(full_ms - SEQ_RAMP_MS) : 0; // The two ramps deliver one ramp time at full current
+
+		if (duration < PLANNER_MIN_STEP_MS)
+		{
+			break; // Sorted, every remaining cell needs less
+		}
+
+		plan.step[plan.count].cell = NOC - i;
+		plan.step[plan.count].charge_mAh = need_mAh[i];
+		plan.step[plan.count].duration_ms = duration;
+		plan.total_ms += duration + PLANNER_SWITCH_COST_MS;
+		plan.count++;
+	}
+
+	plan.replans++;
+
+	if (active && sequencer_is_busy()) // Running sequence takes the new steps after its running one
+	{
+		hand_over(0);
+	}
+}
+
+
+/**
+ * @brief  Start executing the plan until the pack is balanced
+ */
+void planner_begin()
+{
+	active = 1;
+}
+
+
+/**
+ * @brief  Start a sequence of the planned steps when the converter is free, call from main loop
+ */
+void planner_service()
+{
+	if (!active || sequencer_is_busy() || plan.next >= plan.count)
+	{
+		return;
+	}
+
+	int first = plan.step[plan.next].cell;
+
+	if (hand_over(1) != 0)
+	{
+		printf("Balancing plan stopped: sequence from Cell %d could not start\n", first);
+		planner_stop();
+	}
+}
+
+
+/**
+ * @brief  Stop executing the plan, a running step is finished by the sequencer
+ */
+void planner_stop()
+{
+	if (active && sequencer_is_busy())
+	{
+		sequencer_update_charge(NULL, NULL, NULL, 0); // Drop the steps still waiting
+	}
+	active = 0;
+}
+
+
+/**
+ * @brief  Check whether the plan is being executed
+ */
+int planner_is_active()
+{
+	return active;
+}
+
+
+/**
+ * @brief  Check whether the last update found every cell within the target spread
+ */
+int planner_is_balanced()
+{
+	return balanced;
+}
+
+
+/**
+ * @brief  Current plan
+ */
+const BalancingPlan *planner_get_plan()
+{
+	return &plan;
+}
+
+
+/**
+ * @brief  Export the plan over the serial monitor
+ *
+ *   $PLAN,<setpoint A>,<reference SOC %>,<predicted s>,<replans>,<steps>,<cell>,<mAh>,<s>,...
+ * Steps already handed to the running sequence are listed, the running step is not
+ */
+void planner_print_plan()
+{
+	printf("$PLAN,%.2f,%.2f,%.1f,%lu,%d", plan.setpoint, plan.reference_soc, plan.total_ms / 1000.0f,
+			(unsigned long)plan.replans, plan.count);
+	for (int j = 0; j < plan.count; j++)
+	{
+		printf(",%d,%.1f,%.1f", plan.step[j].cell, plan.step[j].charge_mAh, plan.step[j].duration_ms / 1000.0f);
+	}
+	printf("\n");
+}
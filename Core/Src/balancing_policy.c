@@ -0,0 +1,225 @@
+/**
+  ******************************************************************************
+  * @file           : balancing_policy.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "balancing_policy.h" // Include header file for balancing policy functions
+#include "current_sense.h" // Include filtered pack and balancing current
+#include "flyback_operation.h" // Include converter state and soft stop
+#include "pack_config.h" // Include number of cells
+#include <math.h> // Include fabsf()
+#include <stdio.h> // Include standard I/O functions
+
+/*
+ * Chooses how balancing behaves from what the pack is doing. The filtered pack
+ * current (see current_sense.c) is sampled every POLICY_SAMPLE_MS into a fast
+ * and a slow exponential average, after removing the flyback's own input draw
+ * (output current / NOC / efficiency) so balancing at rest does not look like
+ * a discharge.
+ *
+ *   PULSE      |fast| > POLICY_PULSE_A or |fast - slow| > POLICY_PULSE_STEP_A.
+ *              Entered at once. The cell voltages carry IR drop and relaxation,
+ *              so the SOC estimates are not trusted: the running step is soft
+ *              stopped, no new step starts and the plan is not updated until
+ *              POLICY_PULSE_HOLDOFF_MS after the last pulse sample.
+ *   CHARGE     slow < -POLICY_ACTIVE_A. The charger supplies the energy and the
+ *              highest cell decides when charging ends, so balancing starts at a
+ *              lower spread (POLICY_CHARGE_START_SCALE) to bring the other cells
+ *              up to the top-of-charge cell before it gets there.
+ *   DISCHARGE  slow > POLICY_ACTIVE_A. Balancing as at rest.
+ *   REST       otherwise.
+ * A change between rest, charge and discharge is only used once it has
+ * persisted for POLICY_SETTLE_MS.
+ *
+ * The pulse thresholds are fractions of the pack current limit
+ * (PACK_MAX_CURRENT_A), so a pulse stops balancing before the overcurrent fault
+ * opens the relay. That fault sees the converter's input as well, so while a
+ * step runs it trips on a smaller external current, by up to
+ * FLYBACK_MAX_CURRENT / NOC / POLICY_CONVERTER_EFFICIENCY.
+ *
+ * Time in each mode and converter time in each mode are accumulated so the
+ * policy can be compared with field duty cycles (Tools/balance_benchmark.py
+ * --duty simulates the hours saved).
+ */
+
+/* ***** POLICY STATE ***** */
+static PolicyMode mode = POLICY_REST; // Mode in use
+static PolicyMode candidate = POLICY_REST; // Mode suggested by the latest samples
+static uint32_t candidate_since_ms = 0; // Time the candidate was first seen (ms)
+static uint32_t last_pulse_ms = 0; // Time of the last pulse sample (ms)
+static uint32_t last_sample_ms = 0; // Time of the last sample (ms)
+static int started = 0; // 1 once the averages hold a sample
+static float fast_A = 0.0f; // Fast average of the external pack current (A)
+static float slow_A = 0.0f; // Slow average of the external pack current (A)
+static PolicyStats stats; // Time per mode
+
+
+/**
+ * @brief  Mode suggested by the current averages
+ */
+static PolicyMode classify()
+{
+	if (fabsf(fast_A) > POLICY_PULSE_A || fabsf(fast_A - slow_A) > POLICY_PULSE_STEP_A)
+	{
+		return POLICY_PULSE;
+	}
+	if (slow_A < -POLICY_ACTIVE_A)
+	{
+		return POLICY_CHARGE;
+	}
+	if (slow_A > POLICY_ACTIVE_A)
+	{
+		return POLICY_DISCHARGE;
+	}
+	return POLICY_REST;
+}
+
+
+/**
+ * @brief  Sample the filtered pack current and update the mode, call from main loop
+ */
+void policy_service()
+{
+	uint32_t now = HAL_GetTick();
+	uint32_t dt = now - last_sample_ms;
+	float pack_i, balancing_i; // Pack and balancing current sampled together (A)
+	PolicyMode suggested;
+
+	if (started && dt < POLICY_SAMPLE_MS)
+	{
+		return;
+	}
+	last_sample_ms = now;
+
+	current_sense_read(&pack_i, &balancing_i);
+	pack_i -= flyback_is_busy() ? balancing_i / (NOC * POLICY_CONVERTER_EFFICIENCY) : 0.0f; // Remove the converter's own input
+
+	if (!started)
+	{
+		fast_A = pack_i;
+		slow_A = pack_i;
+		started = 1;
+		return;
+	}
+
+	fast_A += (pack_i - fast_A) * ((dt < POLICY_FAST_TAU_MS) ? (float)dt / POLICY_FAST_TAU_MS : 1.0f);
+	slow_A += (pack_i - slow_A) * ((dt < POLICY_SLOW_TAU_MS) ? (float)dt / POLICY_SLOW_TAU_MS : 1.0f);
+
+	stats.mode_ms[mode] += dt;
+	if (flyback_is_busy())
+	{
+		stats.balancing_ms[mode] += dt;
+	}
+
+	suggested = classify();
+	if (suggested == POLICY_PULSE)
+	{
+		if (mode != POLICY_PULSE)
+		{
+			stats.pulses++;
+			if (flyback_is_busy())
+			{
+				stats.interrupted++;
+			}
+		}
+		mode = POLICY_PULSE;
+		last_pulse_ms = now;
+		candidate = POLICY_PULSE;
+		return;
+	}
+
+	if (mode == POLICY_PULSE) // Stay until the cells have relaxed, then take the mode straight away
+	{
+		if (now - last_pulse_ms >= POLICY_PULSE_HOLDOFF_MS)
+		{
+			mode = suggested;
+			candidate = suggested;
+		}
+		return;
+	}
+
+	if (suggested != candidate)
+	{
+		candidate = suggested;
+		candidate_since_ms = now;
+	} else if (candidate != mode && now - candidate_since_ms >= POLICY_SETTLE_MS)
+	{
+		mode = candidate;
+	}
+}
+
+
+/**
+ * @brief  Current pack activity mode
+ */
+PolicyMode policy_mode()
+{
+	return mode;
+}
+
+
+/**
+ * @brief  Check whether balancing may run, 0 during a pulse and its hold-off
+ */
+int policy_allows_balancing()
+{
+	return mode != POLICY_PULSE;
+}
+
+
+/**
+ * @brief  Multiplier on the balancing start threshold for the current mode
+ */
+float policy_start_scale()
+{
+	return (mode == POLICY_CHARGE) ? POLICY_CHARGE_START_SCALE : 1.0f;
+}
+
+
+/**
+ * @brief  Slow average of the pack current without the converter's own draw (A), positive discharges
+ */
+float policy_external_current()
+{
+	return slow_A;
+}
+
+
+/**
+ * @brief  Printable name of a mode
+ */
+const char *policy_mode_name(PolicyMode m)
+{
+	static const char *const names[POLICY_MODE_COUNT] = {"rest", "charge", "discharge", "pulse"};
+
+	return (m < POLICY_MODE_COUNT) ? names[m] : "?";
+}
+
+
+/**
+ * @brief  Time in each mode since boot
+ */
+const PolicyStats *policy_get_stats()
+{
+	return &stats;
+}
+
+
+/**
+ * @brief  Export mode, currents and time per mode over the serial monitor
+ *
+ *   $POL,<mode>,<fast A>,<slow A>,<pulses>,<steps interrupted>,<rest s>,<balancing s>,<charge s>,<balancing s>,<discharge s>,<balancing s>,<pulse s>
+ */
+void policy_print_report()
+{
+	printf("$POL,%s,%.2f,%.2f,%lu,%lu", policy_mode_name(mode), fast_A, slow_A, (unsigned long)stats.pulses, (unsigned long)stats.interrupted);
+	for (int m = POLICY_REST; m <= POLICY_DISCHARGE; m++)
+	{
+		printf(",%lu,%lu", (unsigned long)(stats.mode_ms[m] / 1000), (unsigned long)(stats.balancing_ms[m] / 1000));
+	}
+	printf(",%lu\n", (unsigned long)(stats.mode_ms[POLICY_PULSE] / 1000));
+}
@@ -0,0 +1,433 @@
+/**
+  ******************************************************************************
+  * @file           : balancing_sequencer.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "balancing_sequencer.h" // Include header file for balancing sequencer functions
+#include "flyback_operation.h" // Include flyback converter control functions
+#include "switch_matrix.h" // Include switch matrix control
+#include "cycle_timer.h" // Include cycle counter for changeover timing
+#include <stdio.h> // Include standard I/O functions
+#include <string.h> // Include string manipulation functions
+
+/*
+ * Non-blocking balancing of one or more cells, each given a charge to deliver.
+ * The regulation time of each cell is a limit, in case the converter cannot
+ * deliver, and is split into slots of slot_ms. The cells are served
+ * round-robin so that all of them progress together. Every slot ends early
+ * when the measured charge reaches what the cell is still owed, and the cell
+ * is done once it has received its charge.
+ *
+ * The planner (balancing_planner.c) hands its whole plan to one sequence with
+ * slots as long as the longest limit, so every cell gets one contiguous slot in
+ * plan order. Each re-plan replaces the cells still waiting and the charge they
+ * are owed through sequencer_update_charge(); the cell whose slot is running
+ * keeps its target.
+ *
+ * Between slots the converter is idle for as short a time as possible:
+ *   - the next cell and its request are prepared while the current slot ramps down
+ *   - when the slot completes the matrix is reset, the next path selected and the
+ *     converter restarted straight away, with only the switch matrix dead times between
+ *   - when consecutive slots use the same cell the path is kept and only the
+ *     converter is restarted
+ * The transfer completion callback is taken over so that no serial output is
+ * produced inside the changeover.
+ *
+ * Useful energy delivered per second of wall time is reported as the figure of merit.
+ */
+
+/* ***** SEQUENCER STATE ***** */
+static int sequence_active = 0; // 1 while a sequence is running
+static int seq_cells[NOC]; // Cell numbers in the sequence
+static uint32_t seq_remaining_ms[NOC]; // Regulation time each cell may still use (ms)
+static float seq_remaining_mAh[NOC]; // Charge still owed to each cell (mAh)
+static int seq_count = 0; // Number of cells in the sequence
+static int seq_current = -1; // Index of the cell whose slot is running
+static float seq_setpoint = 0.0f; // Balancing current setpoint (A)
+static uint32_t seq_slot_ms = 0; // Regulation time per slot (ms)
+static uint32_t seq_start_tick = 0; // Tick at which the sequence started
+static uint32_t seq_cell_mask = 0; // Bit (cell - 1) set for every cell the sequence has been given
+
+static int next_index = -1; // Index of the cell prepared for the next slot, -1 if none left
+static FlybackRequest next_request; // Request prepared for the next slot
+static int next_prepared = 0; // 1 once the next slot has been prepared during ramp-down
+
+static volatile int slot_done = 0; // Set by the transfer completion callback
+static FlybackResult slot_result; // Result of the slot that just completed
+static uint32_t slot_done_cycles = 0; // Cycle count at slot completion
+
+static SequencerReport report; // Figures of merit
+
+extern float volt[NOC]; // Access the latest cell voltages from main.c
+extern float pack_temperature; // Access the pack temperature from main.c
+
+
+/**
+ * @brief  Pick the next cell still owed charge with regulation time left, round-robin after the current one
+ *         - Returns index into seq_cells, -1 when every cell is done
+ */
+static int pick_next_cell()
+{
+	for (int step = 1; step <= seq_count; step++)
+	{
+		int index = (seq_current + step) % seq_count;
+
+		if (seq_remaining_ms[index] > 0 && seq_remaining_mAh[index] > SEQ_CHARGE_DONE_MAH)
+		{
+			return index;
+		}
+	}
+	return -1;
+}
+
+
+/**
+ * @brief  Prepare the next slot so the changeover only has to switch and start
+ */
+static void prepare_next_slot()
+{
+	next_index = pick_next_cell();
+
+	if (next_index >= 0)
+	{
+		uint32_t slot = (seq_remaining_ms[next_index] < seq_slot_ms) ? seq_remaining_ms[next_index] : seq_slot_ms;
+
+		next_request.target_cell = seq_cells[next_index];
+		next_request.setpoint = seq_setpoint;
+		next_request.duration_ms = slot;
+		next_request.charge_target_mAh = seq_remaining_mAh[next_index];
+		next_request.ramp_up_ms = SEQ_RAMP_MS;
+		next_request.ramp_down_ms = SEQ_RAMP_MS;
+	}
+	next_prepared = 1;
+}
+
+
+/**
+ * @brief  Switch to and start the prepared slot
+ *         - Returns 0 if started, -1 if the path or converter refused
+ */
+static int start_next_slot()
+{
+	int cell = next_request.target_cell;
+
+	if (seq_current < 0 || seq_cells[seq_current] != cell) // Different cell, change the path
+	{
+		switch_matrix_reset(); // Break before make, includes dead time
+		if (switch_matrix_select(cell) != 0)
+		{
+			return -1;
+		}
+	}
+
+	seq_current = next_index;
+	next_prepared = 0;
+
+	flyback_update_derating(pack_temperature, volt[NOC - cell]); // Derate for the new target before soft-start
+	if (flyback_start(&next_request) != 0)
+	{
+		return -1;
+	}
+
+	seq_remaining_ms[seq_current] -= next_request.duration_ms; // Slot time counts against the limit whether or not it is derated
+	return 0;
+}
+
+
+/**
+ * @brief  Close the sequence, open the matrix and print the report
+ */
+static void finish_sequence()
+{
+	switch_matrix_reset(); // Leave the matrix open
+	sequence_active = 0;
+	report.elapsed_ms = HAL_GetTick() - seq_start_tick;
+
+	printf("\n********** BALANCING SEQUENCE COMPLETED **********\n");
+	sequencer_print_report();
+}
+
+
+/**
+ * @brief  Record a completed transfer, replaces the default printing callback
+ */
+void flyback_complete_callback(const FlybackResult *result)
+{
+	slot_result = *result;
+	slot_done_cycles = cycle_timer_now();
+	slot_done = 1;
+}
+
+
+/**
+ * @brief  Count the cells the sequence has been given, for the report
+ */
+static int count_cells()
+{
+	int cells = 0;
+
+	for (uint32_t mask = seq_cell_mask; mask; mask >>= 1)
+	{
+		cells += mask & 1;
+	}
+	return cells;
+}
+
+
+/**
+ * @brief  Start a sequence once the cells and their targets are stored
+ *         - Returns 0 if started, -1 if the first path failed
+ */
+static int start_sequence(int count, float setpoint, uint32_t slot_ms)
+{
+	seq_count = count;
+	seq_current = -1;
+	seq_setpoint = setpoint;
+	seq_slot_ms = slot_ms;
+	slot_done = 0;
+
+	memset(&report, 0, sizeof(report));
+	report.cells = count_cells();
+	seq_start_tick = HAL_GetTick();
+
+	prepare_next_slot();
+	if (start_next_slot() != 0)
+	{
+		switch_matrix_reset();
+		printf("Balancing sequence could not start on Cell %d\n", next_request.target_cell);
+		return -1;
+	}
+
+	sequence_active = 1;
+	return 0;
+}
+
+
+/**
+ * @brief  Start balancing that delivers a measured charge to each cell
+ *         - cells -> cell numbers (1 to NOC) to receive charge, served in this order
+ *         - charge_mAh -> charge to deliver to each cell (mAh)
+ *         - limit_ms -> longest regulation time given to each cell (ms)
+ *         - slot_ms -> regulation time of one slot (ms), at least the longest limit gives each cell one slot
+ *         - Returns 0 if started, -1 if busy, the request is invalid or the first path failed
+ */
+int sequencer_start_charge(const int *cells, const float *charge_mAh, const uint32_t *limit_ms, int count, float setpoint, uint32_t slot_ms)
+{
+	if (sequence_active || flyback_is_busy() || count < 1 || count > NOC || slot_ms == 0)
+	{
+		return -1;
+	}
+
+	seq_cell_mask = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (cells[i] < 1 || cells[i] > NOC || !(charge_mAh[i] > SEQ_CHARGE_DONE_MAH) || limit_ms[i] == 0)
+		{
+			return -1;
+		}
+		seq_cells[i] = cells[i];
+		seq_remaining_ms[i] = limit_ms[i];
+		seq_remaining_mAh[i] = charge_mAh[i];
+		seq_cell_mask |= 1UL << (cells[i] - 1);
+	}
+
+	if (start_sequence(count, setpoint, slot_ms) != 0)
+	{
+		return -1;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		report.target_mAh += charge_mAh[i]; // After start_sequence() cleared the report
+	}
+	printf("Balancing sequence started: %d cell(s), %.2fA, %.1fmAh\n", count, setpoint, report.target_mAh);
+	return 0;
+}
+
+
+/**
+ * @brief  Replace the cells still waiting in the running sequence and the charge they are owed
+ *         - The cell whose slot is running keeps its target, the new cells follow it in the order given
+ *         - cells -> cell numbers (1 to NOC) to receive charge after the running slot, may be NULL if count is 0
+ *         - charge_mAh -> charge to deliver to each cell (mAh)
+ *         - limit_ms -> longest regulation time given to each cell (ms)
+ *         - count -> number of cells, 0 ends the sequence after the running slot
+ *         - Returns 0 if updated, -1 if no sequence is running
+ */
+int sequencer_update_charge(const int *cells, const float *charge_mAh, const uint32_t *limit_ms, int count)
+{
+	int kept = 1;
+
+	if (!sequence_active)
+	{
+		return -1;
+	}
+
+	// Running slot moves to the front, cells already done are dropped
+	seq_cells[0] = seq_cells[seq_current];
+	seq_remaining_ms[0] = seq_remaining_ms[seq_current];
+	seq_remaining_mAh[0] = seq_remaining_mAh[seq_current];
+	seq_current = 0;
+
+	report.target_mAh = report.charge_mAh + seq_remaining_mAh[0]; // Delivered by completed slots and owed to the running one
+	for (int i = 0; i < count && kept < NOC; i++)
+	{
+		if (cells[i] < 1 || cells[i] > NOC || cells[i] == seq_cells[0] || !(charge_mAh[i] > SEQ_CHARGE_DONE_MAH) || limit_ms[i] == 0)
+		{
+			continue;
+		}
+		seq_cells[kept] = cells[i];
+		seq_remaining_ms[kept] = limit_ms[i];
+		seq_remaining_mAh[kept] = charge_mAh[i];
+		seq_cell_mask |= 1UL << (cells[i] - 1);
+		report.target_mAh += charge_mAh[i];
+		kept++;
+	}
+	seq_count = kept;
+	report.cells = count_cells();
+
+	next_prepared = 0; // Prepared from the old list, prepare again
+	return 0;
+}
+
+
+/**
+ * @brief  Advance the sequence, call from main loop
+ *         - Services the power stage, prepares the next slot during ramp-down
+ *           and performs the changeover when a slot completes
+ */
+void sequencer_service()
+{
+	if (!sequence_active)
+	{
+		return;
+	}
+
+	flyback_update_derating(pack_temperature, volt[NOC - seq_cells[seq_current]]); // Keep derating inputs current
+	flyback_service();
+
+	if (!next_prepared && flyback_get_state() == FLYBACK_RAMP_DOWN) // Overlap preparation with ramp-down
+	{
+		prepare_next_slot();
+	}
+
+	if (!slot_done)
+	{
+		if (!flyback_is_busy()) // Converter stopped without reporting completion
+		{
+			printf("Balancing sequence stopped: converter stopped on Cell %d\n", seq_cells[seq_current]);
+			finish_sequence();
+		}
+		return;
+	}
+	slot_done = 0;
+
+	// Account the completed slot
+	report.slots++;
+	report.active_ms += slot_result.active_ms;
+	report.charge_mAh += slot_result.charge_mAh;
+	seq_remaining_mAh[seq_current] -= slot_result.charge_mAh; // Measured, includes the ramps
+	report.energy_mWh += slot_result.charge_mAh * volt[NOC - slot_result.target_cell]; // mAh x V = mWh
+
+	if (slot_result.terminated) // Cut off by the interlock, the path cannot be trusted
+	{
+		printf("Balancing sequence stopped: converter terminated on Cell %d\n", slot_result.target_cell);
+		finish_sequence();
+		return;
+	}
+	if (slot_result.aborted) // Fully derated or stopped, give this cell no further slots
+	{
+		seq_remaining_ms[seq_current] = 0;
+		next_prepared = 0;
+	}
+
+	if (!next_prepared) // Ramp-down was skipped or the plan changed
+	{
+		prepare_next_slot();
+	}
+
+	if (next_index < 0) // Every cell has received its charge or used its time
+	{
+		finish_sequence();
+		return;
+	}
+
+	if (start_next_slot() != 0)
+	{
+		printf("Balancing sequence stopped: Cell %d could not be started\n", next_request.target_cell);
+		finish_sequence();
+		return;
+	}
+
+	uint32_t switch_us = (cycle_timer_now() - slot_done_cycles) / (SystemCoreClock / 1000000); // Converter idle time between slots
+	report.switch_us_total += switch_us;
+	if (switch_us > report.switch_us_max)
+	{
+		report.switch_us_max = switch_us;
+	}
+}
+
+
+/**
+ * @brief  Stop the converter and open the switch matrix immediately
+ */
+void sequencer_abort()
+{
+	if (flyback_is_busy())
+	{
+		terminate_flyback();
+	}
+	switch_matrix_reset();
+
+	if (sequence_active)
+	{
+		sequence_active = 0;
+		report.elapsed_ms = HAL_GetTick() - seq_start_tick;
+	}
+}
+
+
+/**
+ * @brief  Check whether a sequence is running
+ */
+int sequencer_is_busy()
+{
+	return sequence_active;
+}
+
+
+/**
+ * @brief  Figures of merit for the last sequence
+ */
+const SequencerReport *sequencer_get_report()
+{
+	if (sequence_active)
+	{
+		report.elapsed_ms = HAL_GetTick() - seq_start_tick;
+	}
+	return &report;
+}
+
+
+/**
+ * @brief  Export figures of merit over the serial monitor
+ *
+ *   $SEQ,<cells>,<slots>,<elapsed s>,<mAh>,<mWh>,<useful mW>,<converter on %>,<mean changeover us>,<max changeover us>,<target mAh>
+ * Useful mW is the energy delivered to the target cells divided by wall time
+ */
+void sequencer_print_report()
+{
+	const SequencerReport *r = sequencer_get_report();
+	float elapsed_s = r->elapsed_ms / 1000.0f;
+	float useful_mW = (elapsed_s > 0.0f) ? r->energy_mWh * 3600.0f / elapsed_s : 0.0f; // mWh per s x 3600 = mW
+	float active_pct = (r->elapsed_ms > 0) ? 100.0f * r->active_ms / r->elapsed_ms : 0.0f;
+	uint32_t started = r->slots + (sequence_active ? 1 : 0); // The running slot followed a changeover too
+	uint32_t changeovers = (started > 1) ? started - 1 : 0;
+
+	printf("$SEQ,%d,%lu,%.1f,%.2f,%.3f,%.1f,%.1f,%lu,%lu,%.2f\n", r->cells, (unsigned long)r->slots, elapsed_s,
+			r->charge_mAh, r->energy_mWh, useful_mW, active_pct,
+			(unsigned long)(changeovers ? r->switch_us_total / changeovers : 0), (unsigned long)r->switch_us_max, r->target_mAh);
+}
@@ -0,0 +1,328 @@
+/**
+  ******************************************************************************
+  * @file           : balancing_trigger.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "balancing_trigger.h" // Include header file for balancing trigger functions
+#include "flash_storage.h" // Include flash storage for persisting the configuration
+#include <stdio.h> // Include standard I/O functions
+#include <string.h> // Include string manipulation functions
+
+/*
+ * Decides when balancing starts from the SOC standard deviation, so that noise
+ * around a single threshold does not start and stop the converter:
+ *   - a minimum dwell time after each start or stop before the next start
+ *   - a start also needs the window average above the start threshold (see
+ *     pack_stats.c), so a single noisy snapshot does not start balancing
+ *   - a least-squares trend over the last TRIGGER_TREND_SAMPLES cycles; a start
+ *     is skipped if the spread is predicted to fall back below the start
+ *     threshold within the horizon, and while balancing it gives the predicted
+ *     time to reach the stop threshold
+ * A running plan stops only once the planner finds every cell within its
+ * target spread (PLANNER_TARGET_SPREAD, max - min). A standard deviation
+ * threshold would stop it short of that goal, so the stop threshold is only a
+ * guard while no plan runs: the start threshold is never below it (hysteresis),
+ * however far the balancing policy lowers it for the pack activity (see
+ * balancing_policy.c).
+ *
+ * Every cycle in which the old rule (snapshot above a single threshold) would
+ * have started balancing but the trigger did not is counted under its reason.
+ * The thresholds and times can be changed from the serial console and saved.
+ */
+
+/* ***** TRIGGER STATE ***** */
+static TriggerConfig config; // Active configuration
+static TriggerCounters counters; // Decisions and avoided starts
+static int last_balancing = 0; // Balancing state at the last evaluation
+static uint32_t last_change_ms = 0; // Time of the last start or stop (ms)
+static int changed = 0; // 1 once there has been a start or stop
+
+static uint32_t trend_ms[TRIGGER_TREND_SAMPLES]; // Time of each sample (ms)
+static float trend_std[TRIGGER_TREND_SAMPLES]; // SOC standard deviation at each sample (%)
+static int trend_next = 0; // Slot of the next sample
+static int trend_fill = 0; // Samples held
+static float slope = 0.0f; // Least-squares slope of the samples (% per s)
+static float eta_s = -1.0f; // Predicted time to the stop threshold (s)
+static float start_scale = 1.0f; // Multiplier on the start threshold from the balancing policy
+
+
+/**
+ * @brief  Load the default configuration
+ */
+static void default_config()
+{
+	config.version = TRIGGER_CONFIG_VERSION;
+	config.dwell_s = TRIGGER_DWELL_S_DEFAULT;
+	config.horizon_s = TRIGGER_HORIZON_S_DEFAULT;
+	config.reserved = 0;
+	config.start_std = TRIGGER_START_STD_DEFAULT;
+	config.stop_std = TRIGGER_STOP_STD_DEFAULT;
+}
+
+
+/**
+ * @brief  Add a sample and refit the trend
+ */
+static void trend_add(float std, uint32_t now_ms)
+{
+	float t[TRIGGER_TREND_SAMPLES]; // Sample times relative to this one (s), keeps the fit well conditioned
+	float mean_t = 0.0f, mean_std = 0.0f, stt = 0.0f, sts = 0.0f;
+
+	trend_ms[trend_next] = now_ms;
+	trend_std[trend_next] = std;
+	trend_next = (trend_next + 1) % TRIGGER_TREND_SAMPLES;
+	if (trend_fill < TRIGGER_TREND_SAMPLES)
+	{
+		trend_fill++;
+	}
+
+	if (trend_fill < 3) // Too few points for a trend
+	{
+		slope = 0.0f;
+		return;
+	}
+
+	for (int i = 0; i < trend_fill; i++)
+	{
+		t[i] = -(float)(now_ms - trend_ms[i]) / 1000.0f;
+		mean_t += t[i];
+		mean_std += trend_std[i];
+	}
+	mean_t /= trend_fill;
+	mean_std /= trend_fill;
+
+	for (int i = 0; i < trend_fill; i++)
+	{
+		stt += (t[i] - mean_t) * (t[i] - mean_t);
+		sts += (t[i] - mean_t) * (trend_std[i] - mean_std);
+	}
+	slope = (stt > 0.0f) ? sts / stt : 0.0f;
+}
+
+
+/**
+ * @brief  Predicted time for the standard deviation to fall to a level (s), -1 if not falling
+ */
+static float time_to(float std_now, float level)
+{
+	if (std_now <= level)
+	{
+		return 0.0f;
+	}
+	return (slope < 0.0f) ? (std_now - level) / -slope : -1.0f;
+}
+
+
+/**
+ * @brief  Start threshold in use, the configured one scaled by the policy but not below the stop threshold
+ */
+static float start_threshold()
+{
+	float start = config.start_std * start_scale;
+
+	return (start > config.stop_std) ? start : config.stop_std;
+}
+
+
+/**
+ * @brief  Restore the configuration from flash, or use the defaults
+ */
+void trigger_init()
+{
+	if (!storage_read(STORAGE_ID_TRIGGER, &config, sizeof(config)) || config.version != TRIGGER_CONFIG_VERSION
+			|| !(config.stop_std > 0.0f && config.stop_std < config.start_std)) // Nothing stored, old layout or corrupt
+	{
+		default_config();
+	}
+	trigger_reset_counters();
+}
+
+
+/**
+ * @brief  Decide whether to start or stop balancing, call once per monitoring cycle
+ *         - std_now -> SOC standard deviation of this cycle (%)
+ *         - std_window -> SOC standard deviation averaged over the pack_stats window (%)
+ *         - balancing -> 1 if a balancing plan is running
+ *         - balanced -> 1 if the planner found every cell within its target spread
+ */
+TriggerDecision trigger_evaluate(float std_now, float std_window, int balancing, int balanced, uint32_t now_ms)
+{
+	int dwell_done = !changed || (now_ms - last_change_ms) >= config.dwell_s * 1000u;
+
+	trend_add(std_now, now_ms);
+
+	if (last_balancing && !balancing) // Stopped by the planner itself, counts as a change
+	{
+		last_change_ms = now_ms;
+		changed = 1;
+		dwell_done = 0;
+	}
+	last_balancing = balancing;
+
+	if (balancing)
+	{
+		eta_s = time_to(std_now, config.stop_std);
+
+		if (balanced) // Only the planner knows when its goal is reached
+		{
+			counters.stops++;
+			last_change_ms = now_ms;
+			changed = 1;
+			last_balancing = 0;
+			return TRIGGER_STOP;
+		}
+		return TRIGGER_HOLD;
+	}
+
+	float start = start_threshold();
+
+	eta_s = -1.0f;
+	if (std_now <= start || balanced) // The old rule would not start either
+	{
+		return TRIGGER_HOLD;
+	}
+
+	if (!dwell_done)
+	{
+		counters.avoided_dwell++;
+		return TRIGGER_HOLD;
+	}
+	if (std_window <= start)
+	{
+		counters.avoided_noise++;
+		return TRIGGER_HOLD;
+	}
+	float back_s = time_to(std_now, start);
+	if (back_s >= 0.0f && back_s <= config.horizon_s)
+	{
+		counters.avoided_trend++;
+		return TRIGGER_HOLD;
+	}
+
+	counters.starts++;
+	last_change_ms = now_ms;
+	changed = 1;
+	last_balancing = 1;
+	return TRIGGER_START;
+}
+
+
+/**
+ * @brief  Scale the start threshold for the pack activity, 1 for the configured value
+ */
+void trigger_set_start_scale(float scale)
+{
+	start_scale = scale;
+}
+
+
+/**
+ * @brief  Trend of SOC standard deviation (% per s)
+ */
+float trigger_slope()
+{
+	return slope;
+}
+
+
+/**
+ * @brief  Predicted time until the stop threshold is reached while balancing (s), -1 if not converging
+ */
+float trigger_eta_s()
+{
+	return eta_s;
+}
+
+
+/**
+ * @brief  Active configuration
+ */
+const TriggerConfig *trigger_get_config()
+{
+	return &config;
+}
+
+
+/**
+ * @brief  Change one configuration value
+ *         - name -> "start" or "stop" (% standard deviation), "dwell" or "horizon" (s)
+ *         - Returns 0 if changed, -1 if the name is unknown or the value out of range
+ */
+int trigger_set(const char *name, float value)
+{
+	if (strcmp(name, "start") == 0)
+	{
+		if (!(value > config.stop_std && value <= 100.0f))
+		{
+			return -1;
+		}
+		config.start_std = value;
+	} else if (strcmp(name, "stop") == 0)
+	{
+		if (!(value > 0.0f && value < config.start_std))
+		{
+			return -1;
+		}
+		config.stop_std = value;
+	} else if (strcmp(name, "dwell") == 0 || strcmp(name, "horizon") == 0)
+	{
+		if (!(value >= 0.0f && value <= 65535.0f))
+		{
+			return -1;
+		}
+		if (name[0] == 'd')
+		{
+			config.dwell_s = (uint16_t)value;
+		} else {
+			config.horizon_s = (uint16_t)value;
+		}
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+
+/**
+ * @brief  Write the active configuration to flash
+ *         - Returns 0 on success, -1 on a flash error
+ */
+int trigger_save()
+{
+	return storage_write(STORAGE_ID_TRIGGER, &config, sizeof(config));
+}
+
+
+/**
+ * @brief  Decisions and avoided starts since boot
+ */
+const TriggerCounters *trigger_get_counters()
+{
+	return &counters;
+}
+
+
+/**
+ * @brief  Clear the counters
+ */
+void trigger_reset_counters()
+{
+	memset(&counters, 0, sizeof(counters));
+}
+
+
+/**
+ * @brief  Export configuration, trend and counters over the serial monitor
+ *
+ *   $TRIG,<start %>,<stop %>,<dwell s>,<horizon s>,<slope % per min>,<eta s>,<starts>,<stops>,<avoided dwell>,<avoided noise>,<avoided trend>,<start in use %>
+ */
+void trigger_print_report()
+{
+	printf("$TRIG,%.2f,%.2f,%u,%u,%.3f,%.0f,%lu,%lu,%lu,%lu,%lu,%.2f\n", config.start_std, config.stop_std,
+			config.dwell_s, config.horizon_s, slope * 60.0f, eta_s, (unsigned long)counters.starts, (unsigned long)counters.stops,
+			(unsigned long)counters.avoided_dwell, (unsigned long)counters.avoided_noise, (unsigned long)counters.avoided_trend, start_threshold());
+}
@@ -0,0 +1,358 @@
+/**
+  ******************************************************************************
+  * @file           : blackbox.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "blackbox.h" // Include header file for black-box recorder functions
+#include "flash_storage.h" // Include raw flash erase and program
+#include <stdio.h> // Include standard I/O functions
+
+/*
+ * Keeps the last BLACKBOX_SAMPLES samples of cell voltages, currents and
+ * balancing state in a RAM ring buffer. blackbox_trigger() (called by the fault
+ * manager when a fault that stops balancing is set) only marks the trigger:
+ * BLACKBOX_POST_SAMPLES more samples are recorded so the capture shows the
+ * fault action, then the buffer is frozen.
+ *
+ * A frozen capture is stored by blackbox_service() from the main loop, one page
+ * erase or BLACKBOX_PROGRAM_SAMPLES samples per call, so neither the fault path
+ * nor the main loop waits for the whole capture to be written. The header goes
+ * in last, after the CRC of the programmed samples, so a capture cut short by
+ * a reset is never read back. Recording restarts once the capture is stored;
+ * triggers in the meantime are counted in the next header.
+ *
+ * The BLACKBOX region (see the linker script) is split into slots of
+ * BLACKBOX_PAGES_PER_EVENT pages, used in turn after the newest capture, so
+ * every page sees the same number of erases and the oldest capture is the one
+ * overwritten. The region sits in bank 2, so programming does not stall code
+ * running from bank 1.
+ *
+ * "blackbox dump <n>" prints a capture as hex, Tools/blackbox_decode.py turns
+ * the dump (or a simulator flash image) back into a table of samples.
+ */
+
+/* ***** DEFINE CONSTANTS ***** */
+#define SLOT_BYTES (BLACKBOX_PAGES_PER_EVENT * FLASH_PAGE_SIZE) // Bytes owned by each capture
+#define DUMP_LINE_BYTES 64 // Bytes per dump line
+
+/**
+ * @brief Recorder states
+ */
+typedef enum {
+	BLACKBOX_RECORDING = 0, // Filling the ring buffer
+	BLACKBOX_POST_TRIGGER = 1, // Recording the samples after the trigger
+	BLACKBOX_ERASING = 2, // Erasing the pages of the slot
+	BLACKBOX_PROGRAMMING = 3, // Programming the samples
+	BLACKBOX_SEALING = 4 // Programming the header
+} BlackboxState;
+
+/* ***** RECORDER STATE ***** */
+extern uint8_t _blackbox_start[]; // Start of black-box region (defined in linker script)
+extern uint8_t _blackbox_end[]; // End of black-box region
+
+static BlackboxSample ring[BLACKBOX_SAMPLES]; // Latest samples
+static uint16_t head = 0; // Ring index of the next sample
+static uint16_t count = 0; // Samples in the ring
+static BlackboxState state = BLACKBOX_RECORDING;
+static uint16_t post_left = 0; // Samples still to record after the trigger
+static BlackboxHeader pending; // Header of the capture being stored
+static int slot = 0; // Slot of the next capture
+static uint16_t step = 0; // Page erased or sample programmed next
+static uint32_t next_sequence = 1; // Sequence number of the next capture
+static uint32_t missed = 0; // Triggers ignored since the last capture
+
+
+/**
+ * @brief  Number of capture slots in the region
+ */
+static int slot_count()
+{
+	return (int)((_blackbox_end - _blackbox_start) / SLOT_BYTES);
+}
+
+
+/**
+ * @brief  Stored header of a slot
+ */
+static const BlackboxHeader *slot_header(int index)
+{
+	return (const BlackboxHeader *)(_blackbox_start + index * SLOT_BYTES);
+}
+
+
+/**
+ * @brief  Check whether a slot holds a sealed capture of this layout
+ */
+static int slot_valid(const BlackboxHeader *header)
+{
+	return header->magic == BLACKBOX_MAGIC && header->version == BLACKBOX_VERSION && header->samples <= BLACKBOX_SAMPLES;
+}
+
+
+/**
+ * @brief  CRC16 of the samples stored in a slot
+ *         - header -> start of the slot
+ *         - samples -> number of samples programmed
+ */
+static uint16_t slot_crc(const BlackboxHeader *header, uint16_t samples)
+{
+	return CRC16((BYTE *)(header + 1), samples * sizeof(BlackboxSample));
+}
+
+
+/**
+ * @brief  Freeze the ring buffer and start storing it
+ */
+static void freeze()
+{
+	pending.magic = BLACKBOX_MAGIC;
+	pending.version = BLACKBOX_VERSION;
+	pending.sequence = next_sequence;
+	pending.samples = count;
+	pending.trigger_index = count - BLACKBOX_POST_SAMPLES;
+	pending.sample_ms = BLACKBOX_SAMPLE_MS;
+	step = 0;
+	state = BLACKBOX_ERASING;
+}
+
+
+/**
+ * @brief  Program the next chunk of samples, oldest first
+ *         - Returns 0 on success, -1 on flash error
+ */
+static int program_chunk()
+{
+	uint16_t first = (head + BLACKBOX_SAMPLES - count) % BLACKBOX_SAMPLES; // Ring index of the oldest sample
+	uint16_t index = (first + step) % BLACKBOX_SAMPLES;
+	uint16_t n = BLACKBOX_PROGRAM_SAMPLES;
+
+	if (n > count - step)
+	{
+		n = count - step;
+	}
+	if (n > BLACKBOX_SAMPLES - index) // Stop at the end of the ring, the rest follows in the next chunk
+	{
+		n = BLACKBOX_SAMPLES - index;
+	}
+
+	uintptr_t address = (uintptr_t)(slot_header(slot) + 1) + step * sizeof(BlackboxSample);
+	if (storage_program(address, &ring[index], n * sizeof(BlackboxSample)) != 0)
+	{
+		return -1;
+	}
+	step += n;
+	return 0;
+}
+
+
+/**
+ * @brief  Return to recording with an empty ring buffer
+ */
+static void restart()
+{
+	head = 0;
+	count = 0;
+	state = BLACKBOX_RECORDING;
+}
+
+
+/**
+ * @brief  Find the newest stored capture so the next one goes to the following slot
+ */
+void blackbox_init()
+{
+	uint32_t newest = 0;
+
+	for (int i = 0; i < slot_count(); i++)
+	{
+		const BlackboxHeader *header = slot_header(i);
+
+		if (slot_valid(header) && header->sequence >= newest)
+		{
+			newest = header->sequence;
+			slot = (i + 1) % slot_count();
+		}
+	}
+	next_sequence = newest + 1;
+}
+
+
+/**
+ * @brief  Add a sample to the ring buffer, call every BLACKBOX_SAMPLE_MS
+ */
+void blackbox_record(const BlackboxSample *sample)
+{
+	if (state > BLACKBOX_POST_TRIGGER) // Frozen until stored
+	{
+		return;
+	}
+
+	ring[head] = *sample;
+	head = (head + 1) % BLACKBOX_SAMPLES;
+	if (count < BLACKBOX_SAMPLES)
+	{
+		count++;
+	}
+
+	if (state == BLACKBOX_POST_TRIGGER && --post_left == 0)
+	{
+		freeze();
+	}
+}
+
+
+/**
+ * @brief  Freeze the buffer after BLACKBOX_POST_SAMPLES more samples
+ *         - fault -> FaultId that caused the capture, BLACKBOX_TRIGGER_MANUAL from the console
+ *         - fault_bits -> active faults, bit = FaultId
+ */
+void blackbox_trigger(uint8_t fault, uint32_t fault_bits)
+{
+	if (state != BLACKBOX_RECORDING) // Earlier capture not stored yet
+	{
+		missed++;
+		return;
+	}
+
+	pending.trigger_tick = HAL_GetTick();
+	pending.fault = fault;
+	pending.fault_bits = fault_bits;
+	pending.missed = missed;
+	post_left = BLACKBOX_POST_SAMPLES;
+	state = BLACKBOX_POST_TRIGGER;
+	printf("Black box triggered, storing capture %lu\n", (unsigned long)next_sequence);
+}
+
+
+/**
+ * @brief  Store a frozen capture in flash one page or chunk at a time, call from main loop
+ */
+void blackbox_service()
+{
+	int result = 0;
+
+	switch (state)
+	{
+	case BLACKBOX_ERASING:
+		result = storage_erase_area((uintptr_t)_blackbox_start + slot * SLOT_BYTES + step * FLASH_PAGE_SIZE, FLASH_PAGE_SIZE);
+		if (++step == BLACKBOX_PAGES_PER_EVENT)
+		{
+			step = 0;
+			state = BLACKBOX_PROGRAMMING;
+		}
+		break;
+	case BLACKBOX_PROGRAMMING:
+		result = program_chunk();
+		if (step == count)
+		{
+			state = BLACKBOX_SEALING;
+		}
+		break;
+	case BLACKBOX_SEALING:
+		pending.crc = slot_crc(slot_header(slot), pending.samples); // Over the samples as programmed, the header is still erased
+		result = storage_program((uintptr_t)slot_header(slot), &pending, sizeof(pending));
+		if (result == 0)
+		{
+			printf("Black box capture %lu stored (%u samples)\n", (unsigned long)pending.sequence, pending.samples);
+			next_sequence++;
+			slot = (slot + 1) % slot_count();
+			missed = 0;
+			restart();
+		}
+		break;
+	default:
+		break;
+	}
+
+	if (result != 0)
+	{
+		printf("Black box capture could not be stored to flash\n");
+		restart(); // Slot left without a header, overwritten by the next capture
+	}
+}
+
+
+/**
+ * @brief  Check whether a capture is waiting for its post-trigger samples or being stored
+ */
+int blackbox_is_busy()
+{
+	return state != BLACKBOX_RECORDING;
+}
+
+
+/**
+ * @brief  List the stored captures over the serial monitor
+ *
+ *   $BBOX,<state>,<samples buffered>,<missed triggers>
+ *   $BBOXL,<sequence>,<fault>,<fault bitmap hex>,<trigger tick ms>,<samples>,<CRC ok> for each stored capture
+ */
+void blackbox_print_report()
+{
+	printf("$BBOX,%d,%u,%lu\n", (int)state, count, (unsigned long)missed);
+	for (int i = 0; i < slot_count(); i++)
+	{
+		const BlackboxHeader *header = slot_header(i);
+
+		if (slot_valid(header))
+		{
+			printf("$BBOXL,%lu,%u,%02lX,%lu,%u,%d\n", (unsigned long)header->sequence, header->fault, (unsigned long)header->fault_bits,
+					(unsigned long)header->trigger_tick, header->samples, slot_crc(header, header->samples) == header->crc);
+		}
+	}
+}
+
+
+/**
+ * @brief  Print a stored capture as hex for Tools/blackbox_decode.py
+ *
+ *   $BBOXD,<sequence>,<byte offset>,<hex> for every DUMP_LINE_BYTES of header and samples
+ *         - Returns 0 on success, -1 if no capture has that sequence number
+ */
+int blackbox_dump(uint32_t sequence)
+{
+	for (int i = 0; i < slot_count(); i++)
+	{
+		const BlackboxHeader *header = slot_header(i);
+		const uint8_t *data = (const uint8_t *)header;
+		uint32_t length;
+
+		if (!slot_valid(header) || header->sequence != sequence)
+		{
+			continue;
+		}
+
+		length = sizeof(BlackboxHeader) + header->samples * sizeof(BlackboxSample);
+		for (uint32_t offset = 0; offset < length; offset += DUMP_LINE_BYTES)
+		{
+			printf("$BBOXD,%lu,%lu,", (unsigned long)sequence, (unsigned long)offset);
+			for (uint32_t b = offset; b < offset + DUMP_LINE_BYTES && b < length; b++)
+			{
+				printf("%02X", data[b]);
+			}
+			printf("\n");
+		}
+		return 0;
+	}
+	return -1;
+}
+
+
+/**
+ * @brief  Erase every stored capture
+ *         - Returns 0 on success, -1 on flash error or while a capture is being stored
+ */
+int blackbox_erase()
+{
+	if (state > BLACKBOX_POST_TRIGGER)
+	{
+		return -1;
+	}
+	slot = 0;
+	next_sequence = 1;
+	return storage_erase_area((uintptr_t)_blackbox_start, (uint32_t)(_blackbox_end - _blackbox_start));
+}
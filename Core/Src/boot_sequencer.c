@@ -0,0 +1,148 @@
+/**
+  ******************************************************************************
+  * @file           : boot_sequencer.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "boot_sequencer.h" // Include header file for boot sequencer functions
+#include "cycle_timer.h" // Include cycle counter for step timestamps
+#include <stdio.h> // Include standard I/O functions
+
+/*
+ * Runs the start-up initialisation as a table of steps on independent lanes.
+ * A step may only start wait_us after the previous step of its lane ended, which
+ * is how the minimum timings of the cell monitor (shutdown, wake, start-up, see
+ * pl455.h) are met. While the monitor lane waits, the steps of the MCU lane run:
+ * peripheral set-up, ADC calibration and the modules restoring from flash. So
+ * the boot takes about as long as the longer lane rather than the sum of every
+ * step and delay.
+ *
+ * Lanes are checked in BootLane order for a step that is due, so a monitor step
+ * runs as soon as its wait is over and the current MCU step has returned. Steps
+ * are not pre-empted, so a step that blocks for long (the first-boot current
+ * zero calibration) goes in the late lane, which only starts once the others
+ * are done.
+ *
+ * Each step is timestamped from the cycle counter, in microseconds since the
+ * clock configuration, and "boot" on the serial console prints the timeline.
+ * The time to the first protected sample is reported by warm_start.c.
+ */
+
+/* ***** BOOT STATE ***** */
+static const BootStep *table = 0; // Steps of the last sequence
+static int table_count = 0; // Steps in table
+static uint32_t run_lanes = 0; // Lanes run, bit = BootLane
+static uint32_t start_us[BOOT_STEPS_MAX]; // Start of every step (us), 0 if not run
+static uint32_t end_us[BOOT_STEPS_MAX]; // End of every step (us)
+static uint32_t sequence_end_us = 0; // End of the last step (us)
+
+
+/**
+ * @brief  Time since the cycle counter was started (us)
+ */
+static uint32_t now_us()
+{
+	return cycle_timer_now() / (SystemCoreClock / 1000000);
+}
+
+
+/**
+ * @brief  Next step of a lane after a table index
+ *         - Returns the table index, count if the lane has no steps left
+ */
+static int next_step(int lane, int after)
+{
+	int i = after + 1;
+
+	while (i < table_count && table[i].lane != lane)
+	{
+		i++;
+	}
+	return i;
+}
+
+
+/**
+ * @brief  Run the steps of the lanes in the mask, overlapping the lanes
+ *         - steps -> table of steps, kept for the report
+ *         - lanes -> lanes to run, bit = BootLane (BOOT_LANE_BIT), steps of other lanes are skipped
+ */
+void boot_run(const BootStep *steps, int count, uint32_t lanes)
+{
+	int next[BOOT_LANE_COUNT]; // Table index of the next step of every lane
+	uint32_t ready_us[BOOT_LANE_COUNT]; // End of the previous step of every lane (us)
+	int left = 0;
+
+	table = steps;
+	table_count = (count > BOOT_STEPS_MAX) ? BOOT_STEPS_MAX : count;
+	run_lanes = lanes;
+
+	for (int lane = 0; lane < BOOT_LANE_COUNT; lane++)
+	{
+		next[lane] = (lanes & BOOT_LANE_BIT(lane)) ? next_step(lane, -1) : table_count;
+		ready_us[lane] = now_us();
+	}
+	for (int i = 0; i < table_count; i++)
+	{
+		start_us[i] = 0;
+		end_us[i] = 0;
+		left += (lanes & BOOT_LANE_BIT(table[i].lane)) != 0;
+	}
+
+	while (left > 0)
+	{
+		for (int lane = 0; lane < BOOT_LANE_COUNT; lane++)
+		{
+			int i = next[lane];
+
+			if (i >= table_count || now_us() - ready_us[lane] < table[i].wait_us) // Lane done or still waiting
+			{
+				continue;
+			}
+			if (lane == BOOT_LANE_LATE && (next[BOOT_LANE_MONITOR] < table_count || next[BOOT_LANE_MCU] < table_count))
+			{
+				continue; // Other lanes first
+			}
+
+			start_us[i] = now_us();
+			table[i].run();
+			end_us[i] = now_us();
+
+			ready_us[lane] = end_us[i];
+			next[lane] = next_step(lane, i);
+			left--;
+			break; // Higher priority lanes first again
+		}
+	}
+
+	sequence_end_us = now_us();
+}
+
+
+/**
+ * @brief  Export the start and end of every step over the serial monitor
+ *
+ *   $BOOTSEQ,<sequence end us>,<steps run>
+ *   $BOOTSTEP,<name>,<lane>,<start us>,<end us> for every step run, times since clock configuration
+ */
+void boot_print_report()
+{
+	int steps = 0;
+
+	for (int i = 0; i < table_count; i++)
+	{
+		steps += (run_lanes & BOOT_LANE_BIT(table[i].lane)) != 0;
+	}
+	printf("$BOOTSEQ,%lu,%d\n", (unsigned long)sequence_end_us, steps);
+
+	for (int i = 0; i < table_count; i++)
+	{
+		if (run_lanes & BOOT_LANE_BIT(table[i].lane))
+		{
+			printf("$BOOTSTEP,%s,%u,%lu,%lu\n", table[i].name, table[i].lane, (unsigned long)start_us[i], (unsigned long)end_us[i]);
+		}
+	}
+}
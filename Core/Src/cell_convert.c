@@ -0,0 +1,164 @@
+/**
+  ******************************************************************************
+  * @file           : cell_convert.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "cell_convert.h" // Include header file for cell conversion functions
+#include "ocv_model.h" // Include batched OCV surface lookup
+#include "cycle_timer.h" // Include cycle counter for the benchmark
+#include <stdio.h> // Include standard I/O functions
+
+/*
+ * Converts a whole stack snapshot from the cell monitor response in one call:
+ * raw 16-bit codes (big-endian, highest cell first) to uV, then to SOC.
+ *
+ * A code is scaled to uV by a Q16 constant with one 32 x 32 -> 64 bit multiply,
+ * instead of the double-precision multiply the Cortex-M4 has to emulate in
+ * software. With the DSP extension two codes are loaded as one word and
+ * byte-swapped with REV16, so the frame needs no byte-by-byte assembly. The SOC
+ * stage is ocv_soc_centi_batch() (see ocv_model.c), which picks the curves once
+ * per snapshot and blends two temperatures with SMLAD. Other builds, such as the
+ * host simulator, use the scalar loops, which give the same results.
+ *
+ * CMSIS-DSP is not part of this tree, and its vector functions work on q15 /
+ * q31 / float arrays with one gain, which does not fit a table lookup per cell;
+ * the CMSIS-Core intrinsics are used directly instead.
+ *
+ * cell_convert_print_benchmark() times the batch against the previous per-cell
+ * path (double multiply, float to uV, single lookup) on synthetic stacks.
+ */
+
+/* ***** DEFINE CONSTANTS ***** */
+#define BENCH_CODE_LOW 39134 // Code of 3.0V, lowest synthetic cell
+#define BENCH_CODE_SPAN 15654 // Codes across 1.2V
+#define BENCH_TEMP_DECIC 250 // Temperature of the benchmark lookups (0.1 degC)
+
+/* ***** BENCHMARK BUFFERS ***** */
+static uint8_t bench_codes[2 * CELL_CONVERT_BENCH_CELLS]; // Synthetic response data
+static uint8_t bench_branch[CELL_CONVERT_BENCH_CELLS]; // Alternating branches
+static uint32_t bench_uv[CELL_CONVERT_BENCH_CELLS];
+static uint16_t bench_soc[CELL_CONVERT_BENCH_CELLS];
+
+
+/**
+ * @brief  Rounded uV of one code
+ */
+static uint32_t code_uv(uint32_t code)
+{
+	return (uint32_t)(((uint64_t)code * CELL_CONVERT_LSB_UV_Q16 + 0x8000u) >> 16);
+}
+
+
+/**
+ * @brief  Cell voltage (uV) from one raw code
+ */
+uint32_t cell_convert_code_uv(uint16_t code)
+{
+	return code_uv(code);
+}
+
+
+/**
+ * @brief  Convert big-endian cell codes to uV
+ *         - codes -> first code of the response data, two bytes per cell
+ *         - count -> number of cells
+ *         - cell_uv -> output, cell voltages (uV)
+ *         - cell_volt -> output, cell voltages (V), NULL if not needed
+ */
+void cell_convert_codes(const uint8_t *codes, int count, uint32_t *cell_uv, float *cell_volt)
+{
+	int i = 0;
+
+#if defined(__ARM_FEATURE_DSP)
+	for (; i + 1 < count; i += 2) // Two codes per load
+	{
+		uint32_t pair = __REV16(__UNALIGNED_UINT32_READ(codes + 2 * i)); // Both codes to native order, frame data is not word aligned
+
+		cell_uv[i] = code_uv(pair & 0xFFFFu);
+		cell_uv[i + 1] = code_uv(pair >> 16);
+	}
+#endif
+	for (; i < count; i++)
+	{
+		cell_uv[i] = code_uv((uint32_t)codes[2 * i] << 8 | codes[2 * i + 1]);
+	}
+
+	if (cell_volt)
+	{
+		for (i = 0; i < count; i++)
+		{
+			cell_volt[i] = cell_uv[i] * 1e-6f;
+		}
+	}
+}
+
+
+/**
+ * @brief  Convert cell codes to uV and SOC in one call
+ *         - codes -> first code of the response data, two bytes per cell
+ *         - count -> number of cells
+ *         - temp_decic -> temperature of every cell (0.1 degC)
+ *         - branch -> OcvBranch of each cell
+ *         - cell_uv -> output, cell voltages (uV)
+ *         - soc_centi -> output, SOC of each cell (0.01% units)
+ */
+void cell_convert_stack(const uint8_t *codes, int count, int16_t temp_decic, const uint8_t *branch, uint32_t *cell_uv, uint16_t *soc_centi)
+{
+	cell_convert_codes(codes, count, cell_uv, 0);
+	ocv_soc_centi_batch(cell_uv, branch, count, temp_decic, soc_centi);
+}
+
+
+/**
+ * @brief  Cycles per cell of the previous per-cell conversion
+ */
+static uint32_t time_per_cell_path(int count)
+{
+	uint32_t start = cycle_timer_now();
+
+	for (int i = 0; i < count; i++)
+	{
+		float volt = (bench_codes[2 * i] << 8 | bench_codes[2 * i + 1]) * 0.00007666; // As getcellVoltages() did
+		uint32_t cell_uv = (uint32_t)(volt * 1000000.0f + 0.5f);
+
+		bench_soc[i] = ocv_soc_centi(cell_uv, BENCH_TEMP_DECIC, (OcvBranch)bench_branch[i]);
+	}
+
+	return (cycle_timer_now() - start) / count;
+}
+
+
+/**
+ * @brief  Export cycles per cell of the batch and the per-cell conversion
+ *
+ *   $CONV,<cells>,<batch cycles per cell>,<per-cell cycles per cell>,... for 6, 96 and CELL_CONVERT_BENCH_CELLS cells
+ */
+void cell_convert_print_benchmark()
+{
+	const int sizes[] = {6, 96, CELL_CONVERT_BENCH_CELLS};
+
+	for (int i = 0; i < CELL_CONVERT_BENCH_CELLS; i++) // Spread from 3.0V to 4.2V
+	{
+		uint16_t code = BENCH_CODE_LOW + (uint32_t)i * BENCH_CODE_SPAN / (CELL_CONVERT_BENCH_CELLS - 1);
+
+		bench_codes[2 * i] = code >> 8;
+		bench_codes[2 * i + 1] = code & 0xFF;
+		bench_branch[i] = i & 1;
+	}
+
+	printf("$CONV");
+	for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+	{
+		uint32_t start = cycle_timer_now();
+
+		cell_convert_stack(bench_codes, sizes[s], BENCH_TEMP_DECIC, bench_branch, bench_uv, bench_soc);
+		uint32_t batch = (cycle_timer_now() - start) / sizes[s];
+
+		printf(",%d,%lu,%lu", sizes[s], (unsigned long)batch, (unsigned long)time_per_cell_path(sizes[s]));
+	}
+	printf("\n");
+}
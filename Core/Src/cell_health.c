@@ -0,0 +1,358 @@
+/**
+  ******************************************************************************
+  * @file           : cell_health.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "cell_health.h" // Include header file for cell health functions
+#include "chemistry_profile.h" // Include rated capacity
+#include "flash_storage.h" // Include flash storage for persisting the records
+#include <math.h> // Include fabsf()
+#include <stdio.h> // Include standard I/O functions
+#include <string.h> // Include string manipulation functions
+
+/*
+ * Estimates the capacity and internal resistance of every cell online, so the
+ * balancing target can account for cells that are not identical.
+ *
+ * Capacity: once every cell current has stayed below CELL_HEALTH_REST_A for
+ * CELL_HEALTH_REST_MS, the OCV lookup gives a trustworthy SOC. Between two such
+ * rest points the charge through each cell is integrated, and
+ *   Q = charge / (SOC_before - SOC_after)
+ * for every cell whose SOC moved by at least CELL_HEALTH_MIN_DSOC. Each estimate
+ * moves the stored capacity by dSOC / (dSOC + CELL_HEALTH_DSOC_WEIGHT) of the
+ * difference, so long excursions count for more than short ones. While the
+ * pack keeps resting the rest point follows the latest (most relaxed) reading.
+ * The first reading after power-up counts as a rest point if no current flows.
+ *
+ * Resistance: when a cell current changes by at least CELL_HEALTH_STEP_A from
+ * one monitoring cycle to the next (a balancing step starting or ending, a load
+ * switching), R = -dV / dI. This is the resistance over one monitoring period,
+ * R0 plus the part of the polarisation that builds up in that time.
+ *
+ * Estimates are kept in one compact record per cell, saved with every capacity
+ * update and every CELL_HEALTH_SAVE_R_UPDATES resistance updates. Records taken
+ * with a different chemistry profile are discarded.
+ *
+ * Balancing works on usable charge, SOC x capacity, as a percentage of rated
+ * capacity (see main.c), which maximises the charge the pack can deliver.
+ * With equal capacities this is the same as equal SOC.
+ */
+
+/* ***** HEALTH STATE ***** */
+static CellHealthStore store; // Records as saved
+static float capacity[NOC]; // Estimated capacity (mAh), index as volt[]
+static float resistance[NOC]; // Estimated resistance (Ohm)
+static float rest_soc[NOC]; // OCV SOC at the last rest point (%)
+static float charge_mAh[NOC]; // Charge out of each cell since the last rest point, positive discharges (mAh)
+static int rest_valid = 0; // 1 once there is a rest point
+static uint32_t rest_ms = 0; // Time every cell current has been below CELL_HEALTH_REST_A (ms)
+static float last_volt[NOC]; // Cell voltage at the previous cycle (V)
+static float last_current[NOC]; // Cell current at the previous cycle (A)
+static int started = 0; // 1 after the first update
+static int unsaved_r_updates = 0; // Resistance updates since the last save
+
+
+/**
+ * @brief  Start every cell at rated capacity and the default resistance
+ */
+static void default_records()
+{
+	store.version = CELL_HEALTH_VERSION;
+	store.rated_mAh = chemistry_profile()->capacity_mAh;
+	for (int i = 0; i < NOC; i++)
+	{
+		capacity[i] = store.rated_mAh;
+		resistance[i] = CELL_HEALTH_R_DEFAULT_OHM;
+		store.cell[i].capacity_updates = 0;
+		store.cell[i].resistance_updates = 0;
+	}
+}
+
+
+/**
+ * @brief  Copy the estimates into the stored records
+ */
+static void fill_records()
+{
+	for (int i = 0; i < NOC; i++)
+	{
+		store.cell[i].capacity_mAh = (uint16_t)(capacity[i] + 0.5f);
+		store.cell[i].resistance_10uohm = (uint16_t)(resistance[i] * 100000.0f + 0.5f);
+	}
+}
+
+
+/**
+ * @brief  Move the rest point of every cell to the latest OCV SOC
+ */
+static void set_rest_point(const float *ocv_soc)
+{
+	for (int i = 0; i < NOC; i++)
+	{
+		rest_soc[i] = ocv_soc[i];
+		charge_mAh[i] = 0.0f;
+	}
+	rest_valid = 1;
+}
+
+
+/**
+ * @brief  Capacity estimates from the charge moved since the last rest point
+ *         - Returns the number of cells updated
+ */
+static int capacity_estimate(const float *ocv_soc)
+{
+	float rated = store.rated_mAh;
+	int updated = 0;
+
+	for (int i = 0; i < NOC; i++)
+	{
+		float dsoc = rest_soc[i] - ocv_soc[i]; // SOC lost since the last rest point (%)
+		float estimate;
+
+		if (fabsf(dsoc) < CELL_HEALTH_MIN_DSOC)
+		{
+			continue;
+		}
+
+		estimate = charge_mAh[i] / dsoc * 100.0f;
+		if (estimate < rated * CELL_HEALTH_CAPACITY_MIN_PCT / 100.0f || estimate > rated * CELL_HEALTH_CAPACITY_MAX_PCT / 100.0f)
+		{
+			continue; // Charge and SOC disagree, e.g. a reading taken before the cell had relaxed
+		}
+
+		capacity[i] += fabsf(dsoc) / (fabsf(dsoc) + CELL_HEALTH_DSOC_WEIGHT) * (estimate - capacity[i]);
+		if (store.cell[i].capacity_updates < UINT8_MAX)
+		{
+			store.cell[i].capacity_updates++;
+		}
+		updated++;
+	}
+	return updated;
+}
+
+
+/**
+ * @brief  Resistance estimates from the change since the previous cycle
+ *         - Returns the number of cells updated
+ */
+static int resistance_estimate(const float *cell_volt, const float *cell_current)
+{
+	int updated = 0;
+
+	for (int i = 0; i < NOC; i++)
+	{
+		float di = cell_current[i] - last_current[i];
+		float estimate;
+
+		if (fabsf(di) < CELL_HEALTH_STEP_A)
+		{
+			continue;
+		}
+
+		estimate = -(cell_volt[i] - last_volt[i]) / di; // Discharge current lowers the terminal voltage
+		if (estimate <= 0.0f || estimate > CELL_HEALTH_R_MAX_OHM)
+		{
+			continue;
+		}
+
+		resistance[i] += CELL_HEALTH_R_GAIN * (estimate - resistance[i]);
+		if (store.cell[i].resistance_updates < UINT8_MAX)
+		{
+			store.cell[i].resistance_updates++;
+		}
+		updated++;
+	}
+	return updated;
+}
+
+
+/**
+ * @brief  Restore the records from flash, or start every cell at rated capacity
+ */
+void cell_health_init()
+{
+	if (!storage_read(STORAGE_ID_HEALTH, &store, sizeof(store)) || store.version != CELL_HEALTH_VERSION
+			|| store.rated_mAh != chemistry_profile()->capacity_mAh) // Nothing stored, or records of another cell type
+	{
+		default_records();
+		return;
+	}
+
+	for (int i = 0; i < NOC; i++)
+	{
+		capacity[i] = store.cell[i].capacity_mAh;
+		resistance[i] = store.cell[i].resistance_10uohm / 100000.0f;
+	}
+}
+
+
+/**
+ * @brief  Track rest points and current steps, call once per monitoring cycle
+ *         - cell_volt -> cell voltages (V), index as volt[]
+ *         - cell_current -> current through each cell, positive discharges (A)
+ *         - ocv_soc -> SOC of each cell from the OCV lookup (%)
+ *         - dt_ms -> time since the previous call (ms)
+ */
+void cell_health_update(const float *cell_volt, const float *cell_current, const float *ocv_soc, uint32_t dt_ms)
+{
+	int quiet = 1;
+	int save = 0;
+
+	for (int i = 0; i < NOC; i++)
+	{
+		charge_mAh[i] += cell_current[i] * (float)dt_ms / 3600.0f; // A x ms / 3600 = mAh
+		quiet &= (fabsf(cell_current[i]) < CELL_HEALTH_REST_A);
+	}
+
+	if (!started) // Power-up, the pack has rested if nothing flows now
+	{
+		started = 1;
+		rest_ms = quiet ? CELL_HEALTH_REST_MS : 0;
+	} else {
+		if (resistance_estimate(cell_volt, cell_current) > 0)
+		{
+			save = (++unsaved_r_updates >= CELL_HEALTH_SAVE_R_UPDATES);
+		}
+		if (!quiet)
+		{
+			rest_ms = 0;
+		} else if (rest_ms < CELL_HEALTH_REST_MS) {
+			rest_ms += dt_ms;
+			if (rest_ms >= CELL_HEALTH_REST_MS && rest_valid && capacity_estimate(ocv_soc) > 0) // Rest point after activity
+			{
+				save = 1;
+			}
+		}
+	}
+
+	if (quiet && rest_ms >= CELL_HEALTH_REST_MS)
+	{
+		set_rest_point(ocv_soc);
+	}
+
+	memcpy(last_volt, cell_volt, sizeof(last_volt));
+	memcpy(last_current, cell_current, sizeof(last_current));
+
+	if (save && cell_health_save() != 0)
+	{
+		printf("Cell health records could not be saved to flash\n");
+	}
+}
+
+
+/**
+ * @brief  Usable charge of every cell as a percentage of rated capacity
+ *         - soc -> SOC of each cell (%), index as volt[]
+ *         - usable -> SOC x estimated capacity / rated capacity (%)
+ */
+void cell_health_usable(const float *soc, float *usable)
+{
+	float rated = store.rated_mAh;
+
+	for (int i = 0; i < NOC; i++)
+	{
+		usable[i] = soc[i] * capacity[i] / rated;
+	}
+}
+
+
+/**
+ * @brief  Estimated capacity of a cell (mAh), index as volt[]
+ */
+float cell_health_capacity_mAh(int index)
+{
+	return capacity[index];
+}
+
+
+/**
+ * @brief  Estimated resistance of a cell (Ohm), index as volt[]
+ */
+float cell_health_resistance_ohm(int index)
+{
+	return resistance[index];
+}
+
+
+/**
+ * @brief  Stored record of a cell, index as volt[]
+ */
+const CellHealthRecord *cell_health_record(int index)
+{
+	return &store.cell[index];
+}
+
+
+/**
+ * @brief  Write the records to flash
+ */
+int cell_health_save()
+{
+	fill_records();
+	unsaved_r_updates = 0;
+	return storage_write(STORAGE_ID_HEALTH, &store, sizeof(store));
+}
+
+
+/**
+ * @brief  Rest point, charge counted since it and previous cycle, e.g. to keep over a warm reset (see warm_start.c)
+ */
+void cell_health_get_tracking(CellHealthTracking *tracking)
+{
+	memcpy(tracking->rest_soc, rest_soc, sizeof(rest_soc));
+	memcpy(tracking->charge_mAh, charge_mAh, sizeof(charge_mAh));
+	memcpy(tracking->last_volt, last_volt, sizeof(last_volt));
+	memcpy(tracking->last_current, last_current, sizeof(last_current));
+	tracking->rest_ms = rest_ms;
+	tracking->rest_valid = rest_valid;
+}
+
+
+/**
+ * @brief  Continue counting from a saved rest point and charge
+ *         - The next update carries on as if no reset happened, instead of starting a new rest period
+ */
+void cell_health_restore_tracking(const CellHealthTracking *tracking)
+{
+	memcpy(rest_soc, tracking->rest_soc, sizeof(rest_soc));
+	memcpy(charge_mAh, tracking->charge_mAh, sizeof(charge_mAh));
+	memcpy(last_volt, tracking->last_volt, sizeof(last_volt));
+	memcpy(last_current, tracking->last_current, sizeof(last_current));
+	rest_ms = tracking->rest_ms;
+	rest_valid = tracking->rest_valid;
+	started = 1;
+}
+
+
+/**
+ * @brief  Forget every estimate and start again from rated capacity
+ */
+void cell_health_reset()
+{
+	default_records();
+	unsaved_r_updates = 0;
+}
+
+
+/**
+ * @brief  Export capacity, state of health and resistance over the serial monitor
+ *
+ *   $HEALTH,<rest s>,<capacity mAh cell 1>,<SOH % cell 1>,<R mOhm cell 1>,<capacity updates>,<R updates>,...,<cell NOC>
+ * State of health is the estimated capacity as a percentage of rated
+ */
+void cell_health_print_report()
+{
+	printf("$HEALTH,%lu", (unsigned long)(rest_ms / 1000));
+	for (int cell = 1; cell <= NOC; cell++)
+	{
+		int i = NOC - cell;
+		printf(",%.0f,%.1f,%.2f,%u,%u", capacity[i], capacity[i] * 100.0f / store.rated_mAh, resistance[i] * 1000.0f,
+				store.cell[i].capacity_updates, store.cell[i].resistance_updates);
+	}
+	printf("\n");
+}
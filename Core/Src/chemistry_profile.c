@@ -0,0 +1,281 @@
+/**
+  ******************************************************************************
+  * @file           : chemistry_profile.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "chemistry_profile.h" // Include header file for chemistry profile functions
+#include "pl455.h" // Include CRC16 checksum function (before pack_config.h, its prototypes use NOC as a parameter name)
+#include "ocv_model.h" // Include built-in OCV surface
+#include "flash_storage.h" // Include raw flash erase and program
+#include "flyback_operation.h" // Include converter current limits
+#include <stdio.h> // Include standard I/O functions
+
+/*
+ * Everything that depends on the cell type (OCV surface, voltage limits,
+ * capacity and balancing limits) comes from a chemistry profile. Profiles are
+ * built from CSV characterisation data by Tools/chem_profile.py and uploaded
+ * over the serial console into the PROFILE partition reserved in the linker
+ * script, so changing cell type needs no firmware rebuild.
+ *
+ * The image is used in place: chemistry_profile() returns a pointer into the
+ * partition and the OCV model reads the surface straight from flash. An image
+ * is only used once its magic, version, CRC and dimensions have been checked
+ * and every curve of its surface is non-decreasing, which the interpolation in
+ * ocv_model.c relies on (a falling step would wrap to a huge SOC), and its
+ * limits are ordered and within what the converter can run.
+ * When the partition is empty or invalid, or while an upload is in progress,
+ * the built-in Molicel P45B profile is active.
+ */
+
+/* ***** DEFINE CONSTANTS ***** */
+#define CHEM_PROFILE_SURFACE_BYTES(p) ((uint32_t)OCV_BRANCH_COUNT * (p)->ocv_t_size * (p)->ocv_v_size * sizeof(uint16_t))
+
+extern uint8_t _profile_start[]; // Start of profile partition (defined in linker script)
+extern uint8_t _profile_end[]; // End of profile partition (defined in linker script)
+
+/* ***** PROFILE STATE ***** */
+static const ChemistryProfile builtin_profile = {
+	.magic = CHEM_PROFILE_MAGIC,
+	.version = CHEM_PROFILE_VERSION,
+	.length = sizeof(ChemistryProfile),
+	.name = "Molicel P45B",
+	.cell_min_mv = 2500,
+	.cell_max_mv = 4200,
+	.capacity_mAh = 4500,
+	.balance_max_mA = 4000,
+	.derate_start_mv = 4100,
+	.derate_stop_mv = 4200,
+	.ocv_v0_uv = OCV_V0_UV,
+	.ocv_v_size = OCV_V_SIZE,
+	.ocv_v_shift = OCV_V_SHIFT,
+	.ocv_t_size = OCV_T_SIZE,
+	.ocv_t0_decic = OCV_T0_DECIC,
+	.ocv_t_step_decic = OCV_T_STEP_DECIC,
+	.ocv_offset = 0, // Surface is ocv_surface, not part of the image
+};
+
+static const ChemistryProfile *active_profile = &builtin_profile; // Profile in use
+static const uint16_t *active_ocv = &ocv_surface[0][0][0]; // Surface of the profile in use
+static uint32_t upload_length = 0; // Length announced by chemistry_profile_upload_begin(), 0 if no upload
+
+
+/**
+ * @brief  Check that every curve of a surface is non-decreasing in voltage
+ *         - Returns 1 if it is
+ */
+static int surface_non_decreasing(const ChemistryProfile *p, const uint16_t *surface)
+{
+	uint32_t rows = (uint32_t)OCV_BRANCH_COUNT * p->ocv_t_size;
+
+	for (uint32_t r = 0; r < rows; r++)
+	{
+		const uint16_t *row = surface + r * p->ocv_v_size;
+
+		for (uint32_t i = 1; i < p->ocv_v_size; i++)
+		{
+			if (row[i] < row[i - 1])
+			{
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+
+/**
+ * @brief  Check a profile image in the partition
+ *         - Returns 1 if the image can be used
+ */
+static int profile_valid(const ChemistryProfile *p)
+{
+	uint32_t partition = (uint32_t)(_profile_end - _profile_start);
+
+	if (p->magic != CHEM_PROFILE_MAGIC || p->version != CHEM_PROFILE_VERSION)
+	{
+		return 0;
+	}
+	if (p->length < sizeof(ChemistryProfile) || p->length > partition)
+	{
+		return 0;
+	}
+	if (CRC16((BYTE *)p + CHEM_PROFILE_CRC_START, p->length - CHEM_PROFILE_CRC_START) != p->crc)
+	{
+		return 0;
+	}
+
+	// Dimensions must describe a surface the OCV model can index inside the image
+	if (p->ocv_v_size < 2 || p->ocv_t_size < 1 || p->ocv_v_shift < 1 || p->ocv_v_shift > 16
+			|| (p->ocv_t_size > 1 && p->ocv_t_step_decic <= 0) || (p->ocv_offset & 1)
+			|| p->ocv_offset < sizeof(ChemistryProfile) || p->ocv_offset > p->length
+			|| CHEM_PROFILE_SURFACE_BYTES(p) > p->length - p->ocv_offset) // Offset checked first so the subtraction cannot wrap
+	{
+		return 0;
+	}
+	if (!surface_non_decreasing(p, (const uint16_t *)((const uint8_t *)p + p->ocv_offset)))
+	{
+		return 0;
+	}
+
+	// Limits must be ordered, derating must end by the overvoltage threshold
+	if (p->cell_min_mv >= p->cell_max_mv || p->derate_start_mv >= p->derate_stop_mv || p->derate_stop_mv > p->cell_max_mv
+			|| p->capacity_mAh == 0)
+	{
+		return 0;
+	}
+	if (p->balance_max_mA < FLYBACK_MIN_CURRENT * 1000.0f) // Zero divides in the planner, below the minimum the clamp would exceed it
+	{
+		return 0;
+	}
+
+	return 1;
+}
+
+
+/**
+ * @brief  Return to the built-in profile
+ */
+static void use_builtin()
+{
+	active_profile = &builtin_profile;
+	active_ocv = &ocv_surface[0][0][0];
+}
+
+
+/**
+ * @brief  Select the profile in the partition if it is valid, otherwise the built-in one
+ */
+void chemistry_profile_init()
+{
+	const ChemistryProfile *stored = (const ChemistryProfile *)_profile_start;
+
+	if (profile_valid(stored))
+	{
+		active_profile = stored;
+		active_ocv = (const uint16_t *)(_profile_start + stored->ocv_offset);
+	} else {
+		use_builtin();
+	}
+
+	chemistry_profile_print();
+}
+
+
+/**
+ * @brief  Active profile, in place in flash
+ */
+const ChemistryProfile *chemistry_profile()
+{
+	return active_profile;
+}
+
+
+/**
+ * @brief  OCV surface of the active profile, [branch][temperature][voltage]
+ */
+const uint16_t *chemistry_profile_ocv()
+{
+	return active_ocv;
+}
+
+
+/**
+ * @brief  Check whether the built-in profile is active
+ */
+int chemistry_profile_is_builtin()
+{
+	return active_profile == &builtin_profile;
+}
+
+
+/**
+ * @brief  Start an upload, the built-in profile is used until the new image is validated
+ *         - length -> image length (bytes)
+ *         - Returns 0 if the partition was erased, -1 otherwise
+ */
+int chemistry_profile_upload_begin(uint32_t length)
+{
+	uint32_t partition = (uint32_t)(_profile_end - _profile_start);
+
+	upload_length = 0;
+	if (length < sizeof(ChemistryProfile) || length > partition)
+	{
+		return -1;
+	}
+
+	use_builtin(); // Partition is about to be erased underneath the active profile
+	if (storage_erase_area((uintptr_t)_profile_start, partition) != 0)
+	{
+		return -1;
+	}
+
+	upload_length = length;
+	return 0;
+}
+
+
+/**
+ * @brief  Program part of the new image
+ *         - offset -> position in the image, a multiple of 8 bytes
+ *         - Returns 0 on success, -1 if outside the image or not aligned
+ */
+int chemistry_profile_upload_data(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+	if (upload_length == 0 || (offset & 7) || len == 0 || offset + len > upload_length)
+	{
+		return -1;
+	}
+
+	return storage_program((uintptr_t)(_profile_start + offset), data, len);
+}
+
+
+/**
+ * @brief  Validate and activate the uploaded image
+ *         - Returns 0 if the new profile is active, -1 if it was rejected (built-in stays active)
+ */
+int chemistry_profile_upload_end()
+{
+	const ChemistryProfile *stored = (const ChemistryProfile *)_profile_start;
+
+	if (upload_length == 0 || stored->length != upload_length || !profile_valid(stored))
+	{
+		upload_length = 0;
+		return -1;
+	}
+
+	upload_length = 0;
+	active_profile = stored;
+	active_ocv = (const uint16_t *)(_profile_start + stored->ocv_offset);
+	return 0;
+}
+
+
+/**
+ * @brief  Erase the partition and return to the built-in profile
+ *         - Returns 0 on success, -1 on flash error
+ */
+int chemistry_profile_erase()
+{
+	upload_length = 0;
+	use_builtin();
+	return storage_erase_area((uintptr_t)_profile_start, (uint32_t)(_profile_end - _profile_start));
+}
+
+
+/**
+ * @brief  Print the active profile over the serial monitor
+ */
+void chemistry_profile_print()
+{
+	const ChemistryProfile *p = active_profile;
+
+	printf("Chemistry profile: %.*s (%s) | Cell %u-%umV | %umAh | Balancing %umA, derate %u-%umV | OCV %u x %u x %d\n",
+			CHEM_PROFILE_NAME_LEN, p->name, chemistry_profile_is_builtin() ? "built-in" : "flash",
+			p->cell_min_mv, p->cell_max_mv, p->capacity_mAh, p->balance_max_mA, p->derate_start_mv, p->derate_stop_mv,
+			p->ocv_v_size, p->ocv_t_size, OCV_BRANCH_COUNT);
+}
@@ -0,0 +1,340 @@
+/**
+  ******************************************************************************
+  * @file           : current_calibration.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "current_calibration.h" // Include header file for current calibration functions
+#include "current_sense.h" // Include filtered current sense codes
+#include "flyback_operation.h" // Include power stage state (balancing current is zero while idle)
+#include "flash_storage.h" // Include flash storage for persisting coefficients
+#include <stdio.h> // Include standard I/O functions
+#include <stdlib.h> // Include abs()
+
+/*
+ * Each channel is converted as mA = (code - offset) x gain >> CAL_GAIN_SHIFT using
+ * integer arithmetic only. The offset removes the amplifier and ADC zero error,
+ * the gain starts at the nominal value from the schematic and can be trimmed by
+ * applying a known current (two-point calibration, zero being the first point).
+ * Coefficients are kept in flash through flash_storage, which adds the CRC.
+ *
+ * Zero calibration of the balancing channel is safe whenever the flyback is idle.
+ * The pack sensor also carries the flyback input and, while the relay is closed,
+ * the load, so the pack channel is only zeroed with both off: at boot (when no
+ * coefficients are stored) or on request ("calibrate zero pack"). A reading above
+ * CAL_MAX_OFFSET is rejected as real current rather than offset. The gain is
+ * trimmed on request ("calibrate gain") with a metered current flowing.
+ *
+ * Boot and console calibrations wait for their blocks, which takes about
+ * (CAL_SETTLE_BLOCKS + CAL_ZERO_SAMPLES) x CURRENT_SENSE_BLOCK_MS. The periodic
+ * zero of the balancing channel runs in the main loop instead:
+ * calibration_service() takes at most one new block per call and gives up if
+ * the converter starts before the average is complete.
+ */
+
+/* ***** DEFINE CONSTANTS ***** */
+#define CAL_SAMPLE_TIMEOUT_MS 100 // Longest wait for a new filtered block (ms)
+#define CAL_SETTLE_BLOCKS 2 // Blocks discarded while the filters settle (start-up or converter just stopped)
+#define CAL_FLAG_ZERO(ch) (1u << (ch)) // Channel offset has been measured
+#define CAL_FLAG_GAIN(ch) (1u << ((ch) + 8)) // Channel gain has been measured
+
+/**
+ * @brief Calibration record stored in flash
+ */
+typedef struct {
+	ChannelCalibration channel[CURRENT_CHANNEL_COUNT]; // Coefficients per channel
+	uint32_t flags; // CAL_FLAG_ZERO / CAL_FLAG_GAIN per channel
+} CalibrationRecord;
+
+/* ***** CALIBRATION STATE ***** */
+static CalibrationRecord calibration; // Active coefficients
+static int32_t persisted_offset[CURRENT_CHANNEL_COUNT]; // Offsets as last written to flash
+static uint32_t last_auto_zero_tick = 0; // Tick of the last automatic zero calibration
+static int auto_zero_blocks = -1; // Blocks taken by the running automatic zero, -1 while none runs
+static int32_t auto_zero_sum = 0; // Sum of the codes averaged so far
+static uint32_t auto_zero_block = 0; // Current sense block count at the last block taken
+static uint32_t auto_zero_block_tick = 0; // Tick of the last block taken
+
+
+/**
+ * @brief  Nominal gain of a channel (q16 mA per code)
+ */
+static int32_t nominal_gain(CurrentChannel channel)
+{
+	return (channel == CURRENT_CHANNEL_PACK) ? CAL_PACK_GAIN_NOMINAL : CAL_BALANCING_GAIN_NOMINAL;
+}
+
+
+/**
+ * @brief  Raw filtered code of a channel from a current sense sample
+ */
+static int16_t channel_code(CurrentChannel channel, CurrentSample sample)
+{
+	return (channel == CURRENT_CHANNEL_PACK) ? sample.pack_code : sample.balancing_code;
+}
+
+
+/**
+ * @brief  Average the filtered code of a channel over CAL_ZERO_SAMPLES new blocks
+ *         - The first CAL_SETTLE_BLOCKS blocks are discarded
+ *         - Returns 0 on success, -1 if the ADC stream stopped
+ */
+static int measure_average(CurrentChannel channel, int32_t *average)
+{
+	int32_t sum = 0;
+	uint32_t block = current_sense_block_count();
+
+	for (int i = 0; i < CAL_SETTLE_BLOCKS + CAL_ZERO_SAMPLES; i++)
+	{
+		uint32_t start = HAL_GetTick();
+
+		while (current_sense_block_count() == block) // Wait for the next filtered block
+		{
+			if (HAL_GetTick() - start > CAL_SAMPLE_TIMEOUT_MS)
+			{
+				return -1;
+			}
+		}
+		block = current_sense_block_count();
+
+		if (i >= CAL_SETTLE_BLOCKS)
+		{
+			sum += channel_code(channel, current_sense_sample());
+		}
+	}
+
+	*average = (sum + CAL_ZERO_SAMPLES / 2) / CAL_ZERO_SAMPLES; // Rounded mean
+	return 0;
+}
+
+
+/**
+ * @brief  Write the active coefficients to flash
+ */
+static void save_calibration()
+{
+	if (storage_write(STORAGE_ID_CALIBRATION, &calibration, sizeof(calibration)) != 0)
+	{
+		printf("Current calibration could not be saved to flash\n");
+		return;
+	}
+
+	for (int ch = 0; ch < CURRENT_CHANNEL_COUNT; ch++)
+	{
+		persisted_offset[ch] = calibration.channel[ch].offset;
+	}
+}
+
+
+/**
+ * @brief  Accept a measured zero offset
+ *         - persist -> 1 to always write to flash, 0 to write only if the offset moved by CAL_PERSIST_DELTA
+ *         - Returns 0 on success, -1 if the offset is too large
+ */
+static int apply_zero(CurrentChannel channel, int32_t offset, int persist)
+{
+	if (abs(offset) > CAL_MAX_OFFSET) // Too large for amplifier offset, current must be flowing
+	{
+		printf("Current calibration rejected: channel %d offset %ld codes\n", channel, (long)offset);
+		return -1;
+	}
+
+	calibration.channel[channel].offset = offset;
+	calibration.flags |= CAL_FLAG_ZERO(channel);
+
+	if (persist || abs(offset - persisted_offset[channel]) >= CAL_PERSIST_DELTA) // Avoid wearing flash with noise-sized updates
+	{
+		save_calibration();
+	}
+	return 0;
+}
+
+
+/**
+ * @brief  Restore coefficients from flash, zero any channel that was never calibrated
+ *         - Must be called after current_sense_start() with the flyback idle
+ */
+void calibration_init()
+{
+	if (!storage_read(STORAGE_ID_CALIBRATION, &calibration, sizeof(calibration))) // Nothing stored yet, start from nominal
+	{
+		calibration.flags = 0;
+		for (int ch = 0; ch < CURRENT_CHANNEL_COUNT; ch++)
+		{
+			calibration.channel[ch].offset = 0;
+			calibration.channel[ch].gain = nominal_gain((CurrentChannel)ch);
+		}
+	}
+
+	for (int ch = 0; ch < CURRENT_CHANNEL_COUNT; ch++)
+	{
+		persisted_offset[ch] = calibration.channel[ch].offset;
+
+		if (!(calibration.flags & CAL_FLAG_ZERO(ch))) // First boot, take the zero point now, retried on the next boot if current is flowing
+		{
+			calibration_zero((CurrentChannel)ch, 1);
+		}
+	}
+
+	last_auto_zero_tick = HAL_GetTick();
+}
+
+
+/**
+ * @brief  Convert a filtered ADC code to mA
+ */
+int32_t calibration_code_to_mA(CurrentChannel channel, int16_t code)
+{
+	const ChannelCalibration *cal = &calibration.channel[channel];
+
+	return (int32_t)(((int64_t)(code - cal->offset) * cal->gain) >> CAL_GAIN_SHIFT);
+}
+
+
+/**
+ * @brief  Measure the zero-current offset of a channel
+ *         - Rejected while the flyback runs, and for the pack channel while the pack relay is closed
+ *         - persist -> 1 to always write to flash, 0 to write only if the offset moved by CAL_PERSIST_DELTA
+ *         - Returns 0 on success, -1 if the measurement was rejected
+ */
+int calibration_zero(CurrentChannel channel, int persist)
+{
+	int32_t offset;
+
+	if (flyback_is_busy()) // Output and input current are only known to be zero while idle
+	{
+		return -1;
+	}
+
+	if (channel == CURRENT_CHANNEL_PACK && HAL_GPIO_ReadPin(GPIOA, PACK_ENABLE_Pin) == GPIO_PIN_SET) // Load current flows through the closed relay
+	{
+		printf("Current calibration rejected: pack relay closed\n");
+		return -1;
+	}
+
+	if (measure_average(channel, &offset) != 0)
+	{
+		printf("Current calibration failed: no ADC data\n");
+		return -1;
+	}
+
+	return apply_zero(channel, offset, persist);
+}
+
+
+/**
+ * @brief  Two-point gain calibration with a known current applied
+ *         - The zero point must have been taken first (calibration_zero)
+ *         - reference_current -> current flowing in the channel (A), measured with a reference meter
+ *         - Returns 0 on success, -1 if the measurement was rejected
+ */
+int calibration_gain(CurrentChannel channel, float reference_current)
+{
+	int32_t code;
+	int32_t delta; // Codes above zero
+	int32_t gain; // New gain (q16 mA per code)
+	int32_t nominal = nominal_gain(channel);
+
+	if (!(calibration.flags & CAL_FLAG_ZERO(channel)) || reference_current <= 0.0f)
+	{
+		return -1;
+	}
+
+	if (measure_average(channel, &code) != 0)
+	{
+		return -1;
+	}
+
+	delta = code - calibration.channel[channel].offset;
+	if (delta <= 0)
+	{
+		return -1;
+	}
+
+	gain = (int32_t)(((int64_t)(reference_current * 1000.0f) << CAL_GAIN_SHIFT) / delta);
+
+	if (abs(gain - nominal) > nominal / 100 * CAL_GAIN_TOLERANCE) // Far from the schematic value, wrong reference or hardware fault
+	{
+		printf("Current gain calibration rejected: channel %d gain %ld (nominal %ld)\n", channel, (long)gain, (long)nominal);
+		return -1;
+	}
+
+	calibration.channel[channel].gain = gain;
+	calibration.flags |= CAL_FLAG_GAIN(channel);
+	save_calibration();
+	return 0;
+}
+
+
+/**
+ * @brief  Periodic zero calibration of the balancing channel while the converter is idle, call from main loop
+ *         - Tracks offset drift with temperature, one current sense block per call
+ *         - The first CAL_SETTLE_BLOCKS blocks are discarded, as in measure_average()
+ */
+void calibration_service()
+{
+	uint32_t now = HAL_GetTick();
+
+	if (auto_zero_blocks < 0) // Not running, start once the interval has passed with the converter idle
+	{
+		if (now - last_auto_zero_tick < CAL_AUTO_ZERO_INTERVAL_MS || flyback_is_busy())
+		{
+			return;
+		}
+		last_auto_zero_tick = now;
+		auto_zero_blocks = 0;
+		auto_zero_sum = 0;
+		auto_zero_block = current_sense_block_count();
+		auto_zero_block_tick = now;
+		return;
+	}
+
+	if (flyback_is_busy() || now - auto_zero_block_tick > CAL_SAMPLE_TIMEOUT_MS) // Current flowing or ADC stream stopped, retry next interval
+	{
+		auto_zero_blocks = -1;
+		return;
+	}
+	if (current_sense_block_count() == auto_zero_block) // No new block yet
+	{
+		return;
+	}
+	auto_zero_block = current_sense_block_count();
+	auto_zero_block_tick = now;
+
+	if (auto_zero_blocks++ >= CAL_SETTLE_BLOCKS)
+	{
+		auto_zero_sum += channel_code(CURRENT_CHANNEL_BALANCING, current_sense_sample());
+	}
+	if (auto_zero_blocks == CAL_SETTLE_BLOCKS + CAL_ZERO_SAMPLES)
+	{
+		auto_zero_blocks = -1;
+		apply_zero(CURRENT_CHANNEL_BALANCING, (auto_zero_sum + CAL_ZERO_SAMPLES / 2) / CAL_ZERO_SAMPLES, 0); // Rounded mean
+	}
+}
+
+
+/**
+ * @brief  Active coefficients for a channel
+ */
+const ChannelCalibration *calibration_get(CurrentChannel channel)
+{
+	return &calibration.channel[channel];
+}
+
+
+/**
+ * @brief  Export the coefficients of every channel over the serial monitor
+ *
+ *   $CAL,<channel>,<offset codes>,<gain q16 mA per code>,<zero measured>,<gain measured> for every channel, 0 = pack
+ */
+void calibration_print_report()
+{
+	for (int ch = 0; ch < CURRENT_CHANNEL_COUNT; ch++)
+	{
+		printf("$CAL,%d,%ld,%ld,%d,%d\n", ch, (long)calibration.channel[ch].offset, (long)calibration.channel[ch].gain,
+				(calibration.flags & CAL_FLAG_ZERO(ch)) != 0, (calibration.flags & CAL_FLAG_GAIN(ch)) != 0);
+	}
+}
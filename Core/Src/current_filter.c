@@ -0,0 +1,107 @@
+/**
+  ******************************************************************************
+  * @file           : current_filter.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "current_filter.h" // Include header file for current filter functions
+#include <string.h> // Include string manipulation functions
+
+/*
+ * Fixed-point FIR filter matching the arithmetic of the G474 FMAC (RM0440, FMAC
+ * chapter) so the same coefficients give identical results in hardware and in
+ * software. Inputs are right-aligned 12-bit ADC codes used directly as q1.15
+ * values, so the output is in ADC codes as well.
+ *   - each q1.15 x q1.15 product (q2.30) is truncated to the q3.22 accumulator
+ *   - the 26-bit accumulator saturates
+ *   - the output is shifted left by the gain R and truncated to q1.15 with saturation
+ * This file has no HAL dependency and can be compiled on a PC to check a filter design.
+ */
+
+/* ***** DEFINE CONSTANTS ***** */
+#define ACC_FRACTION_DROP 8 // q2.30 product -> q3.22 accumulator
+#define OUT_FRACTION_DROP 7 // q3.22 accumulator -> q1.15 output
+#define ACC_MAX ((1L << 25) - 1) // 26-bit signed accumulator limits
+#define ACC_MIN (-(1L << 25))
+
+
+/**
+ * @brief 8-tap Hamming windowed low-pass, cutoff 0.08 x sample rate
+ * All taps are positive and sum to exactly 1.0 (32768) for unity DC gain
+ */
+const int16_t current_filter_coeffs[CURRENT_FILTER_TAPS] = {
+	415, 1780, 5417, 8772, 8772, 5417, 1780, 415
+};
+
+
+/**
+ * @brief  Clear filter history
+ */
+void current_filter_init(CurrentFilter *filter)
+{
+	memset(filter, 0, sizeof(CurrentFilter));
+}
+
+
+/**
+ * @brief  Filter one sample
+ *         - Returns filtered value in the same scale as the input
+ */
+int16_t current_filter_step(CurrentFilter *filter, int16_t sample)
+{
+	int32_t acc = 0; // q3.22 accumulator
+	int32_t out;
+	uint8_t pos;
+
+	filter->index = (filter->index + 1) % CURRENT_FILTER_TAPS; // Newest sample overwrites the oldest
+	filter->history[filter->index] = sample;
+	pos = filter->index;
+
+	for (int k = 0; k < CURRENT_FILTER_TAPS; k++) // y[n] = sum b[k] x[n-k]
+	{
+		acc += ((int32_t)current_filter_coeffs[k] * filter->history[pos]) >> ACC_FRACTION_DROP;
+
+		if (acc > ACC_MAX) // Saturate to accumulator width
+		{
+			acc = ACC_MAX;
+		} else if (acc < ACC_MIN)
+		{
+			acc = ACC_MIN;
+		}
+
+		pos = (pos == 0) ? CURRENT_FILTER_TAPS - 1 : pos - 1;
+	}
+
+	out = (acc << CURRENT_FILTER_GAIN_SHIFT) >> OUT_FRACTION_DROP;
+
+	if (out > INT16_MAX) // Saturate output to q1.15
+	{
+		out = INT16_MAX;
+	} else if (out < INT16_MIN)
+	{
+		out = INT16_MIN;
+	}
+
+	filter->output = (int16_t)out;
+	return filter->output;
+}
+
+
+/**
+ * @brief  Filter a block of ADC codes
+ *         - output may be NULL if only the final value (filter->output) is needed
+ */
+void current_filter_block(CurrentFilter *filter, const uint16_t *samples, int16_t *output, uint16_t count)
+{
+	for (uint16_t i = 0; i < count; i++)
+	{
+		int16_t y = current_filter_step(filter, (int16_t)samples[i]);
+		if (output)
+		{
+			output[i] = y;
+		}
+	}
+}
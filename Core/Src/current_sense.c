@@ -0,0 +1,259 @@
+/**
+  ******************************************************************************
+  * @file           : current_sense.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "current_sense.h" // Include header file for current sensing functions
+#include "adc.h" // Include ADC handles for pack and balancing current
+#include "current_calibration.h" // Include offset and gain correction
+
+/*
+ * ADC1 (pack current, master) and ADC2 (balancing current, slave) run in dual
+ * regular simultaneous mode with hardware oversampling, so both currents are
+ * sampled at the same instant. The common data register packs both results in
+ * one word (ADC1 in the low half, ADC2 in the high half), which a single DMA
+ * channel stores in a circular buffer of two blocks. When a block completes:
+ *   - the block is handed to the FMAC by its write DMA channel, the FMAC only
+ *     uses the low half of each word, runs the FIR filter on pack current and
+ *     its read DMA channel stores the outputs, so no CPU time is spent per sample
+ *   - balancing current (high half) is filtered by the bit-exact software model
+ * With CURRENT_FILTER_USE_FMAC = 0 both streams use the software model.
+ *
+ * Both filters see exactly one block per callback, so the last output of a
+ * block always lands in pack_filtered[CURRENT_SENSE_BLOCK - 1]. The snapshot
+ * taken at the start of each callback therefore holds a time-coherent pair from
+ * the previous block.
+ */
+
+/* ***** DEFINE CONSTANTS ***** */
+// FMAC local memory layout (256 x 16-bit words)
+#define FMAC_X1_BASE 0 // Input samples
+#define FMAC_X1_SIZE (CURRENT_FILTER_TAPS + CURRENT_SENSE_BLOCK) // Taps + headroom for DMA bursts
+#define FMAC_X2_BASE (FMAC_X1_BASE + FMAC_X1_SIZE) // Coefficients
+#define FMAC_X2_SIZE CURRENT_FILTER_TAPS
+#define FMAC_Y_BASE (FMAC_X2_BASE + FMAC_X2_SIZE) // Output samples
+#define FMAC_Y_SIZE 8
+
+#define FMAC_FUNC_LOAD_X2 2 // Preload coefficients
+#define FMAC_FUNC_FIR 8 // Convolution (FIR filter)
+
+/* ***** GLOBAL VARIABLES ***** */
+static uint32_t dual_adc_buffer[2 * CURRENT_SENSE_BLOCK]; // Packed ADC1 / ADC2 circular DMA buffer
+static volatile CurrentSample snapshot; // Filtered pair at the end of the last completed block
+static volatile uint32_t block_count = 0; // Blocks latched since start
+static CurrentFilter pack_filter; // Software filter state for pack current
+static CurrentFilter balancing_filter; // Software filter state for balancing current
+
+#if CURRENT_FILTER_USE_FMAC
+static int16_t pack_filtered[CURRENT_SENSE_BLOCK]; // FMAC output, written by read DMA (circular)
+static DMA_HandleTypeDef hdma_fmac_write; // DMA1 channel 3, ADC block -> FMAC
+static DMA_HandleTypeDef hdma_fmac_read; // DMA1 channel 4, FMAC -> pack_filtered
+#endif
+
+
+#if CURRENT_FILTER_USE_FMAC
+/**
+ * @brief  Configure the FMAC as an FIR filter fed and drained by DMA
+ */
+static void fmac_init()
+{
+	__HAL_RCC_FMAC_CLK_ENABLE(); // Enable FMAC clock
+
+	FMAC->CR = FMAC_CR_RESET; // Reset FMAC state and buffers
+	while (FMAC->CR & FMAC_CR_RESET);
+
+	FMAC->X1BUFCFG = (FMAC_X1_BASE << FMAC_X1BUFCFG_X1_BASE_Pos) | (FMAC_X1_SIZE << FMAC_X1BUFCFG_X1_BUF_SIZE_Pos);
+	FMAC->X2BUFCFG = (FMAC_X2_BASE << FMAC_X2BUFCFG_X2_BASE_Pos) | (FMAC_X2_SIZE << FMAC_X2BUFCFG_X2_BUF_SIZE_Pos);
+	FMAC->YBUFCFG = (FMAC_Y_BASE << FMAC_YBUFCFG_Y_BASE_Pos) | (FMAC_Y_SIZE << FMAC_YBUFCFG_Y_BUF_SIZE_Pos);
+
+	// Preload coefficients into X2
+	FMAC->PARAM = (FMAC_FUNC_LOAD_X2 << FMAC_PARAM_FUNC_Pos) | (CURRENT_FILTER_TAPS << FMAC_PARAM_P_Pos) | FMAC_PARAM_START;
+	for (int k = 0; k < CURRENT_FILTER_TAPS; k++)
+	{
+		FMAC->WDATA = (uint16_t)current_filter_coeffs[k];
+	}
+	while (FMAC->PARAM & FMAC_PARAM_START); // Preload completes once all coefficients are written
+
+	// Write channel: memory (ADC block) -> FMAC WDATA, started per block
+	hdma_fmac_write.Instance = DMA1_Channel3;
+	hdma_fmac_write.Init.Request = DMA_REQUEST_FMAC_WRITE;
+	hdma_fmac_write.Init.Direction = DMA_MEMORY_TO_PERIPH;
+	hdma_fmac_write.Init.PeriphInc = DMA_PINC_DISABLE;
+	hdma_fmac_write.Init.MemInc = DMA_MINC_ENABLE;
+	hdma_fmac_write.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+	hdma_fmac_write.Init.MemDataAlignment = DMA_MDATAALIGN_WORD; // Whole packed word, FMAC ignores the upper half
+	hdma_fmac_write.Init.Mode = DMA_NORMAL;
+	hdma_fmac_write.Init.Priority = DMA_PRIORITY_LOW;
+	if (HAL_DMA_Init(&hdma_fmac_write) != HAL_OK)
+	{
+		Error_Handler();
+	}
+	DMA1_Channel3->CPAR = (uint32_t)&FMAC->WDATA;
+
+	// Read channel: FMAC RDATA -> pack_filtered, runs continuously
+	hdma_fmac_read.Instance = DMA1_Channel4;
+	hdma_fmac_read.Init.Request = DMA_REQUEST_FMAC_READ;
+	hdma_fmac_read.Init.Direction = DMA_PERIPH_TO_MEMORY;
+	hdma_fmac_read.Init.PeriphInc = DMA_PINC_DISABLE;
+	hdma_fmac_read.Init.MemInc = DMA_MINC_ENABLE;
+	hdma_fmac_read.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+	hdma_fmac_read.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+	hdma_fmac_read.Init.Mode = DMA_CIRCULAR;
+	hdma_fmac_read.Init.Priority = DMA_PRIORITY_LOW;
+	if (HAL_DMA_Init(&hdma_fmac_read) != HAL_OK)
+	{
+		Error_Handler();
+	}
+	HAL_DMA_Start(&hdma_fmac_read, (uint32_t)&FMAC->RDATA, (uint32_t)pack_filtered, CURRENT_SENSE_BLOCK);
+
+	FMAC->CR = FMAC_CR_DMAREN | FMAC_CR_DMAWEN; // Service both buffers by DMA
+
+	// Start FIR, it waits for input samples from the write channel
+	FMAC->PARAM = (FMAC_FUNC_FIR << FMAC_PARAM_FUNC_Pos) | (CURRENT_FILTER_TAPS << FMAC_PARAM_P_Pos)
+			| (CURRENT_FILTER_GAIN_SHIFT << FMAC_PARAM_R_Pos) | FMAC_PARAM_START;
+}
+
+
+/**
+ * @brief  Hand a block of packed ADC words to the FMAC write DMA channel
+ */
+static void fmac_feed(const uint32_t *block)
+{
+	DMA1_Channel3->CCR &= ~DMA_CCR_EN; // Channel must be disabled to reload it
+	DMA1_Channel3->CMAR = (uint32_t)block;
+	DMA1_Channel3->CNDTR = CURRENT_SENSE_BLOCK;
+	DMA1_Channel3->CCR |= DMA_CCR_EN;
+}
+#endif
+
+
+/**
+ * @brief  Calibrate ADCs, configure FMAC and start continuous sampling
+ */
+void current_sense_start()
+{
+	HAL_ADCEx_Calibration_Start(&hadc1, ADC_SINGLE_ENDED); // Calibrate ADC1 once before streaming
+	HAL_ADCEx_Calibration_Start(&hadc2, ADC_SINGLE_ENDED); // Calibrate ADC2 once before streaming
+
+	current_filter_init(&pack_filter);
+	current_filter_init(&balancing_filter);
+
+#if CURRENT_FILTER_USE_FMAC
+	fmac_init();
+#endif
+
+	HAL_ADCEx_MultiModeStart_DMA(&hadc1, dual_adc_buffer, 2 * CURRENT_SENSE_BLOCK); // Start master, slave follows
+}
+
+
+/**
+ * @brief  Hand a completed DMA half-buffer to the filters
+ *         - Called from the ADC half / full transfer callbacks
+ */
+void current_sense_block_ready(ADC_HandleTypeDef *hadc, int second_half)
+{
+	const uint32_t *block = &dual_adc_buffer[second_half ? CURRENT_SENSE_BLOCK : 0];
+
+	if (hadc->Instance != ADC1) // Only the master transfers data in dual mode
+	{
+		return;
+	}
+
+	// Both filters hold the last output of the previous block, latch it as a coherent pair
+#if CURRENT_FILTER_USE_FMAC
+	snapshot.pack_code = pack_filtered[CURRENT_SENSE_BLOCK - 1];
+#else
+	snapshot.pack_code = pack_filter.output;
+#endif
+	snapshot.balancing_code = balancing_filter.output;
+	block_count++;
+
+#if CURRENT_FILTER_USE_FMAC
+	fmac_feed(block);
+#endif
+
+	for (uint16_t i = 0; i < CURRENT_SENSE_BLOCK; i++)
+	{
+#if !CURRENT_FILTER_USE_FMAC
+		current_filter_step(&pack_filter, (int16_t)(block[i] & 0xFFFF)); // ADC1 result in low half
+#endif
+		current_filter_step(&balancing_filter, (int16_t)(block[i] >> 16)); // ADC2 result in high half
+	}
+}
+
+
+/**
+ * @brief  Latest time-coherent pair of filtered ADC codes
+ */
+CurrentSample current_sense_sample()
+{
+	CurrentSample sample;
+
+	__disable_irq(); // Callback may update the snapshot between the two reads
+	sample.pack_code = snapshot.pack_code;
+	sample.balancing_code = snapshot.balancing_code;
+	__enable_irq();
+
+	return sample;
+}
+
+
+/**
+ * @brief  Number of blocks filtered since start, changes whenever a new sample is latched
+ */
+uint32_t current_sense_block_count()
+{
+	return block_count;
+}
+
+
+/**
+ * @brief  Latest filtered pack current (mA), offset and gain corrected
+ */
+int32_t current_sense_pack_mA()
+{
+	return calibration_code_to_mA(CURRENT_CHANNEL_PACK, current_sense_sample().pack_code);
+}
+
+
+/**
+ * @brief  Latest filtered balancing current (mA), offset and gain corrected
+ */
+int32_t current_sense_balancing_mA()
+{
+	return calibration_code_to_mA(CURRENT_CHANNEL_BALANCING, current_sense_sample().balancing_code);
+}
+
+
+/**
+ * @brief  Latest filtered pack current (A)
+ */
+float current_sense_pack_current()
+{
+	return current_sense_pack_mA() / 1000.0f;
+}
+
+
+/**
+ * @brief  Latest filtered balancing current (A)
+ */
+float current_sense_balancing_current()
+{
+	return current_sense_balancing_mA() / 1000.0f;
+}
+
+
+/**
+ * @brief  Pack and balancing current (A) sampled at the same instant
+ */
+void current_sense_read(float *pack_current, float *balancing_current)
+{
+	CurrentSample sample = current_sense_sample();
+
+	*pack_current = calibration_code_to_mA(CURRENT_CHANNEL_PACK, sample.pack_code) / 1000.0f;
+	*balancing_current = calibration_code_to_mA(CURRENT_CHANNEL_BALANCING, sample.balancing_code) / 1000.0f;
+}
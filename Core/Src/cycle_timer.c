@@ -0,0 +1,49 @@
+/**
+  ******************************************************************************
+  * @file           : cycle_timer.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "cycle_timer.h" // Include header file for cycle timer functions
+
+/*
+ * Microsecond timing from the Cortex-M4 DWT cycle counter. HAL_Delay only has
+ * millisecond resolution, which is far longer than the switching dead times needed.
+ * The counter wraps every 25s at 170MHz, differences are taken modulo 2^32.
+ */
+
+
+/**
+ * @brief  Start the DWT cycle counter
+ *         - Must be called after SystemClock_Config() so SystemCoreClock is valid
+ */
+void cycle_timer_init()
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; // Enable trace and debug blocks (DWT)
+	DWT->CYCCNT = 0; // Reset counter
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk; // Start counting CPU cycles
+}
+
+
+/**
+ * @brief  Current CPU cycle count
+ */
+uint32_t cycle_timer_now()
+{
+	return DWT->CYCCNT;
+}
+
+
+/**
+ * @brief  Busy-wait for a number of microseconds
+ */
+void cycle_timer_delay_us(uint32_t us)
+{
+	uint32_t start = DWT->CYCCNT;
+	uint32_t cycles = us * (SystemCoreClock / 1000000); // Cycles per microsecond from the configured core clock
+
+	while ((DWT->CYCCNT - start) < cycles);
+}
@@ -0,0 +1,257 @@
+/**
+  ******************************************************************************
+  * @file           : fault_manager.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "fault_manager.h" // Include header file for fault manager functions
+#include "blackbox.h" // Include black-box capture trigger
+#include <stdio.h> // Include standard I/O functions
+
+/*
+ * Every protection check reports its condition once per sample through
+ * fault_report(). A fault is set after set_samples consecutive samples with the
+ * condition, so a single corrupted reading cannot stop the pack, and cleared
+ * after clear_samples consecutive samples without it. Latched faults are not
+ * cleared automatically: they stay active until fault_clear_latched() is called
+ * (console "fault clear") and their condition has been gone for clear_samples.
+ *
+ * Each fault has a fixed severity. main.c acts on the highest active severity:
+ * WARN only reports, DERATE stops balancing, OPEN_RELAY also opens the pack
+ * relay. Monitoring carries on in every state. Setting a DERATE or OPEN_RELAY
+ * fault triggers a black-box capture (see blackbox.c).
+ *
+ * The state is an array indexed by FaultId, active faults are kept as a bitmap
+ * and a count per severity, so reporting a sample, fault_severity() and
+ * fault_bitmap() are all O(1). After a warm reset fault_restore() brings the
+ * state back (see warm_start.c), so a latched fault still needs "fault clear".
+ */
+
+/* ***** FAULT TABLE ***** */
+static const FaultConfig config[FAULT_COUNT] = {
+	[FAULT_CELL_OVERVOLTAGE] = {"Cell overvoltage", FAULT_SEVERITY_OPEN_RELAY, 1, 3, 3},
+	[FAULT_CELL_UNDERVOLTAGE] = {"Cell undervoltage", FAULT_SEVERITY_OPEN_RELAY, 1, 3, 3},
+	[FAULT_PACK_OVERCURRENT] = {"Pack overcurrent", FAULT_SEVERITY_OPEN_RELAY, 1, 3, 3}, // Sampled per current sense block, set after about 100ms (3 x CURRENT_SENSE_BLOCK_MS)
+	[FAULT_CELL_HIGH] = {"Cell high", FAULT_SEVERITY_DERATE, 0, 2, 5},
+	[FAULT_CELL_LOW] = {"Cell low", FAULT_SEVERITY_WARN, 0, 2, 5},
+	[FAULT_MONITOR_READING] = {"Monitor reading", FAULT_SEVERITY_OPEN_RELAY, 1, 2, 3}, // Opens the relay when the cell monitor stops answering, no watchdog reset
+};
+
+/* ***** FAULT STATE ***** */
+static FaultState state[FAULT_COUNT];
+static uint32_t active_bits = 0; // Active faults, bit = FaultId
+static uint8_t severity_count[FAULT_SEVERITY_COUNT]; // Active faults of each severity
+
+
+/**
+ * @brief  Make a fault active
+ */
+static void set_fault(FaultId id)
+{
+	state[id].active = 1;
+	state[id].trips++;
+	active_bits |= 1UL << id;
+	severity_count[config[id].severity]++;
+	printf("Fault set: %s%s\n", config[id].name, config[id].latched ? " (latched)" : "");
+
+	if (config[id].severity >= FAULT_SEVERITY_DERATE) // Keep the samples leading up to faults that stop balancing
+	{
+		blackbox_trigger(id, active_bits);
+	}
+}
+
+
+/**
+ * @brief  Make a fault inactive
+ */
+static void clear_fault(FaultId id)
+{
+	state[id].active = 0;
+	active_bits &= ~(1UL << id);
+	severity_count[config[id].severity]--;
+	printf("Fault cleared: %s\n", config[id].name);
+}
+
+
+/**
+ * @brief  Debounce one sample of a fault condition
+ *         - id -> fault the sample belongs to
+ *         - condition -> non-zero if the fault condition is present in this sample
+ */
+void fault_report(FaultId id, int condition)
+{
+	FaultState *s = &state[id];
+	const FaultConfig *c = &config[id];
+
+	if (condition)
+	{
+		s->clear_count = 0;
+		if (s->set_count < c->set_samples)
+		{
+			s->set_count++;
+		}
+		if (s->set_count >= c->set_samples)
+		{
+			s->condition = 1;
+			if (!s->active)
+			{
+				set_fault(id);
+			}
+		}
+	} else {
+		s->set_count = 0;
+		if (s->clear_count < c->clear_samples)
+		{
+			s->clear_count++;
+		}
+		if (s->clear_count >= c->clear_samples)
+		{
+			s->condition = 0;
+			if (s->active && !c->latched)
+			{
+				clear_fault(id);
+			}
+		}
+	}
+}
+
+
+/**
+ * @brief  Highest severity among the active faults
+ */
+FaultSeverity fault_severity()
+{
+	for (int sev = FAULT_SEVERITY_COUNT - 1; sev > FAULT_SEVERITY_NONE; sev--)
+	{
+		if (severity_count[sev])
+		{
+			return (FaultSeverity)sev;
+		}
+	}
+	return FAULT_SEVERITY_NONE;
+}
+
+
+/**
+ * @brief  Check whether a fault is active
+ */
+int fault_is_active(FaultId id)
+{
+	return state[id].active;
+}
+
+
+/**
+ * @brief  Active faults, bit = FaultId
+ */
+uint32_t fault_bitmap()
+{
+	return active_bits;
+}
+
+
+/**
+ * @brief  Active faults held only by their latch, bit = FaultId
+ */
+uint32_t fault_latched_bitmap()
+{
+	uint32_t bits = 0;
+
+	for (int id = 0; id < FAULT_COUNT; id++)
+	{
+		if (state[id].active && config[id].latched && !state[id].condition)
+		{
+			bits |= 1UL << id;
+		}
+	}
+	return bits;
+}
+
+
+/**
+ * @brief  Clear latched faults whose condition has gone
+ *         - Returns the number of faults still active
+ */
+int fault_clear_latched()
+{
+	int remaining = 0;
+
+	for (int id = 0; id < FAULT_COUNT; id++)
+	{
+		if (!state[id].active)
+		{
+			continue;
+		}
+		if (config[id].latched && !state[id].condition)
+		{
+			clear_fault((FaultId)id);
+		} else {
+			remaining++;
+		}
+	}
+	return remaining;
+}
+
+
+/**
+ * @brief  Continue from a saved debounce state, e.g. after a warm reset (see warm_start.c)
+ *         - states -> FAULT_COUNT entries as returned by fault_state() before the reset
+ *         - Active faults stay active without a new black-box capture, latched ones still need "fault clear"
+ */
+void fault_restore(const FaultState *states)
+{
+	active_bits = 0;
+	for (int sev = 0; sev < FAULT_SEVERITY_COUNT; sev++)
+	{
+		severity_count[sev] = 0;
+	}
+
+	for (int id = 0; id < FAULT_COUNT; id++)
+	{
+		state[id] = states[id];
+		if (state[id].active)
+		{
+			active_bits |= 1UL << id;
+			severity_count[config[id].severity]++;
+			printf("Fault restored: %s%s\n", config[id].name, config[id].latched ? " (latched)" : "");
+		}
+	}
+}
+
+
+/**
+ * @brief  Behaviour of a fault
+ */
+const FaultConfig *fault_config(FaultId id)
+{
+	return &config[id];
+}
+
+
+/**
+ * @brief  Debounce state of a fault
+ */
+const FaultState *fault_state(FaultId id)
+{
+	return &state[id];
+}
+
+
+/**
+ * @brief  Export fault bitmaps, severity and trip counts over the serial monitor
+ *
+ *   $FAULT,<active bitmap hex>,<latched bitmap hex>,<severity>,<trips fault 0>,...,<trips fault FAULT_COUNT - 1>
+ * The latched bitmap holds the active faults that "fault clear" would clear
+ */
+void fault_print_report()
+{
+	printf("$FAULT,%02lX,%02lX,%d", (unsigned long)active_bits, (unsigned long)fault_latched_bitmap(), (int)fault_severity());
+	for (int id = 0; id < FAULT_COUNT; id++)
+	{
+		printf(",%lu", (unsigned long)state[id].trips);
+	}
+	printf("\n");
+}
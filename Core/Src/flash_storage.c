@@ -0,0 +1,286 @@
+/**
+  ******************************************************************************
+  * @file           : flash_storage.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "flash_storage.h" // Include header file for flash storage functions
+#include "pl455.h" // Include CRC16 checksum function
+#include <string.h> // Include string manipulation functions
+
+/*
+ * The NVM region reserved in the linker script is split into STORAGE_ID_COUNT
+ * record areas of STORAGE_PAGES_PER_RECORD flash pages. Each write appends a new
+ * copy of the record (header + payload, padded to a double-word) to the active
+ * page. When the active page is full the other page is erased and written, so a
+ * valid copy is always present. The copy with the highest sequence number wins.
+ * The region sits in bank 2, so programming does not stall code running from bank 1.
+ */
+
+/* ***** DEFINE CONSTANTS ***** */
+#define STORAGE_SLOT_ALIGN 8 // Flash is programmed in 64-bit double-words
+#define STORAGE_RECORD_AREA (FLASH_PAGE_SIZE * STORAGE_PAGES_PER_RECORD) // Bytes owned by each record id
+
+/**
+ * @brief Header stored in front of every record copy
+ */
+typedef struct {
+	uint16_t magic; // STORAGE_MAGIC when the slot has been programmed
+	uint16_t crc; // CRC16 over length, id, sequence and payload
+	uint16_t length; // Payload length (bytes)
+	uint16_t id; // Record identifier
+	uint32_t sequence; // Incremented on each write, highest is the latest copy
+} StorageHeader;
+
+/**
+ * @brief Result of scanning one page
+ */
+typedef struct {
+	uint32_t latest_offset; // Offset of the newest valid copy in the page
+	uint32_t latest_sequence; // Sequence number of the newest valid copy
+	uint32_t free_offset; // Offset of the first unprogrammed slot
+	int found; // 1 if the page holds a valid copy
+} PageScan;
+
+extern uint32_t _nvm_start[]; // Start of NVM region (defined in linker script)
+
+static uint64_t slot_buffer[(sizeof(StorageHeader) + STORAGE_MAX_PAYLOAD + STORAGE_SLOT_ALIGN - 1) / sizeof(uint64_t)]; // Record image before programming
+
+
+/**
+ * @brief  Round a slot length up to the flash programming granularity
+ */
+static uint32_t slot_size(uint16_t length)
+{
+	return (sizeof(StorageHeader) + length + STORAGE_SLOT_ALIGN - 1) & ~(STORAGE_SLOT_ALIGN - 1);
+}
+
+
+/**
+ * @brief  Address of a page belonging to a record id
+ */
+static uintptr_t page_address(StorageRecordId id, int page)
+{
+	return (uintptr_t)_nvm_start + (uint32_t)id * STORAGE_RECORD_AREA + (uint32_t)page * FLASH_PAGE_SIZE;
+}
+
+
+/**
+ * @brief  CRC16 of a record copy, header fields after the CRC are covered along with the payload
+ */
+static uint16_t record_crc(const StorageHeader *header)
+{
+	return CRC16((BYTE *)&header->length, sizeof(StorageHeader) - 4 + header->length);
+}
+
+
+/**
+ * @brief  Scan a page for the newest valid copy and the first free slot
+ */
+static PageScan scan_page(StorageRecordId id, int page)
+{
+	PageScan scan = {0};
+	uintptr_t base = page_address(id, page);
+	uint32_t offset = 0;
+
+	while (offset + sizeof(StorageHeader) <= FLASH_PAGE_SIZE)
+	{
+		const StorageHeader *header = (const StorageHeader *)(base + offset);
+
+		if (header->magic != STORAGE_MAGIC || header->length > STORAGE_MAX_PAYLOAD) // Erased or unusable slot ends the page
+		{
+			break;
+		}
+
+		if (header->id == id && record_crc(header) == header->crc && (!scan.found || header->sequence > scan.latest_sequence))
+		{
+			scan.found = 1;
+			scan.latest_offset = offset;
+			scan.latest_sequence = header->sequence;
+		}
+
+		offset += slot_size(header->length); // Skip to the next copy, including interrupted writes
+	}
+
+	// A slot that is neither erased nor valid means the remainder cannot be used
+	if (offset + sizeof(StorageHeader) <= FLASH_PAGE_SIZE && *(const uint16_t *)(base + offset) != 0xFFFF)
+	{
+		offset = FLASH_PAGE_SIZE;
+	}
+
+	scan.free_offset = offset;
+	return scan;
+}
+
+
+/**
+ * @brief  Erase one flash page
+ */
+static int erase_page(uintptr_t address)
+{
+	FLASH_EraseInitTypeDef erase = {0};
+	uint32_t page_error = 0;
+	uint32_t offset = (uint32_t)address - FLASH_BASE;
+
+	erase.TypeErase = FLASH_TYPEERASE_PAGES;
+	erase.Banks = (offset < FLASH_BANK_SIZE) ? FLASH_BANK_1 : FLASH_BANK_2; // Dual bank mode (DBANK = 1, default option byte)
+	erase.Page = (offset % FLASH_BANK_SIZE) / FLASH_PAGE_SIZE;
+	erase.NbPages = 1;
+
+	return (HAL_FLASHEx_Erase(&erase, &page_error) == HAL_OK) ? 0 : -1;
+}
+
+
+/**
+ * @brief  Read the latest valid copy of a record
+ *         - Returns 1 if a copy of the requested length was found, 0 otherwise
+ */
+int storage_read(StorageRecordId id, void *data, uint16_t len)
+{
+	PageScan scans[STORAGE_PAGES_PER_RECORD];
+	int best = -1;
+
+	for (int page = 0; page < STORAGE_PAGES_PER_RECORD; page++)
+	{
+		scans[page] = scan_page(id, page);
+		if (scans[page].found && (best < 0 || scans[page].latest_sequence > scans[best].latest_sequence))
+		{
+			best = page;
+		}
+	}
+
+	if (best < 0)
+	{
+		return 0; // No valid copy stored
+	}
+
+	const StorageHeader *header = (const StorageHeader *)(page_address(id, best) + scans[best].latest_offset);
+	if (header->length != len) // Stored layout does not match the caller's structure
+	{
+		return 0;
+	}
+
+	memcpy(data, header + 1, len); // Copy payload following the header
+	return 1;
+}
+
+
+/**
+ * @brief  Append a new copy of a record
+ *         - Returns 0 on success, -1 on flash error or oversized payload
+ */
+int storage_write(StorageRecordId id, const void *data, uint16_t len)
+{
+	PageScan scans[STORAGE_PAGES_PER_RECORD];
+	int active = 0;
+	uint32_t sequence = 0;
+	uintptr_t address;
+	uint32_t size = slot_size(len);
+	StorageHeader *header = (StorageHeader *)slot_buffer;
+	int result = 0;
+
+	if (len > STORAGE_MAX_PAYLOAD)
+	{
+		return -1;
+	}
+
+	// Find the page holding the newest copy, that is where the next copy is appended
+	for (int page = 0; page < STORAGE_PAGES_PER_RECORD; page++)
+	{
+		scans[page] = scan_page(id, page);
+		if (scans[page].found && scans[page].latest_sequence >= sequence)
+		{
+			sequence = scans[page].latest_sequence;
+			active = page;
+		}
+	}
+
+	// Build the record image, padding bytes are left erased (0xFF)
+	memset(slot_buffer, 0xFF, sizeof(slot_buffer));
+	header->magic = STORAGE_MAGIC;
+	header->length = len;
+	header->id = id;
+	header->sequence = sequence + 1;
+	memcpy(header + 1, data, len);
+	header->crc = record_crc(header);
+
+	HAL_FLASH_Unlock(); // Unlock flash control register
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS); // Clear any stale error flags
+
+	if (scans[active].free_offset + size > FLASH_PAGE_SIZE) // Active page full, move to the next page
+	{
+		active = (active + 1) % STORAGE_PAGES_PER_RECORD;
+		scans[active].free_offset = 0;
+		if (erase_page(page_address(id, active)) != 0)
+		{
+			result = -1;
+		}
+	}
+
+	address = page_address(id, active) + scans[active].free_offset;
+	for (uint32_t i = 0; result == 0 && i < size / sizeof(uint64_t); i++) // Program the record one double-word at a time
+	{
+		if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, (uint32_t)(address + i * sizeof(uint64_t)), slot_buffer[i]) != HAL_OK)
+		{
+			result = -1;
+		}
+	}
+
+	HAL_FLASH_Lock(); // Lock flash control register
+	return result;
+}
+
+
+/**
+ * @brief  Erase every page of a flash area outside the record slots (e.g. the chemistry profile partition)
+ *         - start and len must be page aligned
+ *         - Returns 0 on success, -1 on flash error
+ */
+int storage_erase_area(uintptr_t start, uint32_t len)
+{
+	int result = 0;
+
+	HAL_FLASH_Unlock(); // Unlock flash control register
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS); // Clear any stale error flags
+
+	for (uint32_t offset = 0; result == 0 && offset < len; offset += FLASH_PAGE_SIZE)
+	{
+		result = erase_page(start + offset);
+	}
+
+	HAL_FLASH_Lock(); // Lock flash control register
+	return result;
+}
+
+
+/**
+ * @brief  Program erased flash outside the record slots
+ *         - address must be double-word aligned, a partial last double-word is padded with 0xFF
+ *         - Returns 0 on success, -1 on flash error
+ */
+int storage_program(uintptr_t address, const void *data, uint32_t len)
+{
+	const uint8_t *bytes = data;
+	int result = 0;
+
+	HAL_FLASH_Unlock(); // Unlock flash control register
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS); // Clear any stale error flags
+
+	for (uint32_t offset = 0; result == 0 && offset < len; offset += sizeof(uint64_t))
+	{
+		uint64_t word = UINT64_MAX; // Erased value for padding
+		uint32_t chunk = (len - offset < sizeof(uint64_t)) ? len - offset : sizeof(uint64_t);
+
+		memcpy(&word, bytes + offset, chunk); // Source may be unaligned
+		if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, (uint32_t)(address + offset), word) != HAL_OK)
+		{
+			result = -1;
+		}
+	}
+
+	HAL_FLASH_Lock(); // Lock flash control register
+	return result;
+}
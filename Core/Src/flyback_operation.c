@@ -10,120 +10,370 @@
 #include "flyback_operation.h" // Include header file for flyback operation functions
 #include "tim.h" // Include timer library for PWM control
 #include <stdio.h> // Include standard input/output functions for debugging
-#include "adc.h" // Include ADC library for current sensing
+#include "current_sense.h" // Include filtered current sensing
+#include "switch_matrix.h" // Include switch matrix interlock
 #include "usart.h" // Include UART library for serial communication
 #include <string.h> // Include string manipulation functions
+#include "balancing_accounting.h" // Include charge and energy accounting
+#include "chemistry_profile.h" // Include balancing limits of the cell chemistry
 
 /* ***** GLOBAL VARIABLES ***** */
-float balancing_current_ADC_voltage; // Stores ADC voltage reading for balancing current measurement
-uint16_t balancing_current_ADC[1]; // Stores ADC raw value for balancing current measurement
 uint8_t buffer_ADC[32]; // Buffer for transmitting data via UART
 
+/* ***** POWER STAGE STATE ***** */
+static FlybackState state = FLYBACK_IDLE; // Current power stage state
+static FlybackRequest active_request; // Transfer currently being executed
+static FlybackResult last_result; // Summary of the last completed transfer
+static int duty_cycle = 0; // Current PWM duty cycle (%)
+static float ramp_setpoint = 0.0f; // Setpoint after soft-start / soft-stop ramp (A)
+static float ramp_start_setpoint = 0.0f; // Ramped setpoint when soft-stop began (A)
+static float derate_factor = 1.0f; // Derating factor from temperature and cell voltage (0 to 1)
+static float delivered_mAh = 0.0f; // Charge delivered during the running transfer (mAh)
+static uint32_t state_start_tick = 0; // Tick at which the current state was entered
+static uint32_t transfer_start_tick = 0; // Tick at which the transfer started
+static uint32_t last_control_tick = 0; // Tick of the last feedback loop iteration
+static int stop_requested = 0; // Flag set when an early soft stop is requested
+
 
 /**
- * @brief  Activates the flyback converter for 1A balancing current
- *
- * This function sets an initial PWM duty cycle for the flyback converter
- * and includes a feedback loop to adjust the duty cycle to maintain a
- * balancing current of 1A
+ * @brief  Feedforward duty cycle estimate for a given current
  */
-void flyback_1A_balance()
+static int duty_for_current(float current)
 {
-	int duty_cycle_1A = 28; // Initial PWM duty cycle for 1A current (28%)
+	int duty = FLYBACK_DUTY_FF_OFFSET + (int)(current * FLYBACK_DUTY_FF_SLOPE); // Linear duty cycle estimate
 
-	printf("\n********** Flyback Converter Activated **********\n"); // Print flyback operation message
-	TIM1->CCR1 = duty_cycle_1A; // Set PWM duty cycle
-	HAL_TIM_PWM_Start(&htim1, TIM_CHANNEL_1); // Start PWM on TIM1, Channel 1
+	if (duty > FLYBACK_DUTY_MAX) // Clamp to maximum duty cycle
+	{
+		duty = FLYBACK_DUTY_MAX;
+	}
+	return duty;
+}
 
-	HAL_Delay(1000); // 1 second delay for balancing current stabilisation
 
-	// Feedback loop to maintain 1A balancing current
-	for (int i = 0; i < 5; i++)
-	{
-		float balancing_current = read_balancing_current(); // Read measured output current
+/**
+ * @brief  Clamp a current setpoint to the converter and cell chemistry limits
+ */
+static float clamp_setpoint(float setpoint)
+{
+	float cell_max = chemistry_profile()->balance_max_mA / 1000.0f; // Highest current the cell accepts (A)
+	float max = (cell_max < FLYBACK_MAX_CURRENT) ? cell_max : FLYBACK_MAX_CURRENT;
 
-		printf("Balancing Current: %.2f A | PWM Duty Cycle: %d%%\n", balancing_current, duty_cycle_1A); // Print balancing current and duty cycle
+	if (setpoint < FLYBACK_MIN_CURRENT)
+	{
+		setpoint = FLYBACK_MIN_CURRENT;
+	}
+	if (setpoint > max) // Last, so the cell limit holds even below the converter minimum
+	{
+		setpoint = max;
+	}
+	return setpoint;
+}
 
-		// Adjust duty cycle based on current measurement (feedback loop)
-		if (balancing_current < 0.95) // If balancing current is smaller than 0.95A
-		{
-			duty_cycle_1A += 1; // Increase duty cycle by 1% to increase output current
-		} else if (balancing_current > 1.05) // Else if balancing current is larger than 1.05A
-		{
-			duty_cycle_1A -=1; // Decrease duty cycle by 1% to decrease output current
-		}
 
-		HAL_Delay(1000); // 1 second delay for next feedback cycle
+/**
+ * @brief  Linear derating factor between a start and stop limit (1 below start, 0 above stop)
+ */
+static float linear_derate(float value, float start, float stop)
+{
+	if (value <= start)
+	{
+		return 1.0f;
+	}
+	if (value >= stop)
+	{
+		return 0.0f;
 	}
+	return (stop - value) / (stop - start);
+}
 
+
+/**
+ * @brief  Enter a new power stage state and record the entry time
+ */
+static void enter_state(FlybackState new_state)
+{
+	state = new_state;
+	state_start_tick = HAL_GetTick();
 }
 
 
 /**
- * @brief  Activates the flyback converter for 4A balancing current
+ * @brief  Start an asynchronous balancing transfer
  *
- * Same as 1A function - this can be used as alternative for high balancing current flow
+ * The transfer soft-starts to the setpoint, regulates until the duration or
+ * charge target is met, then soft-stops. Progress is made by flyback_service()
+ * and completion is reported through flyback_complete_callback().
+ * The switch matrix must already drive the path to the target cell.
+ * Returns 0 if the transfer was started, -1 if busy, the request is invalid
+ * or the switch matrix read back does not match the target cell
  */
-void flyback_4A_balance()
+int flyback_start(const FlybackRequest *request)
 {
-	int duty_cycle_4A = 0.76; // Initial duty cycle for 4A current
+	if (state != FLYBACK_IDLE) // Only one transfer can run at a time
+	{
+		return -1;
+	}
+	if (request->duration_ms == 0 && request->charge_target_mAh <= 0.0f) // A transfer needs an end condition
+	{
+		return -1;
+	}
+	if (!switch_matrix_verify(request->target_cell)) // PWM only starts into the commanded, short-free path
+	{
+		return -1;
+	}
+
+	active_request = *request; // Store a copy of the request
+	active_request.setpoint = clamp_setpoint(request->setpoint); // Keep setpoint within converter limits
 
-	printf("***Flyback Converter Activated***\n"); // Print flyback operation message
-	TIM1->CCR1 = duty_cycle_4A; // Set PWM duty cycle
+	delivered_mAh = 0.0f;
+	ramp_setpoint = 0.0f;
+	stop_requested = 0;
+	duty_cycle = duty_for_current(0.0f); // Begin from the zero-current duty estimate
+
+	printf("\n********** Flyback Converter Activated (Cell %d, %.2fA) **********\n", active_request.target_cell, active_request.setpoint); // Print flyback operation message
+	TIM1->CCR1 = duty_cycle; // Set PWM duty cycle
 	HAL_TIM_PWM_Start(&htim1, TIM_CHANNEL_1); // Start PWM on TIM1, Channel 1
 
-	HAL_Delay(1000); // 1 second delay for balancing current stabilisation
+	transfer_start_tick = HAL_GetTick();
+	last_control_tick = transfer_start_tick;
+	enter_state(FLYBACK_RAMP_UP);
+
+	return 0;
+}
+
+
+/**
+ * @brief  Run the power stage state machine
+ *
+ * Non-blocking, must be called regularly from the main loop. Each control period
+ * the balancing current is measured, the ramped and derated setpoint is updated
+ * and the duty cycle is stepped by 1% towards it.
+ */
+void flyback_service()
+{
+	uint32_t now = HAL_GetTick();
+	uint32_t elapsed; // Time spent in the current state (ms)
+	float target; // Effective current setpoint after ramping and derating (A)
+	float balancing_current; // Measured output current (A)
+	float input_current; // Pack current sampled with the output current (A)
+	float ramp_down_mAh; // Charge the soft-stop will add from the present setpoint (mAh)
+
+	if (state == FLYBACK_IDLE || (now - last_control_tick) < FLYBACK_CONTROL_PERIOD_MS)
+	{
+		return; // Nothing to do until the next control period
+	}
+
+	if (!switch_matrix_verify(active_request.target_cell)) // Path changed underneath a running transfer
+	{
+		printf("Switch matrix state lost during transfer to Cell %d\n", active_request.target_cell);
+		terminate_flyback();
+		return;
+	}
+
+	current_sense_read(&input_current, &balancing_current); // Read output and input current from the same ADC sample
+	delivered_mAh += balancing_current * (float)(now - last_control_tick) / 3600.0f; // Integrate charge (A x ms / 3600 = mAh)
+	accounting_add_sample(active_request.target_cell, balancing_current, input_current, now - last_control_tick); // Feed charge and energy accounting
+	last_control_tick = now;
+
+	elapsed = now - state_start_tick;
 
-	// Feedback loop to maintain 4A balancing current
-	for (int i = 0; i < 10; i++)
+	switch (state)
 	{
-		float balancing_current = read_balancing_current(); // Read measured output current
+		case FLYBACK_RAMP_UP: // Soft-start, setpoint rises linearly over ramp_up_ms
+			if (elapsed >= active_request.ramp_up_ms)
+			{
+				ramp_setpoint = active_request.setpoint;
+				enter_state(FLYBACK_REGULATE);
+			} else {
+				ramp_setpoint = active_request.setpoint * (float)elapsed / (float)active_request.ramp_up_ms;
+			}
+			break;
 
-		printf("\nBalancing Current: %.2f A | PWM Duty Cycle: %d%%\n", balancing_current, duty_cycle_4A);  // Print balancing current and duty cycle
+		case FLYBACK_REGULATE: // Regulate until an end condition is met
+			ramp_setpoint = active_request.setpoint; // Follow live setpoint changes
+			ramp_down_mAh = ramp_setpoint * derate_factor * active_request.ramp_down_ms / 2.0f / 3600.0f; // Still delivered by the soft-stop
+			if (stop_requested
+					|| (active_request.duration_ms && elapsed >= active_request.duration_ms)
+					|| (active_request.charge_target_mAh > 0.0f && delivered_mAh + ramp_down_mAh >= active_request.charge_target_mAh)
+					|| derate_factor <= 0.0f)
+			{
+				ramp_start_setpoint = ramp_setpoint * derate_factor;
+				enter_state(FLYBACK_RAMP_DOWN);
+			}
+			break;
 
-		// Adjust duty cycle based on current measurement (feedback loop)
-		if (balancing_current < 3.8) // If balancing current is smaller than 3.8A
-		{
-			duty_cycle_4A += 1; // Increase duty cycle by 1% to increase output current
-		} else if (balancing_current > 4.2)  // Else if balancing current is larger than 4.2A
-		{
-			duty_cycle_4A -=1; // Decrease duty cycle by 1% to decrease output current
-		}
+		case FLYBACK_RAMP_DOWN: // Soft-stop, setpoint falls linearly over ramp_down_ms
+			if (elapsed >= active_request.ramp_down_ms)
+			{
+				HAL_TIM_PWM_Stop(&htim1, TIM_CHANNEL_1); // Stop PWM output on TIM1, Channel 1
 
-		HAL_Delay(1000); // 1 second delay for next feedback cycle
+				last_result.target_cell = active_request.target_cell;
+				last_result.charge_mAh = delivered_mAh;
+				last_result.active_ms = now - transfer_start_tick;
+				last_result.aborted = stop_requested || derate_factor <= 0.0f;
+				last_result.terminated = 0;
+
+				enter_state(FLYBACK_IDLE);
+				accounting_end_transfer(active_request.target_cell); // Close transfer, totals are persisted from the main loop
+				flyback_complete_callback(&last_result); // Report completion
+				return;
+			}
+			ramp_setpoint = ramp_start_setpoint * (float)(active_request.ramp_down_ms - elapsed) / (float)active_request.ramp_down_ms;
+			break;
+
+		default:
+			break;
 	}
 
+	target = ramp_setpoint;
+	if (state != FLYBACK_RAMP_DOWN) // Ramp-down already started from the derated value
+	{
+		target *= derate_factor;
+	}
+
+	// Adjust duty cycle based on current measurement (feedback loop)
+	if (balancing_current < target * (1.0f - FLYBACK_CURRENT_BAND)) // If balancing current is below the band
+	{
+		duty_cycle += 1; // Increase duty cycle by 1% to increase output current
+	} else if (balancing_current > target * (1.0f + FLYBACK_CURRENT_BAND)) // If balancing current is above the band
+	{
+		duty_cycle -= 1; // Decrease duty cycle by 1% to decrease output current
+	}
+
+	if (duty_cycle > FLYBACK_DUTY_MAX)
+	{
+		duty_cycle = FLYBACK_DUTY_MAX;
+	} else if (duty_cycle < 0)
+	{
+		duty_cycle = 0;
+	}
+
+	TIM1->CCR1 = duty_cycle; // Apply new PWM duty cycle
 }
 
 
 /**
- * @brief Read the balancing current using ADC measurement
+ * @brief  Change the current setpoint of the running transfer
  */
-float read_balancing_current()
+void flyback_set_setpoint(float setpoint)
+{
+	active_request.setpoint = clamp_setpoint(setpoint);
+}
+
+
+/**
+ * @brief  Request a soft stop of the running transfer
+ */
+void flyback_stop()
+{
+	stop_requested = 1;
+	if (state == FLYBACK_RAMP_UP) // Ramp down from wherever the soft-start reached
+	{
+		ramp_start_setpoint = ramp_setpoint * derate_factor;
+		enter_state(FLYBACK_RAMP_DOWN);
+	}
+}
+
+
+/**
+ * @brief  Update derating inputs
+ *         - temperature -> converter / pack temperature (degC)
+ *         - cell_voltage -> voltage of the cell receiving charge (V)
+ */
+void flyback_update_derating(float temperature, float cell_voltage)
+{
+	float temp_factor = linear_derate(temperature, FLYBACK_DERATE_TEMP_START, FLYBACK_DERATE_TEMP_STOP);
+	const ChemistryProfile *profile = chemistry_profile();
+	float volt_factor = linear_derate(cell_voltage, profile->derate_start_mv / 1000.0f, profile->derate_stop_mv / 1000.0f); // Limits depend on the cell chemistry
+
+	derate_factor = (temp_factor < volt_factor) ? temp_factor : volt_factor; // Most restrictive limit applies
+}
+
+
+/**
+ * @brief  Check whether a transfer is in progress
+ */
+int flyback_is_busy()
+{
+	return state != FLYBACK_IDLE;
+}
+
+
+/**
+ * @brief  Get current power stage state
+ */
+FlybackState flyback_get_state()
 {
-	uint16_t balancing_current_ADC[1]; // Variable to store ADC raw reading
-	float current; // Variable to store computed current value
+	return state;
+}
 
-	HAL_ADCEx_Calibration_Start(&hadc2, ADC_SINGLE_ENDED); // Calibrate ADC before use
 
-	HAL_ADC_Start_DMA(&hadc2, (uint32_t *)&balancing_current_ADC, 1); // Start ADC conversion via direct memory allocation (DMA)
+/**
+ * @brief  Cell receiving charge from the running transfer, 0 while idle
+ */
+int flyback_get_target()
+{
+	return (state != FLYBACK_IDLE) ? active_request.target_cell : 0;
+}
+
 
-	balancing_current_ADC_voltage = ((float)(*balancing_current_ADC) / 4096.0) * 3.3; // Calculate voltage: 4096 for 12-bit, 3.3 for STM32 input range
+/**
+ * @brief  Get summary of the last completed transfer
+ */
+const FlybackResult *flyback_get_result()
+{
+	return &last_result;
+}
+
+
+/**
+ * @brief  Transfer completion callback
+ *
+ * Called from flyback_service() once the PWM has been stopped, and from
+ * terminate_flyback() during fault handling, where an override must not print
+ * or wait. Override in application code to be notified of completion.
+ */
+__weak void flyback_complete_callback(const FlybackResult *result)
+{
+	if (result->terminated) // Reported by whoever terminated it
+	{
+		return;
+	}
+	printf("PWM Terminated! Cell %d received %.2fmAh in %lums%s\n", result->target_cell, result->charge_mAh, (unsigned long)result->active_ms, result->aborted ? " (stopped early)" : ""); // Print transfer summary
+}
 
-	current = (balancing_current_ADC_voltage / 20) / 0.005; // Convert voltage to current (20V/V gain, 5mΩ shunt resistor)
 
-	return current; // Return calculated current value
+/**
+ * @brief Read the balancing current using ADC measurement
+ *        - Filtered value from the continuous ADC stream (see current_sense.c)
+ */
+float read_balancing_current()
+{
+	return current_sense_balancing_current(); // Latest filtered balancing current (A)
 }
 
 
 /**
- * @brief  Stop the flyback converter operation
+ * @brief  Immediately stop the flyback converter operation (no soft-stop)
+ *         - Closes a running transfer like a completed one, marked terminated
+ *         - Does not print or wait, so fault handling can carry on straight away
  */
 void terminate_flyback()
 {
 	HAL_TIM_PWM_Stop(&htim1, TIM_CHANNEL_1); // Stop PWM output on TIM1, Channel 1
-	printf("PWM Terminated!\n"); // Print termination message
 
-	HAL_Delay(500); // 500ms delay before next voltage readings
-}
+	if (state == FLYBACK_IDLE)
+	{
+		return;
+	}
+
+	last_result.target_cell = active_request.target_cell;
+	last_result.charge_mAh = delivered_mAh;
+	last_result.active_ms = HAL_GetTick() - transfer_start_tick;
+	last_result.aborted = 1;
+	last_result.terminated = 1;
 
+	enter_state(FLYBACK_IDLE); // Abandon the running transfer
+	accounting_end_transfer(active_request.target_cell); // Close transfer, totals are persisted from the main loop
+	flyback_complete_callback(&last_result); // Report completion
+}
@@ -18,49 +18,73 @@
 #include "stm32g4xx_hal.h" // standard HAL library for STM32G4 series
 #include <stdio.h> // Standard input/output functions
 #include <stdlib.h> // Standard library functions (e.g. printf)
-#include "molicel_soc_lookup.h" // Lookup table for Molicel P45B SOC vs OCV values
 #include <string.h> // String manipulation functions
-#include <math.h> // Maths library (for sqrt function in std dev determination)
 #include "active_balancing.h" // Active balancing algorithm
 #include"pack_config.h" // Battery pack configuration
+#include "balancing_accounting.h" // Balancing charge and energy accounting
+#include "current_sense.h" // Filtered pack and balancing current
+#include "current_calibration.h" // Current sense offset and gain calibration
+#include "cycle_timer.h" // Microsecond delays from the DWT cycle counter
+#include "balancing_sequencer.h" // Non-blocking balancing sequencer
+#include "ocv_model.h" // Temperature and hysteresis aware OCV model
+#include "chemistry_profile.h" // Cell chemistry profile (OCV surface and limits)
+#include "serial_console.h" // Serial monitor commands
+#include "soc_ekf.h" // Kalman filter SOC estimator
+#include "flyback_operation.h" // Balancing transfer target and current
+#include "pack_stats.h" // Streaming pack statistics
+#include "balancing_planner.h" // Multi-cell balancing planner
+#include "balancing_trigger.h" // Hysteretic balancing start and stop
+#include "balancing_policy.h" // Pack activity aware balancing modes
+#include "cell_health.h" // Per-cell capacity and resistance estimates
+#include "cell_convert.h" // Batch conversion of cell monitor codes
+#include "fault_manager.h" // Debounced, latching faults with severities
+#include "blackbox.h" // Pre-trigger capture of samples around faults
+#include "watchdog.h" // Independent watchdog supervision of the periodic tasks
+#include "warm_start.h" // State retained over resets without power loss
+#include "boot_sequencer.h" // Overlapped, timed start-up steps
 
 
 /* ***** DEFINE CONSTANT ***** */
 
-#define STD_DEV_SOC_THRESH 5.0 // Standard deviation threshold for triggering balancing (in percentage), changed based on balancing reqs
+#define MONITOR_PERIOD_MS 2000 // Period of the cell monitoring cycle (ms)
 
 
 /* ***** DEFINE GLOBAL VARIABLES ***** */
 
 BYTE  recFrame[132]; // Buffer for receiving data from cell monitor IC
-uint16_t pack_current_ADC[1]; // Array to store ADC reading for pack current
+volatile uint32_t monitor_frames = 0; // Frames received from the cell monitor IC, counted by HAL_UART_RxCpltCallback()
+int reading_fresh = 0; // 1 if the last reading converted a frame received after its request
 uint8_t buffer[100];  // Buffer for transmitting data via UART
 uint8_t recvBuf[1]; // Buffer for receiving data via UART
 
-// Fault status variables
-int fault_status = 0; // Fault status flag, initially set to 0 for no error
-const float undervolt_thresh = 2.5; // Cell undervoltage threshold
-const float overvolt_thresh = 4.2; // Cell overvoltage threshold
-const float current_thresh = 1.0; // Pack max current threshold
-
-// First reading
-int first_reading = 1; // Flag to ignore first set of readings from cell monitor IC
-int check_first_reading(int *first_reading); // Function prototype for checking first readings
+// Fault variables
+const float current_thresh = PACK_MAX_CURRENT_A; // Pack max current threshold (see pack_config.h)
+uint32_t last_current_block = 0; // Current sense block last checked for overcurrent
+uint32_t last_blackbox_tick = 0; // Tick of the last black-box sample
+uint32_t retained_fault_bits = 0; // Active faults when the state was last retained over resets
 
 // User button
 int button_press = 0; // Flag for user button press
 
 // Voltage readings
 float volt[6]; // Array to store voltage readings for each cell
+uint32_t cell_uv[NOC]; // Cell voltages (uV), as read before conversion to float
+
+// Pack temperature
+float pack_temperature = 25.0; // Pack temperature in degC (no sensor fitted, nominal value used for derating)
 
 // Pack current
-float pack_ADC_voltage; // Variable to store pack current ADC voltage
 float pack_current; // Variable to store pack current in Amps
 
 // State of Charge (SOC)
-float soc_values[NOC]; // Array to store SOC values for each cell
-float mean_soc = 0.0; // Mean SOC value
-float std_dev_soc = 0.0; // Standard deviation of SOC
+float soc_values[NOC]; // Array to store SOC values for each cell (Kalman filter estimate)
+float ocv_soc_values[NOC]; // Array to store SOC values looked up from the OCV model
+uint32_t last_soc_tick = 0; // Tick of the last SOC estimator update
+float usable_values[NOC]; // Usable charge of each cell, SOC x estimated capacity as % of rated capacity (see cell_health.c)
+float mean_soc = 0.0; // Mean usable charge (% of rated capacity), the capacity weighted pack SOC
+float std_dev_soc = 0.0; // Standard deviation of usable charge (% of rated capacity)
+PackStats soc_stats; // Streaming usable charge statistics shared with the balancing algorithm
+int soc_stats_ready = 0; // Flag set once soc_stats holds a full set of values
 
 
 /* ***** SYSTEM CLOCK ***** */
@@ -68,42 +92,61 @@ float std_dev_soc = 0.0; // Standard deviation of SOC
 void SystemClock_Config(void); // Function to configure system clock
 
 
-/** @brief  Function to initialise the cell monitor IC
-  *         - Configures fault registers, voltage thresholds, pack configuration and auto-addressing
-  */
-void init_chip()
-{
-    printf("IC initialisation\n"); // Print initialisation message to serial monitor
+/* ***** CELL MONITOR CONFIGURATION ***** */
 
+static const ChipRegWrite chip_config[] = {
 	// Mask and clear IC fault registers
-	WriteReg(0, 107, 0x8000, 2, FRMWRT_SGL_NR); // Mask chip FAULT
-	WriteReg(0, 82, 0xFFC0, 2, FRMWRT_SGL_NR); // Clear fault summary flags
-	WriteReg(0, 81, 0x38, 1, FRMWRT_SGL_NR); // Clear system status fault flags
+	{107, 0x8000, 2, FRMWRT_SGL_NR, 0}, // Mask chip FAULT
+	{82, 0xFFC0, 2, FRMWRT_SGL_NR, 0}, // Clear fault summary flags
+	{81, 0x38, 1, FRMWRT_SGL_NR, 0}, // Clear system status fault flags
 
 	// Set cell over-voltage and cell under-voltage thresholds (also later done in print_cell_voltages() function)
-	WriteReg(0, 144, 0xD1EC, 2, FRMWRT_SGL_NR); // set OV threshold = 4.1000V
-	WriteReg(0, 142, 0x6148, 2, FRMWRT_SGL_NR); // set UV threshold = 1.9000V
+	{144, 0xD1EC, 2, FRMWRT_SGL_NR, 0}, // set OV threshold = 4.1000V
+	{142, 0x6148, 2, FRMWRT_SGL_NR, 0}, // set UV threshold = 1.9000V
 
 	// Auto-address all boards
-	WriteReg(0, 14, 0x38, 1, FRMWRT_ALL_NR); // Set auto-address mode, internal regulator NPN disabled
-	WriteReg(0, 12, 0x08, 1, FRMWRT_ALL_NR); // Enter auto-address mode
-
-	WriteReg(0, 16, 0x1080, 2, FRMWRT_SGL_NR);	// Enable single-end communication
+	{14, 0x38, 1, FRMWRT_ALL_NR, 0}, // Set auto-address mode, internal regulator NPN disabled
+	{12, 0x08, 1, FRMWRT_ALL_NR, 0}, // Enter auto-address mode
 
-	delayms(10); // 10ms delay for settings to take effect
+	{16, 0x1080, 2, FRMWRT_SGL_NR, 10}, // Enable single-end communication, 10ms delay for settings to take effect
 
-	WriteReg(0, 60, 0x00, 1, FRMWRT_SGL_NR); // Set 0 mux delay
-	WriteReg(0, 61, 0x00, 1, FRMWRT_SGL_NR); // Set 0 initial delay
-	WriteReg(0, 62, 0xCC, 1, FRMWRT_SGL_NR); // Set 99.92us ADC sampling period
-	WriteReg(0, 7, 0x00, 1, FRMWRT_SGL_NR); // Set no oversampling period
+	{60, 0x00, 1, FRMWRT_SGL_NR, 0}, // Set 0 mux delay
+	{61, 0x00, 1, FRMWRT_SGL_NR, 0}, // Set 0 initial delay
+	{62, 0xCC, 1, FRMWRT_SGL_NR, 0}, // Set 99.92us ADC sampling period
+	{7, 0x00, 1, FRMWRT_SGL_NR, 0}, // Set no oversampling period
 
 	// Select number of cells to sample
-	WriteReg(0, 13, 0x06, 1, FRMWRT_SGL_NR); // Set number of cells to 6
-	WriteReg(0, 3, 0x003F0000, 4, FRMWRT_SGL_NR); // Enable 6 cell voltage measurements only
+	{13, 0x06, 1, FRMWRT_SGL_NR, 0}, // Set number of cells to 6
+	{3, 0x003F0000, 4, FRMWRT_SGL_NR, 0}, // Enable 6 cell voltage measurements only
+
+	{107, 0x8000, 2, FRMWRT_SGL_NR, 0}, // Mask chip FAULT
+	{82, 0xFFC0, 2, FRMWRT_ALL_NR, 0}, // clear all fault summary flags
+	{81, 0x38, 1, FRMWRT_ALL_NR, 0}, // clear fault flags in the system status register
+};
+
+#define CHIP_CONFIG_WRITES ((int)(sizeof(chip_config) / sizeof(chip_config[0])))
+
 
-	WriteReg(0, 107, 0x8000, 2, FRMWRT_SGL_NR); // Mask chip FAULT
-	WriteReg(0, 82, 0xFFC0, 2, FRMWRT_ALL_NR); // clear all fault summary flags
-	WriteReg(0, 81, 0x38, 1, FRMWRT_ALL_NR); // clear fault flags in the system status register
+/** @brief  Function to initialise the cell monitor IC
+  *         - Configures fault registers, voltage thresholds, pack configuration and auto-addressing
+  *         - The writes are kept as a shadow so a warm boot can skip them (see warm_start.c)
+  */
+void init_chip()
+{
+    printf("IC initialisation\n"); // Print initialisation message to serial monitor
+
+	warm_start_set_chip(chip_config, 0); // Not configured until the last write
+	for (int i = 0; i < CHIP_CONFIG_WRITES; i++)
+	{
+		const ChipRegWrite *w = &chip_config[i];
+
+		WriteReg(0, w->addr, w->value, w->len, w->type);
+		if (w->delay_ms)
+		{
+			delayms(w->delay_ms);
+		}
+	}
+	warm_start_set_chip(chip_config, CHIP_CONFIG_WRITES);
 }
 
 
@@ -134,6 +177,11 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 {
 	if(GPIO_Pin == GPIO_PIN_13) // If user blue button is pressed
 	{
+		if (fault_severity() >= FAULT_SEVERITY_OPEN_RELAY) // Relay stays open until the fault is cleared
+		{
+			printf("Pack relay kept open - clear faults first ($FAULT, \"fault clear\")\n");
+			return;
+		}
 		button_press = 1; // Set button press flag
 		HAL_GPIO_WritePin(GPIOA, PACK_ENABLE_Pin, GPIO_PIN_SET); // Close pack relay
 		printf("Pack relay closed...\n"); // Print message to serial monitor
@@ -148,47 +196,212 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
  */
 void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
 {
+	monitor_frames++; // A complete frame is in recFrame
 	HAL_UART_Receive_IT(&huart3, recFrame, 15); // Re-enable UART receive interrupt for continuous data reception
 }
 
 
 /**
- * @brief  Checks if a critical fault has been detected and takes necessary action
+ * @brief  Act on the highest severity of the active faults (see fault_manager.c), call from main loop
+ * 		   - Open relay: open the pack relay first, then stop balancing, monitoring carries on
+ * 		   - Derate: balancing is held off by the main loop and assess_equalisation()
  */
 void fault_flag_status()
 {
-	if (fault_status) // Check fault status flag
+	if (fault_severity() < FAULT_SEVERITY_OPEN_RELAY)
+	{
+		return;
+	}
+
+	HAL_GPIO_WritePin(GPIOA, PACK_ENABLE_Pin, GPIO_PIN_RESET); // Open pack relay (disable relay GPIO) before anything that prints or waits
+
+	if (button_press || sequencer_is_busy() || flyback_is_busy() || planner_is_active())
+	{
+		planner_stop(); // No further balancing steps
+		sequencer_abort(); // Stop the flyback converter and open the switch matrix
+		printf("CRITICAL Fault Detected! Balancing stopped and relay opened\n"); // Print error message
+	}
+	button_press = 0; // Pack current is no longer measured
+}
+
+
+/**
+ * @brief  Retain the estimator and fault state over a reset without power loss (see warm_start.c)
+ */
+void retain_state()
+{
+	warm_start_save();
+	retained_fault_bits = fault_bitmap();
+}
+
+
+/**
+ * @brief  Continue from the state retained over a warm reset (see warm_start.c), boot step after the modules it restores
+ */
+void restore_retained_state()
+{
+	warm_start_restore(pack_temperature);
+}
+
+
+/**
+ * @brief  Update SOC of every cell
+ * 		   - OCV lookup for the pack temperature and each cell's hysteresis branch (see ocv_model.c)
+ * 		   - Kalman filter on the cell voltage and current, started from the first OCV lookup (see soc_ekf.c)
+ * 		   - Capacity and resistance estimates, and the usable charge balancing works on (see cell_health.c)
+ */
+void update_soc_estimates()
+{
+	float cell_current[NOC]; // Current through each cell, positive discharges (A)
+	float pack_i, balancing_i; // Pack and balancing current sampled together (A)
+	int target = flyback_get_target(); // Cell receiving balancing charge, 0 if none
+	uint32_t now = HAL_GetTick();
+	uint32_t dt_ms = soc_ekf_is_initialised() ? now - last_soc_tick : 0; // Time since the previous update, 0 on the first
+
+	ocv_model_update(cell_uv, pack_temperature, ocv_soc_values);
+
+	current_sense_read(&pack_i, &balancing_i);
+	for (int i = 0; i < NOC; i++)
+	{
+		cell_current[i] = pack_i - ((target == NOC - i) ? balancing_i : 0.0f); // Target cell is charged by the flyback output
+	}
+
+	if (!soc_ekf_is_initialised())
+	{
+		soc_ekf_init(ocv_soc_values, pack_temperature);
+	} else {
+		soc_ekf_update(volt, cell_current, dt_ms / 1000.0f, pack_temperature);
+	}
+	cell_health_update(volt, cell_current, ocv_soc_values, dt_ms);
+
+	last_soc_tick = now;
+	soc_ekf_get_soc(soc_values);
+	cell_health_usable(soc_values, usable_values);
+
+	if (!soc_stats_ready)
+	{
+		pack_stats_init(&soc_stats, usable_values, NOC);
+		soc_stats_ready = 1;
+	} else {
+		for (int i = 0; i < NOC; i++)
+		{
+			pack_stats_update(&soc_stats, i, usable_values[i]); // Only cells whose value changed cost anything
+		}
+	}
+}
+
+
+/**
+ * @brief  Request, receive and convert a reading of every cell from the monitoring IC
+ * 		   - The receive is armed into recFrame, then re-armed there by HAL_UART_RxCpltCallback(), so every reading is converted
+ * 		   - A reading without a frame received after the request converts the previous frame and is marked stale
+ */
+void read_cell_voltages()
+{
+	uint32_t frames = monitor_frames; // Frames received before the request
+
+	req_cell_volt(); // Request cell voltage readings
+
+	ReadResp(recFrame, 15); // Trigger UART receive from IC, 15 bytes of data expected (see pl455.c), busy once armed
+
+	HAL_Delay(10); // Small 10ms delay after receiving data
+
+	reading_fresh = (monitor_frames != frames); // The IC answered this request
+
+	cell_convert_codes(recFrame + 1, NOC, cell_uv, volt); // Convert the whole stack from the response data in one pass (see cell_convert.c)
+}
+
+
+/**
+ * @brief  Check the last reading is fresh and every cell of it is plausible
+ * 		   - A failed or missing reading returns 0
+ */
+int cell_reading_plausible()
+{
+	int valid = reading_fresh;
+
+	for (int i = 0; i < NOC; i++)
+	{
+		valid &= (cell_uv[i] >= FAULT_READING_MIN_MV * 1000UL);
+	}
+	return valid;
+}
+
+
+/**
+ * @brief  Take a reading and check the cell monitor answered with plausible voltages, no fault is reported
+ */
+int cell_monitor_responding()
+{
+	read_cell_voltages();
+	return cell_reading_plausible();
+}
+
+
+/**
+ * @brief  Check the cell monitor returned a fresh, plausible reading for every cell
+ * 		   - A failed reading returns 0, which must not count as undervoltage
+ * 		   - Failed readings in a row set a latched fault that opens the relay, the cells are not protected without readings
+ */
+int cell_reading_valid()
+{
+	int valid = cell_reading_plausible();
+
+	fault_report(FAULT_MONITOR_READING, !valid);
+
+	if (!valid)
 	{
-		printf("CRITICAL Fault Detected! Relay Opened ... Program Terminated\n"); // Print error message
-		HAL_GPIO_WritePin(GPIOA, PACK_ENABLE_Pin, GPIO_PIN_RESET); // Open pack relay (disable relay GPIO)
-		exit(1); // Terminate program execution, microcontroller must be reset to restart
+		printf("Skipping %s cell monitor reading...\n", reading_fresh ? "invalid" : "missing"); // Print status message
 	}
+	return valid;
 }
 
 
 /**
  * @brief  Print cell voltages and SOC values to the serial monitor
- * 		   - Also check for under/overvoltage and update fault status flag
+ * 		   - Also report under/overvoltage and near-limit cells to the fault manager
  */
 void print_cell_voltages()
 {
+	const ChemistryProfile *profile = chemistry_profile();
+	float undervolt_thresh = profile->cell_min_mv / 1000.0f; // Cell undervoltage threshold from the chemistry profile (V)
+	float overvolt_thresh = profile->cell_max_mv / 1000.0f; // Cell overvoltage threshold from the chemistry profile (V)
+	float high_thresh = profile->derate_stop_mv / 1000.0f; // No balancing current left at this voltage (V)
+	float low_thresh = (profile->cell_min_mv + FAULT_CELL_LOW_MARGIN_MV) / 1000.0f; // Warn before undervoltage (V)
+	int overvolt = 0, undervolt = 0, high = 0, low = 0; // Any cell in each condition this cycle
+
 	printf("\n**************** MONITORING STATUS ****************\n"); // Print message for readability
 
+	update_soc_estimates(); // OCV lookup and Kalman filter SOC for every cell
+
 	for (int i = 0; i < NOC; i++) // Iterate through all monitored cells
 	{
-		soc_values[i] = volt_to_soc(volt[i]); // Convert voltage reading to SOC (see molicel_soc_lookup.c)
-
-		printf( "Cell %d Voltage: %.3fV | SOC = %.1f%%\n", NOC - i, volt[i], soc_values[i]); // Print cell voltages 1 to 6
+		printf( "Cell %d Voltage: %.3fV | SOC = %.1f%% (OCV %.1f%%, %s)\n", NOC - i, volt[i], soc_values[i], ocv_soc_values[i],
+				(ocv_model_get_branch(i) == OCV_BRANCH_CHARGE) ? "charge" : "discharge"); // Print cell voltages 1 to 6
 
 		if (volt[i] > overvolt_thresh) // If cell voltage is greater than overvoltage threshold
 		{
 			printf("Cell %d OVERVOLTAGE ERROR: %.3fV (Threshold: %.1fV)\n", NOC - i, volt[i], overvolt_thresh); // Print error message
-			fault_status = 1; // Update fault status flag
+			overvolt = 1;
 		} else if (volt[i] < undervolt_thresh) {
 			printf("Cell %d UNDERVOLTAGE ERROR: %.3fV (Threshold: %.1fV)\n", NOC - i, volt[i], undervolt_thresh); // Print error message
-			fault_status = 1; // Update fault status flag
+			undervolt = 1;
 		}
+		high |= (volt[i] >= high_thresh);
+		low |= (volt[i] < low_thresh);
+	}
+
+	fault_report(FAULT_CELL_OVERVOLTAGE, overvolt); // One sample per monitoring cycle (see fault_manager.c)
+	fault_report(FAULT_CELL_UNDERVOLTAGE, undervolt);
+	fault_report(FAULT_CELL_HIGH, high);
+	fault_report(FAULT_CELL_LOW, low);
+
+	if (ocv_model_branches_changed()) // Branches only move on a voltage reversal, "ocv" on the console prints them on demand
+	{
+		ocv_model_print_report(); // Export OCV model cost and branches
 	}
+	soc_ekf_print_report(); // Export SOC estimates and estimator cost
+	cell_health_print_report(); // Export capacity and resistance estimates
 }
 
 
@@ -199,13 +412,7 @@ void measure_pack_current()
 {
 	if (button_press) // If button_press flag is set to 1 (from interrupt)
 	{
-		HAL_ADCEx_Calibration_Start(&hadc1, ADC_SINGLE_ENDED); // Calibrate ADC1
-
-		HAL_ADC_Start_DMA(&hadc1, (uint32_t *)&pack_current_ADC, 1); // Start ADC conversion via direct memory allocation (DMA)
-
-		pack_ADC_voltage = ((float)(*pack_current_ADC) / 4096.0) * 3.3; // Calculate voltage: 4096 for 12-bit, 3.3 for STM32 input range
-
-		pack_current = pack_ADC_voltage / 0.5; // Calculate pack current in Amps (20V/V gain from current sense amplifier)
+		pack_current = current_sense_pack_current(); // Latest filtered pack current in Amps (see current_sense.c)
 
 		sprintf((char*)buffer, "\n************* Pack current: %.3fA\r *************\n", pack_current); // Store pack_current in UART buffer
 		HAL_UART_Transmit(&hlpuart1, buffer, strlen((char*)buffer), HAL_MAX_DELAY); // Transmit to serial monitor via UART 1
@@ -215,89 +422,183 @@ void measure_pack_current()
 
 /**
  * @brief  Check if the pack current exceeds the predefined threshold
+ * 		   - One sample per filtered current sense block, so the fault is debounced over blocks, not monitoring cycles
  */
 void pack_overcurrent_check()
 {
-	if (pack_current > current_thresh) // If measured current is greater than threshold (set to 1A)
+	uint32_t block = current_sense_block_count();
+	float current;
+
+	if (block == last_current_block) // No new block since the last check
+	{
+		return;
+	}
+	last_current_block = block;
+
+	current = current_sense_pack_current();
+	if (current > current_thresh && !fault_is_active(FAULT_PACK_OVERCURRENT)) // If measured current is greater than threshold (PACK_MAX_CURRENT_A)
 	{
-		printf("PACK OVERCURRENT ERROR: %.3fA (Threshold: %.1fA)\n", pack_current, current_thresh); // Print error message
-		fault_status = 1; // Set fault flag to 1
+		printf("PACK OVERCURRENT ERROR: %.3fA (Threshold: %.1fA)\n", current, current_thresh); // Print error message
 	}
+	fault_report(FAULT_PACK_OVERCURRENT, current > current_thresh);
 }
 
+
 /**
- * @brief  Skips the first reading from the cell monitor IC
- *         - First reading is always invalid (returns 0)
- *         - Triggers undervoltage fault even when not present
+ * @brief  Add the latest cell voltages, currents and balancing state to the black box (see blackbox.c)
  */
-int check_first_reading(int *first_reading)
+void record_blackbox_sample()
 {
-	if (*first_reading) // Check if first reading flag is set
+	BlackboxSample sample;
+	uint8_t flags = 0;
+
+	sample.tick_ms = HAL_GetTick();
+	for (int i = 0; i < NOC; i++)
+	{
+		sample.cell_mv[i] = (uint16_t)(cell_uv[i] / 1000); // Latest monitoring cycle
+	}
+	sample.pack_mA = (int16_t)current_sense_pack_mA();
+	sample.balancing_mA = (int16_t)current_sense_balancing_mA();
+	sample.target = (uint8_t)flyback_get_target();
+	sample.mode = (uint8_t)policy_mode();
+
+	if (HAL_GPIO_ReadPin(GPIOA, PACK_ENABLE_Pin) == GPIO_PIN_SET)
+	{
+		flags |= BLACKBOX_FLAG_RELAY;
+	}
+	if (sequencer_is_busy())
+	{
+		flags |= BLACKBOX_FLAG_SEQUENCER;
+	}
+	if (planner_is_active())
 	{
-		*first_reading = 0; // Clear flag to indicate first reading has been handled
-		printf("Skipping initial invalid readings...\n"); // Print status message
-		HAL_Delay(500); // 500ms delay for system stabilisation
-		return 1; // Indicate to skip this iteration of while loop
+		flags |= BLACKBOX_FLAG_PLANNER;
 	}
-	return 0; // Proceed normally with the next while loop iteration
+	sample.flags = flags;
+	sample.faults = (uint8_t)fault_bitmap();
+
+	blackbox_record(&sample);
 }
 
 
 /**
  * @brief  Callback function required for ADC conversion
+ *         - Second half of the DMA buffer is complete
  */
 void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc) // callback for ADC DMA
 {
+	current_sense_block_ready(hadc, 1); // Filter second half-buffer
+	watchdog_checkin(WATCHDOG_TASK_CURRENT_SENSE); // Samples are still arriving
 }
 
 
 /**
- * @brief  Compute mean and standard deviation of the values across all cells
-] */
-void compute_soc_stats()
+ * @brief  Callback for ADC DMA half transfer
+ *         - First half of the DMA buffer is complete
+ */
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* hadc)
 {
-	float soc_sum = 0.0; // Initialise variable for sum of SOCs and set to 0
-	float sum_sq = 0.0; // Initialise variable for sum of squared differences and set to 0
-
-	// Compute the sum of all SOC values
-	for (int i = 0; i < NOC; i++)
-	{
-		soc_sum += soc_values[i];
-	}
-
-	mean_soc = soc_sum / NOC; // Calculate mean SOC
+	current_sense_block_ready(hadc, 0); // Filter first half-buffer
+	watchdog_checkin(WATCHDOG_TASK_CURRENT_SENSE); // Samples are still arriving
+}
 
-	// Compute sum of squared differences from the mean
-	for (int i = 0; i < NOC; i++)
-	{
-		sum_sq += (soc_values[i] - mean_soc) * (soc_values[i] - mean_soc);
-	}
 
-	// Compute standard deviation
-	std_dev_soc = sqrt(sum_sq / NOC); // Square root of sum of squared differences divided by number of cells (6)
+/**
+ * @brief  Compute mean and standard deviation of the values across all cells
+ * 		   - Read from the streaming statistics of usable charge kept by update_soc_estimates() (see pack_stats.c)
+ */
+void compute_soc_stats()
+{
+	mean_soc = pack_stats_mean(&soc_stats); // Mean SOC
+	std_dev_soc = pack_stats_std_dev(&soc_stats); // Standard deviation of SOC across the cells
+	pack_stats_sample(&soc_stats); // Add this cycle to the sliding window
 
-	printf("\n***** SOC Mean: %.2f%% | Standard Deviation: %.2f%% *****\n", mean_soc, std_dev_soc); // Print calculated statistics
+	printf("\n***** Usable Charge Mean: %.2f%% | Standard Deviation: %.2f%% (of rated capacity) *****\n", mean_soc, std_dev_soc); // Print calculated statistics
+	printf("***** Window (%d cycles) Mean: %.2f%% | Standard Deviation: %.2f%% *****\n", PACK_STATS_WINDOW,
+			pack_stats_window_mean(&soc_stats), pack_stats_window_std_dev(&soc_stats)); // Print averaged statistics
 }
 
 
 /**
- * @brief  Evaluate whether balancing is required based on SOC standard deviation
+ * @brief  Evaluate whether balancing is required based on the standard deviation of usable charge
+ * 		   - Start and stop thresholds, dwell time and trend prediction (see balancing_trigger.c)
  */
 void assess_equalisation()
 {
+	const TriggerConfig *trigger = trigger_get_config(); // Runtime thresholds
+	TriggerDecision decision;
+
 	printf("\n              ---------------------\n"); // Print line break for readability
 	printf("\n**************** BALANCING STATUS ****************\n");
-	if (std_dev_soc > STD_DEV_SOC_THRESH) // If calculated std dev is greater than predefined threshold (5%)
+
+	policy_print_report(); // Pack activity mode (see balancing_policy.c)
+	if (fault_severity() >= FAULT_SEVERITY_DERATE) // Active fault stops balancing (see fault_manager.c)
+	{
+		planner_stop(); // Any running step is finished by the sequencer
+		printf("Balancing paused - fault bitmap %02lX\n", (unsigned long)fault_bitmap());
+		return;
+	}
+	if (!policy_allows_balancing()) // High-current pulse, SOC estimates are not trusted
+	{
+		printf("Balancing paused - %s mode, pack current %.2fA\n", policy_mode_name(policy_mode()), policy_external_current());
+		return;
+	}
+
+	planner_update(usable_values); // Re-plan the remaining balancing from this cycle's usable charge (see balancing_planner.c)
+	trigger_set_start_scale(policy_start_scale()); // Start earlier while charging
+	decision = trigger_evaluate(std_dev_soc, pack_stats_window_std_dev(&soc_stats), planner_is_active(), planner_is_balanced(), HAL_GetTick());
+
+	if (decision == TRIGGER_START) // Spread has stayed above the start threshold
 	{
-		printf("Balancing Needed - SOC Std Dev: %.2f%% (Threshold: %.2f%%)\n", std_dev_soc, STD_DEV_SOC_THRESH); // Balancing required message
+		printf("Balancing Needed - SOC Std Dev: %.2f%% (Start: %.2f%%, until within %.1f%% SOC)\n", std_dev_soc, trigger->start_std, PLANNER_TARGET_SPREAD); // Balancing required message
 
 		active_balance_trigger(); // Trigger active balancing mechanisms (see active_balancing.c)
+	} else if (decision == TRIGGER_STOP) {
+		planner_stop(); // Any running step is finished by the sequencer
+		printf("Balancing complete - every cell within %.1f%% SOC, Std Dev: %.2f%%\n", PLANNER_TARGET_SPREAD, std_dev_soc);
+	} else if (planner_is_active()) {
+		printf("Balancing in progress - SOC Std Dev: %.2f%%, predicted %.0fs to within %.1f%% SOC\n", std_dev_soc,
+				planner_get_plan()->total_ms / 1000.0f, PLANNER_TARGET_SPREAD); // Plan still to run (see balancing_planner.c)
+		planner_print_plan(); // Steps still to run
 	} else {
-		printf("No Balancing Needed - SOC Std Dev: %.2f%% (Threshold: %.2f%%)\n", std_dev_soc, STD_DEV_SOC_THRESH); // Print no balancing required message
+		printf("No Balancing Needed - SOC Std Dev: %.2f%% (Start: %.2f%%)\n", std_dev_soc, trigger->start_std); // Print no balancing required message
+	}
+
+	if (sequencer_is_busy())
+	{
+		sequencer_print_report(); // Progress of the running sequence (see balancing_sequencer.c)
 	}
+	trigger_print_report(); // Trend and avoided starts
 }
 
 
+/* ***** BOOT SEQUENCE ***** */
+
+static const BootStep boot_steps[] = {
+	// Cell monitor: shut down, wake and configure, with the minimum waits of pl455.h between
+	{"monitor shutdown", powerDown, BOOT_LANE_MONITOR, 0}, // Power down IC for a known start (see pl455.c)
+	{"monitor wake", WakePL455, BOOT_LANE_MONITOR, PL455_SHUTDOWN_MS * 1000}, // Wakeup sequence for IC (see pl455.c)
+	{"monitor configure", init_chip, BOOT_LANE_MONITOR, PL455_STARTUP_MS * 1000}, // Initialise IC registers
+
+	// Peripherals and modules, run while the cell monitor lane waits
+	{"ADC1", MX_ADC1_Init, BOOT_LANE_MCU, 0}, // ADC1 for pack current readings
+	{"TIM1", MX_TIM1_Init, BOOT_LANE_MCU, 0}, // Timer for PWM generation
+	{"ADC2", MX_ADC2_Init, BOOT_LANE_MCU, 0}, // ADC2 for flyback balancing current output readings
+	{"current sense", current_sense_start, BOOT_LANE_MCU, 0}, // Calibrate the ADCs and start filtered current sampling (see current_sense.c)
+	{"accounting", accounting_init, BOOT_LANE_MCU, 0}, // Restore lifetime balancing totals from flash (see balancing_accounting.c)
+	{"chemistry profile", chemistry_profile_init, BOOT_LANE_MCU, 0}, // Select the uploaded chemistry profile, or the built-in one (see chemistry_profile.c)
+	{"trigger", trigger_init, BOOT_LANE_MCU, 0}, // Restore balancing trigger thresholds (see balancing_trigger.c)
+	{"cell health", cell_health_init, BOOT_LANE_MCU, 0}, // Restore per-cell capacity and resistance estimates (see cell_health.c)
+	{"black box", blackbox_init, BOOT_LANE_MCU, 0}, // Find the newest stored fault capture (see blackbox.c)
+	{"retained state", restore_retained_state, BOOT_LANE_MCU, 0}, // Resume estimation after a warm reset (see warm_start.c)
+
+	// Steps that block for long, once the cell monitor is configured
+	{"current calibration", calibration_init, BOOT_LANE_LATE, 0}, // Restore current sense coefficients, zeroing on first boot blocks for about 0.7s (see current_calibration.c)
+};
+
+#define BOOT_STEP_COUNT ((int)(sizeof(boot_steps) / sizeof(boot_steps[0])))
+
+
 /**
   * @brief  Main function where program execution begins
   */
@@ -307,42 +608,88 @@ int main(void)
 
 	SystemClock_Config(); // Configure system clock
 
+	cycle_timer_init(); // Start cycle counter for microsecond delays
+
 	// Initialise peripherals
 	MX_GPIO_Init(); // GPIOs for IC wakeup & MOSFET switching
 	MX_DMA_Init(); // DMA to process ADC readings
 	MX_LPUART1_UART_Init(); // LPUART1 for Serial Monitor
+	serial_console_init(); // Receive serial monitor commands (see serial_console.c)
+	watchdog_init(); // Report a watchdog reset and the task that caused it (see watchdog.c)
 	MX_USART3_UART_Init(); // UART 3 for cell monitor IC communication
-	MX_ADC1_Init(); // ADC1 for pack current readings
-	MX_TIM1_Init(); // Timer for PWM generation
-	MX_ADC2_Init(); // ADC2 for flyback balancing current output readings
 
-	// Initialise local variable
-	BYTE  bFrame[132]; // Buffer for UART receive from cell monitor IC of length 132 bytes
+	uint32_t boot_lanes = BOOT_LANE_BIT(BOOT_LANE_MONITOR) | BOOT_LANE_BIT(BOOT_LANE_MCU) | BOOT_LANE_BIT(BOOT_LANE_LATE);
 
-	powerDown(); // Power down IC initially for soft reset (see pl455.c)
-
-	WakePL455(); // Wakeup sequence for IC (see pl455.c)
-
-	delayms(100); // Small 100ms delay after wakeup
+	// The cell monitor keeps its configuration over a warm reset, check it still answers before skipping its lane
+	if (warm_start_init() && warm_start_chip_configured(chip_config, CHIP_CONFIG_WRITES) && cell_monitor_responding())
+	{
+		printf("Cell monitor still configured, initialisation skipped\n");
+		boot_lanes &= ~BOOT_LANE_BIT(BOOT_LANE_MONITOR);
+	}
 
-	init_chip(); // Initialise IC registers
+	boot_run(boot_steps, BOOT_STEP_COUNT, boot_lanes); // Remaining peripherals and modules, overlapped with the cell monitor start (see boot_sequencer.c)
 
-	HAL_Delay(1000); // Additional 1 second delay for stability
+	uint32_t last_monitor_tick = HAL_GetTick() - MONITOR_PERIOD_MS; // Run the first monitoring cycle straight away
 
+	watchdog_start(); // Supervise the periodic tasks from here on
 
 	// Infinite loop for continuous monitoring and balancing
 	while (1)
 	{
-		req_cell_volt(); // Request cell voltage readings
+		if (watchdog_service() != 0) // A task missed its deadline, the IWDG resets the device shortly
+		{
+			HAL_GPIO_WritePin(GPIOA, PACK_ENABLE_Pin, GPIO_PIN_RESET); // Open pack relay
+			sequencer_abort(); // Stop the flyback converter and open the switch matrix
+			button_press = 0;
+		}
+		watchdog_checkin(WATCHDOG_TASK_MAIN_LOOP);
 
-		ReadResp(bFrame, 15); // Trigger UART receive from IC, 15 bytes of data expected (see pl455.c)
+		sequencer_service(); // Advance any running balancing sequence (see balancing_sequencer.c)
 
-		HAL_Delay(10); // Small 10ms delay after receiving data
+		policy_service(); // Follow pack activity from the filtered pack current (see balancing_policy.c)
 
-		getcellVoltages(recFrame, NOC, volt); // Extract voltage readings from message and store to volt array (see pl455.c)
+		pack_overcurrent_check(); // Debounced overcurrent check on every new current sense block
 
-		// Skip processing of first reading as it always returns invalid
-		if (check_first_reading(&first_reading)) {
+		fault_flag_status(); // Open relay as soon as a fault requires it
+
+		if (fault_bitmap() != retained_fault_bits)
+		{
+			retain_state(); // Keep a new fault over a reset before the next monitoring cycle
+		}
+
+		if (HAL_GetTick() - last_blackbox_tick >= BLACKBOX_SAMPLE_MS)
+		{
+			last_blackbox_tick = HAL_GetTick();
+			record_blackbox_sample(); // Keep the last BLACKBOX_SAMPLES samples in RAM
+		}
+		blackbox_service(); // Store a frozen capture to flash a step at a time
+
+		if (policy_allows_balancing() && fault_severity() < FAULT_SEVERITY_DERATE)
+		{
+			planner_service(); // Start the planned balancing steps once the converter is free
+		} else if (flyback_is_busy()) {
+			sequencer_update_charge(NULL, NULL, NULL, 0); // No further cells, the plan is rebuilt once balancing is allowed again
+			flyback_stop(); // Soft-stop the running step during a high-current pulse
+		}
+
+		accounting_service(planner_is_active()); // Persist balancing totals between transfers, not from the control path
+
+		calibration_service(); // Track balancing current offset drift while the converter is idle, a block at a time
+
+		serial_console_service(); // Execute any received serial monitor commands
+
+		if (HAL_GetTick() - last_monitor_tick < MONITOR_PERIOD_MS) // Monitoring runs every MONITOR_PERIOD_MS
+		{
+			continue;
+		}
+		last_monitor_tick = HAL_GetTick();
+
+		read_cell_voltages(); // Request and convert cell voltage readings
+
+		watchdog_checkin(WATCHDOG_TASK_MONITOR); // Monitoring cycle ran, a failed reading is the fault manager's to handle
+
+		// Skip processing of readings the monitor IC failed to take
+		if (!cell_reading_valid()) {
 			continue;  // Skip this iteration of the loop
 		}
 
@@ -352,16 +699,21 @@ int main(void)
 
 		measure_pack_current(); // Measure and print pack current
 
-		pack_overcurrent_check(); // Check for pack overcurrent condition
+		fault_flag_status(); // Open relay if a cell fault requires it
 
-		fault_flag_status(); // Open relay and terminate program if a fault is detected
+		if (warm_start_first_sample()) // Report time from reset to the first protected sample, once
+		{
+			boot_print_report(); // Boot timeline, printed once protection is armed so it does not delay it
+		}
+
+		fault_print_report(); // Export fault bitmaps
 
 		assess_equalisation(); // Determine if balancing is needed, trigger algorithm if needed
 
+		retain_state(); // Retain estimator and fault state over a warm reset
+
 		// Print separator for readability before next reading
 		printf("\n----------------------------------------------------------------------------------------------------------------------------\n");
-
-		HAL_Delay(2000); // 2 second delay before next iteration
 	}
 }
 
@@ -0,0 +1,338 @@
+/**
+  ******************************************************************************
+  * @file           : ocv_model.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "ocv_model.h" // Include header file for OCV model functions
+#include "cycle_timer.h" // Include cycle counter for evaluation cost
+#include "chemistry_profile.h" // Include active OCV surface and its dimensions
+#include <stdio.h> // Include standard I/O functions
+#include <string.h> // Include memcpy()
+
+/*
+ * The OCV curve of the P45B moves with temperature and sits higher on charge
+ * than on discharge (hysteresis). In the flat 3.6V to 3.8V region a few mV of
+ * shift is several % of SOC, so a single room-temperature curve is not enough.
+ *
+ * The surface of the active chemistry profile holds one curve per branch and
+ * characterised temperature, all on the same uniform voltage grid. A lookup
+ * finds the voltage cell with a shift and the temperature cell with one
+ * division, then interpolates bilinearly with integer arithmetic. The cost is
+ * the same for every reading. Outside the characterised temperature range the
+ * nearest curve is used.
+ *
+ * ocv_soc_centi_batch() converts a whole stack in one call: the curves and
+ * temperature weights are chosen once for all cells, and the two curves are
+ * blended with one dual multiply-accumulate (SMLAD) per cell where the core has
+ * the DSP extension. It gives the same result as ocv_soc_centi() cell by cell.
+ *
+ * The branch of each cell follows its voltage: a cell moves to the charge branch
+ * once its voltage has risen OCV_HYST_SWITCH_UV above the lowest point since it
+ * moved to discharge, and back once it has fallen the same amount below the
+ * highest point. No current measurement is needed, and noise smaller than the
+ * threshold cannot make the branch flip.
+ *
+ * ocv_surface is the built-in (Molicel P45B) surface, run Tools/gen_ocv_surface.py
+ * after adding characterisation data. Other cells are loaded as chemistry
+ * profiles (see chemistry_profile.c). The built-in surface is a placeholder:
+ * only the 25 degC relaxed curve has been characterised and it is listed for
+ * both branches, so neither temperature nor branch changes the SOC until the
+ * missing curves are added to Tools/ocv_characterisation.csv.
+ *
+ * $OCV is printed when a cell changes branch (ocv_model_branches_changed()) and
+ * by "ocv" on the serial console, not every monitoring cycle.
+ */
+
+/* ***** MODEL STATE ***** */
+static OcvCellState cell_state[NOC]; // Branch selector per cell (index as volt[])
+static uint32_t last_cycles_per_cell = 0; // Evaluation cost of the last update
+static int branches_changed = 1; // 1 if a cell changed branch since the last ocv_model_branches_changed()
+
+
+/**
+ * @brief  SOC of one curve of the surface, linear in voltage
+ */
+static uint32_t row_soc(const ChemistryProfile *p, const uint16_t *row, uint32_t cell_uv)
+{
+	uint32_t offset; // Voltage above the first grid point (uV)
+	uint32_t index; // Grid cell containing the voltage
+	uint32_t frac; // Position inside the grid cell (uV)
+
+	if (cell_uv <= p->ocv_v0_uv)
+	{
+		return row[0];
+	}
+
+	offset = cell_uv - p->ocv_v0_uv;
+	index = offset >> p->ocv_v_shift;
+
+	if (index >= (uint32_t)p->ocv_v_size - 1)
+	{
+		return row[p->ocv_v_size - 1];
+	}
+
+	frac = offset & ((1u << p->ocv_v_shift) - 1);
+
+	// Rounded linear interpolation (each curve is non-decreasing)
+	return row[index] + (((uint32_t)(row[index + 1] - row[index]) * frac + (1u << (p->ocv_v_shift - 1))) >> p->ocv_v_shift);
+}
+
+
+/**
+ * @brief  SOC in 0.01% units from cell voltage, temperature and hysteresis branch
+ *         - cell_uv -> cell voltage (uV)
+ *         - temp_decic -> cell temperature (0.1 degC)
+ */
+uint16_t ocv_soc_centi(uint32_t cell_uv, int16_t temp_decic, OcvBranch branch)
+{
+	const ChemistryProfile *p = chemistry_profile();
+	const uint16_t *curves = chemistry_profile_ocv() + (uint32_t)branch * p->ocv_t_size * p->ocv_v_size; // Curves of this branch
+	int32_t t_offset = temp_decic - p->ocv_t0_decic; // Temperature above the first curve (0.1 degC)
+	uint32_t t_index; // Curve at or below the temperature
+	uint32_t t_frac; // Position between the two curves (0.1 degC)
+	uint32_t step = p->ocv_t_step_decic;
+	uint32_t soc_low, soc_high;
+
+	if (t_offset <= 0 || p->ocv_t_size == 1) // Colder than the first curve, or a single characterised temperature
+	{
+		return row_soc(p, curves, cell_uv);
+	}
+
+	t_index = (uint32_t)t_offset / step;
+	if (t_index >= (uint32_t)p->ocv_t_size - 1) // Hotter than the last curve
+	{
+		return row_soc(p, curves + (p->ocv_t_size - 1) * p->ocv_v_size, cell_uv);
+	}
+	t_frac = (uint32_t)t_offset % step;
+
+	soc_low = row_soc(p, curves + t_index * p->ocv_v_size, cell_uv);
+	soc_high = row_soc(p, curves + (t_index + 1) * p->ocv_v_size, cell_uv);
+
+	// Rounded weighted mean of the two curves
+	return (soc_low * (step - t_frac) + soc_high * t_frac + step / 2) / step;
+}
+
+
+/**
+ * @brief  SOC in 0.01% units of a batch of cells at one temperature
+ *         - cell_uv -> cell voltages (uV)
+ *         - branch -> OcvBranch of each cell
+ *         - count -> number of cells
+ *         - temp_decic -> temperature of every cell (0.1 degC)
+ *         - soc_centi -> output, SOC of each cell (0.01% units)
+ */
+void ocv_soc_centi_batch(const uint32_t *cell_uv, const uint8_t *branch, int count, int16_t temp_decic, uint16_t *soc_centi)
+{
+	const ChemistryProfile *p = chemistry_profile();
+	const uint16_t *low_row[OCV_BRANCH_COUNT]; // Curve at or below the temperature, per branch
+	const uint16_t *high_row[OCV_BRANCH_COUNT]; // Curve above it, NULL if only one curve is used
+	int32_t t_offset = temp_decic - p->ocv_t0_decic;
+	uint32_t step = p->ocv_t_step_decic;
+	uint32_t t_index = 0, t_frac = 0;
+	int blend = 0; // 1 if the temperature lies between two curves
+
+	if (t_offset > 0 && p->ocv_t_size > 1)
+	{
+		t_index = (uint32_t)t_offset / step;
+		if (t_index >= (uint32_t)p->ocv_t_size - 1) // Hotter than the last curve
+		{
+			t_index = p->ocv_t_size - 1;
+		} else {
+			t_frac = (uint32_t)t_offset % step;
+			blend = 1;
+		}
+	}
+
+	for (int b = 0; b < OCV_BRANCH_COUNT; b++)
+	{
+		low_row[b] = chemistry_profile_ocv() + ((uint32_t)b * p->ocv_t_size + t_index) * p->ocv_v_size;
+		high_row[b] = blend ? low_row[b] + p->ocv_v_size : 0;
+	}
+
+	if (!blend)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			soc_centi[i] = row_soc(p, low_row[branch[i]], cell_uv[i]);
+		}
+		return;
+	}
+
+#if defined(__ARM_FEATURE_DSP)
+	uint32_t weights = __PKHBT(step - t_frac, t_frac, 16); // Low curve weight in the bottom half, high curve weight in the top
+#endif
+
+	for (int i = 0; i < count; i++)
+	{
+		uint32_t soc_low = row_soc(p, low_row[branch[i]], cell_uv[i]);
+		uint32_t soc_high = row_soc(p, high_row[branch[i]], cell_uv[i]);
+
+#if defined(__ARM_FEATURE_DSP)
+		soc_centi[i] = __SMLAD(__PKHBT(soc_low, soc_high, 16), weights, step / 2) / step; // Both products and the rounding in one instruction
+#else
+		soc_centi[i] = (soc_low * (step - t_frac) + soc_high * t_frac + step / 2) / step;
+#endif
+	}
+}
+
+
+/**
+ * @brief  Update the hysteresis branch of one cell from a new voltage reading
+ *         - index -> cell index as volt[]
+ */
+OcvBranch ocv_track_branch(int index, uint32_t cell_uv)
+{
+	OcvCellState *s = &cell_state[index];
+
+	if (!s->valid) // First reading, a pack at rest is most often coming off discharge
+	{
+		s->turn_uv = cell_uv;
+		s->branch = OCV_BRANCH_DISCHARGE;
+		s->valid = 1;
+		branches_changed = 1;
+	} else if (s->branch == OCV_BRANCH_DISCHARGE)
+	{
+		if (cell_uv < s->turn_uv) // Track the lowest point
+		{
+			s->turn_uv = cell_uv;
+		} else if (cell_uv - s->turn_uv > OCV_HYST_SWITCH_UV) // Voltage has turned upwards
+		{
+			s->branch = OCV_BRANCH_CHARGE;
+			s->turn_uv = cell_uv;
+			branches_changed = 1;
+		}
+	} else {
+		if (cell_uv > s->turn_uv) // Track the highest point
+		{
+			s->turn_uv = cell_uv;
+		} else if (s->turn_uv - cell_uv > OCV_HYST_SWITCH_UV) // Voltage has turned downwards
+		{
+			s->branch = OCV_BRANCH_DISCHARGE;
+			s->turn_uv = cell_uv;
+			branches_changed = 1;
+		}
+	}
+
+	return (OcvBranch)s->branch;
+}
+
+
+/**
+ * @brief  SOC (%) of every cell from the OCV surface
+ *         - cell_uv -> cell voltages (uV), index as volt[], 0 for an invalid reading (maps to 0%)
+ *         - temperature -> cell temperature (degC), the pack temperature is used for all cells
+ *         - soc -> output, SOC of each cell (%)
+ */
+void ocv_model_update(const uint32_t *cell_uv, float temperature, float *soc)
+{
+	int16_t temp_decic = (int16_t)(temperature * 10.0f + ((temperature < 0.0f) ? -0.5f : 0.5f)); // Rounded to 0.1 degC
+	uint8_t branch[NOC];
+	uint16_t soc_centi[NOC];
+	uint32_t start = cycle_timer_now();
+
+	for (int i = 0; i < NOC; i++)
+	{
+		branch[i] = ocv_track_branch(i, cell_uv[i]);
+	}
+	ocv_soc_centi_batch(cell_uv, branch, NOC, temp_decic, soc_centi);
+
+	for (int i = 0; i < NOC; i++)
+	{
+		soc[i] = soc_centi[i] / 100.0f;
+	}
+
+	last_cycles_per_cell = (cycle_timer_now() - start) / NOC;
+}
+
+
+/**
+ * @brief  Branch currently selected for a cell
+ */
+OcvBranch ocv_model_get_branch(int index)
+{
+	return (OcvBranch)cell_state[index].branch;
+}
+
+
+/**
+ * @brief  Branch selector state of every cell (index as volt[])
+ */
+const OcvCellState *ocv_model_state()
+{
+	return cell_state;
+}
+
+
+/**
+ * @brief  Continue from a saved branch selector state, e.g. after a warm reset (see warm_start.c)
+ *         - state -> NOC entries as returned by ocv_model_state() before the reset
+ */
+void ocv_model_restore(const OcvCellState *state)
+{
+	memcpy(cell_state, state, sizeof(cell_state));
+	branches_changed = 1;
+}
+
+
+/**
+ * @brief  Check whether a cell changed branch since the last call
+ *         - Returns 1 once after any change, after the first readings or after a restore, otherwise 0
+ */
+int ocv_model_branches_changed()
+{
+	int changed = branches_changed;
+
+	branches_changed = 0;
+	return changed;
+}
+
+
+/**
+ * @brief  Bytes of OCV surface in the active profile
+ */
+static uint32_t surface_bytes()
+{
+	const ChemistryProfile *p = chemistry_profile();
+
+	return (uint32_t)OCV_BRANCH_COUNT * p->ocv_t_size * p->ocv_v_size * sizeof(uint16_t);
+}
+
+
+/**
+ * @brief  Bytes used by the surface (flash) and the branch selector (RAM)
+ */
+uint32_t ocv_model_footprint()
+{
+	return surface_bytes() + sizeof(cell_state);
+}
+
+
+/**
+ * @brief  CPU cycles per cell in the last ocv_model_update(), including the branch selector
+ */
+uint32_t ocv_model_cycles_per_cell()
+{
+	return last_cycles_per_cell;
+}
+
+
+/**
+ * @brief  Export model cost and branches over the serial monitor
+ *
+ *   $OCV,<surface bytes>,<selector bytes>,<cycles per cell>,<branch of cell 1>,...,<branch of cell NOC>
+ * Branch is D for discharge, C for charge
+ */
+void ocv_model_print_report()
+{
+	printf("$OCV,%lu,%lu,%lu", (unsigned long)surface_bytes(), (unsigned long)sizeof(cell_state),
+			(unsigned long)last_cycles_per_cell);
+	for (int cell = 1; cell <= NOC; cell++)
+	{
+		printf(",%c", (cell_state[NOC - cell].branch == OCV_BRANCH_CHARGE) ? 'C' : 'D');
+	}
+	printf("\n");
+}
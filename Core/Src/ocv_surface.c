@@ -0,0 +1,163 @@
+/**
+  ******************************************************************************
+  * @file           : ocv_surface.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/*
+ * GENERATED by Tools/gen_ocv_surface.py from Tools/ocv_characterisation.csv, do not edit.
+ * [branch][temperature][voltage], voltage from 2600000 uV in steps of 2048 uV,
+ * temperature from 25.0 degC in steps of 10.0 degC, SOC in 0.01 % units.
+ * 3112 bytes, max error against the source curves: 0.0832 % SOC
+ */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "ocv_model.h" // Include surface dimensions
+
+#if OCV_V_SIZE != 778 || OCV_V0_UV != 2600000 || OCV_V_SHIFT != 11 \
+		|| OCV_T_SIZE != 1 || OCV_T0_DECIC != 250 || OCV_T_STEP_DECIC != 100
+#error "ocv_model.h surface constants do not match the generated table, update them"
+#endif
+
+const uint16_t ocv_surface[OCV_BRANCH_COUNT][OCV_T_SIZE][OCV_V_SIZE] = {
+	{ // discharge
+		{ // 25.0 degC
+			0, 1, 2, 2, 3, 4, 5, 6, 7, 7, 8, 9,
+			10, 11, 11, 12, 13, 14, 15, 16, 16, 17, 18, 19,
+			20, 20, 21, 22, 23, 24, 25, 25, 26, 27, 28, 29,
+			29, 30, 31, 32, 33, 34, 34, 35, 36, 37, 38, 39,
+			39, 40, 41, 42, 43, 43, 44, 45, 46, 47, 48, 48,
+			49, 50, 51, 52, 52, 53, 54, 55, 56, 57, 57, 58,
+			59, 60, 61, 61, 62, 63, 64, 65, 66, 66, 67, 68,
+			69, 70, 70, 71, 72, 73, 74, 75, 75, 76, 77, 78,
+			79, 79, 81, 83, 85, 88, 90, 92, 94, 97, 99, 101,
+			103, 106, 108, 110, 112, 115, 117, 119, 121, 124, 126, 128,
+			130, 133, 135, 137, 139, 142, 144, 146, 148, 151, 153, 155,
+			157, 160, 162, 164, 166, 169, 171, 173, 175, 178, 180, 182,
+			184, 187, 189, 191, 193, 196, 198, 200, 202, 205, 207, 209,
+			211, 214, 216, 218, 220, 223, 225, 227, 229, 232, 234, 236,
+			238, 241, 243, 245, 247, 250, 252, 254, 256, 259, 261, 263,
+			266, 268, 270, 272, 275, 277, 279, 281, 284, 286, 288, 290,
+			293, 295, 297, 299, 304, 310, 315, 321, 326, 332, 338, 343,
+			349, 355, 360, 366, 371, 377, 383, 388, 394, 400, 405, 411,
+			417, 422, 428, 433, 439, 445, 450, 456, 462, 467, 473, 478,
+			484, 490, 495, 501, 507, 512, 518, 524, 529, 535, 540, 546,
+			552, 557, 563, 569, 574, 580, 585, 591, 597, 602, 608, 614,
+			619, 625, 631, 636, 642, 647, 653, 659, 664, 670, 676, 681,
+			687, 692, 698, 704, 709, 715, 721, 726, 732, 738, 743, 749,
+			754, 760, 766, 771, 777, 783, 788, 794, 799, 805, 811, 816,
+			822, 828, 833, 839, 845, 850, 856, 862, 869, 875, 881, 887,
+			893, 899, 905, 912, 918, 924, 930, 936, 942, 948, 955, 961,
+			967, 973, 979, 985, 992, 998, 1008, 1020, 1032, 1044, 1057, 1069,
+			1081, 1094, 1106, 1118, 1130, 1143, 1155, 1167, 1180, 1192, 1204, 1216,
+			1229, 1241, 1253, 1266, 1278, 1290, 1302, 1312, 1323, 1333, 1343, 1353,
+			1364, 1374, 1384, 1394, 1404, 1415, 1425, 1435, 1445, 1456, 1466, 1476,
+			1486, 1497, 1507, 1517, 1527, 1538, 1548, 1558, 1568, 1579, 1589, 1599,
+			1609, 1620, 1630, 1640, 1650, 1660, 1671, 1681, 1691, 1701, 1712, 1722,
+			1732, 1742, 1753, 1763, 1773, 1783, 1794, 1808, 1828, 1849, 1869, 1890,
+			1910, 1931, 1951, 1972, 1992, 2008, 2021, 2033, 2046, 2059, 2072, 2085,
+			2097, 2110, 2123, 2136, 2149, 2161, 2174, 2187, 2200, 2213, 2225, 2238,
+			2251, 2264, 2277, 2289, 2302, 2315, 2328, 2341, 2353, 2366, 2379, 2392,
+			2405, 2417, 2430, 2443, 2456, 2469, 2481, 2494, 2514, 2540, 2565, 2591,
+			2616, 2642, 2668, 2693, 2719, 2744, 2770, 2796, 2821, 2847, 2872, 2898,
+			2924, 2949, 2975, 3000, 3017, 3034, 3051, 3069, 3086, 3103, 3120, 3137,
+			3154, 3171, 3188, 3205, 3222, 3239, 3256, 3273, 3290, 3307, 3325, 3342,
+			3359, 3376, 3393, 3410, 3427, 3444, 3461, 3478, 3495, 3525, 3559, 3593,
+			3627, 3661, 3695, 3729, 3763, 3798, 3832, 3866, 3900, 3934, 3968, 4001,
+			4022, 4042, 4063, 4083, 4104, 4124, 4145, 4165, 4186, 4206, 4227, 4247,
+			4268, 4288, 4309, 4329, 4350, 4370, 4391, 4411, 4432, 4452, 4472, 4493,
+			4513, 4534, 4554, 4575, 4595, 4616, 4636, 4657, 4677, 4698, 4718, 4739,
+			4759, 4780, 4800, 4821, 4841, 4862, 4882, 4903, 4923, 4944, 4964, 4984,
+			5006, 5029, 5052, 5076, 5099, 5123, 5146, 5170, 5193, 5216, 5240, 5263,
+			5287, 5310, 5333, 5357, 5380, 5404, 5427, 5450, 5474, 5497, 5521, 5544,
+			5567, 5591, 5614, 5638, 5661, 5684, 5708, 5731, 5755, 5778, 5803, 5844,
+			5884, 5925, 5966, 6004, 6024, 6045, 6065, 6086, 6106, 6127, 6147, 6168,
+			6188, 6208, 6229, 6249, 6270, 6290, 6311, 6331, 6352, 6372, 6393, 6413,
+			6434, 6454, 6475, 6495, 6513, 6530, 6547, 6564, 6581, 6598, 6615, 6633,
+			6650, 6667, 6684, 6701, 6718, 6735, 6752, 6769, 6786, 6803, 6820, 6837,
+			6854, 6871, 6889, 6906, 6923, 6940, 6957, 6974, 6991, 7012, 7038, 7063,
+			7089, 7114, 7140, 7166, 7191, 7217, 7242, 7268, 7294, 7319, 7345, 7370,
+			7396, 7422, 7447, 7473, 7498, 7519, 7540, 7560, 7581, 7601, 7622, 7642,
+			7663, 7683, 7704, 7724, 7744, 7765, 7785, 7806, 7826, 7847, 7867, 7888,
+			7908, 7929, 7949, 7970, 7990, 8011, 8031, 8052, 8072, 8093, 8113, 8134,
+			8154, 8175, 8195, 8216, 8236, 8256, 8277, 8297, 8318, 8338, 8359, 8379,
+			8400, 8420, 8441, 8461, 8482, 8504, 8538, 8572, 8606, 8640, 8674, 8709,
+			8743, 8777, 8811, 8845, 8879, 8913, 8947, 8982, 9024, 9075, 9126, 9177,
+			9228, 9280, 9331, 9382, 9433, 9484, 9509, 9522, 9534, 9547, 9560, 9573,
+			9586, 9598, 9611, 9624, 9637, 9650, 9662, 9675, 9688, 9701, 9714, 9726,
+			9739, 9752, 9765, 9778, 9790, 9803, 9816, 9829, 9842, 9854, 9867, 9880,
+			9893, 9906, 9918, 9931, 9944, 9957, 9970, 9982, 9995, 10000,
+		},
+	},
+	{ // charge
+		{ // 25.0 degC
+			0, 1, 2, 2, 3, 4, 5, 6, 7, 7, 8, 9,
+			10, 11, 11, 12, 13, 14, 15, 16, 16, 17, 18, 19,
+			20, 20, 21, 22, 23, 24, 25, 25, 26, 27, 28, 29,
+			29, 30, 31, 32, 33, 34, 34, 35, 36, 37, 38, 39,
+			39, 40, 41, 42, 43, 43, 44, 45, 46, 47, 48, 48,
+			49, 50, 51, 52, 52, 53, 54, 55, 56, 57, 57, 58,
+			59, 60, 61, 61, 62, 63, 64, 65, 66, 66, 67, 68,
+			69, 70, 70, 71, 72, 73, 74, 75, 75, 76, 77, 78,
+			79, 79, 81, 83, 85, 88, 90, 92, 94, 97, 99, 101,
+			103, 106, 108, 110, 112, 115, 117, 119, 121, 124, 126, 128,
+			130, 133, 135, 137, 139, 142, 144, 146, 148, 151, 153, 155,
+			157, 160, 162, 164, 166, 169, 171, 173, 175, 178, 180, 182,
+			184, 187, 189, 191, 193, 196, 198, 200, 202, 205, 207, 209,
+			211, 214, 216, 218, 220, 223, 225, 227, 229, 232, 234, 236,
+			238, 241, 243, 245, 247, 250, 252, 254, 256, 259, 261, 263,
+			266, 268, 270, 272, 275, 277, 279, 281, 284, 286, 288, 290,
+			293, 295, 297, 299, 304, 310, 315, 321, 326, 332, 338, 343,
+			349, 355, 360, 366, 371, 377, 383, 388, 394, 400, 405, 411,
+			417, 422, 428, 433, 439, 445, 450, 456, 462, 467, 473, 478,
+			484, 490, 495, 501, 507, 512, 518, 524, 529, 535, 540, 546,
+			552, 557, 563, 569, 574, 580, 585, 591, 597, 602, 608, 614,
+			619, 625, 631, 636, 642, 647, 653, 659, 664, 670, 676, 681,
+			687, 692, 698, 704, 709, 715, 721, 726, 732, 738, 743, 749,
+			754, 760, 766, 771, 777, 783, 788, 794, 799, 805, 811, 816,
+			822, 828, 833, 839, 845, 850, 856, 862, 869, 875, 881, 887,
+			893, 899, 905, 912, 918, 924, 930, 936, 942, 948, 955, 961,
+			967, 973, 979, 985, 992, 998, 1008, 1020, 1032, 1044, 1057, 1069,
+			1081, 1094, 1106, 1118, 1130, 1143, 1155, 1167, 1180, 1192, 1204, 1216,
+			1229, 1241, 1253, 1266, 1278, 1290, 1302, 1312, 1323, 1333, 1343, 1353,
+			1364, 1374, 1384, 1394, 1404, 1415, 1425, 1435, 1445, 1456, 1466, 1476,
+			1486, 1497, 1507, 1517, 1527, 1538, 1548, 1558, 1568, 1579, 1589, 1599,
+			1609, 1620, 1630, 1640, 1650, 1660, 1671, 1681, 1691, 1701, 1712, 1722,
+			1732, 1742, 1753, 1763, 1773, 1783, 1794, 1808, 1828, 1849, 1869, 1890,
+			1910, 1931, 1951, 1972, 1992, 2008, 2021, 2033, 2046, 2059, 2072, 2085,
+			2097, 2110, 2123, 2136, 2149, 2161, 2174, 2187, 2200, 2213, 2225, 2238,
+			2251, 2264, 2277, 2289, 2302, 2315, 2328, 2341, 2353, 2366, 2379, 2392,
+			2405, 2417, 2430, 2443, 2456, 2469, 2481, 2494, 2514, 2540, 2565, 2591,
+			2616, 2642, 2668, 2693, 2719, 2744, 2770, 2796, 2821, 2847, 2872, 2898,
+			2924, 2949, 2975, 3000, 3017, 3034, 3051, 3069, 3086, 3103, 3120, 3137,
+			3154, 3171, 3188, 3205, 3222, 3239, 3256, 3273, 3290, 3307, 3325, 3342,
+			3359, 3376, 3393, 3410, 3427, 3444, 3461, 3478, 3495, 3525, 3559, 3593,
+			3627, 3661, 3695, 3729, 3763, 3798, 3832, 3866, 3900, 3934, 3968, 4001,
+			4022, 4042, 4063, 4083, 4104, 4124, 4145, 4165, 4186, 4206, 4227, 4247,
+			4268, 4288, 4309, 4329, 4350, 4370, 4391, 4411, 4432, 4452, 4472, 4493,
+			4513, 4534, 4554, 4575, 4595, 4616, 4636, 4657, 4677, 4698, 4718, 4739,
+			4759, 4780, 4800, 4821, 4841, 4862, 4882, 4903, 4923, 4944, 4964, 4984,
+			5006, 5029, 5052, 5076, 5099, 5123, 5146, 5170, 5193, 5216, 5240, 5263,
+			5287, 5310, 5333, 5357, 5380, 5404, 5427, 5450, 5474, 5497, 5521, 5544,
+			5567, 5591, 5614, 5638, 5661, 5684, 5708, 5731, 5755, 5778, 5803, 5844,
+			5884, 5925, 5966, 6004, 6024, 6045, 6065, 6086, 6106, 6127, 6147, 6168,
+			6188, 6208, 6229, 6249, 6270, 6290, 6311, 6331, 6352, 6372, 6393, 6413,
+			6434, 6454, 6475, 6495, 6513, 6530, 6547, 6564, 6581, 6598, 6615, 6633,
+			6650, 6667, 6684, 6701, 6718, 6735, 6752, 6769, 6786, 6803, 6820, 6837,
+			6854, 6871, 6889, 6906, 6923, 6940, 6957, 6974, 6991, 7012, 7038, 7063,
+			7089, 7114, 7140, 7166, 7191, 7217, 7242, 7268, 7294, 7319, 7345, 7370,
+			7396, 7422, 7447, 7473, 7498, 7519, 7540, 7560, 7581, 7601, 7622, 7642,
+			7663, 7683, 7704, 7724, 7744, 7765, 7785, 7806, 7826, 7847, 7867, 7888,
+			7908, 7929, 7949, 7970, 7990, 8011, 8031, 8052, 8072, 8093, 8113, 8134,
+			8154, 8175, 8195, 8216, 8236, 8256, 8277, 8297, 8318, 8338, 8359, 8379,
+			8400, 8420, 8441, 8461, 8482, 8504, 8538, 8572, 8606, 8640, 8674, 8709,
+			8743, 8777, 8811, 8845, 8879, 8913, 8947, 8982, 9024, 9075, 9126, 9177,
+			9228, 9280, 9331, 9382, 9433, 9484, 9509, 9522, 9534, 9547, 9560, 9573,
+			9586, 9598, 9611, 9624, 9637, 9650, 9662, 9675, 9688, 9701, 9714, 9726,
+			9739, 9752, 9765, 9778, 9790, 9803, 9816, 9829, 9842, 9854, 9867, 9880,
+			9893, 9906, 9918, 9931, 9944, 9957, 9970, 9982, 9995, 10000,
+		},
+	},
+};
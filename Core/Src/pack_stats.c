@@ -0,0 +1,257 @@
+/**
+  ******************************************************************************
+  * @file           : pack_stats.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "pack_stats.h" // Include header file for pack statistics functions
+#include <math.h> // Include sqrtf()
+
+/*
+ * Statistics of one value per cell (e.g. SOC), kept up to date as cells change
+ * instead of being recomputed from scratch:
+ *   - mean and variance with Welford's update for replacing one value, O(1)
+ *   - min and max with their cell index from two tournament trees, O(log n)
+ *     per update and O(1) to read
+ *   - sliding window averages of the pack mean and spread, O(1) per sample
+ * Floating point error in the running mean and variance is bounded by an exact
+ * recomputation every PACK_STATS_REBUILD_INTERVAL updates, O(1) amortised.
+ * All consumers read the same PackStats, so nothing is computed twice per cycle.
+ */
+
+/* ***** DEFINE CONSTANTS ***** */
+#define PACK_STATS_EMPTY 0xFFFF // Tree leaf without a cell
+
+
+/**
+ * @brief  Index of the smaller of two tree entries, empty entries lose
+ */
+static uint16_t pick_min(const PackStats *stats, uint16_t a, uint16_t b)
+{
+	if (a == PACK_STATS_EMPTY)
+	{
+		return b;
+	}
+	if (b == PACK_STATS_EMPTY)
+	{
+		return a;
+	}
+	return (stats->value[b] < stats->value[a]) ? b : a;
+}
+
+
+/**
+ * @brief  Index of the larger of two tree entries, empty entries lose
+ */
+static uint16_t pick_max(const PackStats *stats, uint16_t a, uint16_t b)
+{
+	if (a == PACK_STATS_EMPTY)
+	{
+		return b;
+	}
+	if (b == PACK_STATS_EMPTY)
+	{
+		return a;
+	}
+	return (stats->value[b] > stats->value[a]) ? b : a;
+}
+
+
+/**
+ * @brief  Replay the tournament from one leaf up to the root
+ */
+static void update_trees(PackStats *stats, int index)
+{
+	int node = (PACK_STATS_CAPACITY + index) / 2;
+
+	while (node >= 1)
+	{
+		stats->min_node[node] = pick_min(stats, stats->min_node[2 * node], stats->min_node[2 * node + 1]);
+		stats->max_node[node] = pick_max(stats, stats->max_node[2 * node], stats->max_node[2 * node + 1]);
+		node /= 2;
+	}
+}
+
+
+/**
+ * @brief  Exact two-pass mean and variance, removes accumulated rounding error
+ */
+static void recompute_moments(PackStats *stats)
+{
+	float sum = 0.0f;
+	float m2 = 0.0f;
+
+	for (int i = 0; i < stats->count; i++)
+	{
+		sum += stats->value[i];
+	}
+	stats->mean = sum / stats->count;
+
+	for (int i = 0; i < stats->count; i++)
+	{
+		float d = stats->value[i] - stats->mean;
+		m2 += d * d;
+	}
+	stats->m2 = m2;
+	stats->updates = 0;
+}
+
+
+/**
+ * @brief  Start from a full set of cell values
+ *         - count -> number of cells, up to PACK_STATS_CAPACITY
+ */
+void pack_stats_init(PackStats *stats, const float *values, int count)
+{
+	stats->count = count;
+
+	for (int i = 0; i < PACK_STATS_CAPACITY; i++)
+	{
+		stats->value[i] = (i < count) ? values[i] : 0.0f;
+		stats->min_node[PACK_STATS_CAPACITY + i] = (i < count) ? i : PACK_STATS_EMPTY;
+		stats->max_node[PACK_STATS_CAPACITY + i] = (i < count) ? i : PACK_STATS_EMPTY;
+	}
+
+	for (int node = PACK_STATS_CAPACITY - 1; node >= 1; node--) // Build the trees bottom-up
+	{
+		stats->min_node[node] = pick_min(stats, stats->min_node[2 * node], stats->min_node[2 * node + 1]);
+		stats->max_node[node] = pick_max(stats, stats->max_node[2 * node], stats->max_node[2 * node + 1]);
+	}
+
+	recompute_moments(stats);
+
+	stats->window_mean_sum = 0.0f;
+	stats->window_std_sum = 0.0f;
+	stats->window_next = 0;
+	stats->window_fill = 0;
+}
+
+
+/**
+ * @brief  Change the value of one cell
+ *         - Mean and variance in O(1), min and max in O(log n)
+ */
+void pack_stats_update(PackStats *stats, int index, float value)
+{
+	float old = stats->value[index];
+	float old_mean = stats->mean;
+
+	if (value == old)
+	{
+		return;
+	}
+
+	// Welford update for replacing old with value, the number of cells is unchanged
+	stats->mean += (value - old) / stats->count;
+	stats->m2 += (value - old) * (value - stats->mean + old - old_mean);
+	if (stats->m2 < 0.0f) // Rounding can take a near-zero sum just below zero
+	{
+		stats->m2 = 0.0f;
+	}
+
+	stats->value[index] = value;
+	update_trees(stats, index);
+
+	if (++stats->updates >= PACK_STATS_REBUILD_INTERVAL)
+	{
+		recompute_moments(stats);
+	}
+}
+
+
+/**
+ * @brief  Mean of all cells
+ */
+float pack_stats_mean(const PackStats *stats)
+{
+	return stats->mean;
+}
+
+
+/**
+ * @brief  Population standard deviation of all cells
+ */
+float pack_stats_std_dev(const PackStats *stats)
+{
+	return sqrtf(stats->m2 / stats->count);
+}
+
+
+/**
+ * @brief  Smallest value and its cell index
+ */
+float pack_stats_min(const PackStats *stats, int *index)
+{
+	*index = stats->min_node[1];
+	return stats->value[*index];
+}
+
+
+/**
+ * @brief  Largest value and its cell index
+ */
+float pack_stats_max(const PackStats *stats, int *index)
+{
+	*index = stats->max_node[1];
+	return stats->value[*index];
+}
+
+
+/**
+ * @brief  Largest distance from the mean and its cell index
+ *         - The furthest cell is always the minimum or the maximum
+ */
+float pack_stats_max_deviation(const PackStats *stats, int *index)
+{
+	int min_index, max_index;
+	float below = stats->mean - pack_stats_min(stats, &min_index);
+	float above = pack_stats_max(stats, &max_index) - stats->mean;
+
+	*index = (above >= below) ? max_index : min_index;
+	return (above >= below) ? above : below;
+}
+
+
+/**
+ * @brief  Add the current mean and standard deviation to the sliding window
+ */
+void pack_stats_sample(PackStats *stats)
+{
+	float mean = pack_stats_mean(stats);
+	float std = pack_stats_std_dev(stats);
+
+	if (stats->window_fill == PACK_STATS_WINDOW) // Full, the oldest sample leaves the running sums
+	{
+		stats->window_mean_sum -= stats->window_mean[stats->window_next];
+		stats->window_std_sum -= stats->window_std[stats->window_next];
+	} else {
+		stats->window_fill++;
+	}
+
+	stats->window_mean[stats->window_next] = mean;
+	stats->window_std[stats->window_next] = std;
+	stats->window_mean_sum += mean;
+	stats->window_std_sum += std;
+	stats->window_next = (stats->window_next + 1) % PACK_STATS_WINDOW;
+}
+
+
+/**
+ * @brief  Mean averaged over the window, the current mean if no samples yet
+ */
+float pack_stats_window_mean(const PackStats *stats)
+{
+	return stats->window_fill ? stats->window_mean_sum / stats->window_fill : pack_stats_mean(stats);
+}
+
+
+/**
+ * @brief  Standard deviation averaged over the window, the current value if no samples yet
+ */
+float pack_stats_window_std_dev(const PackStats *stats)
+{
+	return stats->window_fill ? stats->window_std_sum / stats->window_fill : pack_stats_std_dev(stats);
+}
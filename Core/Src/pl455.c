@@ -10,6 +10,8 @@
 // Include necessary header files for program to run
 #include "string.h" // String manipulation functions
 #include "pl455.h" // header file for PL455 cell monitor IC
+#include "cell_convert.h" // Include cell code to voltage scaling
+#include "cycle_timer.h" // Include microsecond delays
 #include "datatypes.h" // Include custom datatype definitions
 #include "stm32g4xx_hal.h" // STM32 HAL library for hardware abstraction
 #include "stdint.h" // Standard integer type definitions
@@ -22,10 +24,10 @@ uint16_t CRC16(BYTE *pBuf, int nLen);
 
 /**
  * @brief  Power down the PL455 monitoring IC
+ *         - A wake pulse is only seen PL455_SHUTDOWN_MS later
  */
 void powerDown(void)
 {
-	HAL_Delay(2000); // 2 second delay
 	WriteReg(0,12,0x40,1,FRMWRT_SGL_NR); // Write to register to power down chip
 }
 
@@ -39,7 +41,7 @@ void WakePL455(void)
 
 	// Toggle wake signal using GPIO pin PA0
 	HAL_GPIO_WritePin(GPIOA, GPIO_PIN_0, GPIO_PIN_RESET); // Assert wakeup pulse (set low)
-	HAL_Delay(0.01); // 10 microsecond delay to meet wakeup timing requirements
+	cycle_timer_delay_us(PL455_WAKE_PULSE_US); // 10 microsecond delay to meet wakeup timing requirements
 	HAL_GPIO_WritePin(GPIOA,GPIO_PIN_0,GPIO_PIN_SET); // Drive wakeup signal high
 
 	GPIO_InitTypeDef GPIO_InitStruct = {0}; // Initialise GPIO structure for wakeup functionality
@@ -64,7 +66,7 @@ void WakePL455(void)
 int  WriteReg(BYTE bID, uint16_t wAddr, uint64_t dwData, BYTE bLen, BYTE bWriteType)
 {
 	int bRes = 0;  // Result variable
-	BYTE bBuf[4] = {0, 0, 0, 0}; // Buffer to store data before transmission
+	BYTE bBuf[8] = {0}; // Buffer to store data before transmission, up to 8 bytes
 
 	// Write data based on length (1 to 8)
 	switch(bLen)
@@ -214,7 +216,7 @@ void getcellVoltages(uint8_t *data, uint8_t NOC, float *volt)
 {
 	for(int i=1;i<=NOC;i++) // Iterate through each cell
 	{
-	*volt ++= (data[2*i-1] << 8 | data[i*2]) * 0.00007666; // Extract and convert raw 16-bit ADC to floating voltage value
+	*volt ++= cell_convert_code_uv(data[2*i-1] << 8 | data[i*2]) * 1e-6f; // Extract and convert raw 16-bit ADC to floating voltage value (see cell_convert.c)
 	}
 }
 
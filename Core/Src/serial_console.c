@@ -0,0 +1,456 @@
+/**
+  ******************************************************************************
+  * @file           : serial_console.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "serial_console.h" // Include header file for serial console functions
+#include "chemistry_profile.h" // Include chemistry profile upload
+#include "balancing_trigger.h" // Include balancing trigger configuration
+#include "cell_convert.h" // Include cell conversion benchmark
+#include "fault_manager.h" // Include fault report and latch clearing
+#include "blackbox.h" // Include black-box capture listing and dump
+#include "watchdog.h" // Include watchdog report
+#include "warm_start.h" // Include boot report
+#include "boot_sequencer.h" // Include boot step timeline
+#include "current_calibration.h" // Include current sense zero and gain calibration
+#include "ocv_model.h" // Include OCV model report
+#include <stdio.h> // Include standard I/O functions
+#include <stdlib.h> // Include strtoul() and strtof()
+#include <string.h> // Include string manipulation functions
+
+/*
+ * Line based commands on the serial monitor (LPUART1, 115200 baud). Bytes are
+ * stored by the receive interrupt in a ring buffer so nothing is lost while the
+ * main loop is busy, and complete lines are executed by serial_console_service().
+ * Every command answers with a line starting "OK" or "ERR", so a host tool can
+ * wait for the reply before sending the next line.
+ *
+ *   help                          list commands
+ *   profile                       print the active chemistry profile
+ *   profile begin <bytes>         erase the partition for a new image
+ *   profile data <offset> <hex>   program up to CONSOLE_DATA_MAX bytes, offset a multiple of 8
+ *   profile end                   validate and activate the new image
+ *   profile erase                 return to the built-in profile
+ *   trigger                       print the balancing trigger configuration and counters
+ *   trigger <name> <value>        set start / stop (% SOC std dev) or dwell / horizon (s)
+ *   trigger save                  keep the configuration in flash
+ *   trigger reset                 clear the counters
+ *   convert                       time the cell code to SOC conversion for 6, 96 and 192 cells
+ *   ocv                           print the OCV model cost and the branch of every cell
+ *   fault                         print the fault bitmaps and trip counts
+ *   fault clear                   clear latched faults whose condition has gone
+ *   blackbox                      list the stored fault captures
+ *   blackbox dump <sequence>      print a capture as hex (decode with Tools/blackbox_decode.py)
+ *   blackbox trigger              take a capture now
+ *   blackbox erase                erase every stored capture
+ *   watchdog                      print the last reset and the deadline margin of every task
+ *   watchdog stall <ms>           block the main loop to test the supervision (up to CONSOLE_STALL_MAX_MS)
+ *   boot                          print the boot type, the time from reset to the first protected sample and the step timeline
+ *   boot reset                    software reset, the next boot is warm
+ *   calibrate                     print the current sense coefficients
+ *   calibrate zero <channel>      measure the offset of pack or balancing, converter idle and for pack the relay open
+ *   calibrate gain <channel> <A>  trim the gain of pack or balancing with a metered current flowing
+ */
+
+/* ***** CONSOLE STATE ***** */
+static volatile uint8_t rx_buffer[CONSOLE_RX_BUFFER]; // Receive ring buffer
+static volatile uint16_t rx_head = 0; // Written by the interrupt
+static uint16_t rx_tail = 0; // Read by serial_console_service()
+static char line[CONSOLE_LINE_MAX + 1]; // Line being assembled
+static uint16_t line_length = 0; // Characters in line
+static int line_overflow = 0; // 1 if the current line was too long
+
+
+/**
+ * @brief  Value of a hexadecimal digit, -1 if not a digit
+ */
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+	{
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f')
+	{
+		return c - 'a' + 10;
+	}
+	if (c >= 'A' && c <= 'F')
+	{
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+
+/**
+ * @brief  Decode a hexadecimal string
+ *         - Returns number of bytes, -1 if malformed or longer than max
+ */
+static int decode_hex(const char *text, uint8_t *data, int max)
+{
+	int count = 0;
+
+	while (text[0] != '\0' && text[0] != ' ')
+	{
+		int high = hex_digit(text[0]);
+		int low = (high >= 0) ? hex_digit(text[1]) : -1;
+
+		if (low < 0 || count >= max)
+		{
+			return -1;
+		}
+		data[count++] = (uint8_t)((high << 4) | low);
+		text += 2;
+	}
+	return count;
+}
+
+
+/**
+ * @brief  Execute a "profile" command
+ */
+static void profile_command(char *args)
+{
+	char *end;
+
+	if (*args == '\0')
+	{
+		chemistry_profile_print();
+		printf("OK\n");
+	} else if (strncmp(args, "begin ", 6) == 0)
+	{
+		uint32_t length = strtoul(args + 6, &end, 0);
+
+		printf((chemistry_profile_upload_begin(length) == 0) ? "OK\n" : "ERR begin\n");
+	} else if (strncmp(args, "data ", 5) == 0)
+	{
+		uint8_t data[CONSOLE_DATA_MAX];
+		uint32_t offset = strtoul(args + 5, &end, 0);
+		int count = (*end == ' ') ? decode_hex(end + 1, data, CONSOLE_DATA_MAX) : -1;
+
+		if (count <= 0 || chemistry_profile_upload_data(offset, data, count) != 0)
+		{
+			printf("ERR data %lu\n", (unsigned long)offset);
+		} else {
+			printf("OK\n");
+		}
+	} else if (strcmp(args, "end") == 0)
+	{
+		if (chemistry_profile_upload_end() == 0)
+		{
+			chemistry_profile_print();
+			printf("OK\n");
+		} else {
+			printf("ERR profile rejected, using built-in\n");
+		}
+	} else if (strcmp(args, "erase") == 0)
+	{
+		printf((chemistry_profile_erase() == 0) ? "OK\n" : "ERR erase\n");
+	} else {
+		printf("ERR unknown profile command\n");
+	}
+}
+
+
+/**
+ * @brief  Execute a "trigger" command
+ */
+static void trigger_command(char *args)
+{
+	if (*args == '\0')
+	{
+		trigger_print_report();
+		printf("OK\n");
+	} else if (strcmp(args, "save") == 0)
+	{
+		printf((trigger_save() == 0) ? "OK\n" : "ERR save\n");
+	} else if (strcmp(args, "reset") == 0)
+	{
+		trigger_reset_counters();
+		printf("OK\n");
+	} else {
+		char *value = strchr(args, ' ');
+		char *end;
+
+		if (value == NULL)
+		{
+			printf("ERR missing value\n");
+			return;
+		}
+		*value++ = '\0'; // Split name and value
+		float number = strtof(value, &end);
+
+		if (end == value || *end != '\0' || trigger_set(args, number) != 0)
+		{
+			printf("ERR trigger %s\n", args);
+		} else {
+			trigger_print_report();
+			printf("OK\n");
+		}
+	}
+}
+
+
+/**
+ * @brief  Execute a "blackbox" command
+ */
+static void blackbox_command(char *args)
+{
+	if (*args == '\0')
+	{
+		blackbox_print_report();
+		printf("OK\n");
+	} else if (strncmp(args, "dump ", 5) == 0)
+	{
+		char *end;
+		unsigned long sequence = strtoul(args + 5, &end, 10);
+
+		if (end == args + 5 || *end != '\0' || blackbox_dump(sequence) != 0)
+		{
+			printf("ERR no capture %s\n", args + 5);
+		} else {
+			printf("OK\n");
+		}
+	} else if (strcmp(args, "trigger") == 0)
+	{
+		if (blackbox_is_busy())
+		{
+			printf("ERR busy\n");
+		} else {
+			blackbox_trigger(BLACKBOX_TRIGGER_MANUAL, fault_bitmap());
+			printf("OK\n");
+		}
+	} else if (strcmp(args, "erase") == 0)
+	{
+		printf((blackbox_erase() == 0) ? "OK\n" : "ERR erase\n");
+	} else {
+		printf("ERR blackbox %s\n", args);
+	}
+}
+
+
+/**
+ * @brief  Current sense channel from its name, -1 if unknown
+ */
+static int parse_channel(const char *name)
+{
+	if (strcmp(name, "pack") == 0)
+	{
+		return CURRENT_CHANNEL_PACK;
+	} else if (strcmp(name, "balancing") == 0)
+	{
+		return CURRENT_CHANNEL_BALANCING;
+	}
+	return -1;
+}
+
+
+/**
+ * @brief  Execute a "calibrate" command
+ */
+static void calibrate_command(char *args)
+{
+	int channel;
+
+	if (*args == '\0')
+	{
+		calibration_print_report();
+		printf("OK\n");
+	} else if (strncmp(args, "zero ", 5) == 0)
+	{
+		channel = parse_channel(args + 5);
+
+		if (channel < 0 || calibration_zero((CurrentChannel)channel, 1) != 0)
+		{
+			printf("ERR zero %s\n", args + 5);
+		} else {
+			calibration_print_report();
+			printf("OK\n");
+		}
+	} else if (strncmp(args, "gain ", 5) == 0)
+	{
+		char *value = strchr(args + 5, ' ');
+		char *end;
+
+		if (value == NULL)
+		{
+			printf("ERR missing current\n");
+			return;
+		}
+		*value++ = '\0'; // Split channel and current
+		channel = parse_channel(args + 5);
+		float current = strtof(value, &end);
+
+		if (channel < 0 || end == value || *end != '\0' || calibration_gain((CurrentChannel)channel, current) != 0)
+		{
+			printf("ERR gain %s\n", args + 5);
+		} else {
+			calibration_print_report();
+			printf("OK\n");
+		}
+	} else {
+		printf("ERR calibrate %s\n", args);
+	}
+}
+
+
+/**
+ * @brief  Execute one command line
+ */
+static void execute_line(char *text)
+{
+	if (strcmp(text, "help") == 0)
+	{
+		printf("Commands: help | profile [begin <bytes> | data <offset> <hex> | end | erase]"
+				" | trigger [start|stop|dwell|horizon <value> | save | reset] | convert | ocv | fault [clear]"
+				" | blackbox [dump <sequence> | trigger | erase] | watchdog [stall <ms>] | boot [reset]"
+				" | calibrate [zero <pack|balancing> | gain <pack|balancing> <A>]\nOK\n");
+	} else if (strcmp(text, "profile") == 0)
+	{
+		profile_command(text + 7);
+	} else if (strncmp(text, "profile ", 8) == 0)
+	{
+		profile_command(text + 8);
+	} else if (strcmp(text, "trigger") == 0)
+	{
+		trigger_command(text + 7);
+	} else if (strncmp(text, "trigger ", 8) == 0)
+	{
+		trigger_command(text + 8);
+	} else if (strcmp(text, "convert") == 0)
+	{
+		cell_convert_print_benchmark();
+		printf("OK\n");
+	} else if (strcmp(text, "ocv") == 0)
+	{
+		ocv_model_print_report();
+		printf("OK\n");
+	} else if (strcmp(text, "blackbox") == 0)
+	{
+		blackbox_command(text + 8);
+	} else if (strncmp(text, "blackbox ", 9) == 0)
+	{
+		blackbox_command(text + 9);
+	} else if (strcmp(text, "watchdog") == 0)
+	{
+		watchdog_print_report();
+		printf("OK\n");
+	} else if (strncmp(text, "watchdog stall ", 15) == 0)
+	{
+		char *end;
+		unsigned long ms = strtoul(text + 15, &end, 10);
+
+		if (end == text + 15 || *end != '\0' || ms > CONSOLE_STALL_MAX_MS)
+		{
+			printf("ERR stall %s\n", text + 15);
+		} else {
+			HAL_Delay(ms); // Main loop makes no progress, interrupts keep running
+			printf("OK\n");
+		}
+	} else if (strcmp(text, "boot") == 0)
+	{
+		warm_start_print_report();
+		boot_print_report();
+		printf("OK\n");
+	} else if (strcmp(text, "boot reset") == 0)
+	{
+		printf("OK\n");
+		HAL_Delay(10); // Let the reply leave the UART
+		NVIC_SystemReset(); // Keeps RAM and the cell monitor configuration (see warm_start.c)
+	} else if (strcmp(text, "calibrate") == 0)
+	{
+		calibrate_command(text + 9);
+	} else if (strncmp(text, "calibrate ", 10) == 0)
+	{
+		calibrate_command(text + 10);
+	} else if (strcmp(text, "fault") == 0)
+	{
+		fault_print_report();
+		printf("OK\n");
+	} else if (strcmp(text, "fault clear") == 0)
+	{
+		int remaining = fault_clear_latched();
+
+		fault_print_report();
+		if (remaining)
+		{
+			printf("ERR %d faults still active\n", remaining);
+		} else {
+			printf("OK\n");
+		}
+	} else {
+		printf("ERR unknown command\n");
+	}
+}
+
+
+/**
+ * @brief  Enable LPUART1 receive interrupt, call after MX_LPUART1_UART_Init()
+ */
+void serial_console_init()
+{
+	LPUART1->CR1 |= USART_CR1_RXNEIE_RXFNEIE; // Interrupt on every received byte
+	HAL_NVIC_SetPriority(LPUART1_IRQn, 1, 0); // Below the cell monitor UART
+	HAL_NVIC_EnableIRQ(LPUART1_IRQn);
+}
+
+
+/**
+ * @brief  Store received bytes in the ring buffer, called from LPUART1_IRQHandler
+ *         - Bytes are dropped when the buffer is full, the command then fails and is repeated
+ */
+void serial_console_rx_irq()
+{
+	if (LPUART1->ISR & USART_ISR_ORE) // Overrun, clear so reception continues
+	{
+		LPUART1->ICR = USART_ICR_ORECF;
+	}
+
+	while (LPUART1->ISR & USART_ISR_RXNE_RXFNE)
+	{
+		uint8_t byte = (uint8_t)LPUART1->RDR; // Reading clears the flag
+		uint16_t next = (rx_head + 1) & (CONSOLE_RX_BUFFER - 1);
+
+		if (next != rx_tail)
+		{
+			rx_buffer[rx_head] = byte;
+			rx_head = next;
+		}
+	}
+}
+
+
+/**
+ * @brief  Assemble received bytes into lines and execute them, call from main loop
+ */
+void serial_console_service()
+{
+	while (rx_tail != rx_head)
+	{
+		char c = (char)rx_buffer[rx_tail];
+		rx_tail = (rx_tail + 1) & (CONSOLE_RX_BUFFER - 1);
+
+		if (c == '\r' || c == '\n') // End of line
+		{
+			if (line_overflow)
+			{
+				printf("ERR line too long\n");
+			} else if (line_length > 0)
+			{
+				line[line_length] = '\0';
+				execute_line(line);
+			}
+			line_length = 0;
+			line_overflow = 0;
+		} else if (line_length < CONSOLE_LINE_MAX)
+		{
+			line[line_length++] = c;
+		} else {
+			line_overflow = 1;
+		}
+	}
+}
@@ -0,0 +1,255 @@
+/**
+  ******************************************************************************
+  * @file           : soc_ekf.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "soc_ekf.h" // Include header file for SOC estimator functions
+#include "ocv_model.h" // Include OCV surface and hysteresis branch of each cell
+#include "chemistry_profile.h" // Include cell capacity and OCV grid limits
+#include "cycle_timer.h" // Include cycle counter for the cycle budget
+#include <math.h> // Include expf()
+#include <stdio.h> // Include standard I/O functions
+
+/*
+ * Extended Kalman filter per cell on a first-order RC model:
+ *   SOC[k+1]  = SOC[k] - eta x I x dt / (3600 x Q)
+ *   Vrc[k+1]  = a x Vrc[k] + R1 x (1 - a) x I,     a = exp(-dt / tau)
+ *   Vcell     = OCV(SOC) - Vrc - R0 x I             (I > 0 discharges the cell)
+ * The state is [SOC, Vrc] with a symmetric 2x2 covariance.
+ *
+ * OCV(SOC) and its slope come from a table that is uniform in SOC, built by
+ * inverting the active OCV surface for each hysteresis branch at the pack
+ * temperature. It is rebuilt when the temperature moves by SOC_EKF_OCV_REBUILD_C
+ * or the chemistry profile changes, so the update itself only indexes it.
+ *
+ * All cells are kept as a structure of arrays and every step runs as a loop
+ * across the cells with the coefficients shared by all of them (a, R1(1-a),
+ * dt / Q) computed once. The Cortex-M4 FPU is scalar, so several cells per
+ * instruction is not available for floats. Instead, the arithmetic loops have
+ * no calls or data-dependent branches, so the compiler can keep the FPU pipeline
+ * full across cells. The cost per cell is measured with the DWT cycle counter
+ * against SOC_EKF_CYCLE_BUDGET.
+ *
+ * Tools/soc_ekf_reference.py is a double-precision host implementation of the
+ * same filter. Its test vectors are kept in Sim/Bench/ekf_vectors.csv and
+ * "make replay" in Sim/ runs them through this file (Sim/Bench/ekf_replay.c).
+ */
+
+/* ***** ESTIMATOR STATE ***** */
+static SocEkfBank bank; // Estimator state of all cells
+static int initialised = 0; // 1 once started from OCV
+static float ocv_table[OCV_BRANCH_COUNT][SOC_EKF_OCV_POINTS]; // OCV (V) at evenly spaced SOC, per branch
+static float ocv_table_temperature = 0.0f; // Temperature the table was built for (degC)
+static const ChemistryProfile *ocv_table_profile = 0; // Profile the table was built from
+static uint32_t last_cycles_per_cell = 0; // Cost of the last update
+
+
+/**
+ * @brief  Build the SOC to OCV tables by bisection on the OCV surface
+ */
+static void build_ocv_table(float temperature)
+{
+	const ChemistryProfile *p = chemistry_profile();
+	int16_t temp_decic = (int16_t)(temperature * 10.0f + ((temperature < 0.0f) ? -0.5f : 0.5f));
+	uint32_t v_top = p->ocv_v0_uv + ((uint32_t)(p->ocv_v_size - 1) << p->ocv_v_shift); // Last grid point (uV)
+
+	for (int b = 0; b < OCV_BRANCH_COUNT; b++)
+	{
+		for (int k = 0; k < SOC_EKF_OCV_POINTS; k++)
+		{
+			uint16_t target = (uint16_t)((10000u * k) / (SOC_EKF_OCV_POINTS - 1)); // 0.01% units
+			uint32_t low = p->ocv_v0_uv;
+			uint32_t high = v_top;
+
+			while (high - low > 1) // Lowest voltage whose SOC reaches the target, the surface is non-decreasing
+			{
+				uint32_t mid = low + (high - low) / 2;
+
+				if (ocv_soc_centi(mid, temp_decic, (OcvBranch)b) >= target)
+				{
+					high = mid;
+				} else {
+					low = mid;
+				}
+			}
+			ocv_table[b][k] = high / 1000000.0f;
+		}
+	}
+
+	ocv_table_temperature = temperature;
+	ocv_table_profile = p;
+}
+
+
+/**
+ * @brief  Start every cell from an OCV estimate
+ *         - soc_percent -> SOC of each cell (%), e.g. from ocv_model_update() at rest
+ */
+void soc_ekf_init(const float *soc_percent, float temperature)
+{
+	build_ocv_table(temperature);
+
+	for (int i = 0; i < NOC; i++)
+	{
+		bank.soc[i] = soc_percent[i] / 100.0f;
+		bank.v_rc[i] = 0.0f;
+		bank.p00[i] = SOC_EKF_P0_SOC;
+		bank.p01[i] = 0.0f;
+		bank.p11[i] = SOC_EKF_P0_VRC;
+	}
+	initialised = 1;
+}
+
+
+/**
+ * @brief  Continue from a saved estimator state, e.g. after a warm reset (see warm_start.c)
+ *         - state -> bank as returned by soc_ekf_state() before the reset
+ */
+void soc_ekf_restore(const SocEkfBank *state, float temperature)
+{
+	build_ocv_table(temperature);
+	bank = *state;
+	initialised = 1;
+}
+
+
+/**
+ * @brief  Check whether the estimator has been started
+ */
+int soc_ekf_is_initialised()
+{
+	return initialised;
+}
+
+
+/**
+ * @brief  One predict and correct step for all cells
+ *         - cell_volt -> measured cell voltages (V), index as volt[]
+ *         - cell_current -> current through each cell (A), positive discharges the cell
+ *         - dt_s -> time since the last update (s)
+ *         - temperature -> pack temperature (degC)
+ */
+void soc_ekf_update(const float *cell_volt, const float *cell_current, float dt_s, float temperature)
+{
+	float ocv[NOC]; // OCV at the predicted SOC (V)
+	float slope[NOC]; // dOCV / dSOC at the predicted SOC (V per unit SOC)
+	uint32_t start;
+
+	if (!initialised || dt_s <= 0.0f)
+	{
+		return;
+	}
+
+	if (ocv_table_profile != chemistry_profile() || fabsf(temperature - ocv_table_temperature) > SOC_EKF_OCV_REBUILD_C)
+	{
+		build_ocv_table(temperature); // Outside the timed section, rare
+	}
+
+	start = cycle_timer_now();
+
+	// Coefficients shared by all cells
+	float a = expf(-dt_s / SOC_EKF_TAU_S);
+	float b = SOC_EKF_R1_OHM * (1.0f - a);
+	float coulomb = SOC_EKF_EFFICIENCY * dt_s / (3.6f * chemistry_profile()->capacity_mAh); // SOC fraction per amp
+	float a2 = a * a;
+
+	// Predict
+	for (int i = 0; i < NOC; i++)
+	{
+		bank.soc[i] -= coulomb * cell_current[i];
+		bank.v_rc[i] = a * bank.v_rc[i] + b * cell_current[i];
+		bank.p00[i] += SOC_EKF_Q_SOC;
+		bank.p01[i] *= a;
+		bank.p11[i] = a2 * bank.p11[i] + SOC_EKF_Q_VRC;
+	}
+
+	// OCV and slope at the predicted SOC, table of each cell's hysteresis branch
+	for (int i = 0; i < NOC; i++)
+	{
+		const float *table = ocv_table[ocv_model_get_branch(i)];
+		float x = bank.soc[i] * (SOC_EKF_OCV_POINTS - 1);
+		int k = (int)x;
+
+		k = (k < 0) ? 0 : (k > SOC_EKF_OCV_POINTS - 2) ? SOC_EKF_OCV_POINTS - 2 : k;
+		slope[i] = (table[k + 1] - table[k]) * (SOC_EKF_OCV_POINTS - 1);
+		ocv[i] = table[k] + (x - k) * (table[k + 1] - table[k]);
+	}
+
+	// Correct, H = [slope, -1]
+	for (int i = 0; i < NOC; i++)
+	{
+		float h = slope[i];
+		float innovation = cell_volt[i] - (ocv[i] - bank.v_rc[i] - SOC_EKF_R0_OHM * cell_current[i]);
+		float ph0 = h * bank.p00[i] - bank.p01[i]; // (P H')[0]
+		float ph1 = h * bank.p01[i] - bank.p11[i]; // (P H')[1]
+		float inv_s = 1.0f / (h * ph0 - ph1 + SOC_EKF_R_V); // 1 / (H P H' + R)
+		float k0 = ph0 * inv_s;
+		float k1 = ph1 * inv_s;
+
+		bank.soc[i] += k0 * innovation;
+		bank.v_rc[i] += k1 * innovation;
+		bank.p00[i] -= k0 * ph0;
+		bank.p01[i] -= k0 * ph1;
+		bank.p11[i] -= k1 * ph1;
+
+		bank.soc[i] = fminf(fmaxf(bank.soc[i], 0.0f), 1.0f); // Keep SOC physical
+	}
+
+	last_cycles_per_cell = (cycle_timer_now() - start) / NOC;
+}
+
+
+/**
+ * @brief  SOC estimate of every cell (%)
+ */
+void soc_ekf_get_soc(float *soc_percent)
+{
+	for (int i = 0; i < NOC; i++)
+	{
+		soc_percent[i] = bank.soc[i] * 100.0f;
+	}
+}
+
+
+/**
+ * @brief  Full estimator state
+ */
+const SocEkfBank *soc_ekf_state()
+{
+	return &bank;
+}
+
+
+/**
+ * @brief  CPU cycles per cell in the last update
+ */
+uint32_t soc_ekf_cycles_per_cell()
+{
+	return last_cycles_per_cell;
+}
+
+
+/**
+ * @brief  Export estimates over the serial monitor
+ *
+ *   $EKF,<cycles per cell>,<budget>,<SOC % cell 1>,<SOC sigma % cell 1>,...,<cell NOC>
+ */
+void soc_ekf_print_report()
+{
+	printf("$EKF,%lu,%d", (unsigned long)last_cycles_per_cell, SOC_EKF_CYCLE_BUDGET);
+	for (int cell = 1; cell <= NOC; cell++)
+	{
+		int i = NOC - cell;
+		printf(",%.2f,%.2f", bank.soc[i] * 100.0f, sqrtf(bank.p00[i]) * 100.0f);
+	}
+	printf("\n");
+
+	if (last_cycles_per_cell > SOC_EKF_CYCLE_BUDGET)
+	{
+		printf("SOC estimator over budget: %lu cycles per cell (budget %d)\n", (unsigned long)last_cycles_per_cell, SOC_EKF_CYCLE_BUDGET);
+	}
+}
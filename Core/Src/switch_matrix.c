@@ -8,77 +8,224 @@
 /* ***** HEADER FILES ***** */
 // Include necessary header files for program to run
 #include "switch_matrix.h" // Include header file for switch matrix operation
+#include "cycle_timer.h" // Include microsecond delay for dead time
+#include "pack_config.h" // Include number of cells
 #include <stdio.h> // Include standard I/O functions
 
+/*
+ * Each cell path is a const table entry of one BSRR word per GPIO port: the low
+ * half sets the path MOSFETs, the high half resets every other switch matrix
+ * MOSFET on that port. Enabling a path is one store per port, so all MOSFETs of
+ * the path on a port change in the same bus cycle and the ports follow within a
+ * few CPU cycles.
+ *
+ * The table is generated at compile time from NOC and the MOSFET wiring list:
+ *   - MOS1 to MOS4 select the polarity, odd cells use MOS2 + MOS4, even cells MOS1 + MOS3
+ *   - MOS5 to MOS(NOC + 5) connect the cell stack, cell n uses MOS(NOC + 5 - n) and MOS(NOC + 6 - n)
+ * A larger pack only needs its extra MOSFETs added to SWITCH_MATRIX_MOSFETS.
+ *
+ * Topology used by the interlock checks (stack node k is the top of cell k, node 0 the pack negative):
+ *   - stack MOSFET m (5 to NOC + 5) connects node NOC + 5 - m to the odd or even rail, by node parity
+ *   - MOS2 connects the odd rail and MOS1 the even rail to the flyback output positive
+ *   - MOS3 connects the odd rail and MOS4 the even rail to the flyback output negative
+ * A switch state (bit m = MOS m on) is short-free when each rail carries at most one
+ * node and no rail or output terminal is connected to both sides. A valid path to cell
+ * n additionally connects node n to the positive output and node n - 1 to the negative.
+ * Every table entry is proven short-free and valid at compile time. At runtime the
+ * GPIO output registers are read back and compared with the table before PWM starts.
+ */
+
+/* ***** DEFINE CONSTANTS ***** */
+// GPIO ports used by the switch matrix, index into matrix_ports
+#define SM_PORT_A 0
+#define SM_PORT_B 1
+#define SM_PORT_C 2
+#define SM_PORT_COUNT 3
+
+/**
+ * @brief Switch matrix MOSFET wiring: X(MOSFET number, port index, pin, ...)
+ */
+#define SWITCH_MATRIX_MOSFETS(X, p, n) \
+	X(1, SM_PORT_A, MCU_SW_MOS1_Pin, p, n) \
+	X(2, SM_PORT_C, MCU_SW_MOS2_Pin, p, n) \
+	X(3, SM_PORT_C, MCU_SW_MOS3_Pin, p, n) \
+	X(4, SM_PORT_A, MCU_SW_MOS4_Pin, p, n) \
+	X(5, SM_PORT_B, MCU_SW_MOS5_Pin, p, n) \
+	X(6, SM_PORT_B, MCU_SW_MOS6_Pin, p, n) \
+	X(7, SM_PORT_A, MCU_SW_MOS7_Pin, p, n) \
+	X(8, SM_PORT_A, MCU_SW_MOS8_Pin, p, n) \
+	X(9, SM_PORT_B, MCU_SW_MOS9_Pin, p, n) \
+	X(10, SM_PORT_B, MCU_SW_MOS10_Pin, p, n) \
+	X(11, SM_PORT_A, MCU_SW_MOS11_Pin, p, n)
+
+// MOSFET m is part of the path to cell n
+#define SM_IN_PATH(m, n) ((m) == NOC + 5 - (n) || (m) == NOC + 6 - (n) \
+		|| (m) == (((n) % 2) ? 2 : 1) || (m) == (((n) % 2) ? 4 : 3))
+
+// Pin masks on port p, built by OR-ing over the wiring list
+#define SM_PATH_BIT(m, port, pin, p, n) | (((port) == (p) && SM_IN_PATH(m, n)) ? (uint32_t)(pin) : 0u)
+#define SM_PORT_BIT(m, port, pin, p, n) | (((port) == (p)) ? (uint32_t)(pin) : 0u)
+#define SM_PATH_MASK(p, n) (0u SWITCH_MATRIX_MOSFETS(SM_PATH_BIT, p, n)) // Path MOSFETs of cell n on port p
+#define SM_PORT_MASK(p) (0u SWITCH_MATRIX_MOSFETS(SM_PORT_BIT, p, 0)) // All switch matrix MOSFETs on port p
+
+// Topology, see description above
+#define SM_MOS(m) (1u << (m)) // Bit for MOSFET m in a switch state
+#define SM_NODE(m) (NOC + 5 - (m)) // Stack node connected by stack MOSFET m
+#define SM_NODE_MOS(k) (NOC + 5 - (k)) // Stack MOSFET connecting node k
+#define SM_ODD_BIT(m, port, pin, p, n) | (((m) >= 5 && SM_NODE(m) % 2 == 1) ? SM_MOS(m) : 0u)
+#define SM_EVEN_BIT(m, port, pin, p, n) | (((m) >= 5 && SM_NODE(m) % 2 == 0) ? SM_MOS(m) : 0u)
+#define SM_ODD_RAIL (0u SWITCH_MATRIX_MOSFETS(SM_ODD_BIT, 0, 0)) // Stack MOSFETs on the odd rail
+#define SM_EVEN_RAIL (0u SWITCH_MATRIX_MOSFETS(SM_EVEN_BIT, 0, 0)) // Stack MOSFETs on the even rail
+#define SM_POS_ODD SM_MOS(2) // Odd rail to output positive
+#define SM_POS_EVEN SM_MOS(1) // Even rail to output positive
+#define SM_NEG_ODD SM_MOS(3) // Odd rail to output negative
+#define SM_NEG_EVEN SM_MOS(4) // Even rail to output negative
+
+#define SM_AT_MOST_ONE(x) (((x) & ((x) - 1)) == 0)
+#define SM_BOTH(s, a, b) (((s) & ((a) | (b))) == ((a) | (b)))
+#define SM_SHORT_FREE(s) (SM_AT_MOST_ONE((s) & SM_ODD_RAIL) && SM_AT_MOST_ONE((s) & SM_EVEN_RAIL) \
+		&& !SM_BOTH(s, SM_POS_ODD, SM_NEG_ODD) && !SM_BOTH(s, SM_POS_EVEN, SM_NEG_EVEN) \
+		&& !SM_BOTH(s, SM_POS_ODD, SM_POS_EVEN) && !SM_BOTH(s, SM_NEG_ODD, SM_NEG_EVEN))
+#define SM_VALID_PATH(s, n) ((s) == (SM_MOS(SM_NODE_MOS(n)) | SM_MOS(SM_NODE_MOS((n) - 1)) \
+		| (((n) % 2) ? (SM_POS_ODD | SM_NEG_EVEN) : (SM_POS_EVEN | SM_NEG_ODD))))
+
+// Switch state driven by table entry n, the pin sanity checks below make pins and MOSFETs one-to-one
+#define SM_ENTRY_BIT(m, port, pin, p, n) | (SM_IN_PATH(m, n) ? SM_MOS(m) : 0u)
+#define SM_ENTRY_STATE(n) (0u SWITCH_MATRIX_MOSFETS(SM_ENTRY_BIT, 0, n))
+#define SM_ASSERT_ENTRY(n) _Static_assert(SM_SHORT_FREE(SM_ENTRY_STATE(n)) && SM_VALID_PATH(SM_ENTRY_STATE(n), n), "switch matrix path is not short-free");
+
+// Wiring list sanity: one entry per MOSFET and no pin shared by two MOSFETs
+#define SM_COUNT_BIT(m, port, pin, p, n) + 1
+#define SM_SUM_BIT(m, port, pin, p, n) + (((port) == (p)) ? (uint32_t)(pin) : 0u)
+#define SM_PORT_SUM(p) (0u SWITCH_MATRIX_MOSFETS(SM_SUM_BIT, p, 0))
+
+// BSRR word: set the path, reset the rest of the matrix on the same port
+#define SM_BSRR(p, n) (SM_PATH_MASK(p, n) | ((SM_PORT_MASK(p) & ~SM_PATH_MASK(p, n)) << 16))
+#define SM_PATH_ENTRY(n) { SM_BSRR(SM_PORT_A, n), SM_BSRR(SM_PORT_B, n), SM_BSRR(SM_PORT_C, n) },
+
+// Expand M(1) ... M(NOC)
+#define SM_CAT_(a, b) a##b
+#define SM_CAT(a, b) SM_CAT_(a, b)
+#define SM_REPEAT_1(M) M(1)
+#define SM_REPEAT_2(M) SM_REPEAT_1(M) M(2)
+#define SM_REPEAT_3(M) SM_REPEAT_2(M) M(3)
+#define SM_REPEAT_4(M) SM_REPEAT_3(M) M(4)
+#define SM_REPEAT_5(M) SM_REPEAT_4(M) M(5)
+#define SM_REPEAT_6(M) SM_REPEAT_5(M) M(6)
+#define SM_REPEAT_7(M) SM_REPEAT_6(M) M(7)
+#define SM_REPEAT_8(M) SM_REPEAT_7(M) M(8)
+#define SM_REPEAT_9(M) SM_REPEAT_8(M) M(9)
+#define SM_REPEAT_10(M) SM_REPEAT_9(M) M(10)
+#define SM_REPEAT_11(M) SM_REPEAT_10(M) M(11)
+#define SM_REPEAT_12(M) SM_REPEAT_11(M) M(12)
+#define SM_REPEAT(n, M) SM_CAT(SM_REPEAT_, n)(M)
+
+/* ***** COMPILE-TIME INTERLOCK ***** */
+_Static_assert((0 SWITCH_MATRIX_MOSFETS(SM_COUNT_BIT, 0, 0)) == NOC + 5, "switch matrix needs NOC + 5 MOSFETs");
+_Static_assert(SM_PORT_SUM(SM_PORT_A) == SM_PORT_MASK(SM_PORT_A), "two MOSFETs share a GPIOA pin");
+_Static_assert(SM_PORT_SUM(SM_PORT_B) == SM_PORT_MASK(SM_PORT_B), "two MOSFETs share a GPIOB pin");
+_Static_assert(SM_PORT_SUM(SM_PORT_C) == SM_PORT_MASK(SM_PORT_C), "two MOSFETs share a GPIOC pin");
+SM_REPEAT(NOC, SM_ASSERT_ENTRY)
+
+/* ***** SWITCH MATRIX TABLES ***** */
+static GPIO_TypeDef *const matrix_ports[SM_PORT_COUNT] = {GPIOA, GPIOB, GPIOC}; // Port for each port index
+
+static const uint32_t path_bsrr[NOC][SM_PORT_COUNT] = { SM_REPEAT(NOC, SM_PATH_ENTRY) }; // BSRR words per cell path (index = cell number - 1)
+
+static const uint16_t port_mask[SM_PORT_COUNT] = { // Switch matrix pins on each port
+	SM_PORT_MASK(SM_PORT_A),
+	SM_PORT_MASK(SM_PORT_B),
+	SM_PORT_MASK(SM_PORT_C)
+};
+
+static const uint32_t reset_bsrr[SM_PORT_COUNT] = { // BSRR words that turn every switch matrix MOSFET off
+	SM_PORT_MASK(SM_PORT_A) << 16,
+	SM_PORT_MASK(SM_PORT_B) << 16,
+	SM_PORT_MASK(SM_PORT_C) << 16
+};
+
+
+/**
+ * @brief  Write one BSRR word to each switch matrix port
+ */
+static void write_ports(const uint32_t bsrr[SM_PORT_COUNT])
+{
+	for (int i = 0; i < SM_PORT_COUNT; i++)
+	{
+		matrix_ports[i]->BSRR = bsrr[i]; // Set and reset in a single store
+	}
+}
+
+
+/**
+ * @brief  Confirm from the GPIO output registers that the matrix drives exactly one state
+ *         - target_cell -> cell whose path should be on, 0 for all MOSFETs off
+ *         - Returns 1 if the read back state matches, 0 otherwise
+ */
+int switch_matrix_verify(int target_cell)
+{
+	if (target_cell < 0 || target_cell > NOC)
+	{
+		return 0;
+	}
+
+	for (int i = 0; i < SM_PORT_COUNT; i++)
+	{
+		uint32_t expected = target_cell ? (path_bsrr[target_cell - 1][i] & 0xFFFF) : 0; // Set half of the table entry
+
+		if ((matrix_ports[i]->ODR & port_mask[i]) != expected)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+
+/**
+ * @brief  Select the switch matrix path to a cell without serial output
+ *         - Refused unless every MOSFET is off, so two paths can never overlap
+ *         - Returns 0 on success, -1 if refused or the read back state is wrong
+ */
+int switch_matrix_select(int target_cell)
+{
+	if (target_cell < 1 || target_cell > NOC) // No path for this cell
+	{
+		return -1;
+	}
+
+	if (!switch_matrix_verify(0)) // Another path is still on, ports would pass through a mixed state
+	{
+		return -1;
+	}
+
+	write_ports(path_bsrr[target_cell - 1]); // Switch all path MOSFETs together
+
+	if (!switch_matrix_verify(target_cell)) // Output registers do not hold the commanded path
+	{
+		write_ports(reset_bsrr);
+		return -1;
+	}
+
+	cycle_timer_delay_us(SWITCH_MATRIX_DEAD_TIME_US); // Let the gates settle before the flyback starts
+	return 0;
+}
 
 
 /**
  * @brief  Enable the switch matrix path to the specified target cell
+ *         - Returns 0 on success, -1 if the path was refused
  */
-void enable_cell_path(int target_cell)
+int enable_cell_path(int target_cell)
 {
-	switch (target_cell) // Execution based on target cell
+	if (switch_matrix_select(target_cell) != 0)
 	{
-		case 1: // Activate MOSFETs for Cell 1 balancing path
-			HAL_GPIO_WritePin(MCU_SW_MOS2_GPIO_Port, MCU_SW_MOS2_Pin, GPIO_PIN_SET); // Activate MOSFET 2
-			HAL_GPIO_WritePin(MCU_SW_MOS4_GPIO_Port, MCU_SW_MOS4_Pin, GPIO_PIN_SET); // Activate MOSFET 4
-			HAL_GPIO_WritePin(MCU_SW_MOS10_GPIO_Port, MCU_SW_MOS10_Pin, GPIO_PIN_SET); // Activate MOSFET 10
-			HAL_GPIO_WritePin(MCU_SW_MOS11_GPIO_Port, MCU_SW_MOS11_Pin, GPIO_PIN_SET); // Activate MOSFET 11
-
-			HAL_Delay(500);
-			printf("Cell 1 target path enabled...\n"); // Print message
-			break;
-
-		case 2: // Activate MOSFETs for Cell 2 balancing path
-			HAL_GPIO_WritePin(MCU_SW_MOS1_GPIO_Port, MCU_SW_MOS1_Pin, GPIO_PIN_SET); // Activate MOSFET 1
-			HAL_GPIO_WritePin(MCU_SW_MOS3_GPIO_Port, MCU_SW_MOS3_Pin, GPIO_PIN_SET); // Activate MOSFET 3
-			HAL_GPIO_WritePin(MCU_SW_MOS9_GPIO_Port, MCU_SW_MOS9_Pin, GPIO_PIN_SET); // Activate MOSFET 9
-			HAL_GPIO_WritePin(MCU_SW_MOS10_GPIO_Port, MCU_SW_MOS10_Pin, GPIO_PIN_SET); // Activate MOSFET 10
-
-			HAL_Delay(500);
-			printf("Cell 2 target path enabled...\n"); // Print message
-			break;
-
-		case 3: // Activate MOSFETs for Cell 3 balancing path
-			HAL_GPIO_WritePin(MCU_SW_MOS2_GPIO_Port, MCU_SW_MOS2_Pin, GPIO_PIN_SET); // Activate MOSFET 2
-			HAL_GPIO_WritePin(MCU_SW_MOS4_GPIO_Port, MCU_SW_MOS4_Pin, GPIO_PIN_SET); // Activate MOSFET 4
-			HAL_GPIO_WritePin(MCU_SW_MOS8_GPIO_Port, MCU_SW_MOS8_Pin, GPIO_PIN_SET); // Activate MOSFET 8
-			HAL_GPIO_WritePin(MCU_SW_MOS9_GPIO_Port, MCU_SW_MOS9_Pin, GPIO_PIN_SET); // Activate MOSFET 9
-
-			HAL_Delay(500);
-			printf("Cell 3 target path enabled...\n"); // Print message
-			break;
-
-		case 4: // Activate MOSFETs for Cell 4 balancing path
-			HAL_GPIO_WritePin(MCU_SW_MOS1_GPIO_Port, MCU_SW_MOS1_Pin, GPIO_PIN_SET); // Activate MOSFET 1
-			HAL_GPIO_WritePin(MCU_SW_MOS3_GPIO_Port, MCU_SW_MOS3_Pin, GPIO_PIN_SET); // Activate MOSFET 3
-			HAL_GPIO_WritePin(MCU_SW_MOS7_GPIO_Port, MCU_SW_MOS7_Pin, GPIO_PIN_SET); // Activate MOSFET 7
-			HAL_GPIO_WritePin(MCU_SW_MOS8_GPIO_Port, MCU_SW_MOS8_Pin, GPIO_PIN_SET); // Activate MOSFET 8
-
-			HAL_Delay(500);
-			printf("Cell 4 target path enabled...\n"); // Print message
-			break;
-
-		case 5: // Activate MOSFETs for Cell 5 balancing path
-			HAL_GPIO_WritePin(MCU_SW_MOS2_GPIO_Port, MCU_SW_MOS2_Pin, GPIO_PIN_SET); // Activate MOSFET 2
-			HAL_GPIO_WritePin(MCU_SW_MOS4_GPIO_Port, MCU_SW_MOS4_Pin, GPIO_PIN_SET); // Activate MOSFET 4
-			HAL_GPIO_WritePin(MCU_SW_MOS6_GPIO_Port, MCU_SW_MOS6_Pin, GPIO_PIN_SET); // Activate MOSFET 6
-			HAL_GPIO_WritePin(MCU_SW_MOS7_GPIO_Port, MCU_SW_MOS7_Pin, GPIO_PIN_SET); // Activate MOSFET 7
-
-			HAL_Delay(500);
-			printf("Cell 5 target path enabled...\n"); // Print message
-			break;
-
-		case 6: // Activate MOSFETs for Cell 6 balancing path
-			HAL_GPIO_WritePin(MCU_SW_MOS1_GPIO_Port, MCU_SW_MOS1_Pin, GPIO_PIN_SET); // Activate MOSFET 1
-			HAL_GPIO_WritePin(MCU_SW_MOS3_GPIO_Port, MCU_SW_MOS3_Pin, GPIO_PIN_SET); // Activate MOSFET 3
-			HAL_GPIO_WritePin(MCU_SW_MOS5_GPIO_Port, MCU_SW_MOS5_Pin, GPIO_PIN_SET); // Activate MOSFET 5
-			HAL_GPIO_WritePin(MCU_SW_MOS6_GPIO_Port, MCU_SW_MOS6_Pin, GPIO_PIN_SET); // Activate MOSFET 6
-
-			HAL_Delay(500);
-			printf("Cell 6 target path enabled...\n"); // Print message
-			break;
+		printf("Cell %d path refused (invalid cell, matrix not idle or read back failed)\n", target_cell);
+		return -1;
 	}
+
+	printf("Cell %d target path enabled...\n", target_cell); // Print message
+	return 0;
 }
 
 
@@ -87,19 +234,7 @@ void enable_cell_path(int target_cell)
  */
 void switch_matrix_reset()
 {
-	HAL_Delay(500);
-
-	HAL_GPIO_WritePin(MCU_SW_MOS1_GPIO_Port, MCU_SW_MOS1_Pin, GPIO_PIN_RESET); // Deactivate MOSFET 1
-	HAL_GPIO_WritePin(MCU_SW_MOS2_GPIO_Port, MCU_SW_MOS2_Pin, GPIO_PIN_RESET); // Deactivate MOSFET 2
-	HAL_GPIO_WritePin(MCU_SW_MOS3_GPIO_Port, MCU_SW_MOS3_Pin, GPIO_PIN_RESET); // Deactivate MOSFET 3
-	HAL_GPIO_WritePin(MCU_SW_MOS4_GPIO_Port, MCU_SW_MOS4_Pin, GPIO_PIN_RESET); // Deactivate MOSFET 4
-	HAL_GPIO_WritePin(MCU_SW_MOS5_GPIO_Port, MCU_SW_MOS5_Pin, GPIO_PIN_RESET); // Deactivate MOSFET 5
-	HAL_GPIO_WritePin(MCU_SW_MOS6_GPIO_Port, MCU_SW_MOS6_Pin, GPIO_PIN_RESET); // Deactivate MOSFET 6
-	HAL_GPIO_WritePin(MCU_SW_MOS7_GPIO_Port, MCU_SW_MOS7_Pin, GPIO_PIN_RESET); // Deactivate MOSFET 7
-	HAL_GPIO_WritePin(MCU_SW_MOS8_GPIO_Port, MCU_SW_MOS8_Pin, GPIO_PIN_RESET); // Deactivate MOSFET 8
-	HAL_GPIO_WritePin(MCU_SW_MOS9_GPIO_Port, MCU_SW_MOS9_Pin, GPIO_PIN_RESET); // Deactivate MOSFET 9
-	HAL_GPIO_WritePin(MCU_SW_MOS10_GPIO_Port, MCU_SW_MOS10_Pin, GPIO_PIN_RESET); // Deactivate MOSFET 10
-	HAL_GPIO_WritePin(MCU_SW_MOS11_GPIO_Port, MCU_SW_MOS11_Pin, GPIO_PIN_RESET); // Deactivate MOSFET 11
-}
-
+	write_ports(reset_bsrr); // Turn every matrix MOSFET off
 
+	cycle_timer_delay_us(SWITCH_MATRIX_DEAD_TIME_US); // Dead time before another path may be enabled
+}
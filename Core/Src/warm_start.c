@@ -0,0 +1,207 @@
+/**
+  ******************************************************************************
+  * @file           : warm_start.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "warm_start.h" // Include header file for warm start functions
+#include "watchdog.h" // Include reset cause
+#include <stddef.h> // Include offsetof()
+#include <stdio.h> // Include standard I/O functions
+#include <string.h> // Include memcpy()
+
+/*
+ * Keeps the state that a cold boot loses - the Kalman filter, the hysteresis
+ * branch of every cell, the rest point and charge counted since it, and the
+ * fault debounce state with its latches and trip counts - in a .noinit RAM block
+ * that the startup code does not clear. main.c calls warm_start_save() after
+ * every monitoring cycle, and the CRC16 over the block is written last, so a
+ * reset in the middle of a save leaves a block that is rejected.
+ *
+ * The block is trusted only after a reset that kept power (watchdog, reset pin,
+ * software reset, see watchdog.c): the RAM content is undefined after power-up.
+ * The backup registers would survive a power loss only with a battery on VBAT,
+ * which the board does not have, and hold 128 bytes against the ~630 needed.
+ *
+ * The cell monitor is powered by the stack, not by the MCU, so after a warm
+ * reset it is still awake and configured. The block holds a shadow of the
+ * register writes last made to it; when it matches the configuration the
+ * firmware would write, main.c skips the power-down, wake-up and
+ * initialisation and takes the first protected sample straight away. The
+ * shadow is emptied before the writes start and filled once they end, so an
+ * interrupted configuration is repeated.
+ *
+ * Estimation resumes from the retained state. The time between the last save
+ * and the reset (at most one monitoring period plus the watchdog timeout) is
+ * not counted; the SOC estimator corrects for it on the next cell readings.
+ */
+
+/* ***** WARM START STATE ***** */
+static WarmStartState block __attribute__((section(".noinit"))); // Kept through a reset without power loss
+static int warm = 0; // 1 if this boot resumed from the block
+static uint32_t first_sample_ms = 0; // Time from reset to the first protected sample, 0 until it is taken
+
+
+/**
+ * @brief  CRC16 of the retained state after the header
+ */
+static uint16_t block_crc()
+{
+	return CRC16((BYTE *)&block + offsetof(WarmStartState, size), sizeof(block) - offsetof(WarmStartState, size));
+}
+
+
+/**
+ * @brief  Update the CRC after changing the block
+ */
+static void seal()
+{
+	block.crc = block_crc();
+}
+
+
+/**
+ * @brief  Check whether the block holds a complete state of this layout
+ */
+static int block_valid()
+{
+	return block.magic == WARM_START_MAGIC && block.version == WARM_START_VERSION && block.size == sizeof(block)
+			&& block.shadow_count <= WARM_START_SHADOW_MAX && block.crc == block_crc();
+}
+
+
+/**
+ * @brief  Validate the retained state and count the boot
+ *         - Returns 1 on a warm boot (reset without power loss and a valid block), 0 on a cold boot
+ */
+int warm_start_init()
+{
+	warm = block_valid() && watchdog_record()->reset_cause != WATCHDOG_CAUSE_POWER;
+
+	if (!warm)
+	{
+		memset(&block, 0, sizeof(block));
+		block.magic = WARM_START_MAGIC;
+		block.version = WARM_START_VERSION;
+		block.size = sizeof(block);
+	} else {
+		block.warm_boots++;
+		printf("Warm start %lu since power-up, resuming from retained state\n", (unsigned long)block.warm_boots);
+	}
+	seal();
+	return warm;
+}
+
+
+/**
+ * @brief  Continue estimation and fault handling from the retained state, call after the module inits on a warm boot
+ *         - temperature -> pack temperature (degC) for the estimator's OCV table
+ */
+void warm_start_restore(float temperature)
+{
+	if (!warm)
+	{
+		return;
+	}
+
+	if (block.estimator_valid)
+	{
+		soc_ekf_restore(&block.ekf, temperature);
+		ocv_model_restore(block.ocv);
+		cell_health_restore_tracking(&block.health);
+	}
+	fault_restore(block.faults); // Latched faults stay latched through the reset
+}
+
+
+/**
+ * @brief  Check the cell monitor still holds a configuration
+ *         - config -> register writes of the configuration sequence
+ *         - count -> number of writes
+ *         - Returns 1 on a warm boot whose shadow matches every write, 0 otherwise
+ */
+int warm_start_chip_configured(const ChipRegWrite *config, int count)
+{
+	if (!warm || block.shadow_count != count)
+	{
+		return 0;
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		const ChipRegWrite *s = &block.shadow[i];
+
+		if (s->addr != config[i].addr || s->value != config[i].value || s->len != config[i].len || s->type != config[i].type)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+
+/**
+ * @brief  Record the configuration written to the cell monitor
+ *         - count -> number of writes, 0 before starting the writes so an interrupted sequence is not trusted
+ */
+void warm_start_set_chip(const ChipRegWrite *config, int count)
+{
+	if (count > WARM_START_SHADOW_MAX)
+	{
+		count = 0; // Not retained, every boot configures the cell monitor
+	}
+	memcpy(block.shadow, config, count * sizeof(ChipRegWrite));
+	block.shadow_count = (uint8_t)count;
+	seal();
+}
+
+
+/**
+ * @brief  Retain the estimator and fault state, call once per monitoring cycle and when a fault changes
+ */
+void warm_start_save()
+{
+	block.estimator_valid = soc_ekf_is_initialised();
+	block.ekf = *soc_ekf_state();
+	memcpy(block.ocv, ocv_model_state(), sizeof(block.ocv));
+	cell_health_get_tracking(&block.health);
+	for (int id = 0; id < FAULT_COUNT; id++)
+	{
+		block.faults[id] = *fault_state((FaultId)id);
+	}
+	seal();
+}
+
+
+/**
+ * @brief  Report the time from reset to the first protected sample, once
+ *         - The HAL tick starts at reset, so it is the time since reset to within the startup code
+ *         - Returns 1 on the call that reported, 0 afterwards
+ */
+int warm_start_first_sample()
+{
+	if (first_sample_ms != 0)
+	{
+		return 0;
+	}
+
+	first_sample_ms = HAL_GetTick();
+	printf("First protected sample %lums after reset (%s boot)\n", (unsigned long)first_sample_ms, warm ? "warm" : "cold");
+	warm_start_print_report();
+	return 1;
+}
+
+
+/**
+ * @brief  Export boot type, time to the first protected sample and warm boots over the serial monitor
+ *
+ *   $BOOT,<warm>,<ms from reset to first protected sample, 0 until taken>,<warm boots since power-up>,<reset cause>,<retained bytes>
+ */
+void warm_start_print_report()
+{
+	printf("$BOOT,%d,%lu,%lu,%u,%u\n", warm, (unsigned long)first_sample_ms, (unsigned long)block.warm_boots,
+			watchdog_record()->reset_cause, (unsigned)sizeof(block));
+}
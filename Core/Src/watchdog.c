@@ -0,0 +1,222 @@
+/**
+  ******************************************************************************
+  * @file           : watchdog.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "watchdog.h" // Include header file for watchdog supervision functions
+#include "current_sense.h" // Include current sense block time
+#include <stdio.h> // Include standard I/O functions
+
+/*
+ * Supervises the periodic tasks with the independent watchdog (IWDG), which runs
+ * from the LSI and resets the device even if the core clock or the code stops.
+ *
+ * Every task calls watchdog_checkin() each time it runs, and watchdog_service()
+ * (main loop) kicks the IWDG only while every task has checked in within its
+ * deadline. A hang anywhere - a blocking UART transmit, a stuck ADC or DMA, an
+ * interrupt storm - therefore ends in a reset within WATCHDOG_TIMEOUT_MS, which
+ * returns every output to its reset state: PWM off, switch matrix open, relay
+ * open. When the main loop is still running it opens them straight away (see
+ * main.c).
+ *
+ * The record in .noinit RAM is not cleared by the startup code, so after a
+ * watchdog reset it still names the task that missed its deadline and when.
+ * If no miss was found the main loop itself stopped, and the check-in times
+ * show what still ran. A power-on or brown-out reset clears the record.
+ *
+ * The IWDG is driven through its registers; the HAL IWDG driver is not part of
+ * this project. The debug freeze keeps it from resetting the board at a
+ * breakpoint.
+ */
+
+/* ***** DEFINE CONSTANTS ***** */
+#define KEY_RELOAD 0xAAAA // IWDG key register values
+#define KEY_ENABLE 0xCCCC
+#define KEY_WRITE_ACCESS 0x5555
+
+/* ***** WATCHDOG STATE ***** */
+static const uint32_t deadline_ms[WATCHDOG_TASK_COUNT] = {
+	[WATCHDOG_TASK_MAIN_LOOP] = 2500, // Slowest pass, a capture dump, takes about 1.5s
+	[WATCHDOG_TASK_MONITOR] = 6000, // Three monitoring periods, checked in by every cycle whatever the reading
+	[WATCHDOG_TASK_CURRENT_SENSE] = 10 * CURRENT_SENSE_BLOCK_MS, // Ten current sense blocks
+};
+
+static const char *const task_name[WATCHDOG_TASK_COUNT] = {
+	[WATCHDOG_TASK_MAIN_LOOP] = "main loop",
+	[WATCHDOG_TASK_MONITOR] = "cell monitoring",
+	[WATCHDOG_TASK_CURRENT_SENSE] = "current sense",
+};
+
+static WatchdogRecord record __attribute__((section(".noinit"))); // Kept through a watchdog reset
+static int running = 0; // 1 once the IWDG is started
+static int missed = 0; // 1 once a task missed its deadline, the IWDG is no longer kicked
+
+
+/**
+ * @brief  Name of a task, or of the main loop stopping
+ */
+static const char *name_of(uint8_t task)
+{
+	return (task < WATCHDOG_TASK_COUNT) ? task_name[task] : "main loop stopped";
+}
+
+
+/**
+ * @brief  Read the reset cause and the record of the last reset
+ */
+void watchdog_init()
+{
+	uint32_t csr = RCC->CSR;
+	int valid = (record.magic == WATCHDOG_RECORD_MAGIC && record.magic_inv == (uint32_t)~WATCHDOG_RECORD_MAGIC);
+
+	RCC->CSR |= RCC_CSR_RMVF; // Clear the reset flags for the next reset
+
+	if (!valid || (csr & RCC_CSR_BORRSTF)) // RAM content is undefined after power-up
+	{
+		record.magic = WATCHDOG_RECORD_MAGIC;
+		record.magic_inv = ~WATCHDOG_RECORD_MAGIC;
+		record.resets = 0;
+		record.task = WATCHDOG_TASK_NONE;
+		record.reset_cause = WATCHDOG_CAUSE_POWER;
+		record.overdue_ms = 0;
+		record.miss_tick = 0;
+		for (int i = 0; i < WATCHDOG_TASK_COUNT; i++)
+		{
+			record.last_checkin[i] = 0;
+		}
+	} else if (csr & RCC_CSR_IWDGRSTF) {
+		record.reset_cause = WATCHDOG_CAUSE_WATCHDOG;
+		record.resets++;
+	} else {
+		record.reset_cause = WATCHDOG_CAUSE_OTHER;
+		record.task = WATCHDOG_TASK_NONE;
+	}
+
+	if (record.reset_cause == WATCHDOG_CAUSE_WATCHDOG)
+	{
+		printf("WATCHDOG RESET (%lu since power-up): %s", (unsigned long)record.resets, name_of(record.task));
+		if (record.task < WATCHDOG_TASK_COUNT)
+		{
+			printf(" missed its deadline by %lums at %lums", (unsigned long)record.overdue_ms, (unsigned long)record.miss_tick);
+		} else {
+			printf(" after %lums", (unsigned long)record.miss_tick);
+		}
+		printf("\n");
+		watchdog_print_report();
+	}
+}
+
+
+/**
+ * @brief  Start the IWDG with every task checked in now
+ */
+void watchdog_start()
+{
+	uint32_t now = HAL_GetTick();
+
+	for (int i = 0; i < WATCHDOG_TASK_COUNT; i++)
+	{
+		record.last_checkin[i] = now;
+	}
+	record.task = WATCHDOG_TASK_NONE; // Main loop stopping, unless a miss is recorded
+	record.miss_tick = now;
+
+	__HAL_DBGMCU_FREEZE_IWDG(); // Stop the count while the core is halted by the debugger
+	IWDG->KR = KEY_ENABLE; // Starts the LSI and the IWDG
+	IWDG->KR = KEY_WRITE_ACCESS; // Unlock PR and RLR
+	IWDG->PR = WATCHDOG_PRESCALER;
+	IWDG->RLR = WATCHDOG_TIMEOUT_MS / WATCHDOG_COUNT_MS;
+	while (IWDG->SR) // Wait for the LSI domain to take the values
+	{
+	}
+	IWDG->KR = KEY_RELOAD;
+	running = 1;
+}
+
+
+/**
+ * @brief  Report a task as alive
+ */
+void watchdog_checkin(WatchdogTask task)
+{
+	record.last_checkin[task] = HAL_GetTick();
+}
+
+
+/**
+ * @brief  Time since a task last checked in (ms)
+ *         - An interrupt may check in after now was read, such a check-in counts as age 0 rather than wrapping
+ */
+static uint32_t checkin_age(int task, uint32_t now)
+{
+	int32_t age = (int32_t)(now - record.last_checkin[task]);
+
+	return (age > 0) ? (uint32_t)age : 0;
+}
+
+
+/**
+ * @brief  Kick the IWDG if every task met its deadline, call from main loop
+ *         - Returns 0 while healthy, -1 once a task has missed its deadline (the device resets within WATCHDOG_TIMEOUT_MS)
+ */
+int watchdog_service()
+{
+	uint32_t now = HAL_GetTick();
+
+	if (!running || missed)
+	{
+		return missed ? -1 : 0;
+	}
+
+	for (int i = 0; i < WATCHDOG_TASK_COUNT; i++)
+	{
+		uint32_t age = checkin_age(i, now);
+
+		if (age > deadline_ms[i])
+		{
+			record.task = i;
+			record.overdue_ms = age - deadline_ms[i];
+			record.miss_tick = now;
+			missed = 1;
+			printf("WATCHDOG: %s missed its deadline by %lums, reset follows\n", task_name[i], (unsigned long)record.overdue_ms);
+			return -1;
+		}
+	}
+
+	record.miss_tick = now; // Time of the last kick, if the main loop stops
+	IWDG->KR = KEY_RELOAD;
+	return 0;
+}
+
+
+/**
+ * @brief  Reset-surviving record
+ */
+const WatchdogRecord *watchdog_record()
+{
+	return &record;
+}
+
+
+/**
+ * @brief  Export the last reset and the margin of every task over the serial monitor
+ *
+ *   $WDOG,<reset cause>,<watchdog resets>,<missed task>,<overdue ms>,<miss tick ms>,<ms since check-in task 0>,<deadline task 0>,...
+ * After a watchdog reset the check-in ages are those at the last kick before the reset
+ */
+void watchdog_print_report()
+{
+	uint32_t now = running ? HAL_GetTick() : record.miss_tick;
+
+	printf("$WDOG,%u,%lu,%u,%lu,%lu", record.reset_cause, (unsigned long)record.resets, record.task,
+			(unsigned long)record.overdue_ms, (unsigned long)record.miss_tick);
+	for (int i = 0; i < WATCHDOG_TASK_COUNT; i++)
+	{
+		printf(",%lu,%lu", (unsigned long)checkin_age(i, now), (unsigned long)deadline_ms[i]);
+	}
+	printf("\n");
+}
@@ -7,12 +7,32 @@
 C_SRCS += \
 ../Core/Src/active_balancing.c \
 ../Core/Src/adc.c \
+../Core/Src/balancing_accounting.c \
+../Core/Src/balancing_planner.c \
+../Core/Src/balancing_policy.c \
+../Core/Src/balancing_sequencer.c \
+../Core/Src/balancing_trigger.c \
+../Core/Src/blackbox.c \
+../Core/Src/boot_sequencer.c \
+../Core/Src/cell_convert.c \
+../Core/Src/cell_health.c \
+../Core/Src/chemistry_profile.c \
+../Core/Src/current_calibration.c \
+../Core/Src/current_filter.c \
+../Core/Src/current_sense.c \
+../Core/Src/cycle_timer.c \
 ../Core/Src/dma.c \
+../Core/Src/fault_manager.c \
+../Core/Src/flash_storage.c \
 ../Core/Src/flyback_operation.c \
 ../Core/Src/gpio.c \
 ../Core/Src/main.c \
-../Core/Src/molicel_soc_lookup.c \
+../Core/Src/ocv_model.c \
+../Core/Src/ocv_surface.c \
+../Core/Src/pack_stats.c \
 ../Core/Src/pl455.c \
+../Core/Src/serial_console.c \
+../Core/Src/soc_ekf.c \
 ../Core/Src/stm32g4xx_hal_msp.c \
 ../Core/Src/stm32g4xx_it.c \
 ../Core/Src/switch_matrix.c \
@@ -20,17 +40,39 @@ C_SRCS += \
 ../Core/Src/sysmem.c \
 ../Core/Src/system_stm32g4xx.c \
 ../Core/Src/tim.c \
-../Core/Src/usart.c 
+../Core/Src/usart.c \
+../Core/Src/warm_start.c \
+../Core/Src/watchdog.c 
 
 OBJS += \
 ./Core/Src/active_balancing.o \
 ./Core/Src/adc.o \
+./Core/Src/balancing_accounting.o \
+./Core/Src/balancing_planner.o \
+./Core/Src/balancing_policy.o \
+./Core/Src/balancing_sequencer.o \
+./Core/Src/balancing_trigger.o \
+./Core/Src/blackbox.o \
+./Core/Src/boot_sequencer.o \
+./Core/Src/cell_convert.o \
+./Core/Src/cell_health.o \
+./Core/Src/chemistry_profile.o \
+./Core/Src/current_calibration.o \
+./Core/Src/current_filter.o \
+./Core/Src/current_sense.o \
+./Core/Src/cycle_timer.o \
 ./Core/Src/dma.o \
+./Core/Src/fault_manager.o \
+./Core/Src/flash_storage.o \
 ./Core/Src/flyback_operation.o \
 ./Core/Src/gpio.o \
 ./Core/Src/main.o \
-./Core/Src/molicel_soc_lookup.o \
+./Core/Src/ocv_model.o \
+./Core/Src/ocv_surface.o \
+./Core/Src/pack_stats.o \
 ./Core/Src/pl455.o \
+./Core/Src/serial_console.o \
+./Core/Src/soc_ekf.o \
 ./Core/Src/stm32g4xx_hal_msp.o \
 ./Core/Src/stm32g4xx_it.o \
 ./Core/Src/switch_matrix.o \
@@ -38,17 +80,39 @@ OBJS += \
 ./Core/Src/sysmem.o \
 ./Core/Src/system_stm32g4xx.o \
 ./Core/Src/tim.o \
-./Core/Src/usart.o 
+./Core/Src/usart.o \
+./Core/Src/warm_start.o \
+./Core/Src/watchdog.o 
 
 C_DEPS += \
 ./Core/Src/active_balancing.d \
 ./Core/Src/adc.d \
+./Core/Src/balancing_accounting.d \
+./Core/Src/balancing_planner.d \
+./Core/Src/balancing_policy.d \
+./Core/Src/balancing_sequencer.d \
+./Core/Src/balancing_trigger.d \
+./Core/Src/blackbox.d \
+./Core/Src/boot_sequencer.d \
+./Core/Src/cell_convert.d \
+./Core/Src/cell_health.d \
+./Core/Src/chemistry_profile.d \
+./Core/Src/current_calibration.d \
+./Core/Src/current_filter.d \
+./Core/Src/current_sense.d \
+./Core/Src/cycle_timer.d \
 ./Core/Src/dma.d \
+./Core/Src/fault_manager.d \
+./Core/Src/flash_storage.d \
 ./Core/Src/flyback_operation.d \
 ./Core/Src/gpio.d \
 ./Core/Src/main.d \
-./Core/Src/molicel_soc_lookup.d \
+./Core/Src/ocv_model.d \
+./Core/Src/ocv_surface.d \
+./Core/Src/pack_stats.d \
 ./Core/Src/pl455.d \
+./Core/Src/serial_console.d \
+./Core/Src/soc_ekf.d \
 ./Core/Src/stm32g4xx_hal_msp.d \
 ./Core/Src/stm32g4xx_it.d \
 ./Core/Src/switch_matrix.d \
@@ -56,7 +120,9 @@ C_DEPS += \
 ./Core/Src/sysmem.d \
 ./Core/Src/system_stm32g4xx.d \
 ./Core/Src/tim.d \
-./Core/Src/usart.d 
+./Core/Src/usart.d \
+./Core/Src/warm_start.d \
+./Core/Src/watchdog.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -66,7 +132,7 @@ Core/Src/%.o Core/Src/%.su Core/Src/%.cyclo: ../Core/Src/%.c Core/Src/subdir.mk
 clean: clean-Core-2f-Src
 
 clean-Core-2f-Src:
-	-$(RM) ./Core/Src/active_balancing.cyclo ./Core/Src/active_balancing.d ./Core/Src/active_balancing.o ./Core/Src/active_balancing.su ./Core/Src/adc.cyclo ./Core/Src/adc.d ./Core/Src/adc.o ./Core/Src/adc.su ./Core/Src/dma.cyclo ./Core/Src/dma.d ./Core/Src/dma.o ./Core/Src/dma.su ./Core/Src/flyback_operation.cyclo ./Core/Src/flyback_operation.d ./Core/Src/flyback_operation.o ./Core/Src/flyback_operation.su ./Core/Src/gpio.cyclo ./Core/Src/gpio.d ./Core/Src/gpio.o ./Core/Src/gpio.su ./Core/Src/main.cyclo ./Core/Src/main.d ./Core/Src/main.o ./Core/Src/main.su ./Core/Src/molicel_soc_lookup.cyclo ./Core/Src/molicel_soc_lookup.d ./Core/Src/molicel_soc_lookup.o ./Core/Src/molicel_soc_lookup.su ./Core/Src/pl455.cyclo ./Core/Src/pl455.d ./Core/Src/pl455.o ./Core/Src/pl455.su ./Core/Src/stm32g4xx_hal_msp.cyclo ./Core/Src/stm32g4xx_hal_msp.d ./Core/Src/stm32g4xx_hal_msp.o ./Core/Src/stm32g4xx_hal_msp.su ./Core/Src/stm32g4xx_it.cyclo ./Core/Src/stm32g4xx_it.d ./Core/Src/stm32g4xx_it.o ./Core/Src/stm32g4xx_it.su ./Core/Src/switch_matrix.cyclo ./Core/Src/switch_matrix.d ./Core/Src/switch_matrix.o ./Core/Src/switch_matrix.su ./Core/Src/syscalls.cyclo ./Core/Src/syscalls.d ./Core/Src/syscalls.o ./Core/Src/syscalls.su ./Core/Src/sysmem.cyclo ./Core/Src/sysmem.d ./Core/Src/sysmem.o ./Core/Src/sysmem.su ./Core/Src/system_stm32g4xx.cyclo ./Core/Src/system_stm32g4xx.d ./Core/Src/system_stm32g4xx.o ./Core/Src/system_stm32g4xx.su ./Core/Src/tim.cyclo ./Core/Src/tim.d ./Core/Src/tim.o ./Core/Src/tim.su ./Core/Src/usart.cyclo ./Core/Src/usart.d ./Core/Src/usart.o ./Core/Src/usart.su
+	-$(RM) ./Core/Src/active_balancing.cyclo ./Core/Src/active_balancing.d ./Core/Src/active_balancing.o ./Core/Src/active_balancing.su ./Core/Src/adc.cyclo ./Core/Src/adc.d ./Core/Src/adc.o ./Core/Src/adc.su ./Core/Src/balancing_accounting.cyclo ./Core/Src/balancing_accounting.d ./Core/Src/balancing_accounting.o ./Core/Src/balancing_accounting.su ./Core/Src/balancing_planner.cyclo ./Core/Src/balancing_planner.d ./Core/Src/balancing_planner.o ./Core/Src/balancing_planner.su ./Core/Src/balancing_policy.cyclo ./Core/Src/balancing_policy.d ./Core/Src/balancing_policy.o ./Core/Src/balancing_policy.su ./Core/Src/balancing_sequencer.cyclo ./Core/Src/balancing_sequencer.d ./Core/Src/balancing_sequencer.o ./Core/Src/balancing_sequencer.su ./Core/Src/balancing_trigger.cyclo ./Core/Src/balancing_trigger.d ./Core/Src/balancing_trigger.o ./Core/Src/balancing_trigger.su ./Core/Src/blackbox.cyclo ./Core/Src/blackbox.d ./Core/Src/blackbox.o ./Core/Src/blackbox.su ./Core/Src/boot_sequencer.cyclo ./Core/Src/boot_sequencer.d ./Core/Src/boot_sequencer.o ./Core/Src/boot_sequencer.su ./Core/Src/cell_convert.cyclo ./Core/Src/cell_convert.d ./Core/Src/cell_convert.o ./Core/Src/cell_convert.su ./Core/Src/cell_health.cyclo ./Core/Src/cell_health.d ./Core/Src/cell_health.o ./Core/Src/cell_health.su ./Core/Src/chemistry_profile.cyclo ./Core/Src/chemistry_profile.d ./Core/Src/chemistry_profile.o ./Core/Src/chemistry_profile.su ./Core/Src/current_calibration.cyclo ./Core/Src/current_calibration.d ./Core/Src/current_calibration.o ./Core/Src/current_calibration.su ./Core/Src/current_filter.cyclo ./Core/Src/current_filter.d ./Core/Src/current_filter.o ./Core/Src/current_filter.su ./Core/Src/current_sense.cyclo ./Core/Src/current_sense.d ./Core/Src/current_sense.o ./Core/Src/current_sense.su ./Core/Src/cycle_timer.cyclo ./Core/Src/cycle_timer.d ./Core/Src/cycle_timer.o ./Core/Src/cycle_timer.su ./Core/Src/dma.cyclo ./Core/Src/dma.d ./Core/Src/dma.o ./Core/Src/dma.su ./Core/Src/fault_manager.cyclo ./Core/Src/fault_manager.d ./Core/Src/fault_manager.o ./Core/Src/fault_manager.su ./Core/Src/flash_storage.cyclo ./Core/Src/flash_storage.d ./Core/Src/flash_storage.o ./Core/Src/flash_storage.su ./Core/Src/flyback_operation.cyclo ./Core/Src/flyback_operation.d ./Core/Src/flyback_operation.o ./Core/Src/flyback_operation.su ./Core/Src/gpio.cyclo ./Core/Src/gpio.d ./Core/Src/gpio.o ./Core/Src/gpio.su ./Core/Src/main.cyclo ./Core/Src/main.d ./Core/Src/main.o ./Core/Src/main.su ./Core/Src/ocv_model.cyclo ./Core/Src/ocv_model.d ./Core/Src/ocv_model.o ./Core/Src/ocv_model.su ./Core/Src/ocv_surface.cyclo ./Core/Src/ocv_surface.d ./Core/Src/ocv_surface.o ./Core/Src/ocv_surface.su ./Core/Src/pack_stats.cyclo ./Core/Src/pack_stats.d ./Core/Src/pack_stats.o ./Core/Src/pack_stats.su ./Core/Src/pl455.cyclo ./Core/Src/pl455.d ./Core/Src/pl455.o ./Core/Src/pl455.su ./Core/Src/serial_console.cyclo ./Core/Src/serial_console.d ./Core/Src/serial_console.o ./Core/Src/serial_console.su ./Core/Src/soc_ekf.cyclo ./Core/Src/soc_ekf.d ./Core/Src/soc_ekf.o ./Core/Src/soc_ekf.su ./Core/Src/stm32g4xx_hal_msp.cyclo ./Core/Src/stm32g4xx_hal_msp.d ./Core/Src/stm32g4xx_hal_msp.o ./Core/Src/stm32g4xx_hal_msp.su ./Core/Src/stm32g4xx_it.cyclo ./Core/Src/stm32g4xx_it.d ./Core/Src/stm32g4xx_it.o ./Core/Src/stm32g4xx_it.su ./Core/Src/switch_matrix.cyclo ./Core/Src/switch_matrix.d ./Core/Src/switch_matrix.o ./Core/Src/switch_matrix.su ./Core/Src/syscalls.cyclo ./Core/Src/syscalls.d ./Core/Src/syscalls.o ./Core/Src/syscalls.su ./Core/Src/sysmem.cyclo ./Core/Src/sysmem.d ./Core/Src/sysmem.o ./Core/Src/sysmem.su ./Core/Src/system_stm32g4xx.cyclo ./Core/Src/system_stm32g4xx.d ./Core/Src/system_stm32g4xx.o ./Core/Src/system_stm32g4xx.su ./Core/Src/tim.cyclo ./Core/Src/tim.d ./Core/Src/tim.o ./Core/Src/tim.su ./Core/Src/usart.cyclo ./Core/Src/usart.d ./Core/Src/usart.o ./Core/Src/usart.su ./Core/Src/warm_start.cyclo ./Core/Src/warm_start.d ./Core/Src/warm_start.o ./Core/Src/warm_start.su ./Core/Src/watchdog.cyclo ./Core/Src/watchdog.d ./Core/Src/watchdog.o ./Core/Src/watchdog.su
 
 .PHONY: clean-Core-2f-Src
 
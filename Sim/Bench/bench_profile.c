@@ -0,0 +1,67 @@
+/**
+  ******************************************************************************
+  * @file           : bench_profile.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "chemistry_profile.h" // Include profile layout
+#include "ocv_model.h" // Include built-in surface and its dimensions
+#include "cycle_timer.h" // Include cycle counter prototype
+
+/*
+ * Stand-ins for the modules a benchmark does not link. chemistry_profile.c
+ * needs the flash driver and pl455.c, so the benchmarks see the built-in
+ * Molicel P45B profile, as on a board with an empty PROFILE partition. The
+ * values are those of builtin_profile in chemistry_profile.c.
+ */
+
+/* ***** PROFILE STATE ***** */
+static const ChemistryProfile builtin_profile = {
+	.magic = CHEM_PROFILE_MAGIC,
+	.version = CHEM_PROFILE_VERSION,
+	.length = sizeof(ChemistryProfile),
+	.name = "Molicel P45B",
+	.cell_min_mv = 2500,
+	.cell_max_mv = 4200,
+	.capacity_mAh = 4500,
+	.balance_max_mA = 4000,
+	.derate_start_mv = 4100,
+	.derate_stop_mv = 4200,
+	.ocv_v0_uv = OCV_V0_UV,
+	.ocv_v_size = OCV_V_SIZE,
+	.ocv_v_shift = OCV_V_SHIFT,
+	.ocv_t_size = OCV_T_SIZE,
+	.ocv_t0_decic = OCV_T0_DECIC,
+	.ocv_t_step_decic = OCV_T_STEP_DECIC,
+	.ocv_offset = 0, // Surface is ocv_surface, not part of the image
+};
+
+
+/**
+ * @brief  Built-in profile
+ */
+const ChemistryProfile *chemistry_profile()
+{
+	return &builtin_profile;
+}
+
+
+/**
+ * @brief  Built-in surface
+ */
+const uint16_t *chemistry_profile_ocv()
+{
+	return &ocv_surface[0][0][0];
+}
+
+
+/**
+ * @brief  No cycle counter on the host, the cost reports read 0
+ */
+uint32_t cycle_timer_now()
+{
+	return 0;
+}
@@ -0,0 +1,171 @@
+/**
+  ******************************************************************************
+  * @file           : ekf_replay.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "soc_ekf.h" // Include SOC estimator under test
+#include <math.h> // Include fabs() and sqrt()
+#include <stdio.h> // Include standard I/O functions
+#include <stdlib.h> // Include strtod()
+
+/*
+ * Replays the test vectors of Tools/soc_ekf_reference.py through the firmware
+ * SOC estimator (soc_ekf.c, ocv_model.c and ocv_surface.c, built unmodified)
+ * and compares every step with the double-precision reference.
+ *
+ *   ekf_replay [vectors csv] [tolerance % SOC]
+ *
+ * Every cell of the bank is given the measured voltage and current of the
+ * vector, starting from the SOC in the "# soc0_pct=" line, at 25 degC on the
+ * discharge branch (the branch selector is not run, it starts there).
+ *
+ * The reference inverts the characterisation points for its OCV table, the
+ * firmware inverts the resampled surface and runs in single precision, so the
+ * two differ slightly, most while the filter pulls in the wrong starting SOC
+ * and the OCV slope changes quickly. The replay fails if the SOC estimate
+ * differs from the reference by more than REPLAY_TRANSIENT_TOLERANCE before
+ * the reference has converged, by more than the tolerance after it, or if the
+ * cells of the bank disagree.
+ */
+
+/* ***** DEFINE CONSTANTS ***** */
+#define REPLAY_DEFAULT_CSV "Bench/ekf_vectors.csv" // Vectors committed with the harness, relative to Sim/
+#define REPLAY_DEFAULT_TOLERANCE 0.1 // Largest accepted SOC difference from the reference once it has converged (% SOC)
+#define REPLAY_TRANSIENT_TOLERANCE 0.5 // Largest accepted SOC difference before that (% SOC)
+#define REPLAY_TEMPERATURE_C 25.0f // Temperature of the reference curve (degC)
+#define REPLAY_CONVERGED_PCT 1.0 // Error below which the estimate counts as converged (% SOC), as the reference
+
+
+/**
+ * @brief  Replay every vector and compare the estimate with the reference
+ */
+int main(int argc, char **argv)
+{
+	const char *path = (argc > 1) ? argv[1] : REPLAY_DEFAULT_CSV;
+	double tolerance = (argc > 2) ? strtod(argv[2], NULL) : REPLAY_DEFAULT_TOLERANCE;
+	FILE *f = fopen(path, "r");
+	char row[160];
+	float soc0 = -1.0f, dt = 0.0f;
+	float volt[NOC], current[NOC], soc[NOC], start[NOC];
+	double worst_transient = 0.0, worst_soc = 0.0, worst_sigma = 0.0, worst_t = 0.0; // Largest differences from the reference
+	double sum_sq = 0.0, worst_error = 0.0, converged_at = -1.0; // Firmware error against the true SOC
+	int steps = 0, settled = 0, spread = 0;
+	int reference_settled = 0; // 1 once the reference has been within REPLAY_CONVERGED_PCT of the true SOC
+
+	if (!f)
+	{
+		fprintf(stderr, "cannot open %s\n", path);
+		return 2;
+	}
+
+	while (fgets(row, sizeof(row), f))
+	{
+		char *field = row;
+		double t, amps, voltage, true_soc, ref_soc, ref_sigma, diff;
+
+		if (row[0] == '#')
+		{
+			sscanf(row, "# soc0_pct=%f dt_s=%f", &soc0, &dt);
+			continue;
+		}
+		t = strtod(field, &field);
+		if (field == row || *field != ',') // Column names
+		{
+			continue;
+		}
+		amps = strtod(field + 1, &field);
+		voltage = strtod(field + 1, &field);
+		true_soc = strtod(field + 1, &field);
+		ref_soc = strtod(field + 1, &field);
+		ref_sigma = strtod(field + 1, &field);
+
+		if (steps == 0)
+		{
+			if (soc0 < 0.0f || dt <= 0.0f)
+			{
+				fprintf(stderr, "%s has no \"# soc0_pct= dt_s=\" line\n", path);
+				fclose(f);
+				return 2;
+			}
+			for (int i = 0; i < NOC; i++)
+			{
+				start[i] = soc0;
+			}
+			soc_ekf_init(start, REPLAY_TEMPERATURE_C);
+		}
+
+		for (int i = 0; i < NOC; i++)
+		{
+			volt[i] = (float)voltage;
+			current[i] = (float)amps;
+		}
+		soc_ekf_update(volt, current, dt, REPLAY_TEMPERATURE_C);
+		soc_ekf_get_soc(soc);
+		steps++;
+
+		for (int i = 1; i < NOC; i++)
+		{
+			spread |= (soc[i] != soc[0]);
+		}
+
+		reference_settled |= (fabs(ref_soc - true_soc) < REPLAY_CONVERGED_PCT);
+		diff = fabs(soc[0] - ref_soc);
+		if (!reference_settled)
+		{
+			worst_transient = (diff > worst_transient) ? diff : worst_transient;
+		} else if (diff > worst_soc)
+		{
+			worst_soc = diff;
+			worst_t = t;
+		}
+		diff = fabs(sqrt(soc_ekf_state()->p00[0]) * 100.0 - ref_sigma);
+		worst_sigma = (diff > worst_sigma) ? diff : worst_sigma;
+
+		diff = fabs(soc[0] - true_soc);
+		if (converged_at < 0.0 && diff < REPLAY_CONVERGED_PCT)
+		{
+			converged_at = t;
+		}
+		if (converged_at >= 0.0)
+		{
+			sum_sq += diff * diff;
+			worst_error = (diff > worst_error) ? diff : worst_error;
+			settled++;
+		}
+	}
+	fclose(f);
+
+	if (steps == 0)
+	{
+		fprintf(stderr, "no vectors in %s\n", path);
+		return 2;
+	}
+
+	printf("%d steps of %.0fs from %s, filter started at %.1f%% SOC\n", steps, dt, path, soc0);
+	if (converged_at >= 0.0)
+	{
+		printf("Firmware: within %.0f%% after %.1fs, then rms %.3f%% max %.3f%% SOC\n", REPLAY_CONVERGED_PCT, converged_at,
+				sqrt(sum_sq / settled), worst_error);
+	} else {
+		printf("Firmware: did not converge within %.0f%% SOC\n", REPLAY_CONVERGED_PCT);
+	}
+	printf("Against the reference: SOC %.4f%% while converging (tolerance %.2f%%), %.4f%% after (at %.1fs, tolerance %.2f%%),"
+			" sigma %.4f%%\n", worst_transient, REPLAY_TRANSIENT_TOLERANCE, worst_soc, worst_t, tolerance, worst_sigma);
+
+	if (spread)
+	{
+		printf("FAIL cells of the bank disagree\n");
+		return 1;
+	}
+	if (worst_transient > REPLAY_TRANSIENT_TOLERANCE || worst_soc > tolerance)
+	{
+		printf("FAIL\n");
+		return 1;
+	}
+	printf("PASS\n");
+	return 0;
+}
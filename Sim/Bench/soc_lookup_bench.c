@@ -0,0 +1,272 @@
+/**
+  ******************************************************************************
+  * @file           : soc_lookup_bench.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "ocv_model.h" // Include surface lookup and built-in surface
+#include <math.h> // Include fabs()
+#include <stdio.h> // Include standard I/O functions
+#include <stdlib.h> // Include strtoul() and strtod()
+#include <string.h> // Include strncmp()
+#include <time.h> // Include clock_gettime()
+
+/*
+ * Host benchmark of the surface lookup, ocv_soc_centi() (ocv_model.c and
+ * ocv_surface.c, built unmodified), against the linear scan of the
+ * characterisation points that volt_to_soc() used before it.
+ *
+ *   soc_lookup_bench [repeats] [characterisation csv]
+ *
+ * The points are the 25 degC discharge curve of Tools/ocv_characterisation.csv,
+ * the source the surface is generated from, so there is no second copy of the
+ * curve. The built-in profile is active (bench_profile.c).
+ *
+ * Cost: both lookups convert the same voltages, at the bottom, middle and top
+ * of the curve and swept over the whole range. The scan's cost grows with the
+ * number of segments it passes, the surface lookup's does not.
+ *
+ * Accuracy: every microvolt from BENCH_V_MIN_UV to BENCH_V_MAX_UV is converted
+ * and compared with exact linear interpolation between the characterisation
+ * points. The scan as it was truncated to whole %, which is reported alongside.
+ * The benchmark fails (exit 1) if the surface is further than BENCH_TOLERANCE_PCT
+ * from the points anywhere, so a regressed surface does not pass.
+ *
+ * Host timings only rank the two; "convert" on the serial console times the
+ * conversion on the target.
+ */
+
+/* ***** DEFINE CONSTANTS ***** */
+#define BENCH_V_MIN_UV 2500000 // Sweep start, below the 0% voltage (uV)
+#define BENCH_V_MAX_UV 4300000 // Sweep end, above the 100% voltage (uV)
+#define BENCH_SWEEP_POINTS 4096 // Voltages per timed sweep
+#define BENCH_DEFAULT_REPEATS 2000 // Timed sweeps per measurement
+#define BENCH_DEFAULT_CSV "../Tools/ocv_characterisation.csv" // Source points, relative to Sim/
+#define BENCH_POINTS_MAX 64 // Characterisation points the scan can hold
+#define BENCH_TEMP_DECIC 250 // Temperature of the curve under test (0.1 degC)
+#define BENCH_TOLERANCE_PCT 0.1 // Largest accepted surface error (% SOC), TOLERANCE_CENTI of Tools/gen_ocv_surface.py
+
+/**
+ * @brief One characterisation point
+ */
+typedef struct {
+	float voltage; // Cell voltage (V)
+	float soc; // SOC (%)
+} SocPoint;
+
+/* ***** BENCHMARK STATE ***** */
+static volatile uint32_t sink = 0; // Keeps the results of timed calls
+static SocPoint points[BENCH_POINTS_MAX]; // Discharge curve at BENCH_TEMP_DECIC, by voltage
+static int point_count = 0; // Points in points
+
+
+/**
+ * @brief  Read the discharge curve at BENCH_TEMP_DECIC from the characterisation file
+ *         - Returns the number of points, 0 if the file cannot be read
+ */
+static int read_points(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char row[128];
+	int count = 0;
+
+	if (!f)
+	{
+		return 0;
+	}
+
+	while (fgets(row, sizeof(row), f) && count < BENCH_POINTS_MAX)
+	{
+		char *field = row;
+		double temperature = strtod(field, &field);
+
+		if (row[0] == '#' || *field != ',' || (int)lround(temperature * 10.0) != BENCH_TEMP_DECIC
+				|| strncmp(field + 1, "discharge,", 10) != 0)
+		{
+			continue; // Comment, header or another curve
+		}
+		field += 11;
+		points[count].voltage = (float)strtod(field, &field);
+		points[count].soc = (float)strtod(field + 1, NULL);
+		count++;
+	}
+
+	fclose(f);
+	return count; // Listed in voltage order (checked by Tools/gen_ocv_surface.py)
+}
+
+
+/**
+ * @brief  Linear table scan as volt_to_soc() was before the surface, truncated to whole %
+ */
+static int scan_soc(float voltage)
+{
+	if (voltage <= points[0].voltage)
+	{
+		return (int)points[0].soc;
+	}
+	if (voltage >= points[point_count - 1].voltage)
+	{
+		return (int)points[point_count - 1].soc;
+	}
+
+	for (int i = 0; i < point_count - 1; i++)
+	{
+		if (voltage >= points[i].voltage && voltage <= points[i + 1].voltage)
+		{
+			float v1 = points[i].voltage;
+			float v2 = points[i + 1].voltage;
+			int soc1 = (int)points[i].soc;
+			int soc2 = (int)points[i + 1].soc;
+
+			return soc1 + (int)((voltage - v1) / (v2 - v1) * (soc2 - soc1));
+		}
+	}
+	return -1;
+}
+
+
+/**
+ * @brief  Exact linear interpolation between the characterisation points (%)
+ */
+static double reference_soc(double voltage)
+{
+	if (voltage <= points[0].voltage)
+	{
+		return points[0].soc;
+	}
+	for (int i = 1; i < point_count; i++)
+	{
+		if (voltage <= points[i].voltage)
+		{
+			double t = (voltage - points[i - 1].voltage) / (points[i].voltage - points[i - 1].voltage);
+
+			return points[i - 1].soc + t * (points[i].soc - points[i - 1].soc);
+		}
+	}
+	return points[point_count - 1].soc;
+}
+
+
+/**
+ * @brief  Host monotonic time (ns)
+ */
+static double now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+/**
+ * @brief  Time both lookups over a set of voltages, prints ns per call
+ */
+static void time_lookups(const char *name, const uint32_t *cell_uv, const float *voltage, int count, int repeats)
+{
+	double start, scan_ns, surface_ns;
+
+	start = now_ns();
+	for (int r = 0; r < repeats; r++)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			sink += scan_soc(voltage[i]);
+		}
+	}
+	scan_ns = (now_ns() - start) / ((double)repeats * count);
+
+	start = now_ns();
+	for (int r = 0; r < repeats; r++)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			sink += ocv_soc_centi(cell_uv[i], BENCH_TEMP_DECIC, OCV_BRANCH_DISCHARGE);
+		}
+	}
+	surface_ns = (now_ns() - start) / ((double)repeats * count);
+
+	printf("  %-10s scan %6.1f ns, surface %5.1f ns per call, %5.1fx\n", name, scan_ns, surface_ns, scan_ns / surface_ns);
+}
+
+
+/**
+ * @brief  Time the lookups at fixed points and over a sweep, then check the surface over the whole range
+ */
+int main(int argc, char **argv)
+{
+	static uint32_t cell_uv[BENCH_SWEEP_POINTS];
+	static float voltage[BENCH_SWEEP_POINTS];
+	static const uint32_t fixed_uv[] = {2700000, 3700000, 4150000}; // Bottom, middle and top segments of the curve
+	static const char *const fixed_name[] = {"2.700V", "3.700V", "4.150V"};
+	int repeats = (argc > 1) ? (int)strtoul(argv[1], NULL, 10) : BENCH_DEFAULT_REPEATS;
+	const char *csv = (argc > 2) ? argv[2] : BENCH_DEFAULT_CSV;
+	double surface_err = 0.0, scan_err = 0.0; // Largest difference from the reference (% SOC)
+	uint32_t surface_err_uv = 0, scan_err_uv = 0; // Voltage of the largest difference (uV)
+
+	if (repeats <= 0)
+	{
+		fprintf(stderr, "usage: soc_lookup_bench [repeats] [characterisation csv]\n");
+		return 2;
+	}
+	point_count = read_points(csv);
+	if (point_count < 2)
+	{
+		fprintf(stderr, "no %.1f degC discharge curve in %s\n", BENCH_TEMP_DECIC / 10.0, csv);
+		return 2;
+	}
+
+	printf("SOC lookup, %d characterisation points, surface of %d points every %.3fmV\n", point_count, OCV_V_SIZE,
+			(1u << OCV_V_SHIFT) / 1000.0);
+
+	for (int f = 0; f < (int)(sizeof(fixed_uv) / sizeof(fixed_uv[0])); f++)
+	{
+		for (int i = 0; i < BENCH_SWEEP_POINTS; i++)
+		{
+			cell_uv[i] = fixed_uv[f] + (uint32_t)(i % 64) * 100; // Stay in one segment, vary the low bits
+			voltage[i] = cell_uv[i] / 1e6f;
+		}
+		time_lookups(fixed_name[f], cell_uv, voltage, BENCH_SWEEP_POINTS, repeats);
+	}
+
+	for (int i = 0; i < BENCH_SWEEP_POINTS; i++)
+	{
+		cell_uv[i] = BENCH_V_MIN_UV + (uint32_t)((uint64_t)(BENCH_V_MAX_UV - BENCH_V_MIN_UV) * i / (BENCH_SWEEP_POINTS - 1));
+		voltage[i] = cell_uv[i] / 1e6f;
+	}
+	time_lookups("sweep", cell_uv, voltage, BENCH_SWEEP_POINTS, repeats);
+
+	for (uint32_t uv = BENCH_V_MIN_UV; uv <= BENCH_V_MAX_UV; uv++)
+	{
+		double reference = reference_soc(uv / 1e6);
+		double surface = fabs(ocv_soc_centi(uv, BENCH_TEMP_DECIC, OCV_BRANCH_DISCHARGE) / 100.0 - reference);
+		double scan = fabs(scan_soc(uv / 1e6f) - reference);
+
+		if (surface > surface_err)
+		{
+			surface_err = surface;
+			surface_err_uv = uv;
+		}
+		if (scan > scan_err)
+		{
+			scan_err = scan;
+			scan_err_uv = uv;
+		}
+	}
+
+	printf("Largest difference from the characterisation curve, %lu voltages:\n", (unsigned long)(BENCH_V_MAX_UV - BENCH_V_MIN_UV + 1));
+	printf("  scan %.3f%% SOC at %.6fV, surface %.3f%% SOC at %.6fV, tolerance %.3f%% SOC\n", scan_err, scan_err_uv / 1e6,
+			surface_err, surface_err_uv / 1e6, BENCH_TOLERANCE_PCT);
+
+	if (surface_err > BENCH_TOLERANCE_PCT)
+	{
+		printf("FAIL\n");
+		return 1;
+	}
+	printf("PASS\n");
+	return 0;
+}
@@ -0,0 +1,43 @@
+/**
+  ******************************************************************************
+  * @file           : pl455_emulator.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef SIM_PL455_EMULATOR_H_
+#define SIM_PL455_EMULATOR_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include <stdint.h> // Standard integer type definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+#define PL455_EMU_REGISTERS 256 // Register map size (8-bit addresses)
+#define PL455_EMU_RESPONSE_MAX 40 // Longest response frame (16 cells + header + CRC)
+#define PL455_EMU_CONVERSION_US 1000 // Time from a sample command to the first response byte (us)
+#define PL455_EMU_BYTE_US 40 // Byte time at 250kbaud, 10 bits per byte (us)
+#define PL455_EMU_LSB_V (5.0 / 65535.0) // Cell voltage code weight, 2 x VREF / 2^16 (V)
+
+/**
+ * @brief Traffic and protocol errors seen by the emulator
+ */
+typedef struct {
+	uint32_t frames; // Command frames received
+	uint32_t crc_errors; // Frames with a bad CRC, ignored
+	uint32_t while_asleep; // Frames sent while the device was powered down, ignored
+	uint32_t samples; // Sample commands answered
+	uint32_t dropped; // Responses overwritten before they were read
+	uint32_t wakeups; // Wake pulses
+} Pl455EmuStats;
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void pl455_emu_reset(); // Power-on state, asleep until the first wake pulse
+void pl455_emu_receive(const uint8_t *data, uint16_t len); // Bytes written to USART3 by the MCU
+void pl455_emu_wake_pin(int level); // Level of the WAKEUP pin (PA0)
+void pl455_emu_fail(int fail); // Stop answering (1) or answer again (0)
+int pl455_emu_response_ready(uint64_t now_us); // 1 once the pending response has been sent
+int pl455_emu_take_response(uint8_t *data, int max); // Move the pending response out, returns its length
+const Pl455EmuStats *pl455_emu_stats(); // Counters since reset
+
+#endif
@@ -0,0 +1,60 @@
+/**
+  ******************************************************************************
+  * @file           : plant.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef SIM_PLANT_H_
+#define SIM_PLANT_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "pack_config.h" // Include number of cells
+#include <stdint.h> // Standard integer type definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+#define PLANT_CELLS NOC // Cells in the simulated pack
+#define PLANT_CAPACITY_MAH 4500.0 // Default cell capacity (mAh)
+#define PLANT_R0_OHM 0.015 // Ohmic resistance of a cell (ohm)
+#define PLANT_R1_OHM 0.010 // Polarisation resistance of a cell (ohm)
+#define PLANT_TAU1_S 20.0 // Polarisation time constant (s)
+#define PLANT_FLYBACK_GAIN 0.9 // Output current over the duty cycle feedforward estimate in flyback_operation.h
+#define PLANT_FLYBACK_TAU_US 2000.0 // Output current time constant (us)
+#define PLANT_FLYBACK_EFFICIENCY 0.82 // Output power over input power
+
+/**
+ * @brief Switch matrix state decoded from the GPIO output registers
+ */
+typedef enum {
+	PLANT_PATH_OPEN = 0, // No MOSFET on
+	PLANT_PATH_SHORT = -1, // Two stack nodes share a rail or a rail drives both output terminals
+	PLANT_PATH_INVALID = -2 // Short-free but not a complete path to one cell
+} PlantPath; // Otherwise the cell number of a valid path
+
+/**
+ * @brief Totals since the start of the run
+ */
+typedef struct {
+	double delivered_mAh[PLANT_CELLS + 1]; // Flyback output charge into each cell (index = cell number)
+	double drawn_mAh; // Charge drawn from the pack by the flyback input
+	double load_mAh; // Charge drawn by the external load
+	uint64_t converter_us; // Time with output current above 10mA
+	uint64_t short_us; // Time with a shorting switch matrix state
+	uint64_t pwm_invalid_us; // Time with PWM running and no valid path
+} PlantStats;
+
+/* ***** FUNCTION PROTOTYPES ***** */
+void plant_init(const double *soc_pct, const double *capacity_mAh, const double *leak_mA, uint32_t seed); // Cell states, index = cell number - 1
+void plant_set_load(double amps); // External pack current, positive discharges
+void plant_step(uint32_t dt_us); // Advance cells and converter by dt
+double plant_cell_voltage(int cell); // Terminal voltage of a cell (V)
+double plant_soc(int cell); // True SOC of a cell (%)
+double plant_charge_spread(); // Highest minus lowest charge held, % of PLANT_CAPACITY_MAH (the SOC spread for equal cells)
+double plant_pack_current(); // Current at the pack sensor, external load and flyback input (A)
+double plant_balancing_current(); // Flyback output current (A)
+int plant_path(); // Switch matrix state as a PlantPath or cell number
+int plant_noise_lsb(); // Measurement noise, -1, 0 or +1 LSB
+const PlantStats *plant_stats(); // Totals since the start of the run
+
+#endif
@@ -0,0 +1,40 @@
+/**
+  ******************************************************************************
+  * @file           : sim.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef SIM_SIM_H_
+#define SIM_SIM_H_
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "stm32g4xx_hal.h" // Include simulated HAL types
+#include "current_sense.h" // Include ADC conversion period
+#include <stdint.h> // Standard integer type definitions
+
+/* ***** DEFINE CONSTANTS ***** */
+#define SIM_POLL_US 250 // Virtual time taken by every HAL_GetTick() call, lets polling loops advance (us)
+#define SIM_CYCCNT_POLL_US 1 // Virtual time taken by every DWT->CYCCNT read (us)
+#define SIM_CORE_CLOCK_HZ 100000000UL // SYSCLK set by SystemClock_Config() (HSI 16MHz / 2 x 25 / 2)
+#define SIM_ADC_SAMPLE_US CURRENT_SENSE_SAMPLE_US // Dual ADC conversion period after oversampling, as configured in adc.c
+#define SIM_FLASH_MAP_START 0x08070000UL // First simulated flash address (black-box region, profile partition, then NVM)
+#define SIM_FLASH_MAP_SIZE 0x10000UL // Black-box region, profile partition and NVM region (bytes)
+
+/* ***** FUNCTION PROTOTYPES ***** */
+// Virtual clock (sim_hal.c)
+uint64_t sim_now_us(); // Virtual time since reset (us)
+void sim_advance(uint32_t us); // Move the virtual clock forward, running the plant, peripherals and scenario
+void sim_set_end(uint64_t end_us); // Virtual time at which the run ends
+int sim_flash_map(); // Map the simulated flash at its device address, 0 on success
+void sim_lpuart_inject(const char *text); // Deliver bytes to the serial console receive interrupt
+int sim_pwm_running(); // 1 while TIM1 channel 1 drives the flyback
+uint32_t sim_pwm_duty(); // TIM1 compare value (% of the 100 count period)
+uint32_t sim_gpio_odr(GPIO_TypeDef *port); // Output register after pending BSRR stores
+
+// Scenario (sim_main.c)
+void scenario_tick(); // Run scenario events that are due, called by the virtual clock
+void scenario_finish(); // Print the summary and leave, called when the virtual clock reaches the end
+
+#endif
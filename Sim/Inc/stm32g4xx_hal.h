@@ -0,0 +1,316 @@
+/**
+  ******************************************************************************
+  * @file           : stm32g4xx_hal.h
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+#ifndef SIM_STM32G4XX_HAL_H_
+#define SIM_STM32G4XX_HAL_H_
+
+/*
+ * Host replacement for the STM32G4 HAL and CMSIS device headers, found before
+ * Drivers/ by the simulator build (see Sim/Makefile). Only the types, constants
+ * and functions used by the application sources in Core/Src are provided.
+ *
+ * Peripherals are plain structs in host memory (see sim_hal.c). Registers whose
+ * hardware behaviour the application relies on are reached through an index
+ * expression that calls the simulator first:
+ *   - GPIO ODR: a BSRR store takes effect before the next ODR read, pin write
+ *     or clock advance, so the switch matrix read back sees what it switched
+ *   - LPUART RDR: reading clears the receive flag, as on the device
+ *   - DWT CYCCNT: follows the virtual clock, so cycle counter delays end
+ * IWDG key register stores are picked up before the clock advances, as BSRR
+ * stores are; an expired IWDG or a software reset ends the run. RCC CSR reports
+ * a power-on reset.
+ */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include <stdint.h> // Standard integer type definitions
+#include <stddef.h> // Include NULL
+
+/* ***** COMPILER ***** */
+#define __weak __attribute__((weak))
+#define __IO volatile
+#define UNUSED(x) ((void)(x))
+
+/* ***** HAL STATUS ***** */
+typedef enum {
+	HAL_OK = 0x00,
+	HAL_ERROR = 0x01,
+	HAL_BUSY = 0x02,
+	HAL_TIMEOUT = 0x03
+} HAL_StatusTypeDef;
+
+#define HAL_MAX_DELAY 0xFFFFFFFFU
+
+/* ***** CORE ***** */
+typedef enum {
+	LPUART1_IRQn = 91,
+	USART3_IRQn = 39
+} IRQn_Type;
+
+typedef struct {
+	__IO uint32_t CTRL;
+	__IO uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+	__IO uint32_t DEMCR;
+} CoreDebug_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+
+/* ***** GPIO ***** */
+typedef struct {
+	__IO uint32_t MODER;
+	__IO uint32_t IDR;
+	__IO uint32_t ODR_reg[1]; // Output data, read as ODR (see above)
+	__IO uint32_t BSRR; // Bit set / reset, applied to ODR by the simulator
+} GPIO_TypeDef;
+
+typedef enum {
+	GPIO_PIN_RESET = 0,
+	GPIO_PIN_SET
+} GPIO_PinState;
+
+typedef struct {
+	uint32_t Pin;
+	uint32_t Mode;
+	uint32_t Pull;
+	uint32_t Speed;
+	uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+#define GPIO_PIN_0 ((uint16_t)0x0001)
+#define GPIO_PIN_1 ((uint16_t)0x0002)
+#define GPIO_PIN_2 ((uint16_t)0x0004)
+#define GPIO_PIN_3 ((uint16_t)0x0008)
+#define GPIO_PIN_4 ((uint16_t)0x0010)
+#define GPIO_PIN_5 ((uint16_t)0x0020)
+#define GPIO_PIN_6 ((uint16_t)0x0040)
+#define GPIO_PIN_7 ((uint16_t)0x0080)
+#define GPIO_PIN_8 ((uint16_t)0x0100)
+#define GPIO_PIN_9 ((uint16_t)0x0200)
+#define GPIO_PIN_10 ((uint16_t)0x0400)
+#define GPIO_PIN_11 ((uint16_t)0x0800)
+#define GPIO_PIN_12 ((uint16_t)0x1000)
+#define GPIO_PIN_13 ((uint16_t)0x2000)
+#define GPIO_PIN_14 ((uint16_t)0x4000)
+#define GPIO_PIN_15 ((uint16_t)0x8000)
+
+#define GPIO_MODE_INPUT 0x00000000U
+#define GPIO_MODE_OUTPUT_PP 0x00000001U
+#define GPIO_NOPULL 0x00000000U
+#define GPIO_PULLUP 0x00000001U
+#define GPIO_PULLDOWN 0x00000002U
+#define GPIO_SPEED_FREQ_LOW 0x00000000U
+
+/* ***** USART ***** */
+typedef struct {
+	__IO uint32_t CR1;
+	__IO uint32_t ISR;
+	__IO uint32_t ICR;
+	__IO uint32_t RDR_reg[1]; // Receive data, read as RDR (see above)
+	__IO uint32_t TDR;
+} USART_TypeDef;
+
+typedef struct {
+	USART_TypeDef *Instance;
+	uint8_t *pRxBuffPtr; // Buffer of the interrupt receive in progress
+	uint16_t RxXferSize; // Bytes requested
+	uint16_t RxXferCount; // Bytes still to receive
+	volatile uint32_t RxState; // HAL_UART_STATE_READY or HAL_UART_STATE_BUSY_RX
+} UART_HandleTypeDef;
+
+#define HAL_UART_STATE_READY 0x20U
+#define HAL_UART_STATE_BUSY_RX 0x22U
+
+#define USART_CR1_RXNEIE_RXFNEIE (1UL << 5)
+#define USART_ISR_ORE (1UL << 3)
+#define USART_ISR_RXNE_RXFNE (1UL << 5)
+#define USART_ICR_ORECF (1UL << 3)
+
+/* ***** ADC ***** */
+typedef struct {
+	__IO uint32_t ISR;
+	__IO uint32_t DR;
+} ADC_TypeDef;
+
+typedef struct {
+	ADC_TypeDef *Instance;
+} ADC_HandleTypeDef;
+
+#define ADC_SINGLE_ENDED 0x0000007FU
+
+/* ***** DMA ***** */
+typedef struct {
+	void *Instance;
+} DMA_HandleTypeDef;
+
+/* ***** TIMERS ***** */
+typedef struct {
+	__IO uint32_t CR1;
+	__IO uint32_t ARR;
+	__IO uint32_t CCR1;
+} TIM_TypeDef;
+
+typedef struct {
+	TIM_TypeDef *Instance;
+} TIM_HandleTypeDef;
+
+#define TIM_CHANNEL_1 0x00000000U
+
+/* ***** FLASH ***** */
+typedef struct {
+	uint32_t TypeErase;
+	uint32_t Banks;
+	uint32_t Page;
+	uint32_t NbPages;
+} FLASH_EraseInitTypeDef;
+
+#define FLASH_BASE 0x08000000UL // Same address as the device, the image is mapped there (see sim_hal.c)
+#define FLASH_SIZE (512UL * 1024UL)
+#define FLASH_BANK_SIZE (FLASH_SIZE / 2)
+#define FLASH_PAGE_SIZE 0x800U
+#define FLASH_BANK_1 0x00000001U
+#define FLASH_BANK_2 0x00000002U
+#define FLASH_TYPEERASE_PAGES 0x00U
+#define FLASH_TYPEPROGRAM_DOUBLEWORD 0x00U
+#define FLASH_FLAG_ALL_ERRORS 0x0000C3FAU
+#define FLASH_LATENCY_3 0x00000003U
+#define __HAL_FLASH_CLEAR_FLAG(flag) ((void)(flag))
+
+/* ***** RCC AND PWR ***** */
+typedef struct {
+	uint32_t PLLState;
+	uint32_t PLLSource;
+	uint32_t PLLM;
+	uint32_t PLLN;
+	uint32_t PLLP;
+	uint32_t PLLQ;
+	uint32_t PLLR;
+} RCC_PLLInitTypeDef;
+
+typedef struct {
+	uint32_t OscillatorType;
+	uint32_t HSIState;
+	uint32_t HSICalibrationValue;
+	RCC_PLLInitTypeDef PLL;
+} RCC_OscInitTypeDef;
+
+typedef struct {
+	uint32_t ClockType;
+	uint32_t SYSCLKSource;
+	uint32_t AHBCLKDivider;
+	uint32_t APB1CLKDivider;
+	uint32_t APB2CLKDivider;
+} RCC_ClkInitTypeDef;
+
+#define PWR_REGULATOR_VOLTAGE_SCALE1 0x00000200U
+#define RCC_OSCILLATORTYPE_HSI 0x00000002U
+#define RCC_HSI_ON 0x00000100U
+#define RCC_HSICALIBRATION_DEFAULT 0x40U
+#define RCC_PLL_ON 0x00000002U
+#define RCC_PLLSOURCE_HSI 0x00000002U
+#define RCC_PLLM_DIV2 0x00000010U
+#define RCC_PLLP_DIV2 0x00000002U
+#define RCC_PLLQ_DIV2 0x00000000U
+#define RCC_PLLR_DIV2 0x00000000U
+#define RCC_CLOCKTYPE_SYSCLK 0x00000001U
+#define RCC_CLOCKTYPE_HCLK 0x00000002U
+#define RCC_CLOCKTYPE_PCLK1 0x00000004U
+#define RCC_CLOCKTYPE_PCLK2 0x00000008U
+#define RCC_SYSCLKSOURCE_PLLCLK 0x00000003U
+#define RCC_SYSCLK_DIV1 0x00000000U
+#define RCC_HCLK_DIV1 0x00000000U
+
+typedef struct {
+	__IO uint32_t CSR; // Reset flags only
+} RCC_TypeDef;
+
+#define RCC_CSR_RMVF (1UL << 23)
+#define RCC_CSR_BORRSTF (1UL << 27)
+#define RCC_CSR_IWDGRSTF (1UL << 29)
+
+/* ***** IWDG ***** */
+typedef struct {
+	__IO uint32_t KR; // Key, applied by the simulator
+	__IO uint32_t PR;
+	__IO uint32_t RLR;
+	__IO uint32_t SR; // Always 0, values are taken at once
+	__IO uint32_t WINR;
+} IWDG_TypeDef;
+
+#define __HAL_DBGMCU_FREEZE_IWDG() ((void)0)
+
+/* ***** PERIPHERAL INSTANCES ***** */
+extern GPIO_TypeDef sim_gpioa, sim_gpiob, sim_gpioc; // Defined in sim_hal.c
+extern USART_TypeDef sim_lpuart1, sim_usart3;
+extern ADC_TypeDef sim_adc1, sim_adc2;
+extern TIM_TypeDef sim_tim1;
+extern CoreDebug_Type sim_core_debug;
+extern RCC_TypeDef sim_rcc;
+extern IWDG_TypeDef sim_iwdg;
+extern uint32_t SystemCoreClock;
+
+uint32_t sim_gpio_sync(); // Apply pending BSRR stores, returns 0
+uint32_t sim_rdr_read(); // Clear the LPUART receive flag, returns 0
+DWT_Type *sim_dwt(); // Cycle counter at the virtual time
+
+#define GPIOA (&sim_gpioa)
+#define GPIOB (&sim_gpiob)
+#define GPIOC (&sim_gpioc)
+#define LPUART1 (&sim_lpuart1)
+#define USART3 (&sim_usart3)
+#define ADC1 (&sim_adc1)
+#define ADC2 (&sim_adc2)
+#define TIM1 (&sim_tim1)
+#define CoreDebug (&sim_core_debug)
+#define RCC (&sim_rcc)
+#define IWDG (&sim_iwdg)
+#define DWT (sim_dwt())
+
+#define ODR ODR_reg[sim_gpio_sync()]
+#define RDR RDR_reg[sim_rdr_read()]
+
+#define __disable_irq() ((void)0) // Simulated interrupts only run inside HAL calls
+#define __enable_irq() ((void)0)
+#define __HAL_RCC_FMAC_CLK_ENABLE() ((void)0)
+
+/* ***** HAL FUNCTIONS (see sim_hal.c) ***** */
+HAL_StatusTypeDef HAL_Init(void);
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority);
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn);
+void NVIC_SystemReset(void);
+HAL_StatusTypeDef HAL_PWREx_ControlVoltageScaling(uint32_t VoltageScaling);
+HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef *RCC_OscInitStruct);
+HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef *RCC_ClkInitStruct, uint32_t FLatency);
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init);
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin);
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_UART_Receive_IT(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size);
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart);
+
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef *hadc, uint32_t SingleDiff);
+HAL_StatusTypeDef HAL_ADCEx_MultiModeStart_DMA(ADC_HandleTypeDef *hadc, uint32_t *pData, uint32_t Length);
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc);
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef *hadc);
+
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef *htim, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIM_PWM_Stop(TIM_HandleTypeDef *htim, uint32_t Channel);
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *PageError);
+
+#endif
@@ -0,0 +1,301 @@
+/**
+  ******************************************************************************
+  * @file           : pl455_emulator.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "pl455_emulator.h" // Include header file for the emulator
+#include "plant.h" // Include cell voltages to sample
+#include "sim.h" // Include virtual clock
+#include <string.h> // Include memset() and memcpy()
+
+/*
+ * Single bq76PL455A-Q1 at device address 0, seen from USART3. Command frames
+ * written by WriteFrame() are decoded byte by byte:
+ *
+ *   init     1 | type (3 bits) | 16-bit address flag | data length code
+ *   [id]     device or group address, single and group types only
+ *   address  register, 1 or 2 bytes
+ *   data     0 to 8 bytes (length code 7 means 8)
+ *   crc      CRC-16 (poly 0xA001, reflected, init 0) of the above, LSB first
+ *
+ * Register writes are stored in a byte-wide map, multi-byte values occupying
+ * consecutive addresses as on the device. Writing DEV_CTRL (12) with the sleep
+ * bit powers the device down until a low-to-high pulse on WAKEUP. A write with
+ * response to CMD (2) samples every cell selected in CHANNELS (3 to 6) from the
+ * plant and queues a response frame:
+ *
+ *   length   number of data bytes - 1
+ *   data     16-bit code per selected cell, highest cell first, MSB first
+ *   crc      as above
+ *
+ * The response is released PL455_EMU_CONVERSION_US plus its byte time after the
+ * command, and the simulated USART3 then delivers it to the armed receive. The
+ * CRC is computed bitwise here, independent of the table in pl455.c.
+ */
+
+/* ***** DEFINE CONSTANTS ***** */
+#define REG_CMD 2 // Command register, write with response to sample
+#define REG_CHANNELS 3 // Channel select, 4 bytes, bits 16 to 31 select cells 1 to 16
+#define REG_DEV_CTRL 12 // Device control
+#define DEV_CTRL_SLEEP 0x40 // Enter shutdown
+#define FRAME_ADDR16 0x08 // Init byte flag for a 16-bit register address
+#define FRAME_TYPE_MASK 0x70 // Init byte request type
+#define FRAME_MAX 16 // Longest command frame (init, id, 2 address, 8 data, 2 crc + margin)
+
+/* ***** EMULATOR STATE ***** */
+static uint8_t registers[PL455_EMU_REGISTERS]; // Register map
+static int asleep = 1; // 1 while powered down
+static int wake_level = 1; // Last level of the WAKEUP pin
+static uint8_t frame[FRAME_MAX]; // Command frame being assembled
+static int frame_length = 0; // Bytes in frame
+static int frame_expected = 0; // Length of the frame being assembled, 0 before the init byte
+static uint8_t response[PL455_EMU_RESPONSE_MAX]; // Queued response frame
+static int response_length = 0; // Bytes in response, 0 if none queued
+static uint64_t response_ready_us = 0; // Virtual time at which the response has been sent
+static Pl455EmuStats stats; // Counters
+static int failed = 0; // 1 while the device ignores every frame, set by a scenario event
+
+
+/**
+ * @brief  CRC-16 as used by the PL455 (poly 0xA001 reflected, init 0)
+ */
+static uint16_t crc16(const uint8_t *data, int len)
+{
+	uint16_t crc = 0;
+
+	for (int i = 0; i < len; i++)
+	{
+		crc ^= data[i];
+		for (int bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+		}
+	}
+	return crc;
+}
+
+
+/**
+ * @brief  Number of data bytes encoded in an init byte
+ */
+static int data_length(uint8_t init)
+{
+	int code = init & 0x07;
+
+	return (code == 7) ? 8 : code;
+}
+
+
+/**
+ * @brief  Check whether a request type carries a device or group address
+ */
+static int has_id(uint8_t init)
+{
+	return (init & FRAME_TYPE_MASK) <= 0x30; // Single and group types, broadcasts have none
+}
+
+
+/**
+ * @brief  Check whether a request type asks for a response
+ */
+static int wants_response(uint8_t init)
+{
+	return !(init & 0x10); // Types 0x00, 0x20 and 0x60 respond
+}
+
+
+/**
+ * @brief  Sample the selected cells and queue the response frame
+ */
+static void sample_cells()
+{
+	uint32_t channels = ((uint32_t)registers[REG_CHANNELS] << 24) | ((uint32_t)registers[REG_CHANNELS + 1] << 16)
+			| ((uint32_t)registers[REG_CHANNELS + 2] << 8) | registers[REG_CHANNELS + 3];
+	int length = 1;
+	uint16_t crc;
+
+	for (int cell = 16; cell >= 1; cell--) // Highest cell first
+	{
+		if (channels & (1UL << (15 + cell)))
+		{
+			double volts = (cell <= PLANT_CELLS) ? plant_cell_voltage(cell) : 0.0;
+			long code = (long)(volts / PL455_EMU_LSB_V + 0.5) + plant_noise_lsb();
+
+			code = (code < 0) ? 0 : (code > 0xFFFF) ? 0xFFFF : code;
+			response[length++] = (uint8_t)(code >> 8);
+			response[length++] = (uint8_t)code;
+		}
+	}
+	response[0] = (uint8_t)(length - 2); // Data bytes - 1
+	crc = crc16(response, length);
+	response[length++] = (uint8_t)crc;
+	response[length++] = (uint8_t)(crc >> 8);
+
+	if (response_length)
+	{
+		stats.dropped++;
+	}
+	response_length = length;
+	response_ready_us = sim_now_us() + PL455_EMU_CONVERSION_US + (uint64_t)length * PL455_EMU_BYTE_US;
+	stats.samples++;
+}
+
+
+/**
+ * @brief  Act on a complete command frame with a valid CRC
+ */
+static void execute_frame()
+{
+	uint8_t init = frame[0];
+	int index = 1;
+	int id = 0;
+	uint16_t addr;
+	int len = data_length(init);
+
+	if (has_id(init))
+	{
+		id = frame[index++];
+	}
+	if (init & FRAME_ADDR16)
+	{
+		addr = (uint16_t)((frame[index] << 8) | frame[index + 1]);
+		index += 2;
+	} else {
+		addr = frame[index++];
+	}
+
+	if (asleep || id != 0) // Only device 0 is fitted
+	{
+		stats.while_asleep += asleep;
+		return;
+	}
+
+	for (int i = 0; i < len && addr + i < PL455_EMU_REGISTERS; i++)
+	{
+		registers[addr + i] = frame[index + i];
+	}
+
+	if (addr == REG_DEV_CTRL && len >= 1 && (frame[index] & DEV_CTRL_SLEEP))
+	{
+		asleep = 1;
+		response_length = 0;
+	} else if (addr == REG_CMD && wants_response(init))
+	{
+		sample_cells();
+	}
+}
+
+
+/**
+ * @brief  Power-on state, asleep until the first wake pulse
+ */
+void pl455_emu_reset()
+{
+	memset(registers, 0, sizeof(registers));
+	memset(&stats, 0, sizeof(stats));
+	asleep = 1;
+	wake_level = 1;
+	frame_length = 0;
+	frame_expected = 0;
+	response_length = 0;
+}
+
+
+/**
+ * @brief  Bytes written to USART3 by the MCU
+ */
+void pl455_emu_receive(const uint8_t *data, uint16_t len)
+{
+	if (failed)
+	{
+		return;
+	}
+
+	for (uint16_t i = 0; i < len; i++)
+	{
+		if (frame_length == 0)
+		{
+			if (!(data[i] & 0x80)) // Not an init byte, out of step
+			{
+				stats.crc_errors++;
+				continue;
+			}
+			frame_expected = 1 + has_id(data[i]) + ((data[i] & FRAME_ADDR16) ? 2 : 1) + data_length(data[i]) + 2;
+		}
+
+		frame[frame_length++] = data[i];
+		if (frame_length < frame_expected)
+		{
+			continue;
+		}
+
+		stats.frames++;
+		if (crc16(frame, frame_length - 2) == (uint16_t)(frame[frame_length - 2] | (frame[frame_length - 1] << 8)))
+		{
+			execute_frame();
+		} else {
+			stats.crc_errors++;
+		}
+		frame_length = 0;
+	}
+}
+
+
+/**
+ * @brief  Level of the WAKEUP pin (PA0), a rising edge wakes the device
+ */
+void pl455_emu_wake_pin(int level)
+{
+	if (level && !wake_level)
+	{
+		asleep = 0;
+		stats.wakeups++;
+	}
+	wake_level = level;
+}
+
+
+/**
+ * @brief  Make the device stop answering, or answer again
+ *         - fail -> 1 to ignore every frame from now on, 0 to return to normal operation
+ */
+void pl455_emu_fail(int fail)
+{
+	failed = fail;
+	frame_length = 0;
+}
+
+
+/**
+ * @brief  Check whether the pending response has been sent
+ */
+int pl455_emu_response_ready(uint64_t now_us)
+{
+	return response_length > 0 && now_us >= response_ready_us;
+}
+
+
+/**
+ * @brief  Move the pending response out, returns its length
+ */
+int pl455_emu_take_response(uint8_t *data, int max)
+{
+	int length = (response_length < max) ? response_length : max;
+
+	memcpy(data, response, length);
+	response_length = 0;
+	return length;
+}
+
+
+/**
+ * @brief  Counters since reset
+ */
+const Pl455EmuStats *pl455_emu_stats()
+{
+	return &stats;
+}
@@ -0,0 +1,370 @@
+/**
+  ******************************************************************************
+  * @file           : plant.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "plant.h" // Include header file for the plant model
+#include "sim.h" // Include PWM and GPIO state
+#include "main.h" // Include switch matrix pin assignments
+#include "ocv_model.h" // Include built-in OCV surface for the OCV curve
+#include <math.h> // Include exp()
+#include <string.h> // Include memset()
+
+/*
+ * Physical side of the bench: six cells in series, the flyback converter and
+ * the switch matrix MOSFETs, advanced by the virtual clock.
+ *
+ * Cells: coulomb counting on a per-cell capacity, OCV from the discharge curve
+ * of the built-in surface (ocv_surface.c, interpolated the other way round), an ohmic
+ * resistance and one RC polarisation branch. A constant leakage current per
+ * cell lets imbalance build up during long runs. The external load only flows
+ * while PACK_ENABLE holds the pack relay closed.
+ *
+ * Switch matrix: the MOSFET gates are read from the GPIO output registers and
+ * decoded with the topology of the schematic, independently of switch_matrix.c:
+ * stack MOSFET m (5 to NOC + 5) joins node NOC + 5 - m to the odd or even rail,
+ * MOS2 / MOS1 join the odd / even rail to the flyback output positive and MOS3 /
+ * MOS4 to the negative. Time spent in a shorting state is counted.
+ *
+ * Flyback: while TIM1 runs and the matrix holds a valid path, the output current
+ * settles with PLANT_FLYBACK_TAU_US towards the duty cycle feedforward line of
+ * flyback_operation.h scaled by PLANT_FLYBACK_GAIN, so the firmware regulator
+ * has an error to correct. The input is drawn from the whole stack at
+ * PLANT_FLYBACK_EFFICIENCY and flows through the pack current sensor.
+ */
+
+/* ***** DEFINE CONSTANTS ***** */
+#define MOSFETS (NOC + 5) // Switch matrix MOSFETs, MOS1 to MOS(NOC + 5)
+#define DUTY_OFFSET 20.0 // Duty cycle at zero output current (%)
+#define DUTY_SLOPE 8.0 // Duty cycle per amp (%/A)
+#define NOMINAL_CELL_V 3.7 // Cell voltage at which the duty cycle line holds (V)
+
+/**
+ * @brief Gate drive of one MOSFET
+ */
+typedef struct {
+	GPIO_TypeDef *port;
+	uint16_t pin;
+} Gate;
+
+/* ***** PLANT STATE ***** */
+static const Gate gates[MOSFETS + 1] = { // Index = MOSFET number
+	{NULL, 0},
+	{MCU_SW_MOS1_GPIO_Port, MCU_SW_MOS1_Pin},
+	{MCU_SW_MOS2_GPIO_Port, MCU_SW_MOS2_Pin},
+	{MCU_SW_MOS3_GPIO_Port, MCU_SW_MOS3_Pin},
+	{MCU_SW_MOS4_GPIO_Port, MCU_SW_MOS4_Pin},
+	{MCU_SW_MOS5_GPIO_Port, MCU_SW_MOS5_Pin},
+	{MCU_SW_MOS6_GPIO_Port, MCU_SW_MOS6_Pin},
+	{MCU_SW_MOS7_GPIO_Port, MCU_SW_MOS7_Pin},
+	{MCU_SW_MOS8_GPIO_Port, MCU_SW_MOS8_Pin},
+	{MCU_SW_MOS9_GPIO_Port, MCU_SW_MOS9_Pin},
+	{MCU_SW_MOS10_GPIO_Port, MCU_SW_MOS10_Pin},
+	{MCU_SW_MOS11_GPIO_Port, MCU_SW_MOS11_Pin}
+};
+
+static double soc[PLANT_CELLS]; // True SOC (fraction), index = cell number - 1
+static double capacity_As[PLANT_CELLS]; // Capacity (As)
+static double leak_A[PLANT_CELLS]; // Self-discharge (A)
+static double v_oc[PLANT_CELLS]; // Open circuit voltage at the present SOC (V)
+static double v_rc[PLANT_CELLS]; // Polarisation voltage (V)
+static double cell_i[PLANT_CELLS]; // Current through each cell in the last step, positive discharges (A)
+static double load_A = 0.0; // External pack current (A)
+static double output_A = 0.0; // Flyback output current (A)
+static double input_A = 0.0; // Flyback input current (A)
+static uint32_t noise_state = 1; // Noise generator state
+static PlantStats stats; // Totals
+
+
+/**
+ * @brief  Open circuit voltage at a SOC, interpolated from the discharge curve of the built-in surface
+ */
+static double ocv(double fraction)
+{
+	const uint16_t *row = ocv_surface[OCV_BRANCH_DISCHARGE][0];
+	double centi = fraction * 10000.0;
+	int low = 0, high = OCV_V_SIZE - 1;
+
+	if (centi <= row[0])
+	{
+		return OCV_V0_UV / 1e6;
+	}
+	if (centi > row[high])
+	{
+		return (OCV_V0_UV + ((uint32_t)high << OCV_V_SHIFT)) / 1e6;
+	}
+
+	while (high - low > 1) // First grid point at or above the SOC, row[low] < centi <= row[high]
+	{
+		int mid = (low + high) / 2;
+
+		if (row[mid] < centi)
+		{
+			low = mid;
+		} else {
+			high = mid;
+		}
+	}
+
+	return (OCV_V0_UV + (low + (centi - row[low]) / (row[high] - row[low])) * (1u << OCV_V_SHIFT)) / 1e6;
+}
+
+
+/**
+ * @brief  Decode the switch matrix from the gate drive levels
+ */
+static int decode_path()
+{
+	uint32_t on = 0; // Bit m set if MOSFET m is on
+	int odd_nodes = 0, even_nodes = 0; // Stack nodes joined to each rail
+	int odd_node = -1, even_node = -1;
+	int pos_odd, pos_even, neg_odd, neg_even;
+	int cell;
+
+	for (int m = 1; m <= MOSFETS; m++)
+	{
+		if (sim_gpio_odr(gates[m].port) & gates[m].pin)
+		{
+			on |= 1UL << m;
+		}
+	}
+	if (!on)
+	{
+		return PLANT_PATH_OPEN;
+	}
+
+	for (int m = 5; m <= MOSFETS; m++)
+	{
+		int node = NOC + 5 - m;
+
+		if (!(on & (1UL << m)))
+		{
+			continue;
+		}
+		if (node % 2)
+		{
+			odd_nodes++;
+			odd_node = node;
+		} else {
+			even_nodes++;
+			even_node = node;
+		}
+	}
+	pos_odd = !!(on & (1UL << 2));
+	pos_even = !!(on & (1UL << 1));
+	neg_odd = !!(on & (1UL << 3));
+	neg_even = !!(on & (1UL << 4));
+
+	if (odd_nodes > 1 || even_nodes > 1 || (pos_odd && neg_odd) || (pos_even && neg_even)
+			|| (pos_odd && pos_even) || (neg_odd && neg_even))
+	{
+		return PLANT_PATH_SHORT;
+	}
+	if (odd_nodes != 1 || even_nodes != 1)
+	{
+		return PLANT_PATH_INVALID;
+	}
+
+	cell = (odd_node > even_node) ? odd_node : even_node; // Top of the cell between the two nodes
+	if (cell - ((odd_node < even_node) ? odd_node : even_node) != 1)
+	{
+		return PLANT_PATH_INVALID;
+	}
+	if ((cell % 2) ? (pos_odd && neg_even) : (pos_even && neg_odd))
+	{
+		return cell;
+	}
+	return PLANT_PATH_INVALID;
+}
+
+
+/**
+ * @brief  External current actually flowing, the load is disconnected while the pack relay is open
+ */
+static double pack_load()
+{
+	return (sim_gpio_odr(PACK_ENABLE_GPIO_Port) & PACK_ENABLE_Pin) ? load_A : 0.0;
+}
+
+
+/**
+ * @brief  Cell states, index = cell number - 1, NULL for the defaults
+ */
+void plant_init(const double *soc_pct, const double *capacity_mAh, const double *leak_mA, uint32_t seed)
+{
+	for (int i = 0; i < PLANT_CELLS; i++)
+	{
+		soc[i] = (soc_pct ? soc_pct[i] : 50.0) / 100.0;
+		capacity_As[i] = (capacity_mAh ? capacity_mAh[i] : PLANT_CAPACITY_MAH) * 3.6;
+		leak_A[i] = (leak_mA ? leak_mA[i] : 0.0) / 1000.0;
+		v_oc[i] = ocv(soc[i]);
+		v_rc[i] = 0.0;
+		cell_i[i] = 0.0;
+	}
+	load_A = 0.0;
+	output_A = 0.0;
+	input_A = 0.0;
+	noise_state = seed ? seed : 1;
+	memset(&stats, 0, sizeof(stats));
+}
+
+
+/**
+ * @brief  External pack current, positive discharges
+ */
+void plant_set_load(double amps)
+{
+	load_A = amps;
+}
+
+
+/**
+ * @brief  Advance cells and converter by dt
+ */
+void plant_step(uint32_t dt_us)
+{
+	double dt = dt_us / 1e6; // (s)
+	int path = decode_path();
+	double target_A = 0.0; // Output current the converter settles to (A)
+	double pack_v = 0.0;
+	double external_A = pack_load();
+
+	if (path == PLANT_PATH_SHORT)
+	{
+		stats.short_us += dt_us;
+	}
+	if (sim_pwm_running())
+	{
+		if (path > 0)
+		{
+			double duty = (double)sim_pwm_duty();
+
+			target_A = (duty > DUTY_OFFSET) ? (duty - DUTY_OFFSET) / DUTY_SLOPE * PLANT_FLYBACK_GAIN
+					* NOMINAL_CELL_V / plant_cell_voltage(path) : 0.0;
+		} else {
+			stats.pwm_invalid_us += dt_us;
+		}
+	}
+	output_A = target_A + (output_A - target_A) * exp(-(double)dt_us / PLANT_FLYBACK_TAU_US);
+	if (path <= 0) // Output disconnected
+	{
+		output_A = 0.0;
+	}
+
+	for (int i = 0; i < PLANT_CELLS; i++)
+	{
+		pack_v += v_oc[i] - v_rc[i];
+	}
+	input_A = (output_A > 0.0 && path > 0) ? output_A * v_oc[path - 1] / (pack_v * PLANT_FLYBACK_EFFICIENCY) : 0.0;
+
+	for (int i = 0; i < PLANT_CELLS; i++)
+	{
+		double decay = exp(-dt / PLANT_TAU1_S);
+
+		cell_i[i] = external_A + input_A - ((path == i + 1) ? output_A : 0.0);
+		soc[i] -= (cell_i[i] + leak_A[i]) * dt / capacity_As[i];
+		soc[i] = (soc[i] < 0.0) ? 0.0 : (soc[i] > 1.0) ? 1.0 : soc[i];
+		v_oc[i] = ocv(soc[i]);
+		v_rc[i] = cell_i[i] * PLANT_R1_OHM + (v_rc[i] - cell_i[i] * PLANT_R1_OHM) * decay;
+	}
+
+	if (path > 0)
+	{
+		stats.delivered_mAh[path] += output_A * dt / 3.6;
+	}
+	stats.drawn_mAh += input_A * dt / 3.6;
+	stats.load_mAh += external_A * dt / 3.6;
+	if (output_A > 0.01)
+	{
+		stats.converter_us += dt_us;
+	}
+}
+
+
+/**
+ * @brief  Terminal voltage of a cell (V)
+ */
+double plant_cell_voltage(int cell)
+{
+	int i = cell - 1;
+
+	return v_oc[i] - cell_i[i] * PLANT_R0_OHM - v_rc[i];
+}
+
+
+/**
+ * @brief  True SOC of a cell (%)
+ */
+double plant_soc(int cell)
+{
+	return soc[cell - 1] * 100.0;
+}
+
+
+/**
+ * @brief  Highest minus lowest charge held, as a percentage of PLANT_CAPACITY_MAH
+ *         - What the firmware balances once it has estimated the capacities
+ */
+double plant_charge_spread()
+{
+	double low = soc[0] * capacity_As[0], high = low;
+
+	for (int i = 1; i < PLANT_CELLS; i++)
+	{
+		double held = soc[i] * capacity_As[i];
+
+		low = (held < low) ? held : low;
+		high = (held > high) ? held : high;
+	}
+	return (high - low) / (PLANT_CAPACITY_MAH * 3.6) * 100.0;
+}
+
+
+/**
+ * @brief  Current at the pack sensor, external load and flyback input (A)
+ */
+double plant_pack_current()
+{
+	return pack_load() + input_A;
+}
+
+
+/**
+ * @brief  Flyback output current (A)
+ */
+double plant_balancing_current()
+{
+	return output_A;
+}
+
+
+/**
+ * @brief  Switch matrix state as a PlantPath or cell number
+ */
+int plant_path()
+{
+	return decode_path();
+}
+
+
+/**
+ * @brief  Measurement noise, -1, 0 or +1 LSB
+ */
+int plant_noise_lsb()
+{
+	noise_state = noise_state * 1103515245UL + 12345UL; // Same sequence for the same seed
+	return (int)((noise_state >> 16) % 3) - 1;
+}
+
+
+/**
+ * @brief  Totals since the start of the run
+ */
+const PlantStats *plant_stats()
+{
+	return &stats;
+}
@@ -0,0 +1,623 @@
+/**
+  ******************************************************************************
+  * @file           : sim_hal.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "sim.h" // Include header file for the simulator
+#include "plant.h" // Include plant model
+#include "pl455_emulator.h" // Include cell monitor emulator
+#include "main.h" // Include pin assignments
+#include "adc.h" // Include ADC handles
+#include "dma.h" // Include DMA initialisation prototype
+#include "gpio.h" // Include GPIO initialisation prototype
+#include "tim.h" // Include timer handle
+#include "usart.h" // Include UART handles
+#include "serial_console.h" // Include console receive interrupt
+#include "current_sense.h" // Include DMA block size
+#include "current_calibration.h" // Include nominal current sense gains
+#include <stdio.h> // Include fwrite()
+#include <stdlib.h> // Include exit()
+#include <string.h> // Include memset()
+#include <sys/mman.h> // Include mmap()
+
+/*
+ * Simulated HAL, peripherals and virtual clock, replacing the CubeMX peripheral
+ * files, the HAL library and the startup code for the host build.
+ *
+ * Virtual time only moves when the firmware waits: HAL_Delay() jumps straight
+ * to its end, every HAL_GetTick() call and DWT->CYCCNT read costs SIM_POLL_US
+ * and SIM_CYCCNT_POLL_US, so polling loops finish after the same number of
+ * virtual milliseconds as on the device. Serial output takes no virtual time.
+ * While time moves, events are run in order:
+ *   - the plant is stepped every SIM_PLANT_STEP_US while the PWM runs, otherwise
+ *     only when it is sampled, its inputs are then constant between steps
+ *   - every ADC DMA half-buffer (CURRENT_SENSE_BLOCK samples) is filled from the
+ *     plant currents and the half / full transfer callback is called
+ *   - PL455 response bytes are delivered to the armed USART3 receive, with
+ *     HAL_UART_RxCpltCallback() once the requested length has arrived
+ *   - scenario events are run and the run ends at the end time
+ * Callbacks are called from inside the HAL function that moved the clock, as an
+ * interrupt would interrupt the main loop at that point.
+ *
+ * Flash is an anonymous mapping at the device addresses of the black-box
+ * region, the chemistry profile partition and the NVM region, so the linker symbols and the 32-bit
+ * addresses flash_storage.c passes to HAL_FLASH_Program() are the device ones.
+ */
+
+/* ***** DEFINE CONSTANTS ***** */
+#define SIM_PLANT_STEP_US 1000 // Plant step while the PWM runs (us), also the duty cycle sampling period
+#define SIM_PACK_OFFSET_CODES 12 // Zero current code of the pack channel
+#define SIM_BALANCING_OFFSET_CODES -8 // Zero current code of the balancing channel
+#define SIM_RX_FIFO 64 // USART3 bytes received and not yet read
+
+/* ***** PERIPHERALS ***** */
+GPIO_TypeDef sim_gpioa, sim_gpiob, sim_gpioc;
+USART_TypeDef sim_lpuart1, sim_usart3;
+ADC_TypeDef sim_adc1, sim_adc2;
+TIM_TypeDef sim_tim1;
+CoreDebug_Type sim_core_debug;
+RCC_TypeDef sim_rcc = {RCC_CSR_BORRSTF}; // Every run starts from power-on
+IWDG_TypeDef sim_iwdg;
+static DWT_Type sim_dwt_regs;
+uint32_t SystemCoreClock = 16000000UL; // HSI until SystemClock_Config()
+
+ADC_HandleTypeDef hadc1;
+ADC_HandleTypeDef hadc2;
+TIM_HandleTypeDef htim1;
+UART_HandleTypeDef hlpuart1;
+UART_HandleTypeDef huart3;
+
+/* ***** SIMULATOR STATE ***** */
+static uint64_t now_us = 0; // Virtual time since reset (us)
+static uint64_t end_us = UINT64_MAX; // Virtual time at which the run ends (us)
+static uint64_t plant_us = 0; // Virtual time the plant has been stepped to (us)
+static int advancing = 0; // 1 inside sim_advance(), callbacks do not move the clock again
+static int pwm_running = 0; // 1 while TIM1 channel 1 runs
+static int wake_level = 0; // Last WAKEUP pin level passed to the PL455 emulator
+
+static uint32_t *adc_buffer = NULL; // Dual ADC circular DMA buffer, NULL until started
+static uint32_t adc_length = 0; // Words in adc_buffer
+static int adc_half = 0; // Half filled next, 0 first
+static uint64_t adc_next_us = UINT64_MAX; // Virtual time the next half-buffer completes (us)
+static uint64_t iwdg_expiry_us = UINT64_MAX; // Virtual time the IWDG resets the device, UINT64_MAX until started (us)
+
+static uint8_t rx_fifo[SIM_RX_FIFO]; // USART3 bytes waiting for a receive
+static int rx_count = 0; // Bytes in rx_fifo
+
+
+/**
+ * @brief  Apply pending BSRR stores to every port, returns 0 (used as the ODR index)
+ */
+uint32_t sim_gpio_sync()
+{
+	GPIO_TypeDef *ports[3] = {&sim_gpioa, &sim_gpiob, &sim_gpioc};
+
+	for (int i = 0; i < 3; i++)
+	{
+		uint32_t bsrr = ports[i]->BSRR;
+
+		if (bsrr)
+		{
+			ports[i]->ODR_reg[0] = (ports[i]->ODR_reg[0] & ~(bsrr >> 16)) | (bsrr & 0xFFFF);
+			ports[i]->BSRR = 0;
+		}
+	}
+
+	if (((sim_gpioa.ODR_reg[0] & IC_WAKEUP_Pin) != 0) != wake_level)
+	{
+		wake_level = !wake_level;
+		pl455_emu_wake_pin(wake_level);
+	}
+	return 0;
+}
+
+
+/**
+ * @brief  Output register after pending BSRR stores
+ */
+uint32_t sim_gpio_odr(GPIO_TypeDef *port)
+{
+	sim_gpio_sync();
+	return port->ODR_reg[0];
+}
+
+
+/**
+ * @brief  Reading RDR clears the receive flag, returns 0 (used as the RDR index)
+ */
+uint32_t sim_rdr_read()
+{
+	sim_lpuart1.ISR &= ~USART_ISR_RXNE_RXFNE;
+	return 0;
+}
+
+
+/**
+ * @brief  Cycle counter at the virtual time, each read costs SIM_CYCCNT_POLL_US
+ */
+DWT_Type *sim_dwt()
+{
+	sim_advance(SIM_CYCCNT_POLL_US);
+	sim_dwt_regs.CYCCNT = (uint32_t)(now_us * (SystemCoreClock / 1000000UL));
+	return &sim_dwt_regs;
+}
+
+
+/**
+ * @brief  Apply a pending IWDG key store, start or reload restart the count
+ *         - Only the last key stored before the clock moves is seen, so the enable key also reloads
+ */
+static void iwdg_sync()
+{
+	if (sim_iwdg.KR == 0xAAAA || sim_iwdg.KR == 0xCCCC)
+	{
+		uint64_t count_us = (4ULL << sim_iwdg.PR) * 1000000ULL / 32000ULL; // LSI 32kHz divided by 4 << PR
+
+		iwdg_expiry_us = now_us + (sim_iwdg.RLR + 1ULL) * count_us;
+	}
+	sim_iwdg.KR = 0;
+}
+
+
+/**
+ * @brief  Step the plant up to the virtual time
+ */
+static void plant_sync()
+{
+	if (now_us > plant_us)
+	{
+		sim_gpio_sync();
+		plant_step((uint32_t)(now_us - plant_us));
+		plant_us = now_us;
+	}
+}
+
+
+/**
+ * @brief  ADC code of a current on a channel with the nominal gain
+ */
+static int16_t current_code(double amps, int32_t gain_q16, int offset)
+{
+	double code = amps * 1000.0 * 65536.0 / gain_q16 + offset + plant_noise_lsb();
+
+	code = (code > 32767.0) ? 32767.0 : (code < -32768.0) ? -32768.0 : code;
+	return (int16_t)((code < 0.0) ? code - 0.5 : code + 0.5);
+}
+
+
+/**
+ * @brief  Fill the next ADC half-buffer from the plant and call its callback
+ */
+static void adc_block()
+{
+	uint32_t half_words = adc_length / 2;
+	uint32_t *block = &adc_buffer[adc_half ? half_words : 0];
+
+	for (uint32_t i = 0; i < half_words; i++) // ADC1 in the low half, ADC2 in the high half
+	{
+		uint16_t pack = (uint16_t)current_code(plant_pack_current(), CAL_PACK_GAIN_NOMINAL, SIM_PACK_OFFSET_CODES);
+		uint16_t balancing = (uint16_t)current_code(plant_balancing_current(), CAL_BALANCING_GAIN_NOMINAL, SIM_BALANCING_OFFSET_CODES);
+
+		block[i] = ((uint32_t)balancing << 16) | pack;
+	}
+
+	if (adc_half)
+	{
+		HAL_ADC_ConvCpltCallback(&hadc1);
+	} else {
+		HAL_ADC_ConvHalfCpltCallback(&hadc1);
+	}
+	adc_half = !adc_half;
+	adc_next_us += (uint64_t)half_words * SIM_ADC_SAMPLE_US;
+}
+
+
+/**
+ * @brief  Move received USART3 bytes into the armed receive
+ */
+static void uart3_deliver()
+{
+	if (rx_count < SIM_RX_FIFO && pl455_emu_response_ready(now_us))
+	{
+		rx_count += pl455_emu_take_response(&rx_fifo[rx_count], SIM_RX_FIFO - rx_count);
+	}
+
+	while (rx_count > 0 && huart3.RxState == HAL_UART_STATE_BUSY_RX)
+	{
+		int n = (rx_count < huart3.RxXferCount) ? rx_count : huart3.RxXferCount;
+
+		memcpy(huart3.pRxBuffPtr, rx_fifo, n);
+		memmove(rx_fifo, &rx_fifo[n], rx_count - n);
+		rx_count -= n;
+		huart3.pRxBuffPtr += n;
+		huart3.RxXferCount -= n;
+
+		if (huart3.RxXferCount == 0)
+		{
+			huart3.RxState = HAL_UART_STATE_READY;
+			HAL_UART_RxCpltCallback(&huart3); // May arm the next receive
+		}
+	}
+}
+
+
+/**
+ * @brief  Virtual time since reset (us)
+ */
+uint64_t sim_now_us()
+{
+	return now_us;
+}
+
+
+/**
+ * @brief  Move the virtual clock forward, running the plant, peripherals and scenario
+ */
+void sim_advance(uint32_t us)
+{
+	uint64_t target = now_us + us;
+
+	sim_gpio_sync(); // Stores take effect before time moves on
+	iwdg_sync();
+	if (advancing) // Called from a callback, time stands still
+	{
+		return;
+	}
+	advancing = 1;
+
+	while (now_us < target)
+	{
+		uint64_t next = target;
+
+		if (pwm_running && plant_us + SIM_PLANT_STEP_US < next)
+		{
+			next = plant_us + SIM_PLANT_STEP_US;
+		}
+		if (adc_next_us < next)
+		{
+			next = adc_next_us;
+		}
+		if (end_us < next)
+		{
+			next = end_us;
+		}
+		if (iwdg_expiry_us < next)
+		{
+			next = iwdg_expiry_us;
+		}
+		now_us = next;
+
+		if (now_us >= iwdg_expiry_us) // Not reloaded in time
+		{
+			fprintf(stderr, "\nIWDG reset at %.3fs\n", now_us / 1e6);
+			exit(3);
+		}
+
+		if (now_us >= adc_next_us)
+		{
+			plant_sync();
+			adc_block();
+		} else if (pwm_running && now_us >= plant_us + SIM_PLANT_STEP_US)
+		{
+			plant_sync();
+		}
+		uart3_deliver();
+		scenario_tick();
+
+		if (now_us >= end_us)
+		{
+			scenario_finish();
+		}
+	}
+
+	advancing = 0;
+}
+
+
+/**
+ * @brief  Virtual time at which the run ends
+ */
+void sim_set_end(uint64_t end)
+{
+	end_us = end;
+}
+
+
+/**
+ * @brief  Map the simulated flash at its device address, erased
+ */
+int sim_flash_map()
+{
+	void *map = mmap((void *)SIM_FLASH_MAP_START, SIM_FLASH_MAP_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+	if (map != (void *)SIM_FLASH_MAP_START)
+	{
+		return -1;
+	}
+	memset(map, 0xFF, SIM_FLASH_MAP_SIZE);
+	return 0;
+}
+
+
+/**
+ * @brief  Deliver bytes to the serial console receive interrupt
+ */
+void sim_lpuart_inject(const char *text)
+{
+	while (*text)
+	{
+		sim_lpuart1.RDR_reg[0] = (uint8_t)*text++;
+		sim_lpuart1.ISR |= USART_ISR_RXNE_RXFNE;
+		if (sim_lpuart1.CR1 & USART_CR1_RXNEIE_RXFNEIE)
+		{
+			serial_console_rx_irq();
+		}
+	}
+}
+
+
+/**
+ * @brief  1 while TIM1 channel 1 drives the flyback
+ */
+int sim_pwm_running()
+{
+	return pwm_running;
+}
+
+
+/**
+ * @brief  TIM1 compare value (% of the 100 count period)
+ */
+uint32_t sim_pwm_duty()
+{
+	return sim_tim1.CCR1;
+}
+
+
+/* ***** HAL CORE ***** */
+
+HAL_StatusTypeDef HAL_Init(void)
+{
+	return HAL_OK;
+}
+
+uint32_t HAL_GetTick(void)
+{
+	sim_advance(SIM_POLL_US);
+	return (uint32_t)(now_us / 1000);
+}
+
+void HAL_Delay(uint32_t Delay)
+{
+	uint64_t wait = (uint64_t)Delay + ((Delay < HAL_MAX_DELAY) ? 1 : 0); // At least Delay whole ticks, as the HAL
+
+	sim_advance((uint32_t)(wait * 1000));
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority)
+{
+	UNUSED(IRQn);
+	UNUSED(PreemptPriority);
+	UNUSED(SubPriority);
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn)
+{
+	UNUSED(IRQn);
+}
+
+void NVIC_SystemReset(void)
+{
+	fprintf(stderr, "\nSoftware reset at %.3fs\n", now_us / 1e6);
+	exit(4);
+}
+
+HAL_StatusTypeDef HAL_PWREx_ControlVoltageScaling(uint32_t VoltageScaling)
+{
+	UNUSED(VoltageScaling);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef *RCC_OscInitStruct)
+{
+	UNUSED(RCC_OscInitStruct);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef *RCC_ClkInitStruct, uint32_t FLatency)
+{
+	UNUSED(RCC_ClkInitStruct);
+	UNUSED(FLatency);
+	SystemCoreClock = SIM_CORE_CLOCK_HZ;
+	return HAL_OK;
+}
+
+
+/* ***** GPIO ***** */
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init)
+{
+	GPIOx->MODER |= GPIO_Init->Pin; // Only records the pins as configured
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+	sim_gpio_sync(); // Apply a pending store first, BSRR holds one word
+	GPIOx->BSRR = (PinState != GPIO_PIN_RESET) ? (uint32_t)GPIO_Pin : (uint32_t)GPIO_Pin << 16;
+	sim_gpio_sync();
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+	return ((GPIOx->IDR | sim_gpio_odr(GPIOx)) & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET; // Output pins read back their level
+}
+
+
+/* ***** UART ***** */
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+	UNUSED(Timeout);
+
+	if (huart == &huart3) // Cell monitor
+	{
+		plant_sync(); // Sample the cells at the time of the command
+		pl455_emu_receive(pData, Size);
+	} else {
+		fwrite(pData, 1, Size, stdout); // Serial monitor
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Receive_IT(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size)
+{
+	if (huart->RxState != HAL_UART_STATE_READY)
+	{
+		return HAL_BUSY;
+	}
+	huart->pRxBuffPtr = pData;
+	huart->RxXferSize = Size;
+	huart->RxXferCount = Size;
+	huart->RxState = HAL_UART_STATE_BUSY_RX;
+
+	if (huart == &huart3)
+	{
+		uart3_deliver(); // Bytes already received complete straight away
+	}
+	return HAL_OK;
+}
+
+
+/* ***** ADC ***** */
+
+HAL_StatusTypeDef HAL_ADCEx_Calibration_Start(ADC_HandleTypeDef *hadc, uint32_t SingleDiff)
+{
+	UNUSED(hadc);
+	UNUSED(SingleDiff);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADCEx_MultiModeStart_DMA(ADC_HandleTypeDef *hadc, uint32_t *pData, uint32_t Length)
+{
+	UNUSED(hadc);
+	adc_buffer = pData;
+	adc_length = Length;
+	adc_half = 0;
+	adc_next_us = now_us + (uint64_t)(Length / 2) * SIM_ADC_SAMPLE_US;
+	return HAL_OK;
+}
+
+
+/* ***** TIMERS ***** */
+
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef *htim, uint32_t Channel)
+{
+	UNUSED(htim);
+	UNUSED(Channel);
+	plant_sync();
+	pwm_running = 1;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Stop(TIM_HandleTypeDef *htim, uint32_t Channel)
+{
+	UNUSED(htim);
+	UNUSED(Channel);
+	plant_sync();
+	pwm_running = 0;
+	return HAL_OK;
+}
+
+
+/* ***** FLASH ***** */
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void)
+{
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void)
+{
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+	uint64_t *word = (uint64_t *)(uintptr_t)Address;
+
+	UNUSED(TypeProgram);
+	if (Address < SIM_FLASH_MAP_START || Address + sizeof(uint64_t) > SIM_FLASH_MAP_START + SIM_FLASH_MAP_SIZE || (Address & 7))
+	{
+		return HAL_ERROR;
+	}
+	if (*word != UINT64_MAX) // Programming a written double-word fails on the device (PROGERR)
+	{
+		return HAL_ERROR;
+	}
+	*word = Data;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *PageError)
+{
+	uint32_t start = FLASH_BASE + ((pEraseInit->Banks == FLASH_BANK_2) ? FLASH_BANK_SIZE : 0) + pEraseInit->Page * FLASH_PAGE_SIZE;
+	uint32_t len = pEraseInit->NbPages * FLASH_PAGE_SIZE;
+
+	if (start < SIM_FLASH_MAP_START || start + len > SIM_FLASH_MAP_START + SIM_FLASH_MAP_SIZE)
+	{
+		*PageError = pEraseInit->Page;
+		return HAL_ERROR;
+	}
+	memset((void *)(uintptr_t)start, 0xFF, len);
+	*PageError = 0xFFFFFFFFU;
+	return HAL_OK;
+}
+
+
+/* ***** CUBEMX INITIALISATION ***** */
+
+void MX_GPIO_Init(void)
+{
+	memset(&sim_gpioa, 0, sizeof(sim_gpioa)); // Every output starts low
+	memset(&sim_gpiob, 0, sizeof(sim_gpiob));
+	memset(&sim_gpioc, 0, sizeof(sim_gpioc));
+	wake_level = 0;
+	pl455_emu_wake_pin(0);
+}
+
+void MX_DMA_Init(void)
+{
+}
+
+void MX_LPUART1_UART_Init(void)
+{
+	hlpuart1.Instance = LPUART1;
+	hlpuart1.RxState = HAL_UART_STATE_READY;
+}
+
+void MX_USART3_UART_Init(void)
+{
+	huart3.Instance = USART3;
+	huart3.RxState = HAL_UART_STATE_READY;
+}
+
+void MX_ADC1_Init(void)
+{
+	hadc1.Instance = ADC1;
+}
+
+void MX_ADC2_Init(void)
+{
+	hadc2.Instance = ADC2;
+}
+
+void MX_TIM1_Init(void)
+{
+	htim1.Instance = TIM1;
+	sim_tim1.ARR = 100 - 1; // Duty cycle in % of the period
+}
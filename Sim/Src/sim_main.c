@@ -0,0 +1,387 @@
+/**
+  ******************************************************************************
+  * @file           : sim_main.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "sim.h" // Include virtual clock
+#include "plant.h" // Include plant model
+#include "pl455_emulator.h" // Include cell monitor emulator
+#include "main.h" // Include user button pin
+#include "balancing_planner.h" // Include target spread
+#include <stdio.h> // Include standard I/O functions
+#include <stdlib.h> // Include strtod() and exit()
+#include <string.h> // Include string manipulation functions
+#include <time.h> // Include clock_gettime()
+
+/*
+ * Runs the unmodified firmware (main() of Core/Src/main.c, built as bms_main())
+ * against the plant for a scenario, as fast as the host allows.
+ *
+ *   bms_sim [options]
+ *     -t <hours>              run length (default 10)
+ *     -s <soc,...>            initial SOC of cells 1 to NOC (%)
+ *     -k <mAh,...>            capacity of cells 1 to NOC
+ *     -l <mA,...>             self-discharge of cells 1 to NOC
+ *     -e <seconds>:<event>    scenario event, repeatable, or -e @<file> with one "<seconds> <event>" per line
+ *     -f <image>              flash image, loaded if present and written back at exit
+ *     -i <seconds>            interval of $SIM telemetry lines (default 600)
+ *     -r <seed>               measurement noise seed
+ *     -q                      discard the firmware's serial monitor output
+ *
+ * Events: "load <A>" sets the external pack current (positive discharges, flows
+ * while the pack relay is closed), "button" presses the user button, "monitor
+ * off" makes the cell monitor stop answering until "monitor on", anything else
+ * is typed into the serial console followed by a newline.
+ *
+ * The firmware's serial output goes to stdout. Simulator lines go to stderr:
+ *   $SIM,<s>,<true charge spread %>,<cell 1 SOC %>,...,<balancing A>,<matrix path>
+ * followed by a summary when the run ends, or when the IWDG or a software reset
+ * restarts the firmware (RAM is not kept, so warm starts cannot be simulated).
+ */
+
+/* ***** DEFINE CONSTANTS ***** */
+#define SCENARIO_EVENTS_MAX 256 // Scenario events
+#define SCENARIO_EVENT_LEN 200 // Longest event text
+#define SCENARIO_DEFAULT_HOURS 10.0
+#define SCENARIO_DEFAULT_TELEMETRY_S 600
+#define SCENARIO_CHECK_US 100000 // Resolution of the balanced time and telemetry (us), events run on time
+
+/**
+ * @brief Timed scenario event
+ */
+typedef struct {
+	uint64_t at_us; // Virtual time to run the event
+	char text[SCENARIO_EVENT_LEN]; // Event
+} ScenarioEvent;
+
+/* ***** SCENARIO STATE ***** */
+static ScenarioEvent events[SCENARIO_EVENTS_MAX]; // Events sorted by time
+static int event_count = 0;
+static int next_event = 0;
+static uint64_t telemetry_us = SCENARIO_DEFAULT_TELEMETRY_S * 1000000ULL; // Telemetry interval
+static uint64_t next_telemetry_us = 0;
+static uint64_t next_check_us = 0; // Virtual time scenario_tick() next has work
+static double initial_soc[PLANT_CELLS]; // True SOC at the start (%)
+static double initial_spread = 0.0; // True charge spread at the start (% of PLANT_CAPACITY_MAH)
+static int64_t balanced_us = -1; // Virtual time the spread first reached PLANNER_TARGET_SPREAD, -1 if not yet
+static const char *flash_image = NULL; // Flash image file, NULL if not kept
+static struct timespec wall_start; // Host time at the start
+static int finished = 0; // 1 once the run reached its end time
+
+int bms_main(void); // Firmware entry point (main.c built with -Dmain=bms_main)
+
+
+/**
+ * @brief  Parse NOC comma separated values
+ */
+static int parse_cells(const char *text, double *values)
+{
+	char *end;
+
+	for (int i = 0; i < PLANT_CELLS; i++)
+	{
+		values[i] = strtod(text, &end);
+		if (end == text || (i < PLANT_CELLS - 1 && *end != ','))
+		{
+			return -1;
+		}
+		text = end + 1;
+	}
+	return 0;
+}
+
+
+/**
+ * @brief  Add an event "<seconds>:<event>" or "<seconds> <event>"
+ */
+static int add_event(const char *text)
+{
+	char *end;
+	double seconds = strtod(text, &end);
+	int i;
+
+	if (end == text || (*end != ':' && *end != ' ') || event_count == SCENARIO_EVENTS_MAX)
+	{
+		return -1;
+	}
+
+	for (i = event_count; i > 0 && events[i - 1].at_us > (uint64_t)(seconds * 1e6); i--) // Keep sorted, stable
+	{
+		events[i] = events[i - 1];
+	}
+	events[i].at_us = (uint64_t)(seconds * 1e6);
+	snprintf(events[i].text, SCENARIO_EVENT_LEN, "%s", end + 1);
+	events[i].text[strcspn(events[i].text, "\r\n")] = '\0';
+	event_count++;
+	return 0;
+}
+
+
+/**
+ * @brief  Add every event of a file, blank lines and lines starting # are skipped
+ */
+static int add_event_file(const char *path)
+{
+	char line[SCENARIO_EVENT_LEN + 32];
+	FILE *file = fopen(path, "r");
+
+	if (!file)
+	{
+		return -1;
+	}
+	while (fgets(line, sizeof(line), file))
+	{
+		if (line[0] == '#' || line[0] == '\n' || line[0] == '\r')
+		{
+			continue;
+		}
+		if (add_event(line) != 0)
+		{
+			fclose(file);
+			return -1;
+		}
+	}
+	fclose(file);
+	return 0;
+}
+
+
+/**
+ * @brief  Copy the flash image between the file and the simulated flash
+ */
+static void flash_image_transfer(int save)
+{
+	FILE *file;
+
+	if (!flash_image || !(file = fopen(flash_image, save ? "wb" : "rb")))
+	{
+		return;
+	}
+	if (save)
+	{
+		fwrite((void *)SIM_FLASH_MAP_START, 1, SIM_FLASH_MAP_SIZE, file);
+	} else if (fread((void *)SIM_FLASH_MAP_START, 1, SIM_FLASH_MAP_SIZE, file) != SIM_FLASH_MAP_SIZE)
+	{
+		memset((void *)SIM_FLASH_MAP_START, 0xFF, SIM_FLASH_MAP_SIZE); // Wrong size, start erased
+	}
+	fclose(file);
+}
+
+
+/**
+ * @brief  Print one $SIM telemetry line
+ */
+static void print_telemetry()
+{
+	fprintf(stderr, "$SIM,%.0f,%.2f", sim_now_us() / 1e6, plant_charge_spread());
+	for (int cell = 1; cell <= PLANT_CELLS; cell++)
+	{
+		fprintf(stderr, ",%.2f", plant_soc(cell));
+	}
+	fprintf(stderr, ",%.2f,%d\n", plant_balancing_current(), plant_path());
+}
+
+
+/**
+ * @brief  Run one event
+ */
+static void run_event(const char *text)
+{
+	if (strncmp(text, "load ", 5) == 0)
+	{
+		plant_set_load(strtod(text + 5, NULL));
+	} else if (strcmp(text, "button") == 0)
+	{
+		HAL_GPIO_EXTI_Callback(GPIO_PIN_13);
+	} else if (strcmp(text, "monitor off") == 0 || strcmp(text, "monitor on") == 0)
+	{
+		pl455_emu_fail(strcmp(text, "monitor off") == 0);
+	} else {
+		sim_lpuart_inject(text);
+		sim_lpuart_inject("\n");
+	}
+}
+
+
+/**
+ * @brief  Run scenario events that are due, called by the virtual clock
+ */
+void scenario_tick()
+{
+	uint64_t now = sim_now_us();
+
+	if (now < next_check_us)
+	{
+		return;
+	}
+	next_check_us = now + SCENARIO_CHECK_US;
+
+	while (next_event < event_count && events[next_event].at_us <= now)
+	{
+		run_event(events[next_event++].text);
+	}
+
+	if (balanced_us < 0 && plant_charge_spread() <= PLANNER_TARGET_SPREAD)
+	{
+		balanced_us = (int64_t)now;
+	}
+
+	if (now >= next_telemetry_us)
+	{
+		print_telemetry();
+		next_telemetry_us += telemetry_us;
+	}
+
+	if (next_event < event_count && events[next_event].at_us < next_check_us)
+	{
+		next_check_us = events[next_event].at_us;
+	}
+}
+
+
+/**
+ * @brief  Leave at the end of the run, the summary is printed at exit
+ */
+void scenario_finish()
+{
+	finished = 1;
+	exit(0);
+}
+
+
+/**
+ * @brief  Print the run summary and keep the flash image
+ */
+static void print_summary()
+{
+	const PlantStats *plant = plant_stats();
+	const Pl455EmuStats *monitor = pl455_emu_stats();
+	struct timespec wall_end;
+	double wall_s, virtual_s = sim_now_us() / 1e6;
+	double delivered = 0.0;
+
+	clock_gettime(CLOCK_MONOTONIC, &wall_end);
+	wall_s = (wall_end.tv_sec - wall_start.tv_sec) + (wall_end.tv_nsec - wall_start.tv_nsec) / 1e9;
+	fflush(stdout);
+	print_telemetry();
+
+	fprintf(stderr, "\n***** SIMULATION SUMMARY *****\n");
+	fprintf(stderr, "%s after %.1fh virtual in %.2fs wall (%.0fx real time)\n", finished ? "Completed" : "Firmware exited",
+			virtual_s / 3600.0, wall_s, (wall_s > 0.0) ? virtual_s / wall_s : 0.0);
+	fprintf(stderr, "True charge spread %.2f%% -> %.2f%%", initial_spread, plant_charge_spread());
+	if (balanced_us >= 0)
+	{
+		fprintf(stderr, ", within %.1f%% after %.2fh\n", PLANNER_TARGET_SPREAD, balanced_us / 3.6e9);
+	} else {
+		fprintf(stderr, ", never within %.1f%%\n", PLANNER_TARGET_SPREAD);
+	}
+	for (int cell = 1; cell <= PLANT_CELLS; cell++)
+	{
+		fprintf(stderr, "Cell %d: SOC %.2f%% -> %.2f%%, received %.1fmAh\n", cell, initial_soc[cell - 1], plant_soc(cell),
+				plant->delivered_mAh[cell]);
+		delivered += plant->delivered_mAh[cell];
+	}
+	fprintf(stderr, "Flyback: %.2fh on, %.1fmAh delivered, %.1fmAh drawn from the pack, load %.1fmAh\n",
+			plant->converter_us / 3.6e9, delivered, plant->drawn_mAh, plant->load_mAh);
+	fprintf(stderr, "Switch matrix: %.3fs shorting, %.3fs PWM without a valid path\n", plant->short_us / 1e6, plant->pwm_invalid_us / 1e6);
+	fprintf(stderr, "PL455: %lu frames, %lu CRC errors, %lu while asleep, %lu samples, %lu responses dropped, %lu wakeups\n",
+			(unsigned long)monitor->frames, (unsigned long)monitor->crc_errors, (unsigned long)monitor->while_asleep,
+			(unsigned long)monitor->samples, (unsigned long)monitor->dropped, (unsigned long)monitor->wakeups);
+
+	flash_image_transfer(1);
+}
+
+
+/**
+ * @brief  Print the options and leave
+ */
+static void usage()
+{
+	fprintf(stderr, "usage: bms_sim [-t hours] [-s soc,...] [-k mAh,...] [-l mA,...] [-e seconds:event | -e @file]\n"
+			"               [-f flash.bin] [-i telemetry_s] [-r seed] [-q]\n");
+	exit(2);
+}
+
+
+/**
+ * @brief  Simulator entry point
+ */
+int main(int argc, char **argv)
+{
+	double soc[PLANT_CELLS] = {50.0, 56.0, 44.0, 52.0, 47.0, 58.0}; // Default imbalance, 14% spread
+	double capacity[PLANT_CELLS], leak[PLANT_CELLS];
+	double hours = SCENARIO_DEFAULT_HOURS;
+	uint32_t seed = 1;
+	int quiet = 0;
+
+	for (int i = 0; i < PLANT_CELLS; i++)
+	{
+		capacity[i] = PLANT_CAPACITY_MAH;
+		leak[i] = 0.0;
+	}
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (strcmp(arg, "-q") == 0)
+		{
+			quiet = 1;
+			continue;
+		}
+		if (arg[0] != '-' || !value)
+		{
+			usage();
+		}
+		i++;
+
+		switch (arg[1])
+		{
+			case 't': hours = strtod(value, NULL); break;
+			case 's': if (parse_cells(value, soc) != 0) usage(); break;
+			case 'k': if (parse_cells(value, capacity) != 0) usage(); break;
+			case 'l': if (parse_cells(value, leak) != 0) usage(); break;
+			case 'e': if ((value[0] == '@') ? add_event_file(value + 1) : add_event(value)) usage(); break;
+			case 'f': flash_image = value; break;
+			case 'i': telemetry_us = (uint64_t)(strtod(value, NULL) * 1e6); break;
+			case 'r': seed = (uint32_t)strtoul(value, NULL, 0); break;
+			default: usage();
+		}
+	}
+	if (hours <= 0.0 || telemetry_us == 0)
+	{
+		usage();
+	}
+
+	if (sim_flash_map() != 0)
+	{
+		fprintf(stderr, "bms_sim: cannot map simulated flash at 0x%08lX\n", SIM_FLASH_MAP_START);
+		return 1;
+	}
+	flash_image_transfer(0);
+
+	plant_init(soc, capacity, leak, seed);
+	pl455_emu_reset();
+	for (int cell = 1; cell <= PLANT_CELLS; cell++)
+	{
+		initial_soc[cell - 1] = plant_soc(cell);
+	}
+	initial_spread = plant_charge_spread();
+
+	if (quiet && !freopen("/dev/null", "w", stdout))
+	{
+		return 1;
+	}
+	setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+
+	sim_set_end((uint64_t)(hours * 3.6e9));
+	clock_gettime(CLOCK_MONOTONIC, &wall_start);
+	atexit(print_summary);
+
+	return bms_main(); // Never returns, the run ends in scenario_finish() or on a firmware fault
+}
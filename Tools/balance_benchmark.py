@@ -0,0 +1,312 @@
+#!/usr/bin/env python3
+"""
+Host benchmark of balancing strategies: time to balance a pack at rest.
+
+Two strategies are simulated on the same packs:
+  greedy   the previous detect_imbalanced_cell() strategy. Every monitoring
+           cycle with the converter free it takes the cell furthest from the
+           mean, and either charges it for 5 s or, if it is high, charges every
+           other cell for 5 s in 1 s slots, at 1 A to 4 A scaled by deviation.
+  planner  balancing_planner.c. It charges each low cell once at full current
+           until it has received its charge deficit, and re-plans every cycle.
+
+Both are run until the SOC spread (max - min) is within PLANNER_TARGET_SPREAD.
+The greedy strategy stopped at a standard deviation of TRIGGER_START_STD_DEFAULT
+and never got there, so here it keeps triggering while the spread is too large.
+The time at which the standard deviation first falls below that threshold is
+also shown.
+
+With --duty the planner is run through the DUTY_CYCLES pack current profiles
+instead of at rest, with three balancing policies:
+  blind      balances whatever the pack is doing (before balancing_policy.c)
+  rest-only  balances only at rest, the conservative alternative
+  policy     balancing_policy.c: balances at rest, charge and discharge, and
+             stops for high-current pulses until POLICY_PULSE_HOLDOFF_MS after
+During a pulse and its hold-off each cell's SOC estimate carries an error of
+PULSE_SOC_ERROR_PCT (IR drop and relaxation), drawn per pulse. The hours saved
+by the policy to reach balance are reported for each duty cycle.
+
+Constants are read from the firmware sources, capacity and current limit from
+Tools/profiles/molicel_p45b.json. The pack model is charge only: the converter
+draws its input equally from all cells with CONVERTER_EFFICIENCY, and the
+measured SOC has SOC_NOISE_PCT of estimator noise.
+
+Usage (from the repository root):
+    python3 Tools/balance_benchmark.py [--packs N] [--seed N] [--duty]
+"""
+
+import argparse
+import json
+import math
+import random
+import re
+from pathlib import Path
+
+ROOT = Path(__file__).resolve().parent.parent
+PROFILE = ROOT / "Tools" / "profiles" / "molicel_p45b.json"
+
+NOC = 6
+CONVERTER_EFFICIENCY = 0.85  # Output over input charge of the flyback
+SOC_NOISE_PCT = 0.2          # rms error of the SOC estimate (%)
+INITIAL_SOC_PCT = 60.0       # Mean SOC of the simulated packs (%)
+INITIAL_SPREADS = (2.0, 4.0, 8.0)  # Standard deviations of the initial SOC (%)
+LIMIT_S = 48 * 3600          # Give up after this long
+
+PULSE_SOC_ERROR_PCT = 3.0    # rms SOC error of a cell during a pulse and its hold-off (%)
+
+# Duty cycles, (name, [(seconds, pack current A, pulse A, pulse every s, pulse length s)]), repeated
+# Positive current discharges. Pulses replace the base current for their length.
+DUTY_CYCLES = (
+    ("commuter", [(3600, 0.0, 0, 0, 0), (2400, 1.5, 15.0, 60, 10), (4 * 3600, 0.0, 0, 0, 0),
+                  (2400, 1.5, 15.0, 60, 10), (1800, 0.0, 0, 0, 0), (5400, -2.25, 0, 0, 0), (8 * 3600, 0.0, 0, 0, 0)]),
+    ("power tool", [(600, 0.0, 0, 0, 0), (1800, 3.0, 20.0, 20, 5), (600, 0.0, 0, 0, 0), (7200, -2.25, 0, 0, 0)]),
+    ("storage", [(3 * 3600, 0.2, 0, 0, 0), (3600, -1.0, 0, 0, 0), (20 * 3600, 0.0, 0, 0, 0)]),
+)
+
+# Previous greedy strategy (active_balancing.h before the planner)
+GREEDY_CURRENT_MIN = 1.0     # BALANCE_CURRENT_MIN (A)
+GREEDY_CURRENT_MAX = 4.0     # BALANCE_CURRENT_MAX (A)
+GREEDY_DEVIATION_FULL = 20.0  # BALANCE_DEVIATION_FULL (%)
+GREEDY_DURATION_S = 5.0      # BALANCE_DURATION_MS
+GREEDY_SLOT_S = 1.0          # BALANCE_SLOT_MS
+
+
+def define(path, name):
+    """Value of a numeric #define in a firmware source file."""
+    match = re.search(rf"#define {name}\s+\(?([-\d.]+)f?", (ROOT / path).read_text())
+    return float(match.group(1))
+
+
+class Pack:
+    """Cell charge (mAh) and the converter slot running on it."""
+
+    def __init__(self, soc, capacity):
+        self.capacity = capacity
+        self.q = [s / 100.0 * capacity for s in soc]
+        self.slot = None  # (cell index, mAh per s, end time)
+
+    def soc(self):
+        return [100.0 * q / self.capacity for q in self.q]
+
+    def advance(self, seconds):
+        if self.slot and seconds > 0:
+            i, rate, _ = self.slot
+            moved = rate * seconds
+            self.q[i] += moved
+            for j in range(NOC):
+                self.q[j] -= moved / (NOC * CONVERTER_EFFICIENCY)
+
+
+def start_slot(pack, t, cell_index, setpoint, regulate_s, ramp_s):
+    """Soft-start, regulate and soft-stop, the ramps deliver half current."""
+    length = regulate_s + 2 * ramp_s
+    rate = setpoint * (regulate_s + ramp_s) / length / 3.6  # mAh per s
+    pack.slot = (cell_index, rate, t + length)
+
+
+class Greedy:
+    def __init__(self, c):
+        self.c = c
+        self.slots = []
+
+    def monitor(self, pack, t, soc):
+        if pack.slot or self.slots:
+            return
+        mean = sum(soc) / NOC
+        worst = max(range(NOC), key=lambda i: abs(soc[i] - mean))
+        deviation = abs(soc[worst] - mean)
+        setpoint = min(GREEDY_CURRENT_MIN + (GREEDY_CURRENT_MAX - GREEDY_CURRENT_MIN) * deviation / GREEDY_DEVIATION_FULL,
+                       GREEDY_CURRENT_MAX)
+        if soc[worst] <= mean:
+            self.slots = [(worst, setpoint, GREEDY_DURATION_S)]
+        else:
+            cells = [i for i in range(NOC) if i != worst]
+            rounds = int(GREEDY_DURATION_S / GREEDY_SLOT_S)
+            self.slots = [(i, setpoint, GREEDY_SLOT_S) for _ in range(rounds) for i in cells]
+        self.next_slot(pack, t)
+
+    def next_slot(self, pack, t):
+        if self.slots:
+            i, setpoint, regulate_s = self.slots.pop(0)
+            start_slot(pack, t, i, setpoint, regulate_s, self.c["ramp_s"])
+
+
+class Planner:
+    def __init__(self, c):
+        self.c = c
+        self.steps = []
+
+    def monitor(self, pack, t, soc):
+        c = self.c
+        running = pack.slot[0] if pack.slot else None
+        reference = max(soc)
+        need = [(reference - s - c["spread"] / 2) / 100.0 * c["capacity"] for s in soc]
+        self.steps = []
+        for i in sorted(range(NOC), key=lambda i: -need[i]):
+            regulate_ms = need[i] * 3600.0 / c["setpoint"] - c["ramp_s"] * 1000
+            if i == running or regulate_ms < c["min_step_ms"]:
+                continue
+            self.steps.append((i, regulate_ms / 1000.0))  # Ends on charge, exact with an ideal converter
+        self.next_slot(pack, t)
+
+    def next_slot(self, pack, t):
+        if self.steps and not pack.slot:
+            i, regulate_s = self.steps.pop(0)
+            start_slot(pack, t, i, self.c["setpoint"], regulate_s, self.c["ramp_s"])
+
+
+class Duty:
+    """Pack current of a repeating duty cycle and what the policies make of it."""
+
+    def __init__(self, segments, c):
+        self.pieces = []  # (start s, end s, current A, is pulse)
+        t = 0.0
+        for seconds, base, pulse, every, length in segments:
+            end = t + seconds
+            while t < end:
+                if pulse:
+                    self.pieces.append((t, min(t + length, end), pulse, True))
+                    t = min(t + length, end)
+                quiet = min(t + every - length, end) if pulse else end
+                if quiet > t:
+                    self.pieces.append((t, quiet, base, False))
+                t = quiet
+        self.period = t
+        self.offset = 0.0  # Point of the cycle at which a run starts (s)
+        self.c = c
+
+    def current(self, t):
+        t = (t + self.offset) % self.period
+        return next(p[2] for p in self.pieces if p[0] <= t < p[1])
+
+    def last_pulse_end(self, t):
+        """End time of the pulse running at t or the last one before, -inf if none."""
+        t += self.offset
+        start = t - t % self.period
+        for base in (start, start - self.period):
+            ends = [base + p[1] for p in self.pieces if p[3] and base + p[0] <= t]
+            if ends:
+                return max(ends) - self.offset
+        return -math.inf
+
+    def pulse_affected(self, t):
+        """In a pulse or its hold-off, where SOC estimates carry the pulse error."""
+        return t - self.last_pulse_end(t) < self.c["holdoff_s"]
+
+    def allowed(self, t, policy):
+        if policy == "blind":
+            return True
+        if policy == "rest-only":
+            return not self.pulse_affected(t) and abs(self.current(t)) <= self.c["active_a"]
+        return not self.pulse_affected(t)
+
+
+def run(strategy, soc0, c, rng, duty=None, policy=None):
+    """Seconds until the spread is within target, and until std dev is below threshold."""
+    pack = Pack(soc0, c["capacity"])
+    t, next_monitor, t_std = 0.0, 0.0, None
+    bias, bias_pulse = [0.0] * NOC, None
+    while t < LIMIT_S:
+        slot_end = pack.slot[2] if pack.slot else math.inf
+        t_next = min(next_monitor, slot_end)
+        pack.advance(t_next - t)
+        t = t_next
+        allowed = duty is None or duty.allowed(t, policy)
+        if pack.slot and (t >= slot_end or not allowed):
+            pack.slot = None  # Finished, or soft-stopped for a pulse
+            if allowed:
+                strategy.next_slot(pack, t)
+        if t >= next_monitor:
+            true = pack.soc()
+            mean = sum(true) / NOC
+            std = math.sqrt(sum((s - mean) ** 2 for s in true) / NOC)
+            if t_std is None and std <= c["std_thresh"]:
+                t_std = t
+            if max(true) - min(true) <= c["spread"]:
+                return t, t_std
+            measured = [s + rng.gauss(0.0, SOC_NOISE_PCT) for s in true]
+            if duty and duty.pulse_affected(t):
+                pulse = duty.last_pulse_end(t)
+                if bias_pulse != pulse:  # New pulse, new estimation error
+                    bias, bias_pulse = [rng.gauss(0.0, PULSE_SOC_ERROR_PCT) for _ in range(NOC)], pulse
+                measured = [m + b for m, b in zip(measured, bias)]
+            if allowed:
+                strategy.monitor(pack, t, measured)
+            next_monitor += c["monitor_s"]
+    return None, t_std
+
+
+def minutes(seconds):
+    return f"{seconds / 60:8.1f}" if seconds is not None else "   never"
+
+
+def duty_benchmark(c, rng, packs):
+    """Hours to balance through each duty cycle for each balancing policy."""
+    policies = ("blind", "rest-only", "policy")
+    print(f"{NOC} cells, {c['capacity']:.0f} mAh, target spread {c['spread']:.1f}%, "
+          f"{packs * len(INITIAL_SPREADS)} packs per duty cycle, mean hours to balance")
+    print("duty cycle  |    blind | rest-only |   policy | saved vs blind | saved vs rest-only")
+    for name, segments in DUTY_CYCLES:
+        duty = Duty(segments, c)
+        hours = {p: 0.0 for p in policies}
+        count = 0
+        for sd in INITIAL_SPREADS:
+            for _ in range(packs):
+                soc0 = [INITIAL_SOC_PCT + rng.gauss(0.0, sd) for _ in range(NOC)]
+                seed = rng.random()
+                duty.offset = rng.uniform(0.0, duty.period)  # Imbalance found at a random point of the cycle
+                for policy in policies:
+                    t, _ = run(Planner(c), soc0, c, random.Random(seed), duty, policy)
+                    hours[policy] += (t if t is not None else LIMIT_S) / 3600.0
+                count += 1
+        h = {p: hours[p] / count for p in policies}
+        print(f"{name:11s} | {h['blind']:8.2f} | {h['rest-only']:9.2f} | {h['policy']:8.2f} | "
+              f"{h['blind'] - h['policy']:14.2f} | {h['rest-only'] - h['policy']:18.2f}")
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--packs", type=int, default=10, help="packs per initial spread")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--duty", action="store_true", help="run the balancing policies through the duty cycles")
+    args = parser.parse_args()
+
+    profile = json.loads(PROFILE.read_text())
+    c = {
+        "capacity": profile["capacity_mAh"],
+        "setpoint": min(profile["balance_max_mA"] / 1000.0, define("Core/Inc/flyback_operation.h", "FLYBACK_MAX_CURRENT")),
+        "ramp_s": define("Core/Inc/balancing_sequencer.h", "SEQ_RAMP_MS") / 1000.0,
+        "spread": define("Core/Inc/balancing_planner.h", "PLANNER_TARGET_SPREAD"),
+        "min_step_ms": define("Core/Inc/balancing_planner.h", "PLANNER_MIN_STEP_MS"),
+        "std_thresh": define("Core/Inc/balancing_trigger.h", "TRIGGER_START_STD_DEFAULT"),
+        "monitor_s": define("Core/Src/main.c", "MONITOR_PERIOD_MS") / 1000.0,
+        "holdoff_s": define("Core/Inc/balancing_policy.h", "POLICY_PULSE_HOLDOFF_MS") / 1000.0,
+        "active_a": define("Core/Inc/balancing_policy.h", "POLICY_ACTIVE_A"),
+    }
+    rng = random.Random(args.seed)
+
+    if args.duty:
+        duty_benchmark(c, rng, args.packs)
+        return
+
+    print(f"{NOC} cells, {c['capacity']:.0f} mAh, target spread {c['spread']:.1f}%, std dev threshold {c['std_thresh']:.1f}%")
+    print("initial sd  spread |  greedy min (std ok) | planner min (std ok) | speed-up")
+    totals = {"greedy": 0.0, "planner": 0.0}
+    for sd in INITIAL_SPREADS:
+        for _ in range(args.packs):
+            soc0 = [INITIAL_SOC_PCT + rng.gauss(0.0, sd) for _ in range(NOC)]
+            seed = rng.random()
+            g, g_std = run(Greedy(c), soc0, c, random.Random(seed))
+            p, p_std = run(Planner(c), soc0, c, random.Random(seed))
+            speedup = f"{g / p:6.1f}x" if g and p else "      -"
+            print(f"{sd:9.1f}% {max(soc0) - min(soc0):6.1f}% | {minutes(g)} ({minutes(g_std)}) | "
+                  f"{minutes(p)} ({minutes(p_std)}) | {speedup}")
+            totals["greedy"] += g if g is not None else LIMIT_S
+            totals["planner"] += p if p is not None else LIMIT_S
+
+    print(f"total time to balance: greedy {totals['greedy'] / 3600:.1f} h, planner {totals['planner'] / 3600:.1f} h, "
+          f"{totals['greedy'] / totals['planner']:.1f}x faster")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,194 @@
+#!/usr/bin/env python3
+"""
+Decode black-box fault captures (see blackbox.h) into a table of samples.
+
+A capture is read from one of:
+  - a serial monitor log holding the "$BBOXD" lines of "blackbox dump <n>",
+  - a flash image written by the host simulator (Sim, option -f),
+  - the board itself over the serial console (needs pyserial).
+
+Usage (from the repository root):
+    python3 Tools/blackbox_decode.py log monitor.txt [sequence] [--csv out.csv]
+    python3 Tools/blackbox_decode.py image flash.bin [sequence] [--csv out.csv]
+    python3 Tools/blackbox_decode.py serial /dev/ttyACM0 [sequence] [--csv out.csv]
+
+Without a sequence number every capture found is decoded (for "serial", the
+newest one). Times are in seconds relative to the trigger, so the samples
+leading up to the fault have negative times.
+"""
+
+import csv
+import struct
+import sys
+from pathlib import Path
+
+MAGIC = 0x58424242           # BLACKBOX_MAGIC
+VERSION = 1                  # BLACKBOX_VERSION
+NOC = 6                      # pack_config.h
+HEADER = struct.Struct("<IHHIIIHHHBBI")           # BlackboxHeader
+SAMPLE = struct.Struct(f"<I{NOC}HhhBBBB")          # BlackboxSample
+SLOT_BYTES = 4 * 2048        # BLACKBOX_PAGES_PER_EVENT x FLASH_PAGE_SIZE
+REGION_BYTES = 32768         # BLACKBOX region in the linker scripts, first in the simulator flash image
+TRIGGER_MANUAL = 0xFF        # BLACKBOX_TRIGGER_MANUAL
+FAULTS = ("Cell overvoltage", "Cell undervoltage", "Pack overcurrent", "Cell high", "Cell low", "Monitor reading")
+MODES = ("rest", "charge", "discharge", "pulse")
+FLAGS = ((0x01, "relay"), (0x02, "sequencer"), (0x04, "planner"))
+
+assert HEADER.size == 32 and SAMPLE.size == 24
+
+
+def crc16(data):
+    """CRC16 as CRC16() in pl455.c (reflected polynomial 0xA001, initial value 0)."""
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def fault_names(bits):
+    names = [name for i, name in enumerate(FAULTS) if bits & (1 << i)]
+    return "+".join(names) if names else "-"
+
+
+def decode(data):
+    """Capture as a dict, None if data does not start with a sealed capture."""
+    if len(data) < HEADER.size:
+        return None
+    (magic, version, crc, sequence, trigger_tick, fault_bits, samples, trigger_index,
+     sample_ms, fault, _, missed) = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION or len(data) < HEADER.size + samples * SAMPLE.size:
+        return None
+    body = bytes(data[HEADER.size:HEADER.size + samples * SAMPLE.size])
+    rows = []
+    for index in range(samples):
+        fields = SAMPLE.unpack_from(body, index * SAMPLE.size)
+        rows.append({
+            "t_s": (index - trigger_index) * sample_ms / 1000.0,
+            "tick_ms": fields[0],
+            "cells_mv": list(fields[1:1 + NOC]),   # index as volt[], cell NOC first
+            "pack_a": fields[1 + NOC] / 1000.0,
+            "balancing_a": fields[2 + NOC] / 1000.0,
+            "target": fields[3 + NOC],
+            "mode": fields[4 + NOC],
+            "flags": fields[5 + NOC],
+            "faults": fields[6 + NOC],
+        })
+    return {
+        "sequence": sequence,
+        "fault": "manual" if fault == TRIGGER_MANUAL else FAULTS[fault] if fault < len(FAULTS) else str(fault),
+        "fault_bits": fault_bits,
+        "trigger_tick": trigger_tick,
+        "missed": missed,
+        "crc_ok": crc16(body) == crc,
+        "rows": rows,
+    }
+
+
+def from_log(lines):
+    """Captures reassembled from "$BBOXD,<sequence>,<offset>,<hex>" lines."""
+    images = {}
+    for line in lines:
+        line = line.strip()
+        if not line.startswith("$BBOXD,"):
+            continue
+        _, sequence, offset, hexdata = line.split(",", 3)
+        image = images.setdefault(int(sequence), bytearray())
+        offset = int(offset)
+        if len(image) < offset:
+            image.extend(b"\xff" * (offset - len(image)))
+        image[offset:offset + len(hexdata) // 2] = bytes.fromhex(hexdata)
+    return [capture for capture in map(decode, images.values()) if capture]
+
+
+def from_image(data):
+    """Captures stored in the black-box region of a simulator flash image."""
+    region = data[:REGION_BYTES]
+    captures = [decode(region[offset:offset + SLOT_BYTES]) for offset in range(0, len(region), SLOT_BYTES)]
+    return sorted((capture for capture in captures if capture), key=lambda capture: capture["sequence"])
+
+
+def from_serial(port, sequence):
+    import serial  # pyserial, only needed for reading from the board
+
+    with serial.Serial(port, 115200, timeout=5) as link:
+        def command(text):
+            link.write((text + "\n").encode())
+            lines = []
+            while True:
+                reply = link.readline().decode(errors="replace").strip()
+                if not reply:
+                    sys.exit(f"no reply to '{text}'")
+                if reply.startswith("OK"):
+                    return lines
+                if reply.startswith("ERR"):
+                    sys.exit(f"'{text}' failed: {reply}")
+                lines.append(reply)  # Listing, dump or monitoring output
+
+        if sequence is None:
+            listed = [int(line.split(",")[1]) for line in command("blackbox") if line.startswith("$BBOXL,")]
+            if not listed:
+                sys.exit("no captures stored")
+            sequence = max(listed)
+        return from_log(command(f"blackbox dump {sequence}"))
+
+
+def print_capture(capture):
+    print(f"Capture {capture['sequence']}: {capture['fault']} at tick {capture['trigger_tick']} ms, "
+          f"active {fault_names(capture['fault_bits'])}, {len(capture['rows'])} samples, "
+          f"{capture['missed']} missed triggers{'' if capture['crc_ok'] else ', CRC MISMATCH'}")
+    cells = "  ".join(f"C{NOC - i:<5}" for i in range(NOC))
+    print(f"{'t (s)':>7}  {cells}  {'pack A':>7} {'bal A':>6} tgt {'mode':<9} {'flags':<24} faults")
+    for row in capture["rows"]:
+        cells = "  ".join(f"{mv:6d}" for mv in row["cells_mv"])
+        mode = MODES[row["mode"]] if row["mode"] < len(MODES) else str(row["mode"])
+        flags = "+".join(name for bit, name in FLAGS if row["flags"] & bit) or "-"
+        print(f"{row['t_s']:7.1f}  {cells}  {row['pack_a']:7.3f} {row['balancing_a']:6.3f} {row['target']:3d} "
+              f"{mode:<9} {flags:<24} {fault_names(row['faults'])}")
+    print()
+
+
+def write_csv(captures, path):
+    with open(path, "w", newline="") as out:
+        writer = csv.writer(out)
+        writer.writerow(["sequence", "t_s", "tick_ms"] + [f"cell{NOC - i}_mv" for i in range(NOC)]
+                        + ["pack_a", "balancing_a", "target", "mode", "flags", "faults"])
+        for capture in captures:
+            for row in capture["rows"]:
+                writer.writerow([capture["sequence"], row["t_s"], row["tick_ms"]] + row["cells_mv"]
+                                + [row["pack_a"], row["balancing_a"], row["target"], row["mode"], row["flags"], row["faults"]])
+
+
+def main():
+    args = sys.argv[1:]
+    csv_path = None
+    if "--csv" in args:
+        at = args.index("--csv")
+        if at + 1 >= len(args):
+            sys.exit(__doc__)
+        csv_path = args[at + 1]
+        del args[at:at + 2]
+    if len(args) not in (2, 3) or args[0] not in ("log", "image", "serial"):
+        sys.exit(__doc__)
+    sequence = int(args[2]) if len(args) == 3 else None
+
+    if args[0] == "log":
+        captures = from_log(Path(args[1]).read_text(errors="replace").splitlines())
+    elif args[0] == "image":
+        captures = from_image(Path(args[1]).read_bytes())
+    else:
+        captures = from_serial(args[1], sequence)
+    if sequence is not None:
+        captures = [capture for capture in captures if capture["sequence"] == sequence]
+    if not captures:
+        sys.exit("no captures found")
+
+    for capture in captures:
+        print_capture(capture)
+    if csv_path:
+        write_csv(captures, csv_path)
+
+
+if __name__ == "__main__":
+    main()
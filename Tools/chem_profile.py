@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+"""
+Build and upload cell chemistry profiles (see chemistry_profile.h).
+
+A profile definition is a JSON file holding the cell name and limits, and the
+path of a CSV with OCV characterisation data in the format of
+Tools/ocv_characterisation.csv (relative to the JSON file). The OCV curves are
+resampled exactly as for the built-in surface (Tools/gen_ocv_surface.py) and
+packed behind a 56 byte header into a binary image the firmware uses in place
+from its PROFILE flash partition.
+
+Usage (from the repository root):
+    python3 Tools/chem_profile.py build Tools/profiles/molicel_p45b.json p45b.bin
+    python3 Tools/chem_profile.py upload p45b.bin /dev/ttyACM0
+
+Uploading needs pyserial. The image is sent as hex over the serial console
+("profile begin / data / end"), waiting for the OK of each line.
+"""
+
+import json
+import struct
+import sys
+from pathlib import Path
+
+sys.path.insert(0, str(Path(__file__).resolve().parent))
+import gen_ocv_surface as ocv  # noqa: E402
+
+MAGIC = 0x4D454843         # CHEM_PROFILE_MAGIC
+VERSION = 1                # CHEM_PROFILE_VERSION
+CRC_START = 8              # CHEM_PROFILE_CRC_START
+NAME_LEN = 16              # CHEM_PROFILE_NAME_LEN
+PARTITION_BYTES = 16384    # PROFILE region in the linker scripts
+HEADER = struct.Struct("<IHHI16sHHHHHHIHBBhhI")  # ChemistryProfile
+CHUNK = 64                 # CONSOLE_DATA_MAX
+LIMITS = ("cell_min_mv", "cell_max_mv", "capacity_mAh", "balance_max_mA", "derate_start_mv", "derate_stop_mv")
+MIN_BALANCE_MA = 500       # FLYBACK_MIN_CURRENT
+
+assert HEADER.size == 56
+
+
+def crc16(data):
+    """CRC16 as CRC16() in pl455.c (reflected polynomial 0xA001, initial value 0)."""
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def build(definition_path, output_path):
+    definition_path = Path(definition_path)
+    definition = json.loads(definition_path.read_text())
+    name = definition["name"].encode()
+    if len(name) > NAME_LEN:
+        sys.exit(f"name must be at most {NAME_LEN} bytes")
+    limits = [int(definition[key]) for key in LIMITS]
+    if limits[0] >= limits[1] or limits[4] >= limits[5] or limits[5] > limits[1] or limits[2] <= 0:
+        sys.exit("cell and derating limits must be ordered, derating must stop by cell_max_mv and capacity positive")
+    if limits[3] < MIN_BALANCE_MA:
+        sys.exit(f"balance_max_mA must be at least {MIN_BALANCE_MA} (FLYBACK_MIN_CURRENT)")
+
+    curves = ocv.read_curves(definition_path.parent / definition["ocv_csv"])
+    surface, v0_uv, size, temperatures, t_step, worst, _ = ocv.build_surface(curves)
+    values = [value for branch in surface for row in branch for value in row]
+    body = struct.pack(f"<{len(values)}H", *values)
+
+    length = HEADER.size + len(body)
+    if length > PARTITION_BYTES:
+        sys.exit(f"profile is {length} bytes, the partition holds {PARTITION_BYTES}")
+
+    header = HEADER.pack(MAGIC, VERSION, 0, length, name.ljust(NAME_LEN, b"\0"), *limits,
+                         v0_uv, size, ocv.V_SHIFT, len(temperatures), temperatures[0], t_step, HEADER.size)
+    image = bytearray(header + body)
+    struct.pack_into("<H", image, 6, crc16(image[CRC_START:]))
+
+    Path(output_path).write_bytes(image)
+    print(f"{definition['name']}: {len(temperatures)} temperature(s) x {size} voltage points, "
+          f"{length} bytes, max OCV error {worst / 100:.4f} % SOC -> {output_path}")
+
+
+def upload(image_path, port):
+    import serial  # pyserial, only needed for upload
+
+    image = Path(image_path).read_bytes()
+    with serial.Serial(port, 115200, timeout=5) as link:
+        def command(text):
+            link.write((text + "\n").encode())
+            while True:
+                reply = link.readline().decode(errors="replace").strip()
+                if not reply:
+                    sys.exit(f"no reply to '{text[:40]}'")
+                if reply.startswith("OK"):
+                    return
+                if reply.startswith("ERR"):
+                    sys.exit(f"'{text[:40]}' failed: {reply}")
+                # Anything else is monitoring output, keep waiting
+
+        command(f"profile begin {len(image)}")
+        for offset in range(0, len(image), CHUNK):
+            command(f"profile data {offset} {image[offset:offset + CHUNK].hex()}")
+        command("profile end")
+    print(f"uploaded {len(image)} bytes")
+
+
+def main():
+    if len(sys.argv) == 4 and sys.argv[1] == "build":
+        build(sys.argv[2], sys.argv[3])
+    elif len(sys.argv) == 4 and sys.argv[1] == "upload":
+        upload(sys.argv[2], sys.argv[3])
+    else:
+        sys.exit(__doc__)
+
+
+if __name__ == "__main__":
+    main()
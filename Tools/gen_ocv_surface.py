@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""
+Generate the OCV-to-SOC surface used by ocv_soc_centi().
+
+The characterisation points are read from Tools/ocv_characterisation.csv, one
+piecewise-linear curve per (hysteresis branch, temperature). Each curve is
+resampled on a uniform voltage grid with a power-of-two step, giving a table
+indexed [branch][temperature][voltage] with SOC in 0.01 % units. The firmware
+interpolates bilinearly in voltage and temperature with integer arithmetic;
+this script runs the same arithmetic along every characterised curve and fails
+if it deviates from the source points by more than the tolerance.
+
+Temperatures must be evenly spaced and every branch needs a curve at every
+temperature. Outside the characterised temperature range the nearest curve is
+used.
+
+The same resampling is used by Tools/chem_profile.py to build loadable
+chemistry profiles.
+
+Usage (from the repository root):
+    python3 Tools/gen_ocv_surface.py
+"""
+
+import csv
+import sys
+from pathlib import Path
+
+ROOT = Path(__file__).resolve().parent.parent
+SOURCE = ROOT / "Tools" / "ocv_characterisation.csv"
+OUTPUT = ROOT / "Core" / "Src" / "ocv_surface.c"
+
+BRANCHES = ("discharge", "charge")  # Order matches OcvBranch in ocv_model.h
+V_SHIFT = 11               # Voltage step 2^11 uV = 2.048 mV
+T_STEP_DEFAULT = 100       # Temperature step (0.1 degC) used when only one temperature is characterised
+TOLERANCE_CENTI = 10       # Largest accepted error against the source curves (0.01 % units)
+CHECK_STEP_UV = 50         # Voltage step used for the accuracy check (uV)
+
+
+def read_curves(path):
+    """Return {(branch, temperature in 0.1 degC): [(voltage uV, SOC %), ...]}."""
+    curves = {}
+    with path.open() as f:
+        rows = csv.DictReader(line for line in f if not line.startswith("#"))
+        for row in rows:
+            branch = row["branch"].strip()
+            if branch not in BRANCHES:
+                sys.exit(f"unknown branch '{branch}', expected one of {BRANCHES}")
+            key = (branch, round(float(row["temperature_C"]) * 10))
+            curves.setdefault(key, []).append((round(float(row["voltage_V"]) * 1e6), float(row["soc_pct"])))
+
+    for key, points in curves.items():
+        points.sort()
+        if any(b[0] == a[0] or b[1] < a[1] for a, b in zip(points, points[1:])):
+            sys.exit(f"curve {key} must have distinct voltages with non-decreasing SOC")
+    return curves
+
+
+def curve(points, uv):
+    """SOC (%) of a piecewise-linear source curve at a voltage in uV, clamped at the ends."""
+    if uv <= points[0][0]:
+        return points[0][1]
+    if uv >= points[-1][0]:
+        return points[-1][1]
+    for (v1, s1), (v2, s2) in zip(points, points[1:]):
+        if v1 <= uv <= v2:
+            return s1 + (uv - v1) / (v2 - v1) * (s2 - s1)
+    raise AssertionError("unreachable")
+
+
+def firmware_row(row, v0_uv, uv):
+    """Bit-exact model of the voltage interpolation in ocv_soc_centi()."""
+    if uv <= v0_uv:
+        return row[0]
+    offset = uv - v0_uv
+    index = offset >> V_SHIFT
+    if index >= len(row) - 1:
+        return row[-1]
+    frac = offset & ((1 << V_SHIFT) - 1)
+    return row[index] + (((row[index + 1] - row[index]) * frac + (1 << (V_SHIFT - 1))) >> V_SHIFT)
+
+
+def build_surface(curves):
+    """Resample the curves on the firmware grid.
+
+    Returns (surface [branch][temperature][voltage], v0_uv, size, temperatures, t_step, worst error, worst point).
+    """
+    temperatures = sorted({t for _, t in curves})
+    for branch in BRANCHES:
+        for t in temperatures:
+            if (branch, t) not in curves:
+                sys.exit(f"no {branch} curve at {t / 10:.1f} degC, every branch needs every temperature")
+
+    steps = {b - a for a, b in zip(temperatures, temperatures[1:])}
+    if len(steps) > 1:
+        sys.exit(f"temperatures {[t / 10 for t in temperatures]} are not evenly spaced")
+    t_step = steps.pop() if steps else T_STEP_DEFAULT
+
+    step = 1 << V_SHIFT
+    v0_uv = min(points[0][0] for points in curves.values())
+    v_end_uv = max(points[-1][0] for points in curves.values())
+    size = (v_end_uv - v0_uv + step - 1) // step + 1  # Last grid point is at or above the top voltage
+
+    surface = [[[round(curve(curves[(b, t)], v0_uv + i * step) * 100) for i in range(size)]
+                for t in temperatures] for b in BRANCHES]
+
+    worst, worst_at = 0.0, None
+    for b, branch in enumerate(BRANCHES):
+        for k, t in enumerate(temperatures):
+            points = curves[(branch, t)]
+            for uv in range(v0_uv - step, v_end_uv + step, CHECK_STEP_UV):
+                error = abs(firmware_row(surface[b][k], v0_uv, uv) - curve(points, uv) * 100)
+                if error > worst:
+                    worst, worst_at = error, (branch, t, uv)
+
+    if worst > TOLERANCE_CENTI:
+        sys.exit(f"error {worst / 100:.4f} % SOC at {worst_at} exceeds tolerance of {TOLERANCE_CENTI / 100:.2f} % SOC,"
+                 " reduce V_SHIFT")
+    return surface, v0_uv, size, temperatures, t_step, worst, worst_at
+
+
+def main():
+    curves = read_curves(SOURCE)
+    surface, v0_uv, size, temperatures, t_step, worst, worst_at = build_surface(curves)
+    step = 1 << V_SHIFT
+
+    footprint = len(BRANCHES) * len(temperatures) * size * 2
+    print(f"{len(curves)} curves, {len(temperatures)} temperature(s) x {size} voltage points x {len(BRANCHES)} branches"
+          f" = {footprint} bytes")
+    print(f"max error {worst / 100:.4f} % SOC ({worst_at[0]}, {worst_at[1] / 10:.1f} degC, {worst_at[2] / 1e6:.4f} V)")
+
+    blocks = []
+    for b, branch in enumerate(BRANCHES):
+        rows = []
+        for k, t in enumerate(temperatures):
+            lines = ["\t\t\t" + ", ".join(f"{value}" for value in surface[b][k][i:i + 12]) + ","
+                     for i in range(0, size, 12)]
+            rows.append(f"\t\t{{ // {t / 10:.1f} degC\n" + "\n".join(lines) + "\n\t\t},")
+        blocks.append(f"\t{{ // {branch}\n" + "\n".join(rows) + "\n\t},")
+
+    OUTPUT.write_text(f"""/**
+  ******************************************************************************
+  * @file           : ocv_surface.c
+  * @project        : ES327_BMS_Active_Balance
+  ******************************************************************************
+  */
+
+/*
+ * GENERATED by Tools/gen_ocv_surface.py from Tools/ocv_characterisation.csv, do not edit.
+ * [branch][temperature][voltage], voltage from {v0_uv} uV in steps of {step} uV,
+ * temperature from {temperatures[0] / 10:.1f} degC in steps of {t_step / 10:.1f} degC, SOC in 0.01 % units.
+ * {footprint} bytes, max error against the source curves: {worst / 100:.4f} % SOC
+ */
+
+/* ***** HEADER FILES ***** */
+// Include necessary header files for program to run
+#include "ocv_model.h" // Include surface dimensions
+
+#if OCV_V_SIZE != {size} || OCV_V0_UV != {v0_uv} || OCV_V_SHIFT != {V_SHIFT} \\
+		|| OCV_T_SIZE != {len(temperatures)} || OCV_T0_DECIC != {temperatures[0]} || OCV_T_STEP_DECIC != {t_step}
+#error "ocv_model.h surface constants do not match the generated table, update them"
+#endif
+
+const uint16_t ocv_surface[OCV_BRANCH_COUNT][OCV_T_SIZE][OCV_V_SIZE] = {{
+{chr(10).join(blocks)}
+}};
+""")
+    print(f"wrote {OUTPUT.relative_to(ROOT)}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+"""
+Double-precision host reference of the SOC estimator in soc_ekf.c.
+
+Model parameters and noise settings are read from Core/Inc/soc_ekf.h. The OCV
+curve is the 25 degC discharge curve of Tools/ocv_characterisation.csv, and
+the capacity comes from Tools/profiles/molicel_p45b.json. A cell is simulated
+on the same first-order RC model through a pulsed discharge with rests. The
+filter starts from a wrong SOC, and the script reports how fast and how
+closely it converges.
+
+Usage (from the repository root):
+    python3 Tools/soc_ekf_reference.py [--vectors vectors.csv] [--seed N]
+
+--vectors writes t_s, current_A, voltage_V, true_soc_pct, ekf_soc_pct and
+sigma_pct for every step, after a comment line with the filter's starting SOC
+and the step length. The vectors of the default seed are kept in
+Sim/Bench/ekf_vectors.csv, and "make replay" in Sim/ runs them through
+soc_ekf.c (Sim/Bench/ekf_replay.c). Write them again after changing the model
+parameters or the OCV curve:
+    python3 Tools/soc_ekf_reference.py --vectors Sim/Bench/ekf_vectors.csv
+"""
+
+import argparse
+import csv
+import json
+import math
+import random
+import re
+import sys
+from pathlib import Path
+
+ROOT = Path(__file__).resolve().parent.parent
+HEADER = ROOT / "Core" / "Inc" / "soc_ekf.h"
+PROFILE = ROOT / "Tools" / "profiles" / "molicel_p45b.json"
+
+sys.path.insert(0, str(ROOT / "Tools"))
+import gen_ocv_surface as ocv  # noqa: E402
+
+DT_S = 2.0                 # MONITOR_PERIOD_MS
+TRUE_SOC0 = 0.90           # Initial SOC of the simulated cell
+EKF_SOC0 = 0.70            # Initial SOC given to the filter
+VOLTAGE_NOISE_V = 0.002    # Cell monitor noise (V rms)
+PULSE_A = 2.0              # Discharge current during pulses (A)
+PULSE_S, REST_S = 600, 300  # Pulse and rest lengths (s)
+DURATION_S = 2 * 3600      # Simulated time (s), ends near 30% SOC
+
+
+def read_parameters(path):
+    """Return {NAME: value} for the SOC_EKF_ constants in soc_ekf.h."""
+    text = path.read_text()
+    return {name: float(value) for name, value in
+            re.findall(r"#define SOC_EKF_(\w+)\s+([-\d.e]+)f?", text)}
+
+
+def soc_to_ocv_table(points, n):
+    """OCV (V) at n evenly spaced SOC values, by inverting the source curve."""
+    table = []
+    for k in range(n):
+        target = 100.0 * k / (n - 1)
+        low, high = points[0][0], points[-1][0]
+        while high - low > 1:
+            mid = (low + high) // 2
+            if ocv.curve(points, mid) >= target:
+                high = mid
+            else:
+                low = mid
+        table.append(high / 1e6)
+    return table
+
+
+def ocv_lookup(table, soc):
+    """OCV and dOCV/dSOC as the firmware table lookup."""
+    n = len(table)
+    x = soc * (n - 1)
+    k = min(max(int(x), 0), n - 2)
+    slope = (table[k + 1] - table[k]) * (n - 1)
+    return table[k] + (x - k) * (table[k + 1] - table[k]), slope
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--vectors", help="write test vectors to this CSV file")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    p = read_parameters(HEADER)
+    capacity_mah = json.loads(PROFILE.read_text())["capacity_mAh"]
+    points = ocv.read_curves(ROOT / "Tools" / "ocv_characterisation.csv")[("discharge", 250)]
+    table = soc_to_ocv_table(points, int(p["OCV_POINTS"]))
+    rng = random.Random(args.seed)
+
+    r0, r1, tau = p["R0_OHM"], p["R1_OHM"], p["TAU_S"]
+    a = math.exp(-DT_S / tau)
+    coulomb = p["EFFICIENCY"] * DT_S / (3.6 * capacity_mah)
+
+    true_soc, true_vrc = TRUE_SOC0, 0.0
+    soc, vrc = EKF_SOC0, 0.0
+    p00, p01, p11 = p["P0_SOC"], 0.0, p["P0_VRC"]
+
+    rows, errors, converged_at = [], [], None
+    steps = int(DURATION_S / DT_S)
+    for step in range(steps):
+        t = step * DT_S
+        current = PULSE_A if (t % (PULSE_S + REST_S)) < PULSE_S else 0.0
+
+        # Simulated cell
+        true_soc -= coulomb * current
+        true_vrc = a * true_vrc + r1 * (1 - a) * current
+        voltage = ocv_lookup(table, true_soc)[0] - true_vrc - r0 * current + rng.gauss(0.0, VOLTAGE_NOISE_V)
+
+        # Filter, same order of operations as soc_ekf_update()
+        soc -= coulomb * current
+        vrc = a * vrc + r1 * (1 - a) * current
+        p00 += p["Q_SOC"]
+        p01 *= a
+        p11 = a * a * p11 + p["Q_VRC"]
+
+        o, h = ocv_lookup(table, soc)
+        innovation = voltage - (o - vrc - r0 * current)
+        ph0 = h * p00 - p01
+        ph1 = h * p01 - p11
+        s = h * ph0 - ph1 + p["R_V"]
+        k0, k1 = ph0 / s, ph1 / s
+        soc += k0 * innovation
+        vrc += k1 * innovation
+        p00 -= k0 * ph0
+        p01 -= k0 * ph1
+        p11 -= k1 * ph1
+        soc = min(max(soc, 0.0), 1.0)
+
+        error = abs(soc - true_soc) * 100
+        if converged_at is None and error < 1.0:
+            converged_at = t
+        if converged_at is not None:
+            errors.append(error)
+        rows.append((t, current, voltage, true_soc * 100, soc * 100, math.sqrt(p00) * 100))
+
+    rms = math.sqrt(sum(e * e for e in errors) / len(errors)) if errors else float("nan")
+    print(f"{steps} steps of {DT_S:.0f}s, start error {abs(EKF_SOC0 - TRUE_SOC0) * 100:.0f}% SOC")
+    print(f"within 1% after {converged_at}s, then rms {rms:.3f}% max {max(errors):.3f}% SOC"
+          if converged_at is not None else "did not converge within 1% SOC")
+
+    if args.vectors:
+        with open(args.vectors, "w", newline="") as f:
+            f.write(f"# soc0_pct={EKF_SOC0 * 100:.1f} dt_s={DT_S:.1f} seed={args.seed}\n")
+            writer = csv.writer(f)
+            writer.writerow(("t_s", "current_A", "voltage_V", "true_soc_pct", "ekf_soc_pct", "sigma_pct"))
+            writer.writerows((f"{t:.1f}", f"{i:.3f}", f"{v:.6f}", f"{ts:.4f}", f"{es:.4f}", f"{sg:.4f}")
+                             for t, i, v, ts, es, sg in rows)
+        print(f"wrote {len(rows)} vectors to {args.vectors}")
+
+
+if __name__ == "__main__":
+    main()